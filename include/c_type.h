@@ -11,8 +11,10 @@ union ctype {
 
 // Type of symbol. VOID only for function return/parameter, NONE only for
 //      function return value in Symbol class when variable is defined.
+//      VECTOR only for IR registers holding packed ints, which only the
+//      loop vectorizer makes.
 enum SymbolType {
-    SYM_INT, SYM_CHAR, SYM_FLOAT, SYM_FUNCT, SYM_VOID, SYM_ERR = -1
+    SYM_INT, SYM_CHAR, SYM_FLOAT, SYM_FUNCT, SYM_VOID, SYM_VECTOR, SYM_ERR = -1
 };
 
 #endif
\ No newline at end of file
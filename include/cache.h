@@ -0,0 +1,52 @@
+/* File: cache.h
+ * Authors: agent
+ * Description: On disk compilation cache. The output of a compilation is
+ *              stored under a hash of the source, the compiler and the flags
+ *              that change the output, so compiling the same input again is
+ *              a file copy
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+
+// Entries are evicted, least recently used first, once the cache directory
+// holds more than this many bytes
+#ifndef CACHE_MAX_BYTES
+#define CACHE_MAX_BYTES (64L * 1024 * 1024)
+#endif
+
+class CompileCache {
+private:
+    std::string dir;
+    // everything the output depends on, kept in the entry to tell apart
+    // inputs whose keys collide
+    std::string input;
+    bool hit;
+    // totals over every compilation that used the directory
+    long hits;
+    long misses;
+
+    std::string entryPath(unsigned long key);
+    void readStats();
+    void writeStats();
+    // write contents to path through a temporary file and a rename, so
+    // no reader ever sees a partial file
+    bool writeAtomic(std::string path, const std::string &contents);
+    void evict();
+public:
+    CompileCache(std::string dir);
+
+    // key of a compilation, source is the whole input file and flags the
+    // options that change the output. Lookup and store go by the input of
+    // the last key.
+    unsigned long key(const std::string &source, std::string fileName, std::string flags);
+    // copy a stored output to outFile, false on a miss
+    bool lookup(unsigned long key, std::string outFile);
+    // store the output a compilation just wrote to outFile
+    void store(unsigned long key, std::string outFile);
+    void printStats();
+};
+
+#endif
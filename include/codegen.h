@@ -5,73 +5,188 @@
  */
 #include <vector>
 #include <list>
+#include <set>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include "irep.h"
+#include "mir.h"
+#include "profile.h"
 
 enum Datalen {DCHAR = 1, DSHORT = 2, DINT = 4, DLONG = 8};
 
+// System V AMD64 integer argument registers, in argument order
+extern const std::vector<std::string> argRegs;
+// and the float argument registers, counted separately
+extern const std::vector<std::string> floatArgRegs;
+
 class CPU {
     private:
-        //vector containing currently free registers
-        std::vector<std::string> freeRegStack;
+        //free registers the callee must preserve (rbx, r12-r15)
+        std::vector<std::string> freeCalleeSaved;
+        //free registers clobbered by calls (r10, r11)
+        std::vector<std::string> freeCallerSaved;
+        //free float registers (xmm8-xmm15), calls clobber all of them
+        std::vector<std::string> freeFloat;
         //map containing vr as a key and the range that the vr is valid
         std::map<std::string, std::pair<int, int>> regRange;
+        //lines of every call instruction, used to find vrs live across calls
+        std::vector<int> callLines;
+        //how often each of those calls ran and each function was entered,
+        //-1 where the profile does not say
+        std::vector<long> callCounts;
+        std::map<std::string, long> entryCounts;
+        //counts of an earlier run, null without one
+        Profile *profile;
         //maps currently allocated virtual registers to physical ones
         std::map<std::string, std::string> vrToPr;
+        //virtual registers that found no free register, to the variable
+        //whose stack slot holds them instead
+        std::map<std::string, std::string> vrToSpill;
         //maps phyisical registers to free status
         std::map<std::string, bool> usage;
+        //callee saved registers each function writes, in first use order
+        std::map<std::string, std::vector<std::string>> calleeSavedUse;
+        //function currently being assigned
+        std::string curFunc;
+
+        bool crossesCall(std::string vr);
+        bool crossesColdCalls(std::string vr);
+        bool isCallerSaved(std::string reg);
         
     public:
         CPU();
+        //weigh saving values around calls against saving registers in
+        //the prologue by the counts, set before BuildRange
+        void setProfile(Profile *profile);
         void BuildRange(std::vector<BasicBlock> &bblist);
         void freeVar(int index);
 
-        std::string Allocate(std::string vr);
-        std::string Ensure(std::string vr);
+        std::string Allocate(std::string vr, bool isFloat = false);
+        std::string Ensure(std::string vr, bool isFloat = false);
         //replace virtual registers with physical registers
         std::vector<BasicBlock> assignRegs(std::vector<BasicBlock> &bblist);
         void Free(std::string reg);
+        //release every register whose value's range ends by the line
+        void expire(int line);
+        //callee saved registers a function has to save in its prologue
+        std::vector<std::string> getCalleeSaved(std::string funName);
         void printRange(); //debugging
 };
 
+// Stack frame of one function, laid out before any of its code is emitted
+struct Frame {
+    //variable name to the offset of its slot below the top of the slot
+    //area, slots of one size are shared by variables whose lifetimes do
+    //not overlap
+    std::map<std::string, int> slots;
+    //bytes of every variable, chars take one, ints and floats four
+    std::map<std::string, Datalen> sizes;
+    int slotBytes = 0;
+    //bytes the prologue reserves below the saved registers
+    int size = 0;
+    //callee saved registers the prologue pushes
+    std::vector<std::string> saved;
+    //makes no calls
+    bool leaf = false;
+    //no %rbp frame, slots are addressed off %rsp
+    bool omitFP = false;
+    //writes the upper halves of the ymm registers, they are cleared with
+    //vzeroupper before calling or returning
+    bool wide = false;
+};
+
 class Program {
 private:
-    int stack_level;
-    // Each bool represents 4 bytes taken
-    std::vector<int> stack;
-    //map containig variable names as key, and he corresponding stack offset
-    std::vector<std::map<std::string, int>> offsets;
-    std::string file;
-    std::string data;
-    std::string bss;
-    std::string text;
+    // data, bss, rodata and text sections of the output
+    MModule module;
     CPU cpu;
 
     bool inFunction;
-    int numArgs;
+    // frames of every function, filled by layoutFrames
+    std::map<std::string, Frame> frames;
+    // frame of the function being emitted
+    Frame *frame;
+    // bytes pushed below %rbp by the current function, used to keep
+    // %rsp 16 byte aligned at call sites
+    int stackDepth;
+    // calls whose result the next instruction returns, they jump to the
+    // callee which returns to our caller, and those returns
+    bool tailCallsEnabled;
+    std::set<Instruction *> tailCalls;
+    std::set<Instruction *> tailReturns;
 
     std::vector<std::string> globals;
+    // globals without an initializer, they go in .bss
+    std::vector<std::string> uninitGlobals;
+    // bytes of every global
+    std::map<std::string, Datalen> globalSizes;
+    // rodata labels of the float constants, by their bits
+    std::map<int, std::string> floatConstants;
+    // vectors are ymm registers of four lanes instead of xmm registers of
+    // two, and the rodata label of the lane numbers
+    bool avx2;
+    std::string laneNumbers;
+    // counters every block adds one to, null unless generating a profile
+    Profile *profile;
 
+    void defineGlobal(std::vector<MInstr> &section, std::string name, MInstr value);
     void declareFunction(std::string name);
+    void releaseFrame();
+    void epilogue();
     void declareGlobal(std::string name);
-    int allocVar(std::string var);
-    void newFunc();
-    int offset(int index);
+    MOperand slot(std::string var);
+    Datalen width(Container c);
+    void load(Container c, MOperand dst);
+    void store(MOperand src, Container c);
+    MOperand value(Container c, std::string scratch);
+    void copy(Container src, Container dst);
+    MOperand stackArg(int index);
+    MOperand floatConstant(float value);
+    void moveFloat(MOperand src, MOperand dst);
+    MOperand vectorReg(Container c);
+    MOperand lanes();
+    void countBlock(std::string key);
     bool findGlobal(std::string name);
-    std::string toAssembly(LetInstr *li);
-    std::string toAssembly(Container c);
+    void emit(MOp op);
+    void emit(MOp op, MOperand a);
+    void emit(MOp op, MOperand a, MOperand b);
+    void emit(MOp op, MOperand a, MOperand b, MOperand c);
+    void toAssembly(LetInstr *li);
+    void vectorAssembly(LetInstr *li);
+    MOperand toAssembly(Container c);
 public:
-    Program(std::string fileName);
+    Program(std::string fileName, CPU &cpu);
 
     std::string toString();
+    // print the whole program as assembly with a single write
+    void write(std::ostream &out);
+    MModule &getModule();
+    // text section, for the passes that rewrite it before it is printed
+    std::vector<MInstr> &getText();
 
+    // emit calls in tail position as jumps, set before layoutFrames
+    void setTailCalls(bool enable);
+    // select AVX2 instead of SSE2 for vector operations, set before
+    // layoutFrames
+    void setAvx2(bool enable);
+
+    // count how often every block runs into the counters of the
+    // profile, set before insertBasicBlock
+    void setProfile(Profile *profile);
+
+    // compute the stack frame of every function before emitting code
+    void layoutFrames(std::vector<BasicBlock> &bblist);
     void insertBasicBlock(BasicBlock &bb);
+    // the counter table and the function main calls to write it to the
+    // profile file, after the last block
+    void insertProfileDump();
 };
 
 void genTest();
 
 /* IR op to Assembly guide:
+(selected as MInstr, see mir.h, then cleaned up by peephole.h at -O1 and up)
 
 turn let x = y (&&,||) into:
 ----------------------------
@@ -90,6 +205,16 @@ turn let x = y op z into:
     mov y, x
     op  z, x
 
+int and char variables take 4 and 1 bytes, registers always hold their
+values sign extended to 64 bits, so loads extend and stores keep the low
+bytes:
+    movslq i, %r           movsbq c, %r
+    movl   %r32, i         movb   %r8, c
+and / and % divide the 32 bit ints:
+    cltd
+    idivl  z
+    movslq %eax, x (%edx for %)
+
 turn let x = y (<,<=,>,>=) z into:
 ----------------------------------
     mov y, x
@@ -101,4 +226,75 @@ turn let x = y (<,<=,>,>=) z into:
     mov $1, x
 .BL2:
 
+turn let x = y op z on floats into (%xmm0 unless x is a register):
+------------------------------------------------------------------
+    movss  y, x
+    opss   z, x
+float constants are loaded from .rodata, compares are ucomiss and the
+unsigned jumps, < and <= swap the operands so unordered values are false:
+    movss   z, %xmm0
+    ucomiss y, %xmm0
+    ja/jae  .BL1
+    ...
+== and != also check the parity flag ucomiss sets for unordered values,
+which are never equal:
+    movss   y, %xmm0
+    ucomiss z, %xmm0
+    jne     .BL1
+    jp      .BL1
+    movq    $1, x      ($0 for !=)
+    jmp     .BL2
+.BL1:
+    movq    $0, x      ($1 for !=)
+.BL2:
+
+turn let x = itof y / ftoi y into:
+----------------------------------
+    cvtsi2ssq  y, x
+    cvttss2siq y, x
+
+turn vector lets (vectorize.h) into, with SSE2 on xmm registers:
+----------------------------------------------------------------
+    let v = splat x      movq x, v; punpcklqdq v, v
+    let v = step x       the splat, then paddq the lane numbers 0, 1
+    let v = a op b       movdqa a, v; pOPq b, v
+    let r = v lane k     movq v, r (lane 1 through pshufd $0xee)
+or with AVX2 on ymm registers:
+    let v = splat x      vmovq x, v; vpbroadcastq v, v
+    let v = a op b       vpOPq b, a, v
+    let r = v lane k     vextracti128 for lanes 2 and 3, vpextrq $k, v, r
+a * b of 64 bit lanes is built from pmuludq of the 32 bit halves
+
+turn switch v from low (L0, ..., Ln) else D into:
+-------------------------------------------------
+    cmpq  $low, v
+    jl    D
+    cmpq  $low+n, v
+    jg    D
+    leaq  .JT(%rip), %rdx
+    movq  -low*8(%rdx, v, 8), %rcx
+    addq  %rdx, %rcx
+    jmpq  *%rcx
+with .JT in .rodata holding .quad Lk-.JT for every label
+
+count a block when generating a profile (profile.h), at the start of a
+function, after a label and after a branch that did not jump:
+    addq $1, .Lprof_counters+8k(%rip)
+main calls .Lprof_dump before returning, which writes the header in
+.rodata and the counters through open, write and close
+
+turn call@ f(a1, ..., an) -> x into (System V AMD64):
+------------------------------------------------------
+    pushq live caller saved registers (r10, r11, xmm8-xmm15 through subq
+          and movss)
+    subq  $8, %rsp          (only if %rsp would be misaligned)
+    pushq an ... a7         (arguments past the sixth int or eighth
+                             float, right to left)
+    movq  ints, %rdi, %rsi, %rdx, %rcx, %r8, %r9
+    movss floats, %xmm0 ... %xmm7
+    callq f
+    addq  $pushed, %rsp
+    popq  saved caller saved registers
+    movq  %rax, x           (movss %xmm0, x for a float)
+
 */
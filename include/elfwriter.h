@@ -0,0 +1,72 @@
+/* File: elfwriter.h
+ * Authors: agent
+ * Description: Writes a machine level module as a relocatable ELF64 object
+ *              file, so no assembler has to run on the output
+ */
+
+#ifndef ELFWRITER_H
+#define ELFWRITER_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "mir.h"
+#include "encoder.h"
+
+// Section header table of every object file we write
+enum ElfSection {
+    SEC_NULL, SEC_TEXT, SEC_DATA, SEC_BSS, SEC_RODATA, SEC_RELA_TEXT, SEC_RELA_RODATA,
+    SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, SEC_NOTE_STACK, SEC_COUNT
+};
+
+// A symbol of the object file
+struct ElfSymbol {
+    std::string name;
+    // section index, 0 for undefined symbols
+    int section = 0;
+    unsigned long value = 0;
+    unsigned long size = 0;
+    // STT_FUNC, STT_OBJECT or STT_NOTYPE
+    int type = 0;
+    bool global = false;
+};
+
+class ElfWriter {
+private:
+    MModule &module;
+    X86Encoder encoder;
+    bool laidOut;
+
+    std::vector<unsigned char> data;
+    std::vector<unsigned char> rodata;
+    unsigned long bssSize;
+    // the jump table entries the linker fills in
+    std::vector<Relocation> rodataRelocs;
+    // symbols in the order they are defined or referenced
+    std::vector<ElfSymbol> symbols;
+    std::map<std::string, int> symbolIndex;
+
+    ElfSymbol &symbol(std::string name);
+    // read the labels and directives of a data, bss or rodata section
+    void layoutSection(std::vector<MInstr> &section, int index);
+    void collectSymbols();
+public:
+    ElfWriter(MModule &module);
+
+    // encode the module and lay out its sections, which is all an object
+    // file loaded into memory needs
+    void layout();
+    std::vector<unsigned char> &getText();
+    std::vector<unsigned char> &getData();
+    std::vector<unsigned char> &getRodata();
+    unsigned long getBssSize();
+    std::vector<ElfSymbol> &getSymbols();
+    std::vector<Relocation> &getTextRelocations();
+    std::vector<Relocation> &getRodataRelocations();
+
+    // encode the module and write the object file with a single write
+    void write(std::ostream &out);
+};
+
+#endif
@@ -0,0 +1,70 @@
+/* File: encoder.h
+ * Authors: agent
+ * Description: Encodes the machine instructions of the text section into
+ *              x86-64 machine code
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "mir.h"
+
+// A field the linker has to fill in with a symbol's address
+struct Relocation {
+    unsigned long offset;
+    std::string sym;
+    // R_X86_64_PC32 or R_X86_64_PLT32, R_X86_64_PC64 for jump tables
+    unsigned int type;
+    long addend;
+};
+
+class X86Encoder {
+private:
+    std::vector<unsigned char> code;
+    // offset of every label in code
+    std::map<std::string, unsigned long> labels;
+    // displacement fields of jumps, patched once every label is known
+    struct Fixup {
+        unsigned long offset;
+        std::string label;
+        bool isShort;
+        unsigned int index;
+    };
+    std::vector<Fixup> fixups;
+    std::vector<Relocation> relocs;
+    // jumps whose target is out of reach of a rel8
+    std::set<unsigned int> longJumps;
+    // index of the instruction being encoded
+    unsigned int current;
+
+    void byte(int b);
+    void imm8(long value);
+    void imm32(long value);
+    void imm64(long value);
+    // REX prefix, opcode and ModRM (with SIB and displacement) for an
+    // instruction whose r/m operand is rm, immBytes follow the displacement.
+    // rexByte keeps an empty REX prefix for the byte registers that need one
+    void rm(std::vector<int> opcode, int reg, MOperand &rm, int immBytes, bool wide = true, bool rexByte = false);
+    // VEX prefix, opcode and ModRM of an AVX instruction with the extra
+    // source register vvvv
+    void vex(int map, bool wide, bool ymm, int opcode, int reg, int vvvv, MOperand &rm, int immBytes);
+    // ModRM, SIB and displacement
+    void modrm(int reg, MOperand &rm, int immBytes);
+    void jump(std::vector<int> shortOpcode, std::vector<int> longOpcode, std::string target);
+    void encode(MInstr &i);
+public:
+    // encode a whole text section, jumps to its own labels are resolved and
+    // everything else becomes a relocation. Jumps get the short rel8 form
+    // whenever their target is close enough
+    void encode(std::vector<MInstr> &text);
+
+    std::vector<unsigned char> &getCode();
+    std::map<std::string, unsigned long> &getLabels();
+    std::vector<Relocation> &getRelocations();
+};
+
+#endif
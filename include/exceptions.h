@@ -63,4 +63,11 @@ public:
     void printException();
 };
 
+// Error to be thrown when the interpreter cannot run the program any further
+class RuntimeError : public CompilerException {
+public:
+    RuntimeError(std::string err);
+    void printException();
+};
+
 #endif
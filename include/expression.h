@@ -7,6 +7,7 @@
 
 #include <list>
 #include "token.h"
+#include "c_type.h"
 
 // Abstract class for implementing a visitor class for the Expression class
 class ExpressionVisitor;
@@ -14,6 +15,9 @@ class ExpressionVisitor;
 // Abstract class for implementing other expressions
 class Expression {
 public:
+    // type of the value, SymbolVisit fills it in
+    SymbolType type = SYM_INT;
+
     virtual void accept(ExpressionVisitor *visitor);
     virtual ~Expression();
 };
@@ -47,6 +51,8 @@ public:
 class PrimaryExp : public Expression {
 public:
     Token value;
+    // level of the scope declaring an identifier, -1 until resolved
+    int scope;
 
     void accept(ExpressionVisitor *visitor);
 
@@ -84,6 +90,8 @@ public:
     Token name;
     Token op;
     Expression *exp;
+    // level of the scope declaring name, -1 until resolved
+    int scope;
     void accept(ExpressionVisitor *visitor);
 
     Assignment(Token name, Token op, Expression *exp);
@@ -0,0 +1,23 @@
+/* File: hash.h
+ * Authors: agent
+ * Description: 64 bit FNV-1a hashing, used to key the incremental state and
+ *              the compilation cache
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <string>
+
+// Start value of a hash
+extern const unsigned long FNV_OFFSET;
+
+// Continue the hash h with some bytes
+unsigned long hashBytes(unsigned long h, const void *bytes, unsigned long size);
+// Continue the hash h with a string and its terminating 0, so "ab" "c"
+// and "a" "bc" hash differently
+unsigned long hashString(unsigned long h, const std::string &s);
+// The hash as 16 hex digits
+std::string string_of_hash(unsigned long h);
+
+#endif
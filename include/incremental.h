@@ -0,0 +1,75 @@
+/* File: incremental.h
+ * Authors: agent
+ * Description: Incremental compilation. The top-level declarations of a
+ *              source are hashed by their tokens and the code of functions
+ *              that did not change since the last build is taken from a
+ *              state file instead of being parsed, lowered and selected again
+ */
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "token.h"
+#include "mir.h"
+
+// Kinds of top-level declarations
+enum DeclKind {
+    D_VAR, D_PROTO, D_FUNC
+};
+
+// A top-level declaration as a range of the token list
+struct TopLevelDecl {
+    DeclKind kind;
+    std::string name;
+    // its tokens are [begin, end), a function's signature ends at sigEnd
+    unsigned int begin;
+    unsigned int end;
+    unsigned int sigEnd;
+    // hash of a function's tokens and of the signatures of every top-level
+    // name it uses, so it is recompiled when a callee's signature changes
+    unsigned long key = 0;
+};
+
+// The code of one function and the jump tables and float constants it reads
+struct FunctionCode {
+    std::vector<MInstr> text;
+    std::vector<MInstr> rodata;
+};
+
+class Incremental {
+private:
+    std::string stateFile;
+    int optLevel;
+    // instruction set the vector loops use
+    std::string target;
+    std::vector<TopLevelDecl> decls;
+    // code of every function by key, as read from the state file
+    std::map<unsigned long, FunctionCode> cache;
+    // code of the functions of this build, written back by save()
+    std::map<unsigned long, FunctionCode> current;
+    int reused;
+    int recompiled;
+
+    void load();
+    void computeKeys(std::vector<Token> &tokens);
+public:
+    Incremental(std::string stateFile, int optLevel, std::string target);
+
+    // split the tokens into top-level declarations, false if they do not
+    // split cleanly, the full compile then reports the errors
+    bool split(std::vector<Token> &tokens);
+    // the program to compile: globals, prototypes and changed functions in
+    // full, unchanged functions only as prototypes
+    std::vector<Token> reduce(std::vector<Token> &tokens);
+    // put every function's code in the text section, in source order, and
+    // its jump tables and float constants in rodata
+    void merge(MModule &module);
+    // replace the state file with the functions of this build
+    void save();
+    void printStats();
+};
+
+#endif
@@ -0,0 +1,182 @@
+/* File: interp.h
+ * Authors: agent
+ * Description: IR interpreter. The IR is translated to a compact register
+ *              machine code with every label already resolved to its
+ *              instruction, which runs main right away without assembling
+ *              or linking anything
+ */
+
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "irep.h"
+
+// Value slots for the frames of all active calls to start with, the stack
+// doubles whenever a call needs more, up to INTERP_MAX_STACK_SLOTS
+#ifndef INTERP_STACK_SLOTS
+#define INTERP_STACK_SLOTS (1L << 16)
+#endif
+
+#ifndef INTERP_MAX_STACK_SLOTS
+#define INTERP_MAX_STACK_SLOTS (1L << 25)
+#endif
+
+// Active calls at once, room for INTERP_DEPTH to start with and doubled
+// the same way. Deeper recursion is a stack overflow.
+#ifndef INTERP_DEPTH
+#define INTERP_DEPTH 4096
+#endif
+
+#ifndef INTERP_MAX_DEPTH
+#define INTERP_MAX_DEPTH (1 << 22)
+#endif
+
+// Dispatch jumps straight from one handler to the next through the
+// handler addresses in the code, compilers without computed gotos get a
+// switch instead
+#ifndef INTERP_THREADED
+#ifdef __GNUC__
+#define INTERP_THREADED 1
+#else
+#define INTERP_THREADED 0
+#endif
+#endif
+
+class Interpreter {
+private:
+    // a register, variable or constant, ints are kept sign extended to 64
+    // bits like in the registers of the generated code
+    union Value {
+        long i;
+        float f;
+    };
+
+    enum class Opcode {
+        // copies, the L and B forms store into an int or char variable
+        MOV, MOVL, MOVB,
+        // globals, which live outside of the frames
+        GLOAD, GSTORE, GSTOREL, GSTOREB,
+        ADD, SUB, MUL, DIV, MOD, AND, OR, XOR, LAND, LOR,
+        LT, GT, LE, GE, EQ, NE,
+        NEG, BNOT, LNOT,
+        FADD, FSUB, FMUL, FDIV, FNEG,
+        FLT, FGT, FLE, FGE, FEQ, FNE,
+        ITOF, FTOI,
+        JUMP, BRANCH, SWITCH,
+        CALL, CALLX, RET, RETV, HALT,
+        NUM_OPCODES
+    };
+
+    // how much of a value a variable of some type keeps
+    enum class Width { WIDE, LONG, BYTE };
+
+    // operands are slots of the current frame unless noted:
+    //   dst = a op b
+    //   jump, branch: a is the condition, b the target
+    //   switch: a is the value, dst the lowest case, b the first of the c
+    //           targets in tables, the default follows them
+    //   call: a is the function, b the argument count in args with the
+    //         arguments after it, c the width of the result, dst is -1
+    //         when the result is unused
+    //   gload, gstore: a and dst are globals
+    struct Code {
+        const void *handler;
+        Opcode op;
+        int dst;
+        int a;
+        int b;
+        int c;
+    };
+
+    struct Function {
+        std::string name;
+        // the first instruction
+        int entry;
+        std::vector<Width> params;
+        int slots;
+        // a frame starts with the constants of the code, the parameters
+        // follow them
+        std::vector<Value> constants;
+    };
+
+    // a function outside of the program, called through the C library
+    struct External {
+        std::string name;
+        void *address;
+    };
+
+    // where a call returns to
+    struct Return {
+        const Code *pc;
+        Value *fp;
+    };
+
+    // what a function is being translated with
+    struct Scope {
+        Function *fun;
+        std::map<std::string, int> vars;
+        std::map<std::string, Width> widths;
+        std::map<int, int> regs;
+        std::map<int, int> ints;
+        std::map<int, int> floats;
+        std::map<std::string, int> labels;
+        // jumps and switch tables to labels that may come later
+        std::vector<std::pair<int, std::string>> jumps;
+        std::vector<std::pair<int, std::string>> cases;
+    };
+
+    std::list<Instruction *> IR;
+    std::vector<Code> code;
+    std::vector<int> args;
+    std::vector<int> tables;
+    std::vector<Function> functions;
+    std::map<std::string, int> byName;
+    std::vector<External> externals;
+    std::map<std::string, int> byExternal;
+    std::vector<Value> globals;
+    std::map<std::string, int> globalSlots;
+    std::map<std::string, Width> globalWidths;
+    // left uninitialized, so only the pages a program reaches are touched
+    std::unique_ptr<Value[]> stack;
+    std::unique_ptr<Return[]> frames;
+    long stackSlots;
+    int depthLimit;
+
+    long calls;
+    double seconds;
+
+    static Width widthOf(SymbolType sym);
+    bool isGlobal(Scope &s, Container c);
+    // the frame slot of a register, local variable or constant
+    int slot(Scope &s, Container c);
+    // a slot holding the value of c, globals are loaded into a new one
+    int operand(Scope &s, Container c);
+    // the slot an operation storing to dest writes, store then moves it
+    // into dest, cutting it down to dest's width
+    int target(Scope &s, Container dest);
+    void store(Scope &s, Container dest, int src);
+    int external(std::string name);
+    void emit(Opcode op, int dst, int a, int b, int c);
+    void translate(Scope &s, Instruction *i);
+    void translate(Function &f, std::vector<Instruction *> &body);
+
+    // make room for a call at depth with a frame of slots, moving the
+    // stack rebases fp, sp and end, false once the limits are reached
+    bool grow(int depth, int slots, Value *&fp, Value *&sp, Value *&end);
+    long execute();
+public:
+    Interpreter(std::list<Instruction *> IR);
+
+    // run the top level code and main, gives what main returns
+    int run();
+
+    void printStats();
+};
+
+#endif
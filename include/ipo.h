@@ -0,0 +1,112 @@
+/* File: ipo.h
+ * Authors: agent
+ * Description: Interprocedural optimizations over a whole program's IR:
+ *              call folding, tail recursion elimination, inlining,
+ *              constant argument propagation and dead function and global
+ *              elimination
+ */
+
+#ifndef IPO_H
+#define IPO_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "irep.h"
+#include "profile.h"
+
+// Functions with more instructions than this are never inlined
+#ifndef INLINE_MAX_INSTRS
+#define INLINE_MAX_INSTRS 40
+#endif
+
+// Calls the profile shows to be hot may inline functions up to this many
+// instructions
+#ifndef INLINE_HOT_MAX_INSTRS
+#define INLINE_HOT_MAX_INSTRS 160
+#endif
+
+// Inlining stops growing a function past this many instructions
+#ifndef INLINE_MAX_CALLER
+#define INLINE_MAX_CALLER 2000
+#endif
+
+class Interprocedural {
+private:
+    struct Function {
+        DefInstr *def;
+        // the instructions between the def and its funcend
+        std::vector<Instruction *> body;
+        Instruction *end;
+        bool dead;
+        // stores to no global and calls only pure functions
+        bool pure;
+        // every return gives value, whatever the arguments
+        bool constant;
+        Container value;
+    };
+    // instructions outside of functions, a null entry stands for the next
+    // function in functions
+    std::vector<Instruction *> topLevel;
+    std::vector<Function> functions;
+    std::map<std::string, unsigned int> byName;
+    // globals, every other variable is local to its function
+    std::set<std::string> globals;
+    // functions and globals code outside the program may use
+    std::set<std::string> exported;
+    // numbers for the registers and labels inlining creates
+    int nextReg;
+    int nextInline;
+    // counts of an earlier run, null without one
+    Profile *profile;
+
+    int folded;
+    int callsRemoved;
+    int tailCalls;
+    int inlined;
+    int hotInlined;
+    int constArgs;
+    int removed;
+    int removedGlobals;
+
+    // every function is known, no code outside the program calls in
+    // except through the exported symbols
+    bool closedWorld();
+    bool isLeaf(Function &f);
+    void summarize();
+    bool inlineCall(Function &caller, unsigned int k);
+public:
+    Interprocedural(std::list<Instruction *> IR);
+
+    // keep a function or global, by its source name, for code outside the
+    // program
+    void exportSymbol(std::string name);
+    // inline by how often the calls ran, calls that never did are left
+    // alone
+    void setProfile(Profile *profile);
+
+    // replace the results of calls to functions that always return the
+    // same constant and remove calls to pure functions whose result is
+    // unused
+    void foldCalls();
+    // a function that returns what calling itself returns loops back to
+    // its entry with the new arguments instead
+    void eliminateTailRecursion();
+    // replace calls to small functions that make no calls themselves
+    // with their bodies
+    void inlineCalls();
+    // parameters every call passes the same constant become locals
+    // initialized to it
+    void propagateConstArgs();
+    // drop the functions main and the exported symbols cannot reach and
+    // the globals none of the remaining code uses
+    void removeDeadCode();
+
+    std::list<Instruction *> getIR();
+    void printStats();
+};
+
+#endif
@@ -0,0 +1,84 @@
+/* File: irbinary.h
+ * Authors: agent
+ * Description: Binary form of the IR. A file holds a header, the containers
+ *              and instructions as fixed width records and a string table,
+ *              it is mapped into memory and read in place
+ */
+
+#ifndef IR_BINARY_H
+#define IR_BINARY_H
+
+#include <cstdint>
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "exceptions.h"
+#include "irep.h"
+
+// Bumped whenever the layout of the records changes
+#define IR_BINARY_VERSION 2
+
+// First bytes of every binary IR file
+#define IR_BINARY_MAGIC "CCIR"
+
+// The file is the header followed by containerCount containers,
+// recordCount records, stringCount + 1 string offsets and the string bytes
+struct IRBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t containerCount;
+    uint32_t recordCount;
+    uint32_t stringCount;
+    uint32_t stringBytes;
+};
+
+// value is the register number, the raw bits of an immediate or the
+// string table index of a name or physical register
+struct IRBinaryContainer {
+    uint8_t type;
+    int8_t sym;
+    uint16_t pad;
+    uint32_t value;
+};
+
+// An instruction, its containers are [first, first + count). name is the
+// string index of a function, label, jump target or switch default, label
+// that of a branch's second label. A switch's table labels are containers
+// after its value and lowest case value
+struct IRBinaryRecord {
+    uint8_t op;
+    uint8_t irop;
+    int8_t sym;
+    uint8_t flags;
+    uint32_t name;
+    uint32_t label;
+    uint32_t first;
+    uint32_t count;
+    // a call's caller saved registers, extra containers after its arguments
+    uint32_t saved;
+};
+
+// Write the instructions in the binary form
+void writeBinaryIR(std::ostream &out, const std::list<Instruction *> &ir);
+
+// Does the file start with the binary magic
+bool isBinaryIR(std::string path);
+
+class IR_BinaryReader {
+private:
+    std::string irFilePath;
+    // one string per table entry, shared by every container naming it
+    std::vector<std::string *> strings;
+
+    std::string *stringAt(uint32_t index);
+    Container container(const IRBinaryContainer &c);
+public:
+    IR_BinaryReader(std::string path);
+
+    // read the file into IR structures
+    std::list<Instruction *> parse();
+};
+
+#endif
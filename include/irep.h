@@ -10,6 +10,7 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "symbol.h"
 #include "token.h"
@@ -18,7 +19,7 @@
 
 // Declare operator types 
 enum OpType {
-    END, DECL, DEF, UNARY_LET, BINARY_LET, CONST_LET, CALL, BRANCH, LABEL, JUMP, RET
+    END, DECL, DEF, UNARY_LET, BINARY_LET, CONST_LET, CALL, BRANCH, LABEL, JUMP, RET, JUMP_TABLE
 };
 
 // Declare the Container Type Either string, immediate, or register
@@ -30,7 +31,14 @@ enum ContainerType {
 enum class IrOp {
     ADD, SUB, MUL, DIV, NOT, ADD_EQ, SUB_EQ, MUL_EQ, DIV_EQ, LESS, GREATER, LESS_EQ, GREATER_EQ,
     NOT_EQ, MOD, MOD_EQ, AND, OR, AND_AND, OR_OR, XOR, BFLIP, PLUS_PLUS,
-    MINUS_MINUS, EQUAL_EQUAL
+    MINUS_MINUS, EQUAL_EQUAL,
+    // conversions between int and float, a float converts toward zero
+    ITOF, FTOI,
+    // vector operations, only the loop vectorizer makes them and only after
+    // the IR is written out, so neither IR reader knows them:
+    // splat x copies x to every lane, step x gives x, x + 1, ... and
+    // v lane k reads lane k. The other ops work lane by lane on vectors.
+    SPLAT, STEP, LANE
 };
 
 // The union type to handle either the string name or register value
@@ -51,8 +59,9 @@ struct Container {
     ContainerType type;
     // the value of the container type
     ContainerValue value;
-    //The symbol Type
-    SymbolType sym;
+    //The symbol Type, registers and immediates holding a float are
+    //SYM_FLOAT, registers holding a vector SYM_VECTOR
+    SymbolType sym = SYM_INT;
 
     //copy constructor
     Container(const Container &cont);
@@ -73,9 +82,12 @@ struct Container {
     bool isPhysRegister();
     bool isVariable();
     bool isImmediate();
+    bool isFloat();
+    bool isVector();
     // Getter
     int getIntValue();
     int getIntImmediate();
+    float getFloatImmediate();
     std::string getReg();
     std::string getStringValue();
     std::string getSymType();
@@ -144,6 +156,7 @@ class DefInstr: public Instruction {
         DefInstr(std::string name, SymbolType type, std::list<Container> *params, SymbolTable *table);
         virtual std::string toString() override;
         std::string getName();
+        SymbolType getType();
         std::list<Container> *getParams();
 
 };
@@ -156,6 +169,8 @@ class CallInstr: public Instruction {
         std::list<Container> *args;
         Container regCapture;
         int regCaptureFlag = 0;
+        // caller saved physical registers to preserve around the call
+        std::list<std::string> *savedRegs = nullptr;
         
     public:
         Container getContainer();
@@ -163,6 +178,8 @@ class CallInstr: public Instruction {
         std::list<Container> *getArgs();
         std::string getName();
         void setExpression(Container captureReg);
+        std::list<std::string> *getSavedRegs();
+        void setSavedRegs(std::list<std::string> *regs);
         CallInstr(std::string name, std::list<Container> *args, SymbolTable *table);
         virtual std::string toString() override;
 
@@ -205,6 +222,26 @@ class JumpInstr: public Instruction {
         std::string getLabelName();
 };
 
+// Jump table
+// switch value from low (L1, ..., Ln) else LABEL
+// jumps to the label of value - low, or to the default label when value is
+// outside of the table
+class SwitchInstr: public Instruction {
+    private:
+        Container value;
+        int low;
+        std::vector<std::string> targets;
+        std::string defaultLabel;
+    public:
+        SwitchInstr(Container value, int low, std::vector<std::string> targets, std::string defaultLabel, SymbolTable *table);
+        Container getContainer();
+        int getLow();
+        std::vector<std::string> &getTargets();
+        std::string getDefault();
+        virtual std::string toString() override;
+
+};
+
 // return
 // return expr (return nil for voids?)
 class ReturnInstr: public Instruction {
@@ -266,6 +303,9 @@ public:
 // convert an IR op into a string
 std::string string_of_irop(IrOp op);
 
+// convert the string form of an IR op back into the op
+IrOp irop_of_string(std::string s);
+
 // convert a token version of an operation into an IR version of an operation
 IrOp irop_of_token(Token t);
 
@@ -275,4 +315,12 @@ std::vector<BasicBlock> bblist_of_instruction_list(std::list<Instruction *>instr
 // remove empty blocks from a list of basic blocks
 void removeEmptyBlocks(std::vector<BasicBlock> &bblist);
 
+// every container an instruction reads or writes
+std::vector<Container> containers_of_instruction(Instruction *i);
+
+// copy an instruction, passing every container through cont and every
+// label through label
+Instruction *map_instruction(Instruction *i, std::function<Container (Container)> cont,
+    std::function<std::string (std::string)> label);
+
 #endif
@@ -11,26 +11,56 @@
 #ifndef IREPVISIT_H
 #define IREPVISIT_H
 
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "expression.h"
 #include "statement.h"
 #include "irep.h"
 #include "symbolvisit.h"
 
+// Switches with at least this many cases are dispatched through a jump
+// table when it is dense enough
+#ifndef SWITCH_TABLE_MIN_CASES
+#define SWITCH_TABLE_MIN_CASES 4
+#endif
+
+// A jump table may have at most this many entries per case
+#ifndef SWITCH_TABLE_DENSITY
+#define SWITCH_TABLE_DENSITY 3
+#endif
+
+// The compare tree of a sparse switch tests this many cases one after the
+// other instead of splitting them further
+#ifndef SWITCH_LINEAR_CASES
+#define SWITCH_LINEAR_CASES 3
+#endif
+
 // Need a more concrete class to store every type of instructions
 // Printer class that inherits from the expression and statement visitor patterns
 class IRepVisitor : public ExpressionVisitor , public  StatementVisitor {
 private:
     // Marks the location of every goto statement jump instruction in the instruction list
-    // As well as what function it belongs too, same for every label instruction
+    // As well as what function it belongs too
     std::list<int> goToMarker;
     std::vector<std::string> goToFuncName;
     std::vector<std::string> goToLabelName;
-    std::vector<std::string> labelNames;
-    std::vector<std::string> labelFunctionNames;
+    // The labels of every function, and the labels found twice in one
+    // function with that function
+    std::unordered_map<std::string, std::unordered_set<std::string>> functionLabels;
+    std::vector<std::pair<std::string, std::string>> repeatedLabels;
 
     //holds last used function name, 
     //used to mark the end of function bodies
     std::string funNameHolder;
+    // definition of the function being visited, its parameters can't be
+    // declared again
+    DefInstr *currentDef = NULL;
+    // end labels of the enclosing loops and switches, a break jumps to the
+    // innermost one
+    std::vector<std::string> breakLabels;
     // Instructions that are created from visiting the parse tree
     std::list<Instruction *> irep;
     
@@ -85,7 +115,19 @@ public:
 
     // Helper
     SymbolType getSymType(Token t);
+
+    // The value of the expression just visited, it is in the last register
+    Container lastReg(Expression *exp);
+    // The value as the given type, converted into a new register if needed
+    Container convert(Container value, SymbolType type);
+    // An int that is 0 exactly when the value is, floats are compared
+    // against 0.0
+    Container truth(Container value);
     
+    // Compare tree of a sparse switch over the sorted cases [begin, end)
+    void switchSearch(Container value, std::vector<std::pair<int, std::string>> &cases,
+        unsigned int begin, unsigned int end, std::string defaultLabel);
+
     // Label Checker
     bool labelsAreGood();
 };
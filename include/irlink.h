@@ -0,0 +1,35 @@
+/* File: irlink.h
+ * Authors: agent
+ * Description: Links the IR of separately compiled files into one program
+ *              that is optimized and code generated as a whole
+ */
+
+#ifndef IR_LINK_H
+#define IR_LINK_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "exceptions.h"
+#include "irep.h"
+
+class IRLinker {
+private:
+    struct Module {
+        std::string name;
+        std::list<Instruction *> ir;
+    };
+    std::vector<Module> modules;
+public:
+    // add the IR of one file, name is used in error messages
+    void add(std::string name, std::list<Instruction *> ir);
+
+    // One program from every module added. Registers and labels are
+    // renumbered so they stay unique, a global declared in several modules
+    // becomes one, a function defined twice is an IR_Error
+    std::list<Instruction *> link();
+};
+
+#endif
@@ -2,19 +2,38 @@
 #define IR_PARSER_H
 
 #include <list>
+#include <map>
+#include <string>
 
 #include "exceptions.h"
-#include "peglib.h"
 #include "irep.h"
 
+// Reads the text form of the IR, one instruction per line as
+// Instruction::toString prints it
 class IR_Parser {
 private:
-	std::string grammar;
-	peg::parser parser;
     std::string irFilePath;
-    std::string source;
+    // the line being read, [cur, end) is what is left of it
+    const char *lineStart;
+    const char *cur;
+    const char *end;
+    int line;
+    // one string per name, shared by every container naming it
+    std::map<std::string, std::string *> names;
 
-    void buildGrammar();
+    IR_Error error(std::string msg);
+    void skipSpace();
+    bool atEnd();
+    bool accept(char c);
+    void expect(char c);
+    // the next run of characters up to a space, comma or parenthesis
+    std::string word();
+    std::string *name(std::string word);
+    Container container(std::string word);
+    Container container();
+    SymbolType type(std::string word);
+    IrOp irop(std::string word);
+    Instruction *instruction();
 public:
 	IR_Parser(std::string path);
 
@@ -22,4 +41,4 @@ public:
     std::list<Instruction *> parse();
 };
 
-#endif
\ No newline at end of file
+#endif
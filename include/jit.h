@@ -0,0 +1,53 @@
+/* File: jit.h
+ * Authors: agent
+ * Description: In memory execution. The sections the object file writer
+ *              lays out are copied into executable memory and linked right
+ *              there, then main is called in this process, so running a
+ *              program needs no files, assembler or linker
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "mir.h"
+#include "elfwriter.h"
+
+// Every section starts at a multiple of this, enough for the widest vector
+// constant
+#ifndef JIT_SECTION_ALIGN
+#define JIT_SECTION_ALIGN 32
+#endif
+
+class Jit {
+private:
+    ElfWriter object;
+
+    // one mapping, the text and the stubs come first on pages of their own
+    unsigned char *memory;
+    unsigned long size;
+    unsigned long textPages;
+    std::map<std::string, unsigned char *> addresses;
+    // functions outside of the program are reached through a stub holding
+    // their address, the C library is too far away for a rel32
+    std::map<std::string, unsigned char *> stubs;
+
+    double loadSeconds;
+    double runSeconds;
+
+    unsigned char *address(std::string sym);
+public:
+    Jit(MModule &module);
+    ~Jit();
+
+    // encode the module, copy it into memory and resolve every relocation
+    void load();
+    // call main, gives what it returns
+    int run();
+
+    void printStats();
+};
+
+#endif
@@ -0,0 +1,84 @@
+/* File: layout.h
+ * Authors: agent
+ * Description: Block placement over the machine instructions of the text
+ *              section, after the peephole optimizer. The blocks of every
+ *              function are chained along their most frequent edges
+ *              (Pettis and Hansen) so the likely successor of a block
+ *              follows it. Conditional jumps are inverted and jumps added
+ *              where a block no longer falls through to the block it did.
+ *              How often blocks run comes from a profile, or without one
+ *              from their loop nesting, and blocks a profile shows never
+ *              ran go behind everything else
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mir.h"
+#include "profile.h"
+
+// Without a profile a block is taken to run this many times as often as
+// the blocks of the loop around it
+#ifndef LAYOUT_LOOP_WEIGHT
+#define LAYOUT_LOOP_WEIGHT 8
+#endif
+
+// Loops deeper than this weigh no more than it
+#ifndef LAYOUT_MAX_DEPTH
+#define LAYOUT_MAX_DEPTH 6
+#endif
+
+class BlockLayout {
+private:
+    struct Block {
+        // from the label or the function's directives to the jump or
+        // return that ends the block
+        std::vector<MInstr> code;
+        // empty when nothing jumps to the block
+        std::string label;
+        // the block jumped to, -1 for none or another function, and
+        // whether the block may go on to the next one
+        int taken;
+        bool falls;
+        // how often the block runs, and how often it falls through
+        long count;
+        long fallCount;
+        // the chain the block is in
+        int chain;
+    };
+    struct Edge {
+        int from;
+        int to;
+        long weight;
+    };
+
+    Profile *profile;
+    std::string function;
+    int nextLabel;
+
+    int moved;
+    int inverted;
+    int added;
+    int removed;
+    int cold;
+
+    std::vector<Block> split(std::vector<MInstr> &text, unsigned int begin, unsigned int end);
+    // with the counts of the profile, false when it does not know the
+    // function
+    bool countsFromProfile(std::vector<Block> &blocks);
+    // taken branches into loops, out of them less often
+    void countsFromLoops(std::vector<Block> &blocks);
+    std::vector<int> chain(std::vector<Block> &blocks, bool profiled);
+    void place(std::vector<Block> &blocks, std::vector<int> &order, std::vector<MInstr> &out);
+public:
+    BlockLayout(Profile *profile);
+
+    void run(std::vector<MInstr> &text);
+    void printStats();
+};
+
+#endif
@@ -0,0 +1,155 @@
+/* File: mir.h
+ * Authors: agent
+ * Description: Machine level IR. Code generation selects x86-64 instructions
+ *              and data into lists of MInstr so later passes can rewrite them
+ *              before AsmEmitter prints them as assembly
+ */
+
+#ifndef MIR_H
+#define MIR_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Machine opcodes, AT&T mnemonics with their size suffix
+enum class MOp {
+    // Pseudo instructions
+    LABEL,
+
+    // Assembler directives
+    GLOBL, TYPE, SIZE, BALIGN, QUAD, LONG, BYTE, ZERO,
+
+    // Data movement, movl and movb store the low bytes of a register and
+    // movslq and movsbq load a narrow value sign extended
+    MOVQ, MOVL, MOVB, MOVZBQ, MOVSLQ, MOVSBQ, LEAQ, PUSHQ, POPQ,
+
+    // Arithmetic and logic, cltd and idivl divide 32 bit ints
+    ADDQ, SUBQ, IMULQ, IDIVQ, CQTO, IDIVL, CLTD, NEGQ, NOTQ, ANDQ, ORQ, XORQ, SHLQ,
+
+    // Comparisons, the a/b conditions are the unsigned ones ucomiss sets
+    // and p/np its parity flag, set for unordered operands
+    CMPQ, TESTQ, SETE, SETNE, SETL, SETLE, SETG, SETGE, SETA, SETAE, SETB, SETBE,
+    SETP, SETNP,
+
+    // Scalar single precision floating point (SSE2) on the xmm registers
+    MOVSS, ADDSS, SUBSS, MULSS, DIVSS, XORPS, UCOMISS, CVTSI2SSQ, CVTTSS2SIQ,
+
+    // Packed 64 bit ints (SSE2) on the xmm registers, movqx is the movq
+    // between a general purpose and an xmm register
+    MOVQX, MOVDQA, MOVDQU, PADDQ, PSUBQ, PMULUDQ, PAND, POR, PXOR, PSRLQ, PSLLQ,
+    PCMPEQD, PSHUFD, PUNPCKLQDQ,
+
+    // The same on the ymm registers (AVX2), the destination is the last of
+    // three operands
+    VMOVQ, VPEXTRQ, VPBROADCASTQ, VEXTRACTI128, VPADDQ, VPSUBQ, VPMULUDQ,
+    VPAND, VPOR, VPXOR, VPSRLQ, VPSLLQ, VPCMPEQD, VZEROUPPER,
+
+    // Control flow, jmpq jumps to the address in a register
+    JMP, JE, JNE, JL, JLE, JG, JGE, JA, JAE, JB, JBE, JP, JNP, JMPQ, CALLQ, RETQ
+};
+
+// Operand kinds
+enum MOperandType {
+    M_NONE, M_REG, M_IMM, M_MEM, M_SYM
+};
+
+// A machine operand
+// Memory operands are disp(base, index, scale), a base of "rip" makes them
+// relative to the symbol in sym
+struct MOperand {
+    MOperandType type = M_NONE;
+    // register, or the base register of a memory operand
+    std::string reg;
+    // index register of a memory operand
+    std::string index;
+    int scale = 1;
+    // immediate value, displacement, or for a call target the number of
+    // arguments passed in registers
+    long value = 0;
+    // label or symbol name
+    std::string sym;
+
+    // Constructors
+    static MOperand Reg(std::string reg);
+    static MOperand Imm(long value);
+    static MOperand Mem(std::string base, long disp);
+    static MOperand Mem(std::string base, std::string index, int scale, long disp);
+    static MOperand Rip(std::string sym);
+    static MOperand Sym(std::string sym);
+
+    // Check functions
+    bool isReg();
+    bool isReg(std::string name);
+    bool isImm();
+    bool isMem();
+    bool isNone();
+    // does the operand read the register (directly, through its byte
+    // register or as an address)
+    bool uses(std::string name);
+
+    bool operator==(const MOperand &other) const;
+    bool operator!=(const MOperand &other) const;
+    std::string toString();
+};
+
+// A machine instruction, operands are in AT&T order (source first)
+struct MInstr {
+    MOp op;
+    std::vector<MOperand> ops;
+
+    MInstr(MOp op);
+    MInstr(MOp op, MOperand a);
+    MInstr(MOp op, MOperand a, MOperand b);
+    MInstr(MOp op, MOperand a, MOperand b, MOperand c);
+
+    bool isLabel();
+    bool isDirective();
+    bool isJump();
+    bool isCondJump();
+    // does the instruction read/overwrite the condition flags
+    bool readsFlags();
+    bool writesFlags();
+    std::string toString();
+};
+
+// A whole assembly file, one instruction list per section. A .quad of two
+// labels in rodata is their difference, float constants are in rodata too
+struct MModule {
+    std::string fileName;
+    std::vector<MInstr> data;
+    std::vector<MInstr> bss;
+    std::vector<MInstr> rodata;
+    std::vector<MInstr> text;
+};
+
+// Prints machine instructions as AT&T assembly. Everything is appended to a
+// single buffer so a module is written out with one write
+class AsmEmitter {
+private:
+    std::string buffer;
+
+    void put(MOperand &o, bool directive);
+public:
+    void emit(MOperand &o);
+    void emit(MInstr &i);
+    void emit(std::vector<MInstr> &code);
+    void emit(MModule &module);
+
+    std::string &getBuffer();
+    void write(std::ostream &out);
+};
+
+// Mnemonic of an opcode
+std::string string_of_mop(MOp op);
+
+// Conditional jump taken exactly when the given one is not
+MOp invert_jump(MOp op);
+
+// setcc instruction testing the same condition as a conditional jump
+MOp set_of_jump(MOp op);
+
+// Name of the low 4 or 1 bytes of a 64 bit register, %eax or %al of %rax
+std::string sub_register(std::string reg, int bytes);
+
+#endif
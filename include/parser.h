@@ -51,27 +51,36 @@ class Parser {
         Statement *gotoStmt();
         Statement *label();
 
-        Token constant();
-        Token typeSpecifier();
-        Token returnType();
+        const Token &constant();
+        const Token &typeSpecifier();
+        const Token &returnType();
 
         // Helper functions
+        // The token helpers hand out references into the token list, which
+        // does not change once the parser is constructed
         // Return the current token and advance to the next one
-        Token advance();
+        const Token &advance();
         // Peek at the previously consumed token
-        Token previous();
+        const Token &previous();
         // Peek at the current token without consuming it
-        Token peek();
-        // Match a list of tokens to match agains the current
-        bool match(std::list<TokenType> tokenList);
+        const Token &peek();
+        // Type of the token n places ahead of the current one, EOFILE past
+        // the end of the list
+        TokenType lookahead(unsigned int n);
+        // Consume the current token if it is in 'types'
+        bool match(TokenSet types);
         // Check if the current token is 'type'
         bool check(TokenType type);
+        // Check if the current token is any of 'types'
+        bool check(TokenSet types);
         // Checks if we hit the end of the token list
         bool isAtEnd();
         // Checks if the current token is TYPE_*
         bool isType();
         // Check if the next token is of type 'type'
         bool checkNext(TokenType type);
+        // Check if the next token is any of 'types'
+        bool checkNext(TokenSet types);
         // Synchronize the token list
         void synchronize();
 
@@ -79,16 +88,11 @@ class Parser {
         Expression *expression();
         Expression *expressionList();        
         
-        Expression *simpleExpression();
-        Expression *andExpr();
-        Expression *bitOrExpr();
-        Expression *bitXorExpr();
-        Expression *bitAndExpr();
-        Expression *relop1Expr();
-        Expression *relop2Expr();
-        Expression *bitShiftExpr();
-        Expression *sumExpr();
-        Expression *term();
+        // Binary operators are parsed by binding power from a table
+        Expression *binaryExpr(int minPower);
+        // Pending operands and operators of runs of equal power operators
+        std::vector<Expression *> operands;
+        std::vector<const Token *> operators;
         Expression *preUnaryExpr();
         Expression *postUnaryExpr();
         Expression *factor();
@@ -98,6 +102,8 @@ class Parser {
 
     public:
         bool hadError();
+        // Number of tokens handed to the parser, for throughput statistics
+        unsigned long getTokenCount();
         Parser(std::vector<Token> tokens);
         std::list<Statement *> parse();
 };
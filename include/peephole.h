@@ -0,0 +1,59 @@
+/* File: peephole.h
+ * Authors: agent
+ * Description: Peephole optimizer over the machine instructions of the
+ *              text section
+ */
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "mir.h"
+
+// Rewrite rules, each one keeps a hit counter
+enum PeepholeRule {
+    P_REDUNDANT_MOVE,   // movq %r, %r
+    P_STORE_LOAD,       // reload of a value that was just stored or loaded
+    P_COPY_PROP,        // value moved through a dead scratch register
+    P_DEAD_WRITE,       // register written and never read
+    P_JUMP_NEXT,        // jump to the instruction that follows anyway
+    P_UNREACHABLE,      // code after a jmp or retq that no label reaches
+    P_ZERO_XOR,         // movq $0, %r -> xorq %r, %r
+    P_MUL_CONST,        // imulq by a constant -> leaq/shlq
+    P_BRANCH_FUSION,    // boolean materialized only to be compared with 1
+    P_SETCC,            // boolean materialized with branches -> setcc
+    P_DEAD_FLAGS,       // cmpq/testq whose flags are never read
+    P_NUM_RULES
+};
+
+class Peephole {
+private:
+    std::vector<MInstr> *code;
+    // position of every label, and how many jumps target it
+    std::map<std::string, unsigned int> labels;
+    std::map<std::string, int> refs;
+    int hits[P_NUM_RULES];
+    int passes;
+
+    bool pass();
+    // try the rules at position k, returns the number of instructions
+    // consumed and appends their replacement to out, 0 if none matched
+    unsigned int rewrite(unsigned int k, std::vector<MInstr> &out);
+
+    // is the register/are the flags dead before the instruction at pos
+    bool regDead(unsigned int pos, std::string reg);
+    bool flagsDead(unsigned int pos);
+    bool at(unsigned int pos, MOp op);
+
+public:
+    Peephole();
+
+    // rewrite the instructions until no rule applies
+    void run(std::vector<MInstr> &code);
+    int getHits(PeepholeRule rule);
+    void printStats();
+};
+
+#endif
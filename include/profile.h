@@ -0,0 +1,85 @@
+/* File: profile.h
+ * Authors: agent
+ * Description: Profile guided optimization. An instrumented program counts
+ *              how often each of its blocks runs in a table in .bss, and
+ *              main writes the table to the profile file before it returns.
+ *              A later compilation of the same source reads the counts back
+ *              to decide which calls to inline, which values to keep in
+ *              callee saved registers and which blocks to move out of the
+ *              way
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "irep.h"
+
+// A block is hot when it runs at least this many percent as often as the
+// most frequent block of the program
+#ifndef PROFILE_HOT_PERCENT
+#define PROFILE_HOT_PERCENT 1
+#endif
+
+// The function main calls to write the counters out, a local label so it
+// cannot clash with a function of the program
+#define PROFILE_DUMP ".Lprof_dump"
+
+// Blocks are known by a key that stays the same from one compilation of
+// a source to the next: the name of the function whose entry they are,
+// the label they start with, or the target of the branch they follow
+// when it does not jump
+class Profile {
+private:
+    std::string fileName;
+    // the key of every counter, in the order of the table
+    std::vector<std::string> keys;
+    std::map<std::string, int> counters;
+    // how often every block ran, read back from the file
+    std::map<std::string, unsigned long> counts;
+    unsigned long hottest;
+
+    // labels inlining made for its copies of a callee
+    static bool inlined(std::string label);
+public:
+    Profile(std::string fileName);
+
+    static std::string entryKey(std::string function);
+    static std::string labelKey(std::string label);
+    static std::string fallKey(BranchInstr *br);
+    // the same for the conditional jump a branch to the label became
+    static std::string fallKey(std::string target);
+
+    std::string getFileName();
+
+    // Generating
+    // the index of the counter of a block, blocks with the same key share
+    // one
+    int counter(std::string key);
+    std::vector<std::string> &getKeys();
+    // what the file starts with, the counters follow it as 64 bit ints
+    std::string header();
+    // call the dump in front of every return of main
+    void instrumentExits(std::list<Instruction *> &IR);
+
+    // Using
+    // read the counts, a missing or malformed file leaves them empty
+    bool load();
+    // how often the block ran, -1 when the profile does not know it
+    long count(std::string key);
+    // how often code[k] of the function ran, from the block it is in.
+    // Blocks the profile does not know and inlined copies are passed over,
+    // a copy runs as often as the call it replaced
+    long countAt(std::string function, std::vector<Instruction *> &code, unsigned int k);
+    bool isHot(long count);
+    // known to have never run
+    bool isCold(long count);
+
+    void printStats();
+};
+
+#endif
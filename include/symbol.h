@@ -50,6 +50,8 @@ class SymbolTable {
         void insertVar(std::string key, Symbol value);
         void insertFun(std::string key, Symbol value);
         Symbol *lookupVar(std::string key);
+        // the table of the innermost scope declaring the variable
+        SymbolTable *lookupVarScope(std::string key);
         Symbol *lookupFun(std::string key);
         Symbol *localVarLookup(std::string key);
         Symbol *localFunLookup(std::string key);
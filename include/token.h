@@ -48,11 +48,11 @@ public:
     // Copy constructor
     Token(const Token &tok);
     // Return the lexeme
-    std::string getLexeme();
+    std::string getLexeme() const;
     // Return the token type
-    TokenType getType();
+    TokenType getType() const;
     // Return the line 
-    int getLine();
+    int getLine() const;
     // Return the literal value stored
     template <class T>
     T getLiteral();
@@ -60,6 +60,17 @@ public:
     friend std::ostream& operator << (std::ostream &out, Token &token);
 };
 
+// A set of token types, one bit per TokenType, so the parser can test the
+// current token against several types with a single mask
+typedef unsigned long long TokenSet;
+
+static_assert(EOFILE < 64, "TokenType no longer fits in a TokenSet");
+
+// The set holding just 'type', sets are joined with |
+constexpr TokenSet tokenSet(TokenType type) {
+    return 1ULL << type;
+}
+
 std::string stringOfTokenType(TokenType type);
 
 #endif
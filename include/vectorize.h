@@ -0,0 +1,87 @@
+/* File: vectorize.h
+ * Authors: agent
+ * Description: Loop vectorizer. Counted loops whose iterations only add up
+ *              (or and, or, xor) values computed from the loop counter get
+ *              a vector loop that does several iterations at once in front
+ *              of them, the scalar loop finishes the remaining ones
+ */
+
+#ifndef VECTORIZE_H
+#define VECTORIZE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "irep.h"
+
+// Vector registers a vectorized loop may hold at once. The allocator hands
+// out eight xmm registers and never spills, the rest are left for floats
+// live around the loop
+#ifndef VECTORIZE_MAX_REGS
+#define VECTORIZE_MAX_REGS 6
+#endif
+
+class Vectorizer {
+private:
+    // value of an expression in terms of the variables at the start of an
+    // iteration
+    struct Node {
+        enum { VAR, IMM, OP } kind;
+        std::string var;
+        int imm;
+        IrOp op;
+        // operands, b is -1 for unary ops
+        int a;
+        int b;
+    };
+    // a variable the loop accumulates into: var = var op term op term ...
+    struct Reduction {
+        std::string var;
+        IrOp op;
+        // terms, with whether they are subtracted
+        std::vector<std::pair<int, bool>> terms;
+    };
+    std::vector<Node> nodes;
+
+    std::list<Instruction *> IR;
+    // 64 bit lanes of a vector, 2 for SSE2 and 4 for AVX2
+    int lanes;
+    int nextReg;
+    // type of every variable of the function being looked at
+    std::map<std::string, SymbolType> globalTypes;
+    std::map<std::string, SymbolType> types;
+    // references to every label, a loop head nothing else jumps to is
+    // entered only from above
+    std::map<std::string, int> labelRefs;
+
+    int vectorized;
+
+    int var(std::string name);
+    int imm(int value);
+    int op(IrOp op, int a, int b);
+    std::string key(int n);
+    bool uses(int n, std::string var);
+    bool invariant(int n, std::map<std::string, int> &vars);
+    bool vectorizable(int n);
+    int temps(int n, std::map<std::string, int> &vars);
+    void hoisted(int n, std::map<std::string, int> &vars, std::map<std::string, int> &out);
+    void terms(int n, IrOp op, bool neg, std::vector<std::pair<int, bool>> &out);
+
+    // try to vectorize the loop starting at the label in code[k], its
+    // vector loop goes to out
+    bool vectorize(std::vector<Instruction *> &code, unsigned int k, std::list<Instruction *> &out);
+    Container scalar(int n, std::list<Instruction *> &out);
+    Container vector(int n, std::map<std::string, Container> &pre, std::list<Instruction *> &out);
+public:
+    Vectorizer(std::list<Instruction *> IR, int lanes);
+
+    // put a vector loop in front of every loop that can take one
+    void vectorizeLoops();
+
+    std::list<Instruction *> getIR();
+    void printStats();
+};
+
+#endif
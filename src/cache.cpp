@@ -0,0 +1,238 @@
+/* File: cache.cpp
+ * Authors: agent
+ * Description: On disk compilation cache, one file per entry named after
+ *              its key
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include "cache.h"
+#include "hash.h"
+
+// Bumped whenever the entries change meaning
+#define CACHE_VERSION 2
+
+static bool readFile(std::string path, std::string &contents) {
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in.is_open())
+        return false;
+
+    std::ostringstream buf;
+    buf << in.rdbuf();
+    contents = buf.str();
+    return !in.bad();
+}
+
+// Fields are length prefixed, so no two inputs run together the same way
+static void addField(std::string &input, std::string field) {
+    input += std::to_string(field.size()) + ":" + field;
+}
+
+static bool isEntry(std::string name) {
+    std::string suffix = ".entry";
+    return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+CompileCache::CompileCache(std::string dir):
+    dir(dir)
+{
+    hit = false;
+    hits = 0;
+    misses = 0;
+
+    // an existing directory is fine, anything else shows up when an entry
+    // cannot be written
+    if (!dir.empty())
+        mkdir(dir.c_str(), 0777);
+}
+
+std::string CompileCache::entryPath(unsigned long key) {
+    return dir + "/" + string_of_hash(key) + ".entry";
+}
+
+unsigned long CompileCache::key(const std::string &source, std::string fileName, std::string flags) {
+    input = "coolcompiler-cache " + std::to_string(CACHE_VERSION) + "\n";
+
+    // a rebuilt compiler may produce different code for the same input,
+    // its size and modification time stand in for its version
+    struct stat exe;
+    if (stat("/proc/self/exe", &exe) == 0)
+        addField(input, std::to_string(exe.st_size) + " " + std::to_string(exe.st_mtime));
+
+    // the file name ends up in the output as the .file directive
+    addField(input, fileName);
+    addField(input, flags);
+    addField(input, source);
+    return hashString(FNV_OFFSET, input);
+}
+
+void CompileCache::readStats() {
+    std::ifstream in(dir + "/stats");
+
+    if (!(in >> hits >> misses)) {
+        hits = 0;
+        misses = 0;
+    }
+}
+
+// Compilations sharing the directory update the totals one at a time,
+// under a lock on a file of its own since the stats file is replaced
+void CompileCache::writeStats() {
+    int lock = open((dir + "/stats.lock").c_str(), O_RDWR | O_CREAT, 0666);
+
+    if (lock >= 0)
+        flock(lock, LOCK_EX);
+
+    readStats();
+    if (hit)
+        hits++;
+    else
+        misses++;
+
+    writeAtomic(dir + "/stats", std::to_string(hits) + " " + std::to_string(misses) + "\n");
+
+    if (lock >= 0)
+        close(lock);
+}
+
+// Every writer gets a temporary file of its own, the last rename wins
+bool CompileCache::writeAtomic(std::string path, const std::string &contents) {
+    std::vector<char> tmp(path.begin(), path.end());
+    const char *suffix = ".XXXXXX";
+    tmp.insert(tmp.end(), suffix, suffix + 7);
+    tmp.push_back('\0');
+
+    int fd = mkstemp(tmp.data());
+    if (fd < 0)
+        return false;
+
+    // mkstemp leaves the file readable by its owner only
+    mode_t mask = umask(0);
+    umask(mask);
+    bool ok = fchmod(fd, 0666 & ~mask) == 0;
+
+    for (size_t done = 0; ok && done < contents.size(); ) {
+        ssize_t n = write(fd, contents.data() + done, contents.size() - done);
+        ok = n > 0;
+        done += ok ? n : 0;
+    }
+
+    if (close(fd) != 0 || !ok || std::rename(tmp.data(), path.c_str()) != 0) {
+        std::remove(tmp.data());
+        return false;
+    }
+    return true;
+}
+
+// An entry is the size of the input it was compiled from, the input and
+// the output. Two inputs can share a 64 bit key, only an entry of this
+// very input is a hit.
+bool CompileCache::lookup(unsigned long key, std::string outFile) {
+    std::string contents;
+    std::string header = std::to_string(input.size()) + "\n";
+
+    hit = readFile(entryPath(key), contents) && contents.compare(0, header.size(), header) == 0 &&
+        contents.compare(header.size(), input.size(), input) == 0 &&
+        writeAtomic(outFile, contents.substr(header.size() + input.size()));
+    if (hit) {
+        // the modification time orders entries for eviction
+        utime(entryPath(key).c_str(), nullptr);
+        writeStats();
+    }
+
+    return hit;
+}
+
+void CompileCache::store(unsigned long key, std::string outFile) {
+    std::string contents;
+
+    writeStats();
+    if (!readFile(outFile, contents))
+        return;
+
+    if (!writeAtomic(entryPath(key), std::to_string(input.size()) + "\n" + input + contents)) {
+        std::cerr << "Could not write cache entry in '" << dir << "'" << std::endl;
+        return;
+    }
+
+    evict();
+}
+
+void CompileCache::evict() {
+    struct Entry {
+        std::string path;
+        long size;
+        time_t used;
+    };
+    std::vector<Entry> entries;
+    long total = 0;
+
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr)
+        return;
+
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr) {
+        struct stat st;
+        std::string path = dir + "/" + e->d_name;
+
+        if (isEntry(e->d_name) && stat(path.c_str(), &st) == 0) {
+            entries.push_back(Entry{path, (long)st.st_size, st.st_mtime});
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+
+    // least recently used first
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.used < b.used;
+    });
+
+    for (auto &entry : entries) {
+        if (total <= CACHE_MAX_BYTES)
+            break;
+        if (std::remove(entry.path.c_str()) == 0)
+            total -= entry.size;
+    }
+}
+
+void CompileCache::printStats() {
+    long count = 0;
+    long bytes = 0;
+
+    readStats();
+
+    DIR *d = opendir(dir.c_str());
+    if (d != nullptr) {
+        struct dirent *e;
+        while ((e = readdir(d)) != nullptr) {
+            struct stat st;
+            std::string path = dir + "/" + e->d_name;
+
+            if (isEntry(e->d_name) && stat(path.c_str(), &st) == 0) {
+                count++;
+                bytes += st.st_size;
+            }
+        }
+        closedir(d);
+    }
+
+    std::cout << "================\nCache Statistics\n================\n\n";
+    std::cout << std::left << std::setw(28) << "this compilation" << (hit ? "hit" : "miss") << std::endl;
+    std::cout << std::left << std::setw(28) << "hits" << hits << std::endl;
+    std::cout << std::left << std::setw(28) << "misses" << misses << std::endl;
+    std::cout << std::left << std::setw(28) << "entries" << count << std::endl;
+    std::cout << std::left << std::setw(28) << "bytes" << bytes << std::endl;
+}
@@ -3,50 +3,95 @@
  *  Description: Structure and helper functions for the transition from IR to x86
  */
 
+#include <cstdint>
 #include "codegen.h"
 
+const std::vector<std::string> argRegs = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+const std::vector<std::string> floatArgRegs = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
+
 // Constructor for CPU
+// rax, rcx and rdx are scratch registers for the code generator and
+// rdi, rsi, r8 and r9 carry call arguments, so none of them are handed out.
+// Floats get xmm8-xmm15, xmm0-xmm7 carry arguments and xmm0 and xmm1 are
+// the scratch registers
 CPU::CPU() {
 
-    //init free register stack
-    freeRegStack.push_back("rax");
-    freeRegStack.push_back("rbx");
-    freeRegStack.push_back("rcx");
-    freeRegStack.push_back("rdx");
-    freeRegStack.push_back("r8 ");
-    freeRegStack.push_back("r9");
-    freeRegStack.push_back("r10");
-    freeRegStack.push_back("r11");
-    freeRegStack.push_back("r12");
-    freeRegStack.push_back("r13");
-    freeRegStack.push_back("r14");
-    freeRegStack.push_back("r15");
+    //init free register stacks, allocation pops from the back
+    freeCalleeSaved.push_back("rbx");
+    freeCalleeSaved.push_back("r15");
+    freeCalleeSaved.push_back("r14");
+    freeCalleeSaved.push_back("r13");
+    freeCalleeSaved.push_back("r12");
+
+    freeCallerSaved.push_back("r11");
+    freeCallerSaved.push_back("r10");
+
+    for (int k = 15; k >= 8; k--)
+        freeFloat.push_back("xmm" + std::to_string(k));
 
     //init register free status
-    usage["rax"] = true;
     usage["rbx"] = true;
-    usage["rcx"] = true;
-    usage["rdx"] = true;
-    usage["r8"] = true;
-    usage["r9"] = true;
     usage["r10"] = true;
     usage["r11"] = true;
     usage["r12"] = true;
     usage["r13"] = true;
     usage["r14"] = true;
     usage["r15"] = true;
+
+    profile = nullptr;
 }
 
+void CPU::setProfile(Profile *profile) {
+    this->profile = profile;
+}
+
+// A virtual register lives from its first definition to its last use. One
+// that holds a value into a loop and is used in it stays alive until the
+// loop's backward jump, the next iteration reads it again.
 void CPU::BuildRange(std::vector<BasicBlock> &bblist) {
     int line = 1;
+    std::map<std::string, int> labels;
+    std::vector<std::pair<int, int>> loops;
+    // how often the current block ran, the code after a label the profile
+    // does not know runs as often as the code before it
+    long count = -1;
+    // the block a branch falls through to starts after it
+    long fallCount = -1;
+
+    regRange.clear();
+    callLines.clear();
+    callCounts.clear();
+    entryCounts.clear();
     for(auto &block : bblist) {
-        block.iter([&line, this](Instruction *inst) {
+        block.iter([&line, &labels, &loops, &count, &fallCount, this](Instruction *inst) {
+            if (fallCount >= 0)
+                count = fallCount;
+            fallCount = -1;
+
             switch (inst->getOp()) {
+            case DEF: {
+                std::string name = ((DefInstr *)inst)->getName();
+                count = this->profile ? this->profile->count(Profile::entryKey(name)) : -1;
+                this->entryCounts[name] = count;
+                break;
+            }
+            case LABEL:
+                labels[((LableInstr *)inst)->getLabelName()] = line;
+                if (this->profile && this->profile->count(Profile::labelKey(((LableInstr *)inst)->getLabelName())) >= 0)
+                    count = this->profile->count(Profile::labelKey(((LableInstr *)inst)->getLabelName()));
+                break;
+            case JUMP: {
+                auto it = labels.find(((JumpInstr *)inst)->getLabelName());
+                if (it != labels.end())
+                    loops.push_back(std::make_pair(it->second, line));
+                break;
+            }
             case CONST_LET: {
                 Container cont = ((LetInstr *)inst)->getContainer();
                 if (cont.isRegister()) {
                     std::string reg = "%r" + std::to_string(cont.getIntValue());
-                    this->regRange[reg].first = line;
+                    if (this->regRange[reg].first == 0)
+                        this->regRange[reg].first = line;
                 }
 
                 Container op1 = ((LetInstr *)inst)->getOp1();
@@ -61,7 +106,8 @@ void CPU::BuildRange(std::vector<BasicBlock> &bblist) {
                 Container cont = ((LetInstr *)inst)->getContainer();
                 if (cont.isRegister()) {
                     std::string reg = "%r" + std::to_string(cont.getIntValue());
-                    this->regRange[reg].first = line;
+                    if (this->regRange[reg].first == 0)
+                        this->regRange[reg].first = line;
                 }
 
                 Container op1 = ((LetInstr *)inst)->getOp1();
@@ -76,7 +122,8 @@ void CPU::BuildRange(std::vector<BasicBlock> &bblist) {
                 Container cont = ((LetInstr *)inst)->getContainer();
                 if (cont.isRegister()) {
                     std::string reg = "%r" + std::to_string(cont.getIntValue());
-                    this->regRange[reg].first = line;
+                    if (this->regRange[reg].first == 0)
+                        this->regRange[reg].first = line;
                 }
 
                 Container op1 = ((LetInstr *)inst)->getOp1();
@@ -96,7 +143,23 @@ void CPU::BuildRange(std::vector<BasicBlock> &bblist) {
                 break;
             }
             case BRANCH: {
-                Container cont = ((BranchInstr *)inst)->getContainer();
+                BranchInstr *br = (BranchInstr *)inst;
+                Container cont = br->getContainer();
+                if (cont.isRegister()) {
+                    std::string reg = "%r" + std::to_string(cont.getIntValue());
+                    this->regRange[reg].second = line;
+                }
+
+                auto it = labels.find(br->getLabelTwo() ? *br->getLabelTwo() : br->getLabelOne());
+                if (it != labels.end())
+                    loops.push_back(std::make_pair(it->second, line));
+
+                if (this->profile)
+                    fallCount = this->profile->count(Profile::fallKey(br));
+                break;
+            }
+            case JUMP_TABLE: {
+                Container cont = ((SwitchInstr *)inst)->getContainer();
                 if (cont.isRegister()) {
                     std::string reg = "%r" + std::to_string(cont.getIntValue());
                     this->regRange[reg].second = line;
@@ -111,6 +174,25 @@ void CPU::BuildRange(std::vector<BasicBlock> &bblist) {
                 }
                 break;
             }
+            case CALL: {
+                for (auto arg : *((CallInstr *)inst)->getArgs()) {
+                    if (arg.isRegister()) {
+                        std::string op = "%r" + std::to_string(arg.getIntValue());
+                        this->regRange[op].second = line;
+                    }
+                }
+
+                Container cont = ((CallInstr *)inst)->getContainer();
+                if (((CallInstr *)inst)->getFlag() && cont.isRegister()) {
+                    std::string reg = "%r" + std::to_string(cont.getIntValue());
+                    if (this->regRange[reg].first == 0)
+                        this->regRange[reg].first = line;
+                }
+
+                this->callLines.push_back(line);
+                this->callCounts.push_back(count);
+                break;
+            }
             default:
                 break;
             }
@@ -118,48 +200,138 @@ void CPU::BuildRange(std::vector<BasicBlock> &bblist) {
             line++;
         });
     }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &r : regRange) {
+            for (auto &loop : loops) {
+                if (r.second.first < loop.first && r.second.second >= loop.first &&
+                        r.second.second < loop.second) {
+                    r.second.second = loop.second;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+// Does the virtual register hold a value across a call instruction?
+bool CPU::crossesCall(std::string vr) {
+    std::pair<int, int> range = regRange[vr];
+
+    for (int call : callLines) {
+        if (call > range.first && call < range.second)
+            return true;
+    }
+
+    return false;
+}
+
+// Saving a value around the calls it lives across costs a push and a pop
+// every time one of them runs, a callee saved register costs them once
+// per entry of the function unless it already saves the register. Values
+// that only live across calls which together run less often than the
+// function is entered are cheaper in a caller saved register.
+bool CPU::crossesColdCalls(std::string vr) {
+    std::pair<int, int> range = regRange[vr];
+    long entries = entryCounts.count(curFunc) ? entryCounts[curFunc] : -1;
+    long runs = 0;
+
+    if (profile == nullptr || entries < 0 || freeCalleeSaved.empty())
+        return false;
+
+    std::vector<std::string> &used = calleeSavedUse[curFunc];
+    if (std::find(used.begin(), used.end(), freeCalleeSaved.back()) != used.end())
+        return false;
+
+    for (unsigned int k = 0; k < callLines.size(); k++) {
+        if (callLines[k] > range.first && callLines[k] < range.second) {
+            if (callCounts[k] < 0)
+                return false;
+            runs += callCounts[k];
+        }
+    }
+
+    return runs < entries;
+}
+
+bool CPU::isCallerSaved(std::string reg) {
+    return reg == "r10" || reg == "r11" || reg.compare(0, 3, "xmm") == 0;
+}
+
+std::vector<std::string> CPU::getCalleeSaved(std::string funName) {
+    return calleeSavedUse[funName];
 }
 
 std::vector<BasicBlock> CPU::assignRegs(std::vector<BasicBlock> &bblist) {
     std::vector<BasicBlock> blocks;
     std::list<Instruction *> ir;
-    int line = 0;
+    // numbered the same way as BuildRange
+    int line = 1;
 
-    for(auto &block : bblist) {
-        block.iter([&line, &ir, this](Instruction *inst) {
-            switch (inst->getOp()) {
-            case CONST_LET: {
-                Container cont = ((LetInstr *)inst)->getContainer();
-                std::string vReg;
-                std::string pReg;
-                
-                Container op1 = ((LetInstr *)inst)->getOp1();
-                std::string opVr;
-                std::string opPr;
+    // A spilled virtual register becomes the variable of its slot, the
+    // frame gives it one like any other variable
+    auto physical = [this](Container c, std::string vr, std::string pr) -> Container {
+        if (this->vrToSpill.count(vr)) {
+            if (c.isVector())
+                throw CodeGenError("Ran out of registers for vector '" + vr + "'.");
+            return Container(STR, new std::string(pr), c.sym);
+        }
 
-                if (op1.isRegister()) {
-                    opVr = "%r" + std::to_string(op1.getIntValue());
-                    opPr = this->Ensure(opVr);
+        ContainerValue val;
+        val.physReg = new std::string(pr);
 
-                    if (this->regRange[opVr].second >= line) {
-                        this->Free(opPr);
-                    }
+        Container p = Container(PREG, val);
+        p.sym = c.sym;
+        return p;
+    };
 
-                    ContainerValue val;
-                    val.physReg = new std::string(opPr);
+    // Replace a used virtual register with its physical one, releasing the
+    // physical register once the virtual one reaches the end of its range
+    auto use = [&line, &physical, this](Container c) -> Container {
+        if (!c.isRegister())
+            return c;
 
-                    op1 = Container(PREG, val);
-                }
+        std::string vr = "%r" + std::to_string(c.getIntValue());
+        std::string pr = this->Ensure(vr, c.isFloat() || c.isVector());
 
-                if (cont.isRegister()) {
-                    vReg = "%r" + std::to_string(cont.getIntValue());
-                    pReg = this->Allocate(vReg);
+        if (this->regRange[vr].second <= line && !this->vrToSpill.count(vr)) {
+            this->Free(pr);
+        }
 
-                    ContainerValue val;
-                    val.physReg = new std::string(pReg);
+        return physical(c, vr, pr);
+    };
 
-                    cont = Container(PREG, val);
-                }
+    // Give a defined virtual register a physical one, values that are never
+    // read are released right away. A register defined again keeps the
+    // one it has. Vectors live in the float registers.
+    auto def = [&line, &physical, this](Container c) -> Container {
+        if (!c.isRegister())
+            return c;
+
+        std::string vr = "%r" + std::to_string(c.getIntValue());
+        std::string pr = this->Ensure(vr, c.isFloat() || c.isVector());
+
+        if (this->regRange[vr].second < line && !this->vrToSpill.count(vr)) {
+            this->Free(pr);
+        }
+
+        return physical(c, vr, pr);
+    };
+
+    for(auto &block : bblist) {
+        block.iter([&line, &ir, &use, &def, this](Instruction *inst) {
+            switch (inst->getOp()) {
+            case DEF: {
+                this->curFunc = ((DefInstr *)inst)->getName();
+                this->vrToSpill.clear();
+                ir.push_back(inst);
+                break;
+            }
+            case CONST_LET: {
+                Container op1 = use(((LetInstr *)inst)->getOp1());
+                Container cont = def(((LetInstr *)inst)->getContainer());
 
                 LetInstr *i = new LetInstr(cont, CONST_LET, NULL);
                 i->setExpression(op1);
@@ -167,37 +339,8 @@ std::vector<BasicBlock> CPU::assignRegs(std::vector<BasicBlock> &bblist) {
                 break;
             }
             case UNARY_LET: {
-                Container cont = ((LetInstr *)inst)->getContainer();
-                std::string vReg;
-                std::string pReg;
-                
-                Container op1 = ((LetInstr *)inst)->getOp1();
-                std::string opVr;
-                std::string opPr;
-
-                if (op1.isRegister()) {
-                    opVr = "%r" + std::to_string(op1.getIntValue());
-                    opPr = this->Ensure(opVr);
-
-                    if (this->regRange[opVr].second >= line) {
-                        this->Free(opPr);
-                    }
-
-                    ContainerValue val;
-                    val.physReg = new std::string(opPr);
-
-                    op1 = Container(PREG, val);
-                }
-
-                if (cont.isRegister()) {
-                    vReg = "%r" + std::to_string(cont.getIntValue());
-                    pReg = this->Allocate(vReg);
-
-                    ContainerValue val;
-                    val.physReg = new std::string(pReg);
-
-                    cont = Container(PREG, val);
-                }
+                Container op1 = use(((LetInstr *)inst)->getOp1());
+                Container cont = def(((LetInstr *)inst)->getContainer());
 
                 LetInstr *i = new LetInstr(cont, UNARY_LET, NULL);
                 i->setExpression(op1, ((LetInstr *)inst)->getOperation());
@@ -206,58 +349,11 @@ std::vector<BasicBlock> CPU::assignRegs(std::vector<BasicBlock> &bblist) {
                 break;
             }
             case BINARY_LET: {
-                Container cont = ((LetInstr *)inst)->getContainer();
-                std::string vReg;
-                std::string pReg;
-                
-                Container op1 = ((LetInstr *)inst)->getOp1();
-                std::string opVr;
-                std::string opPr;
-
-                if (op1.isRegister()) {
-                    opVr = "%r" + std::to_string(op1.getIntValue());
-                    opPr = this->Ensure(opVr);
-
-                    ContainerValue val;
-                    val.physReg = new std::string(opPr);
-
-                    op1 = Container(PREG, val);
-                }
-
-                Container op2 = ((LetInstr *)inst)->getOp2();
-                std::string op2Vr;
-                std::string op2Pr;
-
-                if (op2.isRegister()) {
-                    op2Vr = "%r" + std::to_string(op2.getIntValue());
-                    op2Pr = this->Ensure(op2Vr);
-
-                    ContainerValue val;
-                    val.physReg = new std::string(op2Pr);
-
-                    op2 = Container(PREG, val);
-                }
-
-                if (op1.isPhysRegister()) {
-                    if (this->regRange[opVr].second >= line) {
-                        this->Free(opPr);
-                    }
-                }
-                if (op2.isPhysRegister()) {
-                    if (this->regRange[op2Vr].second >= line) {
-                        this->Free(op2Pr);
-                    }
-                }
-
-                if (cont.isRegister()) {
-                    vReg = "%r" + std::to_string(cont.getIntValue());
-                    pReg = this->Allocate(vReg);
-
-                    ContainerValue val;
-                    val.physReg = new std::string(pReg);
-
-                    cont = Container(PREG, val);
-                }
+                // operands are read into scratch registers before the result
+                // is written, so the result may reuse an operand's register
+                Container op1 = use(((LetInstr *)inst)->getOp1());
+                Container op2 = use(((LetInstr *)inst)->getOp2());
+                Container cont = def(((LetInstr *)inst)->getContainer());
 
                 LetInstr *i = new LetInstr(cont, BINARY_LET, NULL);
                 i->setExpression(op1, op2, ((LetInstr *)inst)->getOperation());
@@ -266,48 +362,30 @@ std::vector<BasicBlock> CPU::assignRegs(std::vector<BasicBlock> &bblist) {
                 break;
             }
             case BRANCH: {
-                Container cont = ((BranchInstr *)inst)->getContainer();
-                std::string vReg;
-                std::string pReg;
-
-                if (cont.isRegister()) {
-                    vReg = "%r" + std::to_string(cont.getIntValue());
-                    pReg = this->Ensure(vReg);
-
-                    if (this->regRange[vReg].second >= line) {
-                        this->Free(pReg);
-                    }
-
-                    ContainerValue val;
-                    val.physReg = new std::string(pReg);
+                Container cont = use(((BranchInstr *)inst)->getContainer());
 
-                    cont = Container(PREG, val);
-                }
                 std::string one = ((BranchInstr *)inst)->getLabelOne();
                 std::string *two = ((BranchInstr *)inst)->getLabelTwo();
                 BranchInstr *i = new BranchInstr(cont, one, two, NULL);
-                // BranchInstr *i = new BranchInstr(cont, ((BranchInstr *)inst)->getLabelOne(), ((BranchInstr *)inst)->getLabelTwo(), NULL);
                 ir.push_back(i);
+                this->expire(line);
                 break;
             }
-            case RET: {
-                Container cont = ((ReturnInstr *)inst)->getContainer();
-                std::string vReg;
-                std::string pReg;
-
-                if (cont.isRegister()) {
-                    vReg = "%r" + std::to_string(cont.getIntValue());
-                    pReg = this->Ensure(vReg);
-
-                    if (this->regRange[vReg].second >= line) {
-                        this->Free(pReg);
-                    }
+            case JUMP: {
+                ir.push_back(inst);
+                this->expire(line);
+                break;
+            }
+            case JUMP_TABLE: {
+                SwitchInstr *si = (SwitchInstr *)inst;
+                Container cont = use(si->getContainer());
 
-                    ContainerValue val;
-                    val.physReg = new std::string(pReg);
+                ir.push_back(new SwitchInstr(cont, si->getLow(), si->getTargets(), si->getDefault(), NULL));
+                break;
+            }
+            case RET: {
+                Container cont = use(((ReturnInstr *)inst)->getContainer());
 
-                    cont = Container(PREG, val);
-                }
                 ReturnInstr *i = new ReturnInstr(cont, NULL);
                 ir.push_back(i);
                 break;
@@ -316,53 +394,27 @@ std::vector<BasicBlock> CPU::assignRegs(std::vector<BasicBlock> &bblist) {
             case CALL: {
                 std::list<Container> *args = ((CallInstr *)inst)->getArgs();
                 std::list<Container> *params = new std::list<Container>();
-                std::list<std::string> vRegs;
 
                 for(auto arg : *args) {
-                    std::string vReg;
-                    std::string pReg;
-
-                    if (arg.isRegister()) {
-                        vReg = "%r" + std::to_string(arg.getIntValue());
-
-                        pReg = this->Ensure(vReg);
-
-                        ContainerValue val;
-                        val.physReg = new std::string(pReg);
-
-                        arg = Container(PREG, val);
-                    }
-
-                    params->push_back(arg);
+                    params->push_back(use(arg));
                 }
 
-                for(auto vReg : vRegs) {
-                    if (this->regRange[vReg].second >= line) {
-                        this->Free(vrToPr[vReg]);
+                // Caller saved registers still holding values after the call
+                // have to be preserved around it by the caller
+                std::list<std::string> *savedRegs = new std::list<std::string>();
+                for (auto p : this->vrToPr) {
+                    if (this->isCallerSaved(p.second)) {
+                        savedRegs->push_back(p.second);
                     }
                 }
 
-                Container cont = ((CallInstr *)inst)->getContainer();
-                if (cont.isRegister()) {
-                    std::string vReg;
-                    std::string pReg;
-                    vReg = "%r" + std::to_string(cont.getIntValue());
-
-                    pReg = this->Ensure(vReg);
-
-                    ContainerValue val;
-                    val.physReg = new std::string(pReg);
-
-                    cont = Container(PREG, val);
+                CallInstr *call = new CallInstr(((CallInstr *)inst)->getName(), params, NULL);
+                call->setSavedRegs(savedRegs);
 
-                    if (this->regRange[vReg].second >= line) {
-                        this->Free(pReg);
-                    }
+                if (((CallInstr *)inst)->getFlag()) {
+                    call->setExpression(def(((CallInstr *)inst)->getContainer()));
                 }
 
-                CallInstr *call = new CallInstr(((CallInstr *)inst)->getName(), params, NULL);
-                call->setExpression(cont);
-
                 ir.push_back(call);
                 break;
             }
@@ -376,11 +428,24 @@ std::vector<BasicBlock> CPU::assignRegs(std::vector<BasicBlock> &bblist) {
     }
 
     blocks = bblist_of_instruction_list(ir);
-    removeEmptyBlocks(bblist);
+    removeEmptyBlocks(blocks);
 
     return blocks;
 }
 
+// Release the registers of values carried around a loop that ends here,
+// they have no use at the backward jump that would release them
+void CPU::expire(int line) {
+    std::vector<std::string> done;
+
+    for (auto &p : vrToPr) {
+        if (regRange[p.first].second <= line)
+            done.push_back(p.second);
+    }
+    for (auto &reg : done)
+        Free(reg);
+}
+
 void CPU::printRange() {
     for (std::map<std::string, std::pair<int, int>>::iterator p = regRange.begin(); p != regRange.end(); ++p) {
             
@@ -388,30 +453,56 @@ void CPU::printRange() {
     }
 }
 
-std::string CPU::Ensure(std::string vr) {
+std::string CPU::Ensure(std::string vr, bool isFloat) {
     auto iter = vrToPr.find(vr);
 
     //if vr is already mapped
     if (iter != vrToPr.end()) {
         return vrToPr[vr];
     }
+    if (vrToSpill.count(vr))
+        return vrToSpill[vr];
 
-    std::string result = Allocate(vr);
-    vrToPr[vr] = result;
-    //emit code to move vr to result?
-
-    return result;
+    return Allocate(vr, isFloat);
 }
 
-std::string CPU::Allocate(std::string vr) {
+// Values live across a call prefer callee saved registers so the call
+// does not have to save them, unless the profile shows the calls are
+// rare, everything else prefers caller saved ones so the prologue does not
+// have to. Floats only have caller saved ones. Once both are used up the
+// value is spilled, it lives in a stack slot for its whole range.
+std::string CPU::Allocate(std::string vr, bool isFloat) {
+    std::vector<std::string> *first = &freeCallerSaved;
+    std::vector<std::string> *second = &freeCalleeSaved;
     std::string reg;
-    if (freeRegStack.size() > 0) {
-        reg = freeRegStack.back();
-        freeRegStack.pop_back();
+
+    if (isFloat) {
+        first = &freeFloat;
+        second = &freeFloat;
+    } else if (crossesCall(vr) && !crossesColdCalls(vr)) {
+        first = &freeCalleeSaved;
+        second = &freeCallerSaved;
+    }
+
+    if (first->size() > 0) {
+        reg = first->back();
+        first->pop_back();
+    } else if (second->size() > 0) {
+        reg = second->back();
+        second->pop_back();
     } else {
-        //revoke a register
-        //store revoked reg contents
+        //the slot's variable cannot clash with one of the program
+        vrToSpill[vr] = ".spill" + vr.substr(2);
+        return vrToSpill[vr];
+    }
+
+    //the function's prologue has to save callee saved registers it writes
+    if (!isCallerSaved(reg)) {
+        std::vector<std::string> &used = calleeSavedUse[curFunc];
+        if (std::find(used.begin(), used.end(), reg) == used.end())
+            used.push_back(reg);
     }
+
     //map vr to physical reg
     vrToPr[vr] = reg;
     //mark as unavailable
@@ -431,8 +522,14 @@ void CPU::Free(std::string reg) {
     }
 
     vrToPr.erase(vr);
-    usage.erase(vr);
-    freeRegStack.push_back(reg);
+    usage[reg] = true;
+
+    if (reg.compare(0, 3, "xmm") == 0)
+        freeFloat.push_back(reg);
+    else if (isCallerSaved(reg))
+        freeCallerSaved.push_back(reg);
+    else
+        freeCalleeSaved.push_back(reg);
 }
 
 // Program
@@ -440,29 +537,32 @@ void CPU::Free(std::string reg) {
 
 // helpers, not methods of Program
 
-// convert a container into asm representation
-std::string Program::toAssembly(Container c) {
+static MOperand reg(std::string name) {
+    return MOperand::Reg(name);
+}
+
+// convert a container into an operand
+MOperand Program::toAssembly(Container c) {
     switch (c.type) {
     case STR: //variable
     {
-        // not sure what to do here
-        // should move stack offset into register
         if (findGlobal(c.getStringValue()))
-            return c.getStringValue() + "(%rip)";
-        int off = allocVar(c.getStringValue());
-        return "-" + std::to_string(off) + "(%rbp)";
+            return MOperand::Rip(c.getStringValue());
+        return slot(c.getStringValue());
     }
     case IMM:
-        return "$" + std::to_string(c.getIntImmediate());
+        if (c.isFloat())
+            return floatConstant(c.getFloatImmediate());
+        return MOperand::Imm(c.getIntImmediate());
     case REG:
-        return "%r" + std::to_string(c.getIntValue());
+        return reg("r" + std::to_string(c.getIntValue()));
     case PREG:
-        return "%" + c.getReg();
+        return reg(c.getReg());
     case NIL:
-        return "";
+        return MOperand();
     }
 
-    return "";
+    return MOperand();
 }
 
 // create an arbitrary branch label
@@ -473,175 +573,1018 @@ std::string createJumpLabel() {
     return ".JL" + std::to_string(i);
 }
 
-std::string tab() {
-    return "    ";
+// create a jump table label
+std::string createTableLabel() {
+    static int i = 0;
+    i++;
+
+    return ".JT" + std::to_string(i);
+}
+
+void Program::emit(MOp op) {
+    module.text.push_back(MInstr(op));
+}
+
+void Program::emit(MOp op, MOperand a) {
+    module.text.push_back(MInstr(op, a));
 }
 
-// Convert a let expression into assembly
+void Program::emit(MOp op, MOperand a, MOperand b) {
+    module.text.push_back(MInstr(op, a, b));
+}
+
+void Program::emit(MOp op, MOperand a, MOperand b, MOperand c) {
+    module.text.push_back(MInstr(op, a, b, c));
+}
+
+// Select the instructions for a let expression
 // description of how the macros work in codegen.h
-std::string Program::toAssembly(LetInstr *li) {
+// %rax and %rcx are the scratch registers, %rbx is callee saved and must not
+// be touched without being saved
+void Program::toAssembly(LetInstr *li) {
 
 #define BINOP(operation) \
     do { \
-        std::string builder; \
-        builder = tab() + "movq " + toAssembly(li->getOp1()) + ", %rax\n"; \
-        builder = tab() + "movq " + toAssembly(li->getOp2()) + ", %rbx\n"; \
-        builder += tab() + operation + " %rax, %rbx\n"; \
-        builder += tab() + "movq %rbx, " + toAssembly(li->getContainer()) + "\n"; \
-        return builder; \
+        load(li->getOp1(), reg("rax")); \
+        load(li->getOp2(), reg("rcx")); \
+        emit(operation, reg("rcx"), reg("rax")); \
+        store(reg("rax"), li->getContainer()); \
+        return; \
     }while (false); \
 
 #define UNOP(operation) \
     do { \
-        std::string builder; \
-        builder = tab() + "movq " + toAssembly(li->getOp1()) + ", %rax\n"; \
-        builder += tab() + operation + " %rax\n"; \
-        builder += tab() + "movq %rax, " + toAssembly(li->getContainer()) + "\n"; \
-        return builder; \
+        load(li->getOp1(), reg("rax")); \
+        emit(operation, reg("rax")); \
+        store(reg("rax"), li->getContainer()); \
+        return; \
     }while (false); \
 
-#define LOGIC_OP(jumpType) \
+#define LOGIC_OP(jumpType, jumpVal, fallVal) \
     do { \
-        std::string builder; \
-        std::string dest = toAssembly(li->getContainer()); \
-        std::string op1 = toAssembly(li->getOp1()); \
-        std::string op2 = toAssembly(li->getOp2()); \
-        std::string lbl1 = createJumpLabel(); \
-        std::string lbl2 = createJumpLabel(); \
-        builder = tab() + "cmp  $0, " + op1 + "\n"; \
-        builder += tab() + jumpType + " " + lbl1 + "\n"; \
-        builder += tab() + "cmp $0, " + op2 + "\n"; \
-        builder += tab() + jumpType + " " + lbl1 + "\n"; \
-        builder += tab() + "movq $1, " + dest + "\n"; \
-        builder += tab() + "jmp " + lbl2 + "\n"; \
-        builder += lbl1 + ":\n"; \
-        builder += tab() + "movq $0, " + dest + "\n"; \
-        builder += lbl2 + ":\n"; \
-        return builder; \
+        MOperand lbl1 = MOperand::Sym(createJumpLabel()); \
+        MOperand lbl2 = MOperand::Sym(createJumpLabel()); \
+        load(li->getOp1(), reg("rax")); \
+        emit(MOp::CMPQ, MOperand::Imm(0), reg("rax")); \
+        emit(jumpType, lbl1); \
+        load(li->getOp2(), reg("rax")); \
+        emit(MOp::CMPQ, MOperand::Imm(0), reg("rax")); \
+        emit(jumpType, lbl1); \
+        store(MOperand::Imm(fallVal), li->getContainer()); \
+        emit(MOp::JMP, lbl2); \
+        emit(MOp::LABEL, lbl1); \
+        store(MOperand::Imm(jumpVal), li->getContainer()); \
+        emit(MOp::LABEL, lbl2); \
+        return; \
     }while(false); \
 
 #define COMPAR(jumpType) \
     do { \
-        std::string builder; \
-        std::string dest = toAssembly(li->getContainer()); \
-        std::string op1 = toAssembly(li->getOp1()); \
-        std::string op2 = toAssembly(li->getOp2()); \
-        std::string lbl1 = createJumpLabel(); \
-        std::string lbl2 = createJumpLabel(); \
-        builder = tab() + "movq " + op1 + ", " + dest + "\n"; \
-        builder += tab() + "subq " + op2 + ", " + dest + "\n"; \
-        builder += tab() + jumpType + " " + lbl1 + "\n"; \
-        builder += tab() + "movq $0, " + dest + "\n"; \
-        builder += tab() + "jmp " + lbl2 + "\n"; \
-        builder += lbl1 + ":\n"; \
-        builder += tab() + "movq $1, " + dest + "\n"; \
-        builder += lbl2 + ":\n"; \
-        return builder; \
+        MOperand lbl1 = MOperand::Sym(createJumpLabel()); \
+        MOperand lbl2 = MOperand::Sym(createJumpLabel()); \
+        load(li->getOp1(), reg("rax")); \
+        emit(MOp::CMPQ, value(li->getOp2(), "rcx"), reg("rax")); \
+        emit(jumpType, lbl1); \
+        store(MOperand::Imm(0), li->getContainer()); \
+        emit(MOp::JMP, lbl2); \
+        emit(MOp::LABEL, lbl1); \
+        store(MOperand::Imm(1), li->getContainer()); \
+        emit(MOp::LABEL, lbl2); \
+        return; \
     }while (false); \
 
-    switch (li->getOperation()) {
-    case IrOp::ADD: BINOP("addq");
-    case IrOp::SUB:
-        if (toAssembly(li->getContainer()) != std::string("")) {
-            BINOP("subq");
+#define FCOMPAR(a, b, jumpType) \
+    do { \
+        MOperand lbl1 = MOperand::Sym(createJumpLabel()); \
+        MOperand lbl2 = MOperand::Sym(createJumpLabel()); \
+        moveFloat(toAssembly(a), reg("xmm0")); \
+        emit(MOp::UCOMISS, toAssembly(b), reg("xmm0")); \
+        emit(jumpType, lbl1); \
+        store(MOperand::Imm(0), li->getContainer()); \
+        emit(MOp::JMP, lbl2); \
+        emit(MOp::LABEL, lbl1); \
+        store(MOperand::Imm(1), li->getContainer()); \
+        emit(MOp::LABEL, lbl2); \
+        return; \
+    }while (false); \
+
+// ucomiss sets ZF and PF for unordered operands, they are equal only when
+// PF is clear
+#define FEQUAL(jumpVal, fallVal) \
+    do { \
+        MOperand lbl1 = MOperand::Sym(createJumpLabel()); \
+        MOperand lbl2 = MOperand::Sym(createJumpLabel()); \
+        moveFloat(toAssembly(li->getOp1()), reg("xmm0")); \
+        emit(MOp::UCOMISS, toAssembly(li->getOp2()), reg("xmm0")); \
+        emit(MOp::JNE, lbl1); \
+        emit(MOp::JP, lbl1); \
+        store(MOperand::Imm(fallVal), li->getContainer()); \
+        emit(MOp::JMP, lbl2); \
+        emit(MOp::LABEL, lbl1); \
+        store(MOperand::Imm(jumpVal), li->getContainer()); \
+        emit(MOp::LABEL, lbl2); \
+        return; \
+    }while (false); \
+
+    if (li->getContainer().isVector() || li->getOperation() == IrOp::LANE) {
+        vectorAssembly(li);
+        return;
+    }
+
+    // conversions, an int is 8 bytes wherever it is
+    if (li->getOp() == UNARY_LET && li->getOperation() == IrOp::ITOF) {
+        MOperand src = value(li->getOp1(), "rax");
+        MOperand dest = toAssembly(li->getContainer());
+        MOperand x = dest.isReg() ? dest : reg("xmm0");
+
+        if (src.isImm()) {
+            emit(MOp::MOVQ, src, reg("rax"));
+            src = reg("rax");
         }
-        else {
-            UNOP("negq");
+        emit(MOp::CVTSI2SSQ, src, x);
+        moveFloat(x, dest);
+        return;
+    }
+    if (li->getOp() == UNARY_LET && li->getOperation() == IrOp::FTOI) {
+        MOperand dest = toAssembly(li->getContainer());
+        MOperand r = dest.isReg() ? dest : reg("rax");
+
+        emit(MOp::CVTTSS2SIQ, toAssembly(li->getOp1()), r);
+        if (r != dest)
+            store(r, li->getContainer());
+        return;
+    }
+
+    // float operations work in the destination when it is a register, in
+    // %xmm0 otherwise
+    if (li->getOp1().isFloat() || (li->getOp() == BINARY_LET && li->getOp2().isFloat())) {
+        MOperand dest = toAssembly(li->getContainer());
+        MOperand acc = dest.isReg() ? dest : reg("xmm0");
+        MOp op;
+
+        if (li->getOp() == UNARY_LET) {
+            switch (li->getOperation()) {
+            case IrOp::SUB:
+                // flip the sign bit
+                if (acc == reg("xmm0"))
+                    acc = reg("xmm1");
+                moveFloat(toAssembly(li->getOp1()), acc);
+                emit(MOp::MOVSS, floatConstant(-0.0f), reg("xmm0"));
+                emit(MOp::XORPS, reg("xmm0"), acc);
+                moveFloat(acc, dest);
+                return;
+            case IrOp::ADD:
+                moveFloat(toAssembly(li->getOp1()), dest);
+                return;
+            default:
+                throw CodeGenError("Unhandled float operation '" +
+                    string_of_irop(li->getOperation()) + "'.");
+            }
         }
-    case IrOp::MUL: BINOP("mulq");
+
+        switch (li->getOperation()) {
+        case IrOp::ADD: op = MOp::ADDSS; break;
+        case IrOp::SUB: op = MOp::SUBSS; break;
+        case IrOp::MUL: op = MOp::MULSS; break;
+        case IrOp::DIV: op = MOp::DIVSS; break;
+        // ucomiss sets the flags like an unsigned compare
+        case IrOp::LESS: FCOMPAR(li->getOp2(), li->getOp1(), MOp::JA);
+        case IrOp::GREATER: FCOMPAR(li->getOp1(), li->getOp2(), MOp::JA);
+        case IrOp::LESS_EQ: FCOMPAR(li->getOp2(), li->getOp1(), MOp::JAE);
+        case IrOp::GREATER_EQ: FCOMPAR(li->getOp1(), li->getOp2(), MOp::JAE);
+        case IrOp::EQUAL_EQUAL: FEQUAL(0, 1);
+        case IrOp::NOT_EQ: FEQUAL(1, 0);
+        default:
+            throw CodeGenError("Unhandled float operation '" +
+                string_of_irop(li->getOperation()) + "'.");
+        }
+
+        // the second operand must not be overwritten by the first
+        if (toAssembly(li->getOp2()) == acc)
+            acc = reg("xmm0");
+        moveFloat(toAssembly(li->getOp1()), acc);
+        emit(op, toAssembly(li->getOp2()), acc);
+        moveFloat(acc, dest);
+        return;
+    }
+
+    // unary lets only have the one operand
+    if (li->getOp() == UNARY_LET) {
+        switch (li->getOperation()) {
+        case IrOp::SUB: UNOP(MOp::NEGQ);
+        case IrOp::BFLIP: UNOP(MOp::NOTQ);
+        case IrOp::ADD:
+            load(li->getOp1(), reg("rax"));
+            store(reg("rax"), li->getContainer());
+            return;
+        case IrOp::NOT:
+            break;
+        default:
+            throw CodeGenError("Unhandled unary operation '" +
+                string_of_irop(li->getOperation()) + "'.");
+        }
+    }
+
+    switch (li->getOperation()) {
+    case IrOp::ADD: BINOP(MOp::ADDQ);
+    case IrOp::SUB: BINOP(MOp::SUBQ);
+    case IrOp::MUL: BINOP(MOp::IMULQ);
     case IrOp::DIV:
     {
-        std::string builder;
-        std::string dest = toAssembly(li->getContainer());
-        std::string op1 = toAssembly(li->getOp1());
-        std::string op2 = toAssembly(li->getOp2());
-        builder = tab() + "xorq %rdx, %rdx\n";
-        builder += tab() + "movq " + op1 + ", %rax\n";
-        builder += tab() + "movq " + op2 + ", %rbx\n";
-        builder += tab() + "divq %rbx\n";
-        builder += tab() + "movq %rax, " + dest + "\n";
-        return builder;
-    }
-    case IrOp::LESS: COMPAR("jl");
-    case IrOp::GREATER: COMPAR("jg");
-    case IrOp::LESS_EQ: COMPAR("jle");
-    case IrOp::GREATER_EQ: COMPAR("jge");
-    case IrOp::NOT_EQ: COMPAR("jne")
+        load(li->getOp1(), reg("rax"));
+        load(li->getOp2(), reg("rcx"));
+        emit(MOp::CLTD);
+        emit(MOp::IDIVL, reg("ecx"));
+        emit(MOp::MOVSLQ, reg("eax"), reg("rax"));
+        store(reg("rax"), li->getContainer());
+        return;
+    }
+    case IrOp::LESS: COMPAR(MOp::JL);
+    case IrOp::GREATER: COMPAR(MOp::JG);
+    case IrOp::LESS_EQ: COMPAR(MOp::JLE);
+    case IrOp::GREATER_EQ: COMPAR(MOp::JGE);
+    case IrOp::NOT_EQ: COMPAR(MOp::JNE)
     case IrOp::MOD:
     {
-        std::string builder;
-        std::string dest = toAssembly(li->getContainer());
-        std::string op1 = toAssembly(li->getOp1());
-        std::string op2 = toAssembly(li->getOp2());
-        builder = tab() + "xorq %rdx, %rdx\n";
-        builder += tab() + "movq " + op1 + ", %rax\n";
-        builder += tab() + "movq " + op2 + ", %rbx\n";
-        builder += tab() + "divq %rbx\n";
-        builder += tab() + "movq %rdx, " + dest + "\n";
-        return builder;
-    }
-    case IrOp::AND: BINOP("andq");
-    case IrOp::OR: BINOP("orq");
-    case IrOp::AND_AND: LOGIC_OP("je");
-    case IrOp::OR_OR: LOGIC_OP("jne");
-    case IrOp::XOR: BINOP("xorq");
-    case IrOp::EQUAL_EQUAL: COMPAR("je");
-    case IrOp::BFLIP: UNOP("notq");
+        load(li->getOp1(), reg("rax"));
+        load(li->getOp2(), reg("rcx"));
+        emit(MOp::CLTD);
+        emit(MOp::IDIVL, reg("ecx"));
+        emit(MOp::MOVSLQ, reg("edx"), reg("rdx"));
+        store(reg("rdx"), li->getContainer());
+        return;
+    }
+    case IrOp::AND: BINOP(MOp::ANDQ);
+    case IrOp::OR: BINOP(MOp::ORQ);
+    case IrOp::AND_AND: LOGIC_OP(MOp::JE, 0, 1);
+    case IrOp::OR_OR: LOGIC_OP(MOp::JNE, 1, 0);
+    case IrOp::XOR: BINOP(MOp::XORQ);
+    case IrOp::EQUAL_EQUAL: COMPAR(MOp::JE);
+    case IrOp::BFLIP: UNOP(MOp::NOTQ);
     case IrOp::NOT:
     {
-        std::string builder;
-        std::string dest = toAssembly(li->getContainer());
-        std::string op1 = toAssembly(li->getOp1());
-        builder = tab() + "xorq %rax, %rax\n";
-        builder += tab() + "movq " + op1 + ", %rbx\n";
-        builder += tab() + "test %rbx, %rbx\n";
-        builder += tab() + "sete %al\n";
-        builder += tab() + "movq %rax, " + dest + "\n";
-        return builder;
+        emit(MOp::XORQ, reg("rax"), reg("rax"));
+        load(li->getOp1(), reg("rcx"));
+        emit(MOp::TESTQ, reg("rcx"), reg("rcx"));
+        emit(MOp::SETE, reg("al"));
+        store(reg("rax"), li->getContainer());
+        return;
     }
     default:
-        BINOP("UNHANDLED");
+        throw CodeGenError("Unhandled operation '" +
+            string_of_irop(li->getOperation()) + "'.");
     }
 
-    return "";
 #undef BINOP
 #undef COMPAR
+#undef FCOMPAR
+#undef FEQUAL
 #undef LOGIC_OP
 #undef UNOP
 }
 
 // <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
-Program::Program(std::string fileName) {
-     stack_level =  0;
-    std::map<std::string, int> temp2;
+Program::Program(std::string fileName, CPU &cpu) {
+    this->cpu = cpu;
 
-    stack.push_back(1);
-    offsets.push_back(temp2);
+    module.fileName = fileName;
 
-    file = ".file \"" + fileName + "\"\n";
+    inFunction = false;
 
-    data = ".section .data\n";
+    frame = NULL;
 
-    bss = ".section .bss\n";
+    stackDepth = 0;
 
-    text = ".section .text\n";
+    tailCallsEnabled = false;
 
-    inFunction = false;
+    avx2 = false;
 
-    numArgs = 0;
+    profile = nullptr;
 }
 
 std::string Program::toString() {
-    return file + "\n" + data + "\n" + bss + "\n" + text + "\n"; // I like having an extra newline at the end
+    AsmEmitter emitter;
+
+    emitter.emit(module);
+    return emitter.getBuffer();
 }
 
+void Program::write(std::ostream &out) {
+    AsmEmitter emitter;
+
+    emitter.emit(module);
+    emitter.write(out);
+}
+
+MModule &Program::getModule() {
+    return module;
+}
+
+std::vector<MInstr> &Program::getText() {
+    return module.text;
+}
+
+// Emit the function label and the prologue for the function's frame
 void Program::declareFunction(std::string name) {
-    text += tab() + ".globl " + name + "\n";
-    text += tab() + ".type " + name + ", @function\n";
-    text += name + ":\n";
-    text += tab() + "pushq %rbp\n";
-    text += tab() + "movq %rsp, %rbp\n";
+    emit(MOp::GLOBL, MOperand::Sym(name));
+    emit(MOp::TYPE, MOperand::Sym(name), MOperand::Sym("@function"));
+    emit(MOp::LABEL, MOperand::Sym(name));
+
+    if (!frame->omitFP) {
+        emit(MOp::PUSHQ, reg("rbp"));
+        emit(MOp::MOVQ, reg("rsp"), reg("rbp"));
+    }
+
+    // save the callee saved registers the allocator gave this function,
+    // they sit right below the old %rbp
+    for (auto &r : frame->saved) {
+        emit(MOp::PUSHQ, reg(r));
+    }
+
+    if (frame->size > 0)
+        emit(MOp::SUBQ, MOperand::Imm(frame->size), reg("rsp"));
+
+    stackDepth = frame->saved.size() * 8 + frame->size;
+}
+
+// Release the frame and restore the callee saved registers, %rsp points
+// at the return address again. Code after a function that used the upper
+// halves of the ymm registers would pay for mixing them with SSE
+void Program::releaseFrame() {
+    if (frame->wide)
+        emit(MOp::VZEROUPPER);
+
+    if (frame->omitFP) {
+        if (frame->size > 0)
+            emit(MOp::ADDQ, MOperand::Imm(frame->size), reg("rsp"));
+    } else if (frame->saved.size() > 0) {
+        emit(MOp::LEAQ, MOperand::Mem("rbp", -8 * (long)frame->saved.size()), reg("rsp"));
+    } else {
+        emit(MOp::MOVQ, reg("rbp"), reg("rsp"));
+    }
+
+    for (auto r = frame->saved.rbegin(); r != frame->saved.rend(); ++r) {
+        emit(MOp::POPQ, reg(*r));
+    }
+
+    if (!frame->omitFP)
+        emit(MOp::POPQ, reg("rbp"));
+}
+
+// Release the frame and return
+void Program::epilogue() {
+    releaseFrame();
+    emit(MOp::RETQ);
+}
+
+// A global variable, it lives in .bss unless a constant initializer
+// moves it to .data
+void Program::declareGlobal(std::string name) {
+    if (findGlobal(name))
+        return;
+
+    globals.push_back(name);
+    uninitGlobals.push_back(name);
+}
+
+// The symbol and the bytes of a global variable in the given section,
+// aligned to its size
+void Program::defineGlobal(std::vector<MInstr> &section, std::string name, MInstr value) {
+    Datalen len = globalSizes.count(name) ? globalSizes[name] : DLONG;
+
+    section.push_back(MInstr(MOp::GLOBL, MOperand::Sym(name)));
+    section.push_back(MInstr(MOp::TYPE, MOperand::Sym(name), MOperand::Sym("@object")));
+    section.push_back(MInstr(MOp::SIZE, MOperand::Sym(name), MOperand::Imm(len)));
+    if (len > 1)
+        section.push_back(MInstr(MOp::BALIGN, MOperand::Imm(len)));
+    section.push_back(MInstr(MOp::LABEL, MOperand::Sym(name)));
+    section.push_back(value);
+}
+
+// Address of a local variable's slot in the current frame
+MOperand Program::slot(std::string var) {
+    auto it = frame->slots.find(var);
+
+    if (it == frame->slots.end())
+        throw CodeGenError("No stack slot for variable '" + var + "'.");
+
+    int offset = it->second;
+
+    // leaf functions address their slots off %rsp, either in the red zone
+    // or inside the area the prologue reserved
+    if (frame->omitFP) {
+        if (frame->size == 0)
+            return MOperand::Mem("rsp", -offset);
+        return MOperand::Mem("rsp", frame->size - offset);
+    }
+
+    return MOperand::Mem("rbp", -(long)(frame->saved.size() * 8 + offset));
+}
+
+// Bytes of the value in a container, only variables are narrower than a
+// register
+Datalen Program::width(Container c) {
+    if (!c.isVariable())
+        return DLONG;
+
+    std::string var = c.getStringValue();
+    if (findGlobal(var)) {
+        auto it = globalSizes.find(var);
+        return it != globalSizes.end() ? it->second : DLONG;
+    }
+    if (frame != NULL) {
+        auto it = frame->sizes.find(var);
+        if (it != frame->sizes.end())
+            return it->second;
+    }
+    return DLONG;
+}
+
+// Load a value into a register, int and char variables sign extended
+void Program::load(Container c, MOperand dst) {
+    switch (width(c)) {
+    case DCHAR:
+        emit(MOp::MOVSBQ, toAssembly(c), dst);
+        break;
+    case DINT:
+        emit(MOp::MOVSLQ, toAssembly(c), dst);
+        break;
+    default:
+        emit(MOp::MOVQ, toAssembly(c), dst);
+        break;
+    }
+}
+
+// Store a register or an immediate, int and char variables keep its low
+// bytes. Memory goes through %rax.
+void Program::store(MOperand src, Container c) {
+    MOperand dst = toAssembly(c);
+    Datalen len = width(c);
+
+    if (src.isMem() && (dst.isMem() || len != DLONG)) {
+        emit(MOp::MOVQ, src, reg("rax"));
+        src = reg("rax");
+    }
+
+    if (len == DLONG) {
+        emit(MOp::MOVQ, src, dst);
+        return;
+    }
+
+    if (src.isImm())
+        src.value = len == DCHAR ? (long)(signed char)src.value : (long)(int)src.value;
+    else
+        src = reg(sub_register(src.reg, len));
+    emit(len == DCHAR ? MOp::MOVB : MOp::MOVL, src, dst);
+}
+
+// An operand of a 64 bit instruction, narrow variables are loaded into the
+// scratch register first
+MOperand Program::value(Container c, std::string scratch) {
+    if (width(c) == DLONG)
+        return toAssembly(c);
+
+    load(c, reg(scratch));
+    return reg(scratch);
+}
+
+// let dst = src for ints
+void Program::copy(Container src, Container dst) {
+    MOperand d = toAssembly(dst);
+
+    if (d.isReg())
+        load(src, d);
+    else
+        store(value(src, "rax"), dst);
+}
+
+// Address of an argument the caller passed on the stack (the seventh
+// argument is index 0)
+MOperand Program::stackArg(int index) {
+    if (frame->omitFP) {
+        int off = frame->size + frame->saved.size() * 8 + 8 + index * 8;
+        return MOperand::Mem("rsp", off);
+    }
+
+    return MOperand::Mem("rbp", 16 + index * 8);
+}
+
+// A float constant in .rodata, every value is stored once
+MOperand Program::floatConstant(float value) {
+    union ctype bits;
+    bits.fval = value;
+
+    auto it = floatConstants.find(bits.ival);
+    if (it != floatConstants.end())
+        return MOperand::Rip(it->second);
+
+    std::string label = ".FC" + std::to_string(floatConstants.size());
+    floatConstants[bits.ival] = label;
+    module.rodata.push_back(MInstr(MOp::LABEL, MOperand::Sym(label)));
+    module.rodata.push_back(MInstr(MOp::QUAD, MOperand::Imm((uint32_t)bits.ival)));
+    return MOperand::Rip(label);
+}
+
+// movss needs one of its operands in a register
+void Program::moveFloat(MOperand src, MOperand dst) {
+    if (src == dst)
+        return;
+
+    if (src.isReg() || dst.isReg()) {
+        emit(MOp::MOVSS, src, dst);
+    } else {
+        emit(MOp::MOVSS, src, reg("xmm0"));
+        emit(MOp::MOVSS, reg("xmm0"), dst);
+    }
+}
+
+// Where the System V convention passes each of the arguments: the next
+// free register of its kind, or the stack (an empty name) once those are
+// used up
+// The register of a vector, the xmm register the allocator gave it or
+// the ymm register around it
+MOperand Program::vectorReg(Container c) {
+    std::string name = c.getReg();
+
+    if (avx2)
+        name = "y" + name.substr(1);
+    return reg(name);
+}
+
+// The lane numbers 0, 1, ... in .rodata, added to a splatted counter to
+// give every lane its own iteration
+MOperand Program::lanes() {
+    if (laneNumbers.empty()) {
+        laneNumbers = ".VC0";
+        module.rodata.push_back(MInstr(MOp::LABEL, MOperand::Sym(laneNumbers)));
+        for (int l = 0; l < (avx2 ? 4 : 2); l++)
+            module.rodata.push_back(MInstr(MOp::QUAD, MOperand::Imm(l)));
+    }
+    return MOperand::Rip(laneNumbers);
+}
+
+// Select the instructions for a let on vectors, see codegen.h. %xmm0 and
+// %xmm1 (%ymm0 and %ymm1) are the scratch registers.
+void Program::vectorAssembly(LetInstr *li) {
+    MOperand x0 = reg(avx2 ? "ymm0" : "xmm0");
+    MOperand x1 = reg(avx2 ? "ymm1" : "xmm1");
+
+    // take a lane out of a vector
+    if (li->getOperation() == IrOp::LANE) {
+        MOperand v = vectorReg(li->getOp1());
+        int k = li->getOp2().getIntImmediate();
+        MOperand dest = toAssembly(li->getContainer());
+        MOperand r = dest.isReg() ? dest : reg("rax");
+
+        if (avx2) {
+            MOperand half = reg("x" + v.reg.substr(1));
+            if (k >= 2) {
+                emit(MOp::VEXTRACTI128, MOperand::Imm(1), v, reg("xmm0"));
+                half = reg("xmm0");
+            }
+            emit(MOp::VPEXTRQ, MOperand::Imm(k & 1), half, r);
+        } else if (k == 0) {
+            emit(MOp::MOVQX, v, r);
+        } else {
+            emit(MOp::PSHUFD, MOperand::Imm(0xee), v, reg("xmm0"));
+            emit(MOp::MOVQX, reg("xmm0"), r);
+        }
+        if (r != dest)
+            store(r, li->getContainer());
+        return;
+    }
+
+    MOperand dest = vectorReg(li->getContainer());
+
+    if (li->getOp() == UNARY_LET) {
+        switch (li->getOperation()) {
+        case IrOp::SPLAT:
+        case IrOp::STEP: {
+            MOperand x = toAssembly(li->getOp1());
+            MOperand low = reg("x" + dest.reg.substr(1));
+
+            if (!x.isReg()) {
+                load(li->getOp1(), reg("rax"));
+                x = reg("rax");
+            }
+            if (avx2) {
+                emit(MOp::VMOVQ, x, low);
+                emit(MOp::VPBROADCASTQ, low, dest);
+                if (li->getOperation() == IrOp::STEP)
+                    emit(MOp::VPADDQ, lanes(), dest, dest);
+            } else {
+                emit(MOp::MOVQX, x, dest);
+                emit(MOp::PUNPCKLQDQ, dest, dest);
+                if (li->getOperation() == IrOp::STEP) {
+                    emit(MOp::MOVDQU, lanes(), x0);
+                    emit(MOp::PADDQ, x0, dest);
+                }
+            }
+            return;
+        }
+        case IrOp::SUB:
+            if (avx2) {
+                emit(MOp::VPXOR, x0, x0, x0);
+                emit(MOp::VPSUBQ, vectorReg(li->getOp1()), x0, dest);
+            } else {
+                emit(MOp::PXOR, x0, x0);
+                emit(MOp::PSUBQ, vectorReg(li->getOp1()), x0);
+                emit(MOp::MOVDQA, x0, dest);
+            }
+            return;
+        case IrOp::BFLIP:
+            // xor with all ones
+            if (avx2) {
+                emit(MOp::VPCMPEQD, x0, x0, x0);
+                emit(MOp::VPXOR, x0, vectorReg(li->getOp1()), dest);
+            } else {
+                emit(MOp::PCMPEQD, x0, x0);
+                emit(MOp::PXOR, vectorReg(li->getOp1()), x0);
+                emit(MOp::MOVDQA, x0, dest);
+            }
+            return;
+        default:
+            throw CodeGenError("Unhandled vector operation '" +
+                string_of_irop(li->getOperation()) + "'.");
+        }
+    }
+
+    MOperand a = vectorReg(li->getOp1());
+    MOperand b = vectorReg(li->getOp2());
+
+    // the low halves of the lanes multiplied with each other plus the
+    // cross products shifted into the high halves
+    if (li->getOperation() == IrOp::MUL) {
+        if (avx2) {
+            emit(MOp::VPSRLQ, MOperand::Imm(32), a, x0);
+            emit(MOp::VPMULUDQ, b, x0, x0);
+            emit(MOp::VPSRLQ, MOperand::Imm(32), b, x1);
+            emit(MOp::VPMULUDQ, a, x1, x1);
+            emit(MOp::VPADDQ, x1, x0, x0);
+            emit(MOp::VPSLLQ, MOperand::Imm(32), x0, x0);
+            emit(MOp::VPMULUDQ, b, a, x1);
+            emit(MOp::VPADDQ, x0, x1, dest);
+        } else {
+            emit(MOp::MOVDQA, a, x0);
+            emit(MOp::PSRLQ, MOperand::Imm(32), x0);
+            emit(MOp::PMULUDQ, b, x0);
+            emit(MOp::MOVDQA, b, x1);
+            emit(MOp::PSRLQ, MOperand::Imm(32), x1);
+            emit(MOp::PMULUDQ, a, x1);
+            emit(MOp::PADDQ, x1, x0);
+            emit(MOp::PSLLQ, MOperand::Imm(32), x0);
+            emit(MOp::MOVDQA, a, x1);
+            emit(MOp::PMULUDQ, b, x1);
+            emit(MOp::PADDQ, x0, x1);
+            emit(MOp::MOVDQA, x1, dest);
+        }
+        return;
+    }
+
+    MOp op;
+    switch (li->getOperation()) {
+    case IrOp::ADD: op = avx2 ? MOp::VPADDQ : MOp::PADDQ; break;
+    case IrOp::SUB: op = avx2 ? MOp::VPSUBQ : MOp::PSUBQ; break;
+    case IrOp::AND: op = avx2 ? MOp::VPAND : MOp::PAND; break;
+    case IrOp::OR: op = avx2 ? MOp::VPOR : MOp::POR; break;
+    case IrOp::XOR: op = avx2 ? MOp::VPXOR : MOp::PXOR; break;
+    default:
+        throw CodeGenError("Unhandled vector operation '" +
+            string_of_irop(li->getOperation()) + "'.");
+    }
+
+    if (avx2) {
+        emit(op, b, a, dest);
+        return;
+    }
+
+    // two operand form, b must not be overwritten before it is read
+    MOperand acc = b == dest ? x0 : dest;
+    if (a != acc)
+        emit(MOp::MOVDQA, a, acc);
+    emit(op, b, acc);
+    if (acc != dest)
+        emit(MOp::MOVDQA, acc, dest);
+}
+
+static std::vector<std::string> argLocations(std::list<Container> &args) {
+    std::vector<std::string> where;
+    unsigned int ints = 0;
+    unsigned int floats = 0;
+
+    for (auto &a : args) {
+        if (a.isFloat())
+            where.push_back(floats < floatArgRegs.size() ? floatArgRegs[floats++] : "");
+        else
+            where.push_back(ints < argRegs.size() ? argRegs[ints++] : "");
+    }
+    return where;
+}
+
+void Program::setTailCalls(bool enable) {
+    tailCallsEnabled = enable;
+}
+
+void Program::setAvx2(bool enable) {
+    avx2 = enable;
+}
+
+void Program::setProfile(Profile *profile) {
+    this->profile = profile;
+}
+
+// Adds one to the block's counter, nothing at the start of a block reads
+// the flags it sets
+void Program::countBlock(std::string key) {
+    MOperand counter = MOperand::Rip(".Lprof_counters");
+    counter.value = 8L * profile->counter(key);
+    emit(MOp::ADDQ, MOperand::Imm(1), counter);
+}
+
+// A call target with the number of arguments passed in registers
+static MOperand libcCall(std::string name, int args) {
+    MOperand callee = MOperand::Sym(name);
+    callee.value = args;
+    return callee;
+}
+
+// open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644), then the header and the
+// counters are written and the file closed. A program that cannot create
+// the file runs on without it.
+void Program::insertProfileDump() {
+    std::string header = profile->header();
+    std::string file = profile->getFileName();
+    long counters = profile->getKeys().size();
+
+    module.bss.push_back(MInstr(MOp::BALIGN, MOperand::Imm(DLONG)));
+    module.bss.push_back(MInstr(MOp::LABEL, MOperand::Sym(".Lprof_counters")));
+    module.bss.push_back(MInstr(MOp::ZERO, MOperand::Imm(std::max(counters, 1L) * DLONG)));
+
+    module.rodata.push_back(MInstr(MOp::LABEL, MOperand::Sym(".Lprof_file")));
+    for (char c : file)
+        module.rodata.push_back(MInstr(MOp::BYTE, MOperand::Imm(c)));
+    module.rodata.push_back(MInstr(MOp::BYTE, MOperand::Imm(0)));
+    module.rodata.push_back(MInstr(MOp::LABEL, MOperand::Sym(".Lprof_header")));
+    for (char c : header)
+        module.rodata.push_back(MInstr(MOp::BYTE, MOperand::Imm(c)));
+
+    // %rbx keeps the file descriptor, pushing it also aligns %rsp
+    emit(MOp::TYPE, MOperand::Sym(PROFILE_DUMP), MOperand::Sym("@function"));
+    emit(MOp::LABEL, MOperand::Sym(PROFILE_DUMP));
+    emit(MOp::PUSHQ, reg("rbx"));
+    emit(MOp::LEAQ, MOperand::Rip(".Lprof_file"), reg("rdi"));
+    emit(MOp::MOVQ, MOperand::Imm(01 | 0100 | 01000), reg("rsi"));
+    emit(MOp::MOVQ, MOperand::Imm(0644), reg("rdx"));
+    emit(MOp::MOVQ, MOperand::Imm(0), reg("rax"));
+    emit(MOp::CALLQ, libcCall("open", 3));
+    emit(MOp::TESTQ, reg("rax"), reg("rax"));
+    emit(MOp::JL, MOperand::Sym(".Lprof_done"));
+    emit(MOp::MOVQ, reg("rax"), reg("rbx"));
+
+    emit(MOp::MOVQ, reg("rbx"), reg("rdi"));
+    emit(MOp::LEAQ, MOperand::Rip(".Lprof_header"), reg("rsi"));
+    emit(MOp::MOVQ, MOperand::Imm(header.size()), reg("rdx"));
+    emit(MOp::CALLQ, libcCall("write", 3));
+    emit(MOp::MOVQ, reg("rbx"), reg("rdi"));
+    emit(MOp::LEAQ, MOperand::Rip(".Lprof_counters"), reg("rsi"));
+    emit(MOp::MOVQ, MOperand::Imm(counters * DLONG), reg("rdx"));
+    emit(MOp::CALLQ, libcCall("write", 3));
+    emit(MOp::MOVQ, reg("rbx"), reg("rdi"));
+    emit(MOp::CALLQ, libcCall("close", 1));
+
+    emit(MOp::LABEL, MOperand::Sym(".Lprof_done"));
+    emit(MOp::POPQ, reg("rbx"));
+    emit(MOp::RETQ);
+}
+
+// Bytes a variable of the type takes
+static Datalen datalenOf(SymbolType type) {
+    switch (type) {
+    case SYM_CHAR:
+        return DCHAR;
+    case SYM_INT:
+    case SYM_FLOAT:
+        return DINT;
+    default:
+        return DLONG;
+    }
+}
+
+// Do two containers name the same register
+static bool sameRegister(Container a, Container b) {
+    if (a.isPhysRegister() && b.isPhysRegister())
+        return a.getReg() == b.getReg();
+    return a.isRegister() && b.isRegister() && a.getIntValue() == b.getIntValue();
+}
+
+// Frame layout pass
+// Every variable of a function gets its slot before the function is emitted
+// so the prologue reserves the whole frame with a single subq. A variable
+// lives from its first to its last reference, stretched over any loop
+// (backwards jump) it overlaps, and variables whose lifetimes never overlap
+// share a slot.
+void Program::layoutFrames(std::vector<BasicBlock> &bblist) {
+    std::vector<Instruction *> body;
+    std::string name;
+    bool inDef = false;
+
+    // Lay out the function whose instructions were collected in body
+    auto layout = [&]() {
+        std::map<std::string, int> labels;
+        std::map<std::string, std::pair<int, int>> live;
+        std::vector<std::pair<int, int>> loops;
+        Frame f;
+
+        f.leaf = true;
+
+        for (unsigned int k = 0; k < body.size(); k++) {
+            Instruction *i = body[k];
+
+            if (i->getOp() == LABEL)
+                labels[((LableInstr *)i)->getLabelName()] = k;
+            if (i->getOp() == DEF) {
+                for (auto &p : *((DefInstr *)i)->getParams())
+                    f.sizes[p.getStringValue()] = datalenOf(p.sym);
+            }
+            if (i->getOp() == DECL) {
+                Container c = ((DeclInstr *)i)->getContainer();
+                f.sizes[c.getStringValue()] = datalenOf(c.sym);
+            }
+            if (i->getOp() == CALL)
+                f.leaf = false;
+
+            // a call is in tail position when its result is returned right
+            // away, arguments on the stack would have to outlive the frame
+            // and a char result is narrowed after the call
+            if (tailCallsEnabled && i->getOp() == CALL && k + 1 < body.size() && body[k + 1]->getOp() == RET &&
+                    !(((CallInstr *)i)->getFlag() && ((CallInstr *)i)->getContainer().sym == SYM_CHAR)) {
+                CallInstr *ci = (CallInstr *)i;
+                Container ret = ((ReturnInstr *)body[k + 1])->getContainer();
+
+                std::vector<std::string> where = argLocations(*ci->getArgs());
+                if (std::count(where.begin(), where.end(), "") == 0 &&
+                        (ret.type == NIL || (ci->getFlag() && sameRegister(ret, ci->getContainer())))) {
+                    tailCalls.insert(i);
+                    tailReturns.insert(body[k + 1]);
+                }
+            }
+
+            for (auto &c : containers_of_instruction(i)) {
+                if (avx2 && c.isVector())
+                    f.wide = true;
+                if (!c.isVariable() || findGlobal(c.getStringValue()))
+                    continue;
+
+                std::string var = c.getStringValue();
+                if (live.find(var) == live.end())
+                    live[var] = std::make_pair(k, k);
+                live[var].second = k;
+            }
+        }
+
+        // find the loops, a jump or branch back to an earlier label
+        for (unsigned int k = 0; k < body.size(); k++) {
+            std::string target;
+
+            if (body[k]->getOp() == JUMP) {
+                target = ((JumpInstr *)body[k])->getLabelName();
+            } else if (body[k]->getOp() == BRANCH) {
+                BranchInstr *br = (BranchInstr *)body[k];
+                target = br->getLabelTwo() ? *br->getLabelTwo() : br->getLabelOne();
+            } else {
+                continue;
+            }
+
+            auto it = labels.find(target);
+            if (it != labels.end() && it->second <= (int)k)
+                loops.push_back(std::make_pair(it->second, k));
+        }
+
+        // a variable used anywhere in a loop stays alive for all of it
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto &l : live) {
+                for (auto &loop : loops) {
+                    std::pair<int, int> &r = l.second;
+                    if (r.first <= loop.second && r.second >= loop.first &&
+                            (r.first > loop.first || r.second < loop.second)) {
+                        r.first = std::min(r.first, loop.first);
+                        r.second = std::max(r.second, loop.second);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // linear scan over the lifetimes, reusing slots that have expired
+        std::vector<std::pair<std::pair<int, int>, std::string>> order;
+        for (auto &l : live)
+            order.push_back(std::make_pair(l.second, l.first));
+        std::sort(order.begin(), order.end());
+
+        // separately for every size, so a slot only ever holds variables
+        // of its own size
+        std::map<int, std::vector<int>> slotEnd;
+        std::map<std::string, int> index;
+        for (auto &o : order) {
+            if (f.sizes.count(o.second) == 0)
+                f.sizes[o.second] = DLONG;
+
+            std::vector<int> &ends = slotEnd[f.sizes[o.second]];
+            int pick = -1;
+            for (unsigned int s = 0; s < ends.size(); s++) {
+                if (ends[s] < o.first.first) {
+                    pick = s;
+                    break;
+                }
+            }
+
+            if (pick == -1) {
+                pick = ends.size();
+                ends.push_back(0);
+            }
+
+            ends[pick] = o.first.second;
+            index[o.second] = pick;
+        }
+
+        // the largest slots go on top, which keeps every slot aligned to
+        // its size below the 8 byte aligned top
+        std::map<int, int> base;
+        f.slotBytes = 0;
+        for (auto s = slotEnd.rbegin(); s != slotEnd.rend(); ++s) {
+            base[s->first] = f.slotBytes;
+            f.slotBytes += s->first * s->second.size();
+        }
+        for (auto &v : index) {
+            int len = f.sizes[v.first];
+            f.slots[v.first] = base[len] + (v.second + 1) * len;
+        }
+        f.saved = cpu.getCalleeSaved(name);
+
+        // A leaf function can do without a frame pointer, spilled values
+        // included. Its slots go in the 128 byte red zone below %rsp when
+        // they fit there.
+        f.omitFP = f.leaf;
+        f.size = (f.slotBytes + 7) / 8 * 8;
+        if (f.omitFP) {
+            if (f.size <= 128)
+                f.size = 0;
+        } else if ((f.saved.size() * 8 + f.size) % 16 != 0) {
+            // keep %rsp 16 byte aligned for the calls this function makes
+            f.size += 8;
+        }
+
+        frames[name] = f;
+    };
+
+    for (auto &block : bblist) {
+        block.iter([&](Instruction *i) {
+            switch (i->getOp()) {
+            case DEF:
+                name = ((DefInstr *)i)->getName();
+                body.clear();
+                body.push_back(i);
+                inDef = true;
+                break;
+            case END:
+                body.push_back(i);
+                layout();
+                inDef = false;
+                break;
+            case DECL:
+                // declarations outside of functions are globals
+                if (!inDef) {
+                    Container c = ((DeclInstr *)i)->getContainer();
+                    declareGlobal(c.getStringValue());
+                    globalSizes[c.getStringValue()] = datalenOf(c.sym);
+                } else {
+                    body.push_back(i);
+                }
+                break;
+            case CONST_LET:
+                // globals with a constant initializer go in .data instead
+                if (!inDef) {
+                    std::string var = ((LetInstr *)i)->getContainer().getStringValue();
+                    uninitGlobals.erase(std::remove(uninitGlobals.begin(), uninitGlobals.end(), var), uninitGlobals.end());
+                } else {
+                    body.push_back(i);
+                }
+                break;
+            default:
+                if (inDef)
+                    body.push_back(i);
+                break;
+            }
+        });
+    }
+
+    // globals that were never given an initializer are zero filled
+    for (auto &var : uninitGlobals) {
+        defineGlobal(module.bss, var, MInstr(MOp::ZERO, MOperand::Imm(globalSizes.count(var) ? globalSizes[var] : DLONG)));
+    }
 }
 
 bool Program::findGlobal(std::string name) {
@@ -659,40 +1602,99 @@ void Program::insertBasicBlock(BasicBlock &bb) {
         switch (i->getOp()) {
         case DEF:
         {
+            frame = &frames[((DefInstr *)i)->getName()];
             declareFunction(((DefInstr *)i)->getName());
-            newFunc();
             inFunction = true; // we are now in a function
-            numArgs = 0; // start with zero local variables
 
-            int k = 16;
-            if (((DefInstr *)i)->getParams()->size() > 0) {
-                text += tab() + "subq $" + std::to_string(((DefInstr *)i)->getParams()->size() * 8) + ", %rsp\n";
-                numArgs += ((DefInstr *)i)->getParams()->size();
-            }
-            for (auto &cont : *((DefInstr *)i)->getParams()) {
-                int off = allocVar(cont.getStringValue());
-                text += tab() + std::string("movq ") + std::to_string(k) + "(%rbp), %rax\n";
-                text += tab() + std::string("movq ") + "%rax, -" + std::to_string(off) + "(%rbp)\n";
-                k += 8;
+            // the first six int and eight float arguments arrive in
+            // registers, the rest were pushed by the caller right above the
+            // return address
+            std::list<Container> *params = ((DefInstr *)i)->getParams();
+            std::vector<std::string> where = argLocations(*params);
+            unsigned int n = 0;
+            int onStack = 0;
+            for (auto &cont : *params) {
+                MOperand src = where[n] != "" ? reg(where[n]) : stackArg(onStack++);
+                n++;
+                if (frame->slots.count(cont.getStringValue()) == 0)
+                    continue;
+
+                if (cont.isFloat())
+                    moveFloat(src, slot(cont.getStringValue()));
+                else
+                    store(src, cont);
             }
+
+            if (profile != nullptr)
+                countBlock(Profile::entryKey(((DefInstr *)i)->getName()));
         }
         break;
         case LABEL:
-            text += ((LableInstr *)i)->getLabelName() + ":\n";
+            emit(MOp::LABEL, MOperand::Sym(((LableInstr *)i)->getLabelName()));
+            if (profile != nullptr)
+                countBlock(Profile::labelKey(((LableInstr *)i)->getLabelName()));
             break;
         case JUMP:
-            text += tab() + "jmp " + ((JumpInstr *)i)->getLabelName() + "\n";
+            emit(MOp::JMP, MOperand::Sym(((JumpInstr *)i)->getLabelName()));
+            break;
+        case JUMP_TABLE:
+        {
+            // jump through the table of the distances of the case labels
+            // from the table, values outside of it go to the default
+            SwitchInstr *si = (SwitchInstr *)i;
+            std::vector<std::string> &targets = si->getTargets();
+            MOperand value = this->value(si->getContainer(), "rax");
+            long low = si->getLow();
+            long high = low + (long)targets.size() - 1;
+
+            // a constant value picks its case right away
+            if (value.isImm()) {
+                long k = value.value - low;
+                emit(MOp::JMP, MOperand::Sym(k >= 0 && k < (long)targets.size() ? targets[k] : si->getDefault()));
+                break;
+            }
+
+            std::string table = createTableLabel();
+            emit(MOp::CMPQ, MOperand::Imm(low), value);
+            emit(MOp::JL, MOperand::Sym(si->getDefault()));
+            emit(MOp::CMPQ, MOperand::Imm(high), value);
+            emit(MOp::JG, MOperand::Sym(si->getDefault()));
+
+            // the entry of the lowest case value sits low * 8 bytes below
+            // the entry of 0
+            long disp = -low * 8;
+            if (!value.isReg() || disp < INT32_MIN || disp > INT32_MAX) {
+                emit(MOp::MOVQ, value, reg("rax"));
+                if (low != 0)
+                    emit(MOp::SUBQ, MOperand::Imm(low), reg("rax"));
+                value = reg("rax");
+                disp = 0;
+            }
+
+            emit(MOp::LEAQ, MOperand::Rip(table), reg("rdx"));
+            emit(MOp::MOVQ, MOperand::Mem("rdx", value.reg, 8, disp), reg("rcx"));
+            emit(MOp::ADDQ, reg("rdx"), reg("rcx"));
+            emit(MOp::JMPQ, reg("rcx"));
+
+            module.rodata.push_back(MInstr(MOp::LABEL, MOperand::Sym(table)));
+            for (auto &t : targets) {
+                module.rodata.push_back(MInstr(MOp::QUAD, MOperand::Sym(t), MOperand::Sym(table)));
+            }
             break;
+        }
         case RET:
-            // deallocate variables
-            if (numArgs > 0)
-                text += tab() + "addq $" + std::to_string(numArgs * 8) + ", %rsp\n";
-            
-            if (toAssembly(((ReturnInstr *)i)->getContainer()) != std::string(""))
-                text += tab() + "movq " + toAssembly(((ReturnInstr *)i)->getContainer()) + ", %rax\n";
+            // the callee of a tail call returns for us
+            if (tailReturns.count(i))
+                break;
 
-            text += tab() + "popq %rbp\n";
-            text += tab() + "retq\n";
+            // the value may live in a register the epilogue restores
+            if (((ReturnInstr *)i)->getContainer().isFloat())
+                moveFloat(toAssembly(((ReturnInstr *)i)->getContainer()), reg("xmm0"));
+            else if (!toAssembly(((ReturnInstr *)i)->getContainer()).isNone())
+                load(((ReturnInstr *)i)->getContainer(), reg("rax"));
+
+            // deallocate variables
+            epilogue();
             break;
         // We only allow global variables of the type:
         // x = constant
@@ -704,7 +1706,7 @@ void Program::insertBasicBlock(BasicBlock &bb) {
                     std::string("Non-constant value for global variable '") +
                     ((LetInstr *)i)->getContainer().getStringValue() + "'.");
             }
-            text += toAssembly((LetInstr *)i);
+            toAssembly((LetInstr *)i);
             break;
         case CONST_LET:
             if (!inFunction) {
@@ -715,17 +1717,17 @@ void Program::insertBasicBlock(BasicBlock &bb) {
                         std::string("Non-constant value for global variable '") +
                         name + "'.");
                 }
-                data += "#----------------------------\n";
-                data += "# Global Var: " + name + "\n";
-                data += tab() + ".globl " + name + "\n";
-                data += tab() + ".data\n";
-                data += tab() + ".type " + name + ", @object\n";
-                data += name + ":\n";
-                data += tab() + ".quad " + std::to_string(c.getIntValue()) + "\n";
-                data += "#----------------------------\n";
-                globals.push_back(name);
+                // a float's bits for a float
+                Datalen len = globalSizes.count(name) ? globalSizes[name] : DLONG;
+                MOp directive = len == DCHAR ? MOp::BYTE : len == DINT ? MOp::LONG : MOp::QUAD;
+                long bits = len == DCHAR ? (signed char)c.getIntValue() : c.getIntValue();
+                defineGlobal(module.data, name, MInstr(directive, MOperand::Imm(bits)));
+                if (!findGlobal(name))
+                    globals.push_back(name);
+            } else if (((LetInstr *)i)->getOp1().isFloat() || ((LetInstr *)i)->getContainer().isFloat()) {
+                moveFloat(toAssembly(((LetInstr *)i)->getOp1()), toAssembly(((LetInstr *)i)->getContainer()));
             } else {
-                text += tab() + "movq " + toAssembly(((LetInstr *)i)->getOp1()) + ", " + toAssembly(((LetInstr *)i)->getContainer()) + "\n";
+                copy(((LetInstr *)i)->getOp1(), ((LetInstr *)i)->getContainer());
             }
             break;
         case UNARY_LET:
@@ -735,75 +1737,148 @@ void Program::insertBasicBlock(BasicBlock &bb) {
                     std::string("Non-constant value for global variable '") +
                     ((LetInstr *)i)->getContainer().getStringValue() + "'.");
             } 
-            text += toAssembly((LetInstr *)i);
+            toAssembly((LetInstr *)i);
             break;
         case BRANCH:
-            text += tab() + "cmp $1, " + toAssembly(((BranchInstr *)i)->getContainer()) + "\n";
-            if (((BranchInstr *)i)->getLabelTwo() != NULL)
-                text += tab() + "jne " + *(((BranchInstr *)i)->getLabelTwo()) + "\n";
-            else
-                text += tab() + "jne " + ((BranchInstr *)i)->getLabelOne() + "\n";
+        {
+            BranchInstr *br = (BranchInstr *)i;
+            MOperand cond = value(br->getContainer(), "rax");
+            MOperand target = MOperand::Sym(br->getLabelTwo() != NULL ? *br->getLabelTwo() : br->getLabelOne());
+
+            // a constant condition either always or never branches
+            if (cond.isImm()) {
+                if (cond.value != 1) {
+                    emit(MOp::JMP, target);
+                    break;
+                }
+            } else {
+                emit(MOp::CMPQ, MOperand::Imm(1), cond);
+                emit(MOp::JNE, target);
+            }
+
+            if (profile != nullptr)
+                countBlock(Profile::fallKey(br));
             break;
+        }
         case END:
             // deallocate variables
-            if (numArgs > 0)
-                text += tab() + "addq $" + std::to_string(numArgs * 8) + ", %rsp\n";
+            epilogue();
 
             // we are no longer in a function
-            text += tab() + "popq %rbp\n";
-            text += tab() + "retq\n";
 
             inFunction = false;
             break;
         case DECL:
-            allocVar(((DeclInstr *)i)->getContainer().getStringValue());
-            text += tab() + "pushq $0\n";
-            numArgs++;
+            // locals already have their slot in the frame
+            if (!inFunction)
+                declareGlobal(((DeclInstr *)i)->getContainer().getStringValue());
             break;
         case CALL:
-            for (auto j : *(((CallInstr *)i)->getArgs())) {
-                text += tab() + "pushq " + toAssembly(j) + "\n";
+        {
+            // System V calling convention: the first six int and eight
+            // float arguments go in registers, the rest are pushed right to
+            // left and %rsp has to be 16 byte aligned at the call
+            CallInstr *ci = (CallInstr *)i;
+            std::vector<Container> args(ci->getArgs()->begin(), ci->getArgs()->end());
+            std::vector<std::string> where = argLocations(*ci->getArgs());
+            std::list<std::string> savedRegs;
+            int stackArgs = std::count(where.begin(), where.end(), "");
+            int intArgs = 0;
+
+            // arguments that go in registers
+            auto passInRegs = [&]() {
+                for (unsigned int k = 0; k < args.size(); k++) {
+                    if (where[k] == "")
+                        continue;
+
+                    if (args[k].isFloat()) {
+                        moveFloat(toAssembly(args[k]), reg(where[k]));
+                    } else {
+                        load(args[k], reg(where[k]));
+                        intArgs++;
+                    }
+                }
+            };
+
+            // a tail call leaves the frame first and jumps, the callee
+            // returns straight to our caller, nothing is live after it
+            if (tailCalls.count(i)) {
+                passInRegs();
+                releaseFrame();
+                emit(MOp::JMP, MOperand::Sym(ci->getName()));
+                break;
+            }
+
+            if (ci->getSavedRegs() != nullptr)
+                savedRegs = *ci->getSavedRegs();
+
+            // float registers have no push
+            for (auto &r : savedRegs) {
+                if (r.compare(0, 3, "xmm") == 0) {
+                    emit(MOp::SUBQ, MOperand::Imm(8), reg("rsp"));
+                    emit(MOp::MOVSS, reg(r), MOperand::Mem("rsp", 0));
+                } else {
+                    emit(MOp::PUSHQ, reg(r));
+                }
+                stackDepth += 8;
+            }
+
+            int pad = (stackDepth + stackArgs * 8) % 16;
+            if (pad != 0)
+                emit(MOp::SUBQ, MOperand::Imm(pad), reg("rsp"));
+
+            for (int k = args.size() - 1; k >= 0; k--) {
+                if (where[k] != "")
+                    continue;
+
+                MOperand a = toAssembly(args[k]);
+                if (a.isReg() && args[k].isFloat()) {
+                    emit(MOp::SUBQ, MOperand::Imm(8), reg("rsp"));
+                    emit(MOp::MOVSS, a, MOperand::Mem("rsp", 0));
+                } else {
+                    emit(MOp::PUSHQ, value(args[k], "rax"));
+                }
+            }
+            passInRegs();
+
+            MOperand callee = MOperand::Sym(ci->getName());
+            callee.value = intArgs;
+            if (frame->wide)
+                emit(MOp::VZEROUPPER);
+            emit(MOp::CALLQ, callee);
+            if (stackArgs * 8 + pad > 0)
+                emit(MOp::ADDQ, MOperand::Imm(stackArgs * 8 + pad), reg("rsp"));
+
+            for (auto r = savedRegs.rbegin(); r != savedRegs.rend(); ++r) {
+                if (r->compare(0, 3, "xmm") == 0) {
+                    emit(MOp::MOVSS, MOperand::Mem("rsp", 0), reg(*r));
+                    emit(MOp::ADDQ, MOperand::Imm(8), reg("rsp"));
+                } else {
+                    emit(MOp::POPQ, reg(*r));
+                }
+                stackDepth -= 8;
             }
-            text += tab() + "callq " + ((CallInstr *)i)->getName() + "\n";
-            if (((CallInstr *)i)->getArgs()->size() > 0)
-                text += tab() + "addq $" + std::to_string(((CallInstr *)i)->getArgs()->size() * 8) + ", %rsp\n";
 
             // if there is a return value, store it in the destination
-            if (toAssembly(((CallInstr *)i)->getContainer()) != std::string("")) {
-                text += tab() + "movq %rax, " + toAssembly(((CallInstr *)i)->getContainer()) + "\n";
+            if (ci->getFlag() && !toAssembly(ci->getContainer()).isNone()) {
+                // only the low bytes of an int or char are returned
+                Container ret = ci->getContainer();
+                if (ret.isFloat()) {
+                    moveFloat(reg("xmm0"), toAssembly(ret));
+                } else {
+                    MOperand r = toAssembly(ret).isReg() ? toAssembly(ret) : reg("rax");
+                    emit(ret.sym == SYM_CHAR ? MOp::MOVSBQ : MOp::MOVSLQ,
+                        reg(ret.sym == SYM_CHAR ? "al" : "eax"), r);
+                    if (r != toAssembly(ret))
+                        store(r, ret);
+                }
             }
             break;
+        }
         default:
-            text += tab() + i->toString() + "\n"; // for testing
+            throw CodeGenError("Unhandled instruction '" + i->toString() + "'.");
         }
     });
 }
 
-// Sends 8 bytes to next available slot in memory
-//      returns index of used memory
-int Program::allocVar(std::string var) {
-    if (offsets[stack_level].find(var) != offsets[stack_level].end()) {
-        return offsets[stack_level][var];
-    }
-
-    int off = offset(stack[stack_level]);
-    stack[stack_level]++;
-    offsets[stack_level][var] = off;
-
-    return off;
-}
-
-void Program::newFunc() {
-    std::map<std::string, int> temp2;
-    
-    stack.push_back(1);
-    offsets.push_back(temp2);
-    stack_level++;
-}
-
-// Returns actual address offset (4 * value)
-int Program::offset(int index) {
-    return 8 * index;
-}
-
 // -----------------------------------------------------------------
@@ -0,0 +1,394 @@
+/* File: elfwriter.cpp
+ * Authors: agent
+ * Description: Relocatable ELF64 object file output
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include "elfwriter.h"
+#include "exceptions.h"
+
+ElfWriter::ElfWriter(MModule &module):
+    module(module)
+{
+    bssSize = 0;
+    laidOut = false;
+}
+
+// Symbol by name, created undefined on first use
+ElfSymbol &ElfWriter::symbol(std::string name) {
+    auto it = symbolIndex.find(name);
+
+    if (it != symbolIndex.end())
+        return symbols[it->second];
+
+    symbolIndex[name] = symbols.size();
+    symbols.push_back(ElfSymbol());
+    symbols.back().name = name;
+    return symbols.back();
+}
+
+void ElfWriter::layoutSection(std::vector<MInstr> &section, int index) {
+    std::vector<unsigned char> &bytes = index == SEC_RODATA ? rodata : data;
+
+    for (auto &i : section) {
+        unsigned long offset = index == SEC_BSS ? bssSize : bytes.size();
+
+        switch (i.op) {
+        case MOp::LABEL:
+        {
+            ElfSymbol &s = symbol(i.ops[0].sym);
+            s.section = index;
+            s.value = offset;
+            break;
+        }
+        case MOp::GLOBL:
+            symbol(i.ops[0].sym).global = true;
+            break;
+        case MOp::TYPE:
+            symbol(i.ops[0].sym).type = i.ops[1].sym == "@function" ? STT_FUNC : STT_OBJECT;
+            break;
+        case MOp::SIZE:
+            symbol(i.ops[0].sym).size = i.ops[1].value;
+            break;
+        case MOp::QUAD:
+            if (index == SEC_BSS)
+                throw CodeGenError("Initialized data in .bss.");
+
+            // the difference of two labels, the first one's address is
+            // only known to the linker. A PC relative field at offset
+            // holds it once the second label's distance from the field is
+            // added back
+            if (i.ops.size() == 2) {
+                ElfSymbol &base = symbol(i.ops[1].sym);
+                if (base.section != index)
+                    throw CodeGenError("Label '" + i.ops[1].sym + "' is not defined before its use.");
+
+                symbol(i.ops[0].sym);
+                rodataRelocs.push_back(Relocation{offset, i.ops[0].sym, R_X86_64_PC64, (long)(offset - base.value)});
+                bytes.insert(bytes.end(), 8, 0);
+                break;
+            }
+
+            for (int k = 0; k < 8; k++)
+                bytes.push_back((i.ops[0].value >> (8 * k)) & 0xff);
+            break;
+        case MOp::LONG:
+        case MOp::BYTE:
+            if (index == SEC_BSS)
+                throw CodeGenError("Initialized data in .bss.");
+
+            for (int k = 0; k < (i.op == MOp::LONG ? 4 : 1); k++)
+                bytes.push_back((i.ops[0].value >> (8 * k)) & 0xff);
+            break;
+        case MOp::BALIGN:
+        {
+            unsigned long pad = (i.ops[0].value - offset % i.ops[0].value) % i.ops[0].value;
+            if (index == SEC_BSS)
+                bssSize += pad;
+            else
+                bytes.insert(bytes.end(), pad, 0);
+            break;
+        }
+        case MOp::ZERO:
+            if (index == SEC_BSS)
+                bssSize += i.ops[0].value;
+            else
+                bytes.insert(bytes.end(), i.ops[0].value, 0);
+            break;
+        default:
+            throw CodeGenError("Instruction '" + i.toString() + "' outside of .text.");
+        }
+    }
+}
+
+// Functions are the labels of the text section a directive mentions, the
+// jump labels inside them stay local to the encoder
+void ElfWriter::collectSymbols() {
+    std::map<std::string, unsigned long> &labels = encoder.getLabels();
+    std::vector<ElfSymbol *> functions;
+
+    for (auto &i : module.text) {
+        if (i.op == MOp::GLOBL)
+            symbol(i.ops[0].sym).global = true;
+        else if (i.op == MOp::TYPE)
+            symbol(i.ops[0].sym).type = STT_FUNC;
+    }
+
+    for (auto &r : encoder.getRelocations()) {
+        symbol(r.sym);
+    }
+
+    for (auto &s : symbols) {
+        auto it = labels.find(s.name);
+        if (s.section == 0 && it != labels.end()) {
+            s.section = SEC_TEXT;
+            s.value = it->second;
+        }
+    }
+
+    // a function runs up to the start of the next one, the labels jump
+    // tables refer to are inside of functions
+    for (auto &s : symbols) {
+        if (s.section == SEC_TEXT && s.type == STT_FUNC)
+            functions.push_back(&s);
+    }
+    std::sort(functions.begin(), functions.end(), [](ElfSymbol *a, ElfSymbol *b) {
+        return a->value < b->value;
+    });
+    for (unsigned int k = 0; k < functions.size(); k++) {
+        unsigned long end = encoder.getCode().size();
+        if (k + 1 < functions.size())
+            end = functions[k + 1]->value;
+        functions[k]->size = end - functions[k]->value;
+    }
+
+    // everything the code refers to that is not defined here is the
+    // linker's to find
+    for (auto &s : symbols) {
+        if (s.section == 0)
+            s.global = true;
+    }
+}
+
+void ElfWriter::layout() {
+    if (laidOut)
+        return;
+
+    encoder.encode(module.text);
+    layoutSection(module.data, SEC_DATA);
+    layoutSection(module.bss, SEC_BSS);
+    layoutSection(module.rodata, SEC_RODATA);
+    collectSymbols();
+    laidOut = true;
+}
+
+std::vector<unsigned char> &ElfWriter::getText() {
+    return encoder.getCode();
+}
+
+std::vector<unsigned char> &ElfWriter::getData() {
+    return data;
+}
+
+std::vector<unsigned char> &ElfWriter::getRodata() {
+    return rodata;
+}
+
+unsigned long ElfWriter::getBssSize() {
+    return bssSize;
+}
+
+std::vector<ElfSymbol> &ElfWriter::getSymbols() {
+    return symbols;
+}
+
+std::vector<Relocation> &ElfWriter::getTextRelocations() {
+    return encoder.getRelocations();
+}
+
+std::vector<Relocation> &ElfWriter::getRodataRelocations() {
+    return rodataRelocs;
+}
+
+void ElfWriter::write(std::ostream &out) {
+    std::string file(sizeof(Elf64_Ehdr), '\0');
+    std::string strtab(1, '\0');
+    std::string shstrtab(1, '\0');
+    std::vector<Elf64_Sym> syms;
+    std::vector<Elf64_Rela> relas;
+    std::vector<Elf64_Rela> rodataRelas;
+    std::vector<int> order;
+    Elf64_Shdr sh[SEC_COUNT];
+    unsigned int firstGlobal;
+
+    layout();
+
+    auto append = [&file](const void *bytes, unsigned long size) {
+        file.append((const char *)bytes, size);
+    };
+    auto align = [&file](unsigned long n) {
+        while (file.size() % n != 0)
+            file += '\0';
+    };
+    auto addString = [](std::string &table, std::string s) -> Elf64_Word {
+        Elf64_Word offset = table.size();
+        table += s;
+        table += '\0';
+        return offset;
+    };
+
+    // symbol table, the null symbol and the source file first and local
+    // symbols before global ones
+    Elf64_Sym sym;
+    memset(&sym, 0, sizeof(sym));
+    syms.push_back(sym);
+
+    sym.st_name = addString(strtab, module.fileName);
+    sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_FILE);
+    sym.st_shndx = SHN_ABS;
+    syms.push_back(sym);
+
+    for (unsigned int k = 0; k < symbols.size(); k++) {
+        if (!symbols[k].global)
+            order.push_back(k);
+    }
+    firstGlobal = syms.size() + order.size();
+    for (unsigned int k = 0; k < symbols.size(); k++) {
+        if (symbols[k].global)
+            order.push_back(k);
+    }
+
+    std::vector<int> symtabIndex(symbols.size());
+    for (int k : order) {
+        ElfSymbol &s = symbols[k];
+
+        memset(&sym, 0, sizeof(sym));
+        sym.st_name = addString(strtab, s.name);
+        sym.st_info = ELF64_ST_INFO(s.global ? STB_GLOBAL : STB_LOCAL, s.type);
+        sym.st_shndx = s.section == 0 ? SHN_UNDEF : s.section;
+        sym.st_value = s.value;
+        sym.st_size = s.size;
+
+        symtabIndex[k] = syms.size();
+        syms.push_back(sym);
+    }
+
+    auto toRela = [&](Relocation &r) -> Elf64_Rela {
+        Elf64_Rela rela;
+        rela.r_offset = r.offset;
+        rela.r_info = ELF64_R_INFO(symtabIndex[symbolIndex[r.sym]], r.type);
+        rela.r_addend = r.addend;
+        return rela;
+    };
+    for (auto &r : encoder.getRelocations()) {
+        relas.push_back(toRela(r));
+    }
+    for (auto &r : rodataRelocs) {
+        rodataRelas.push_back(toRela(r));
+    }
+
+    // section contents, then the section headers
+    memset(sh, 0, sizeof(sh));
+
+    align(16);
+    sh[SEC_TEXT].sh_offset = file.size();
+    sh[SEC_TEXT].sh_size = encoder.getCode().size();
+    append(encoder.getCode().data(), encoder.getCode().size());
+
+    align(8);
+    sh[SEC_DATA].sh_offset = file.size();
+    sh[SEC_DATA].sh_size = data.size();
+    append(data.data(), data.size());
+
+    sh[SEC_BSS].sh_offset = file.size();
+    sh[SEC_BSS].sh_size = bssSize;
+
+    align(8);
+    sh[SEC_RODATA].sh_offset = file.size();
+    sh[SEC_RODATA].sh_size = rodata.size();
+    append(rodata.data(), rodata.size());
+
+    align(8);
+    sh[SEC_RELA_TEXT].sh_offset = file.size();
+    sh[SEC_RELA_TEXT].sh_size = relas.size() * sizeof(Elf64_Rela);
+    append(relas.data(), relas.size() * sizeof(Elf64_Rela));
+
+    sh[SEC_RELA_RODATA].sh_offset = file.size();
+    sh[SEC_RELA_RODATA].sh_size = rodataRelas.size() * sizeof(Elf64_Rela);
+    append(rodataRelas.data(), rodataRelas.size() * sizeof(Elf64_Rela));
+
+    align(8);
+    sh[SEC_SYMTAB].sh_offset = file.size();
+    sh[SEC_SYMTAB].sh_size = syms.size() * sizeof(Elf64_Sym);
+    append(syms.data(), syms.size() * sizeof(Elf64_Sym));
+
+    sh[SEC_STRTAB].sh_offset = file.size();
+    sh[SEC_STRTAB].sh_size = strtab.size();
+    append(strtab.data(), strtab.size());
+
+    sh[SEC_TEXT].sh_name = addString(shstrtab, ".text");
+    sh[SEC_TEXT].sh_type = SHT_PROGBITS;
+    sh[SEC_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sh[SEC_TEXT].sh_addralign = 16;
+
+    sh[SEC_DATA].sh_name = addString(shstrtab, ".data");
+    sh[SEC_DATA].sh_type = SHT_PROGBITS;
+    sh[SEC_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sh[SEC_DATA].sh_addralign = 8;
+
+    sh[SEC_BSS].sh_name = addString(shstrtab, ".bss");
+    sh[SEC_BSS].sh_type = SHT_NOBITS;
+    sh[SEC_BSS].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sh[SEC_BSS].sh_addralign = 8;
+
+    sh[SEC_RODATA].sh_name = addString(shstrtab, ".rodata");
+    sh[SEC_RODATA].sh_type = SHT_PROGBITS;
+    sh[SEC_RODATA].sh_flags = SHF_ALLOC;
+    sh[SEC_RODATA].sh_addralign = 8;
+
+    sh[SEC_RELA_TEXT].sh_name = addString(shstrtab, ".rela.text");
+    sh[SEC_RELA_TEXT].sh_type = SHT_RELA;
+    sh[SEC_RELA_TEXT].sh_flags = SHF_INFO_LINK;
+    sh[SEC_RELA_TEXT].sh_link = SEC_SYMTAB;
+    sh[SEC_RELA_TEXT].sh_info = SEC_TEXT;
+    sh[SEC_RELA_TEXT].sh_addralign = 8;
+    sh[SEC_RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+
+    sh[SEC_RELA_RODATA].sh_name = addString(shstrtab, ".rela.rodata");
+    sh[SEC_RELA_RODATA].sh_type = SHT_RELA;
+    sh[SEC_RELA_RODATA].sh_flags = SHF_INFO_LINK;
+    sh[SEC_RELA_RODATA].sh_link = SEC_SYMTAB;
+    sh[SEC_RELA_RODATA].sh_info = SEC_RODATA;
+    sh[SEC_RELA_RODATA].sh_addralign = 8;
+    sh[SEC_RELA_RODATA].sh_entsize = sizeof(Elf64_Rela);
+
+    sh[SEC_SYMTAB].sh_name = addString(shstrtab, ".symtab");
+    sh[SEC_SYMTAB].sh_type = SHT_SYMTAB;
+    sh[SEC_SYMTAB].sh_link = SEC_STRTAB;
+    sh[SEC_SYMTAB].sh_info = firstGlobal;
+    sh[SEC_SYMTAB].sh_addralign = 8;
+    sh[SEC_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+
+    sh[SEC_STRTAB].sh_name = addString(shstrtab, ".strtab");
+    sh[SEC_STRTAB].sh_type = SHT_STRTAB;
+    sh[SEC_STRTAB].sh_addralign = 1;
+
+    // an empty .note.GNU-stack asks for a non executable stack
+    sh[SEC_NOTE_STACK].sh_name = addString(shstrtab, ".note.GNU-stack");
+    sh[SEC_NOTE_STACK].sh_type = SHT_PROGBITS;
+    sh[SEC_NOTE_STACK].sh_offset = file.size();
+    sh[SEC_NOTE_STACK].sh_addralign = 1;
+
+    sh[SEC_SHSTRTAB].sh_name = addString(shstrtab, ".shstrtab");
+    sh[SEC_SHSTRTAB].sh_type = SHT_STRTAB;
+    sh[SEC_SHSTRTAB].sh_offset = file.size();
+    sh[SEC_SHSTRTAB].sh_size = shstrtab.size();
+    sh[SEC_SHSTRTAB].sh_addralign = 1;
+    append(shstrtab.data(), shstrtab.size());
+
+    align(8);
+    Elf64_Off shoff = file.size();
+    append(sh, sizeof(sh));
+
+    // the header goes in the space left at the start
+    Elf64_Ehdr eh;
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    eh.e_type = ET_REL;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_shoff = shoff;
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = SEC_COUNT;
+    eh.e_shstrndx = SEC_SHSTRTAB;
+    file.replace(0, sizeof(eh), (const char *)&eh, sizeof(eh));
+
+    out.write(file.data(), file.size());
+}
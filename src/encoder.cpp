@@ -0,0 +1,590 @@
+/* File: encoder.cpp
+ * Authors: agent
+ * Description: x86-64 instruction encoder for the machine instructions
+ *              code generation selects
+ */
+
+#include <elf.h>
+#include "encoder.h"
+#include "exceptions.h"
+
+static bool fits8(long value) {
+    return value >= -128 && value <= 127;
+}
+
+static bool fits32(long value) {
+    return value >= -2147483648L && value <= 2147483647L;
+}
+
+// Hardware number of a register, byte registers share the number of the
+// register they are part of
+static int regNum(std::string reg) {
+    static const std::map<std::string, int> nums = {
+        {"rax", 0}, {"rcx", 1}, {"rdx", 2}, {"rbx", 3},
+        {"rsp", 4}, {"rbp", 5}, {"rsi", 6}, {"rdi", 7},
+        {"r8", 8}, {"r9", 9}, {"r10", 10}, {"r11", 11},
+        {"r12", 12}, {"r13", 13}, {"r14", 14}, {"r15", 15},
+        {"eax", 0}, {"ecx", 1}, {"edx", 2}, {"ebx", 3},
+        {"esi", 6}, {"edi", 7},
+        {"al", 0}, {"cl", 1}, {"dl", 2}, {"bl", 3}, {"sil", 6}, {"dil", 7},
+        {"xmm0", 0}, {"xmm1", 1}, {"xmm2", 2}, {"xmm3", 3},
+        {"xmm4", 4}, {"xmm5", 5}, {"xmm6", 6}, {"xmm7", 7},
+        {"xmm8", 8}, {"xmm9", 9}, {"xmm10", 10}, {"xmm11", 11},
+        {"xmm12", 12}, {"xmm13", 13}, {"xmm14", 14}, {"xmm15", 15},
+        {"ymm0", 0}, {"ymm1", 1}, {"ymm2", 2}, {"ymm3", 3},
+        {"ymm4", 4}, {"ymm5", 5}, {"ymm6", 6}, {"ymm7", 7},
+        {"ymm8", 8}, {"ymm9", 9}, {"ymm10", 10}, {"ymm11", 11},
+        {"ymm12", 12}, {"ymm13", 13}, {"ymm14", 14}, {"ymm15", 15}
+    };
+
+    // %r8d and %r8b are numbered like %r8
+    auto it = nums.find(reg);
+    if (it == nums.end() && reg[0] == 'r' && (reg.back() == 'd' || reg.back() == 'b'))
+        it = nums.find(reg.substr(0, reg.size() - 1));
+    if (it == nums.end())
+        throw CodeGenError("Cannot encode register '%" + reg + "'.");
+    return it->second;
+}
+
+// /digit of the immediate forms of the arithmetic group, the other forms'
+// opcodes are derived from it
+static int aluExt(MOp op) {
+    switch (op) {
+    case MOp::ADDQ: return 0;
+    case MOp::ORQ: return 1;
+    case MOp::ANDQ: return 4;
+    case MOp::SUBQ: return 5;
+    case MOp::XORQ: return 6;
+    case MOp::CMPQ: return 7;
+    default: return -1;
+    }
+}
+
+// Second opcode byte of the scalar float arithmetic after 0F
+static int sseOpcode(MOp op) {
+    switch (op) {
+    case MOp::ADDSS: return 0x58;
+    case MOp::MULSS: return 0x59;
+    case MOp::SUBSS: return 0x5C;
+    case MOp::DIVSS: return 0x5E;
+    default: return -1;
+    }
+}
+
+// Opcode after 66 0F of the packed integer instructions, the same for
+// their SSE2 and AVX2 forms
+static int packedOpcode(MOp op) {
+    switch (op) {
+    case MOp::PADDQ: case MOp::VPADDQ: return 0xD4;
+    case MOp::PSUBQ: case MOp::VPSUBQ: return 0xFB;
+    case MOp::PMULUDQ: case MOp::VPMULUDQ: return 0xF4;
+    case MOp::PAND: case MOp::VPAND: return 0xDB;
+    case MOp::POR: case MOp::VPOR: return 0xEB;
+    case MOp::PXOR: case MOp::VPXOR: return 0xEF;
+    case MOp::PCMPEQD: case MOp::VPCMPEQD: return 0x76;
+    case MOp::PUNPCKLQDQ: return 0x6C;
+    default: return -1;
+    }
+}
+
+// Base and index register numbers of a register or memory operand
+static void rmRegs(MOperand &o, int &base, int &index) {
+    base = 0;
+    index = 0;
+
+    if (o.isReg()) {
+        base = regNum(o.reg);
+    } else if (o.isMem()) {
+        if (o.reg != "rip")
+            base = regNum(o.reg);
+        if (!o.index.empty())
+            index = regNum(o.index);
+    } else {
+        throw CodeGenError("Cannot encode '" + o.toString() + "' as a register or memory operand.");
+    }
+}
+
+// Condition code of a conditional jump or set instruction
+static int condCode(MOp op) {
+    switch (op) {
+    case MOp::JB: case MOp::SETB: return 0x2;
+    case MOp::JAE: case MOp::SETAE: return 0x3;
+    case MOp::JBE: case MOp::SETBE: return 0x6;
+    case MOp::JA: case MOp::SETA: return 0x7;
+    case MOp::JP: case MOp::SETP: return 0xA;
+    case MOp::JNP: case MOp::SETNP: return 0xB;
+    case MOp::JE: case MOp::SETE: return 0x4;
+    case MOp::JNE: case MOp::SETNE: return 0x5;
+    case MOp::JL: case MOp::SETL: return 0xC;
+    case MOp::JGE: case MOp::SETGE: return 0xD;
+    case MOp::JLE: case MOp::SETLE: return 0xE;
+    case MOp::JG: case MOp::SETG: return 0xF;
+    default: return -1;
+    }
+}
+
+void X86Encoder::byte(int b) {
+    code.push_back((unsigned char)b);
+}
+
+void X86Encoder::imm8(long value) {
+    byte(value & 0xff);
+}
+
+void X86Encoder::imm32(long value) {
+    for (int k = 0; k < 4; k++)
+        byte((value >> (8 * k)) & 0xff);
+}
+
+void X86Encoder::imm64(long value) {
+    for (int k = 0; k < 8; k++)
+        byte((value >> (8 * k)) & 0xff);
+}
+
+void X86Encoder::rm(std::vector<int> opcode, int reg, MOperand &o, int immBytes, bool wide, bool rexByte) {
+    int base;
+    int index;
+
+    rmRegs(o, base, index);
+
+    int rex = 0x40 | (wide ? 8 : 0) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+    if (rex != 0x40 || rexByte)
+        byte(rex);
+    for (int b : opcode)
+        byte(b);
+
+    modrm(reg, o, immBytes);
+}
+
+// The three byte VEX prefix carries the REX bits inverted, the opcode map
+// (1 for 0F, 2 for 0F38, 3 for 0F3A), W, the extra source register vvvv
+// inverted, the vector length and the implied prefix (1 for 66). The two
+// byte one only has room for R, so it does for map 1 without W, X or B.
+void X86Encoder::vex(int map, bool wide, bool ymm, int opcode, int reg, int vvvv, MOperand &o, int immBytes) {
+    int base;
+    int index;
+
+    rmRegs(o, base, index);
+
+    int last = (~vvvv & 15) << 3 | (ymm ? 4 : 0) | 1;
+    if (map == 1 && !wide && index < 8 && base < 8) {
+        byte(0xC5);
+        byte((~reg & 8) << 4 | last);
+    } else {
+        byte(0xC4);
+        byte((~reg & 8) << 4 | (~index & 8) << 3 | (~base & 8) << 2 | map);
+        byte((wide ? 0x80 : 0) | last);
+    }
+    byte(opcode);
+
+    modrm(reg, o, immBytes);
+}
+
+void X86Encoder::modrm(int reg, MOperand &o, int immBytes) {
+    int base;
+    int index;
+
+    rmRegs(o, base, index);
+    reg &= 7;
+
+    if (o.isReg()) {
+        byte(0xC0 | reg << 3 | (base & 7));
+        return;
+    }
+
+    // disp32(%rip), the linker fills in the distance to the symbol from the
+    // end of the instruction
+    if (o.reg == "rip") {
+        byte(0x05 | reg << 3);
+        relocs.push_back(Relocation{code.size(), o.sym, R_X86_64_PC32, o.value - 4 - immBytes});
+        imm32(0);
+        return;
+    }
+
+    // %rbp and %r13 as a base always need a displacement
+    int mod = 0x80;
+    if (o.value == 0 && (base & 7) != 5)
+        mod = 0x00;
+    else if (fits8(o.value))
+        mod = 0x40;
+
+    // %rsp and %r12 as a base, or any index, need a SIB byte
+    if (!o.index.empty()) {
+        int scale = o.scale == 8 ? 3 : o.scale == 4 ? 2 : o.scale == 2 ? 1 : 0;
+        byte(mod | reg << 3 | 4);
+        byte(scale << 6 | (index & 7) << 3 | (base & 7));
+    } else if ((base & 7) == 4) {
+        byte(mod | reg << 3 | 4);
+        byte(0x24);
+    } else {
+        byte(mod | reg << 3 | (base & 7));
+    }
+
+    if (mod == 0x40)
+        imm8(o.value);
+    else if (mod == 0x80)
+        imm32(o.value);
+}
+
+// Jumps start out short and switch to a rel32 once a pass finds their
+// target out of reach
+void X86Encoder::jump(std::vector<int> shortOpcode, std::vector<int> longOpcode, std::string target) {
+    bool isShort = longJumps.count(current) == 0;
+
+    for (int b : isShort ? shortOpcode : longOpcode)
+        byte(b);
+    fixups.push_back(Fixup{code.size(), target, isShort, current});
+
+    if (isShort)
+        imm8(0);
+    else
+        imm32(0);
+}
+
+void X86Encoder::encode(MInstr &i) {
+    switch (i.op) {
+    case MOp::LABEL:
+        if (labels.count(i.ops[0].sym))
+            throw CodeGenError("Label '" + i.ops[0].sym + "' is defined twice.");
+        labels[i.ops[0].sym] = code.size();
+        return;
+    case MOp::GLOBL: case MOp::TYPE: case MOp::SIZE: case MOp::BALIGN:
+    case MOp::QUAD: case MOp::LONG: case MOp::BYTE: case MOp::ZERO:
+        // symbol information, the object writer reads it
+        return;
+    case MOp::MOVQ:
+    {
+        MOperand &src = i.ops[0];
+        MOperand &dst = i.ops[1];
+
+        if (src.isImm()) {
+            if (fits32(src.value)) {
+                rm({0xC7}, 0, dst, 4);
+                imm32(src.value);
+            } else if (dst.isReg()) {
+                // movabsq
+                int r = regNum(dst.reg);
+                byte(0x48 | (r >> 3));
+                byte(0xB8 + (r & 7));
+                imm64(src.value);
+            } else {
+                throw CodeGenError("Immediate " + std::to_string(src.value) + " does not fit a memory store.");
+            }
+        } else if (src.isReg()) {
+            rm({0x89}, regNum(src.reg), dst, 0);
+        } else {
+            rm({0x8B}, regNum(dst.reg), src, 0);
+        }
+        return;
+    }
+    case MOp::MOVZBQ:
+        rm({0x0F, 0xB6}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    case MOp::MOVSBQ:
+        rm({0x0F, 0xBE}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    case MOp::MOVSLQ:
+        rm({0x63}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    // %sil and %dil only exist with a REX prefix, without one they are
+    // %dh and %bh
+    case MOp::MOVL:
+    case MOp::MOVB:
+    {
+        bool isByte = i.op == MOp::MOVB;
+        MOperand &src = i.ops[0];
+
+        if (src.isImm()) {
+            rm({isByte ? 0xC6 : 0xC7}, 0, i.ops[1], isByte ? 1 : 4, false);
+            if (isByte)
+                imm8(src.value);
+            else
+                imm32(src.value);
+        } else {
+            rm({isByte ? 0x88 : 0x89}, regNum(src.reg), i.ops[1], 0, false,
+                src.reg == "sil" || src.reg == "dil");
+        }
+        return;
+    }
+    case MOp::LEAQ:
+        rm({0x8D}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    case MOp::PUSHQ:
+        if (i.ops[0].isReg()) {
+            int r = regNum(i.ops[0].reg);
+            if (r > 7)
+                byte(0x41);
+            byte(0x50 + (r & 7));
+        } else if (i.ops[0].isImm() && fits8(i.ops[0].value)) {
+            byte(0x6A);
+            imm8(i.ops[0].value);
+        } else if (i.ops[0].isImm()) {
+            byte(0x68);
+            imm32(i.ops[0].value);
+        } else {
+            rm({0xFF}, 6, i.ops[0], 0, false);
+        }
+        return;
+    case MOp::POPQ:
+        if (i.ops[0].isReg()) {
+            int r = regNum(i.ops[0].reg);
+            if (r > 7)
+                byte(0x41);
+            byte(0x58 + (r & 7));
+        } else {
+            rm({0x8F}, 0, i.ops[0], 0, false);
+        }
+        return;
+    case MOp::ADDQ: case MOp::SUBQ: case MOp::ANDQ:
+    case MOp::ORQ: case MOp::XORQ: case MOp::CMPQ:
+    {
+        int ext = aluExt(i.op);
+        MOperand &src = i.ops[0];
+        MOperand &dst = i.ops[1];
+
+        if (src.isImm() && fits8(src.value)) {
+            rm({0x83}, ext, dst, 1);
+            imm8(src.value);
+        } else if (src.isImm() && dst.isReg("rax")) {
+            // the short form for %rax without a ModRM byte
+            byte(0x48);
+            byte(ext * 8 + 5);
+            imm32(src.value);
+        } else if (src.isImm()) {
+            rm({0x81}, ext, dst, 4);
+            imm32(src.value);
+        } else if (src.isReg()) {
+            rm({ext * 8 + 1}, regNum(src.reg), dst, 0);
+        } else {
+            rm({ext * 8 + 3}, regNum(dst.reg), src, 0);
+        }
+        return;
+    }
+    case MOp::TESTQ:
+        // test is symmetric, the register goes in the reg field
+        if (i.ops[0].isReg())
+            rm({0x85}, regNum(i.ops[0].reg), i.ops[1], 0);
+        else
+            rm({0x85}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    case MOp::IMULQ:
+    {
+        MOperand &src = i.ops[0];
+        MOperand &dst = i.ops[1];
+        int r = regNum(dst.reg);
+
+        if (src.isImm() && fits8(src.value)) {
+            rm({0x6B}, r, dst, 1);
+            imm8(src.value);
+        } else if (src.isImm()) {
+            rm({0x69}, r, dst, 4);
+            imm32(src.value);
+        } else {
+            rm({0x0F, 0xAF}, r, src, 0);
+        }
+        return;
+    }
+    case MOp::IDIVQ:
+        rm({0xF7}, 7, i.ops[0], 0);
+        return;
+    case MOp::NEGQ:
+        rm({0xF7}, 3, i.ops[0], 0);
+        return;
+    case MOp::NOTQ:
+        rm({0xF7}, 2, i.ops[0], 0);
+        return;
+    case MOp::CQTO:
+        byte(0x48);
+        byte(0x99);
+        return;
+    case MOp::CLTD:
+        byte(0x99);
+        return;
+    case MOp::IDIVL:
+        rm({0xF7}, 7, i.ops[0], 0, false);
+        return;
+    case MOp::SHLQ:
+        if (i.ops[0].value == 1) {
+            rm({0xD1}, 4, i.ops[1], 0);
+        } else {
+            rm({0xC1}, 4, i.ops[1], 1);
+            imm8(i.ops[0].value);
+        }
+        return;
+    case MOp::SETE: case MOp::SETNE: case MOp::SETL:
+    case MOp::SETLE: case MOp::SETG: case MOp::SETGE:
+    case MOp::SETA: case MOp::SETAE: case MOp::SETB: case MOp::SETBE:
+    case MOp::SETP: case MOp::SETNP:
+        rm({0x0F, 0x90 + condCode(i.op)}, 0, i.ops[0], 0, false);
+        return;
+    // the F3 prefix of the scalar instructions goes before the REX byte
+    case MOp::MOVSS:
+        byte(0xF3);
+        if (i.ops[1].isReg())
+            rm({0x0F, 0x10}, regNum(i.ops[1].reg), i.ops[0], 0, false);
+        else
+            rm({0x0F, 0x11}, regNum(i.ops[0].reg), i.ops[1], 0, false);
+        return;
+    case MOp::ADDSS: case MOp::SUBSS: case MOp::MULSS: case MOp::DIVSS:
+        byte(0xF3);
+        rm({0x0F, sseOpcode(i.op)}, regNum(i.ops[1].reg), i.ops[0], 0, false);
+        return;
+    case MOp::XORPS:
+        rm({0x0F, 0x57}, regNum(i.ops[1].reg), i.ops[0], 0, false);
+        return;
+    case MOp::UCOMISS:
+        rm({0x0F, 0x2E}, regNum(i.ops[1].reg), i.ops[0], 0, false);
+        return;
+    case MOp::CVTSI2SSQ:
+        byte(0xF3);
+        rm({0x0F, 0x2A}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    case MOp::CVTTSS2SIQ:
+        byte(0xF3);
+        rm({0x0F, 0x2C}, regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    // packed integers, the 66 prefix also goes before the REX byte
+    case MOp::MOVQX:
+        byte(0x66);
+        if (i.ops[1].reg.compare(0, 3, "xmm") == 0)
+            rm({0x0F, 0x6E}, regNum(i.ops[1].reg), i.ops[0], 0);
+        else
+            rm({0x0F, 0x7E}, regNum(i.ops[0].reg), i.ops[1], 0);
+        return;
+    case MOp::MOVDQA:
+    case MOp::MOVDQU:
+        byte(i.op == MOp::MOVDQA ? 0x66 : 0xF3);
+        if (i.ops[1].isReg())
+            rm({0x0F, 0x6F}, regNum(i.ops[1].reg), i.ops[0], 0, false);
+        else
+            rm({0x0F, 0x7F}, regNum(i.ops[0].reg), i.ops[1], 0, false);
+        return;
+    case MOp::PADDQ: case MOp::PSUBQ: case MOp::PMULUDQ: case MOp::PAND:
+    case MOp::POR: case MOp::PXOR: case MOp::PCMPEQD: case MOp::PUNPCKLQDQ:
+        byte(0x66);
+        rm({0x0F, packedOpcode(i.op)}, regNum(i.ops[1].reg), i.ops[0], 0, false);
+        return;
+    case MOp::PSRLQ:
+    case MOp::PSLLQ:
+        byte(0x66);
+        rm({0x0F, 0x73}, i.op == MOp::PSRLQ ? 2 : 6, i.ops[1], 1, false);
+        imm8(i.ops[0].value);
+        return;
+    case MOp::PSHUFD:
+        byte(0x66);
+        rm({0x0F, 0x70}, regNum(i.ops[2].reg), i.ops[1], 1, false);
+        imm8(i.ops[0].value);
+        return;
+    case MOp::VPADDQ: case MOp::VPSUBQ: case MOp::VPMULUDQ: case MOp::VPAND:
+    case MOp::VPOR: case MOp::VPXOR: case MOp::VPCMPEQD:
+        vex(1, false, true, packedOpcode(i.op), regNum(i.ops[2].reg), regNum(i.ops[1].reg), i.ops[0], 0);
+        return;
+    case MOp::VPSRLQ:
+    case MOp::VPSLLQ:
+        vex(1, false, true, 0x73, i.op == MOp::VPSRLQ ? 2 : 6, regNum(i.ops[2].reg), i.ops[1], 1);
+        imm8(i.ops[0].value);
+        return;
+    case MOp::VMOVQ:
+        vex(1, true, false, 0x6E, regNum(i.ops[1].reg), 0, i.ops[0], 0);
+        return;
+    case MOp::VPBROADCASTQ:
+        vex(2, false, true, 0x59, regNum(i.ops[1].reg), 0, i.ops[0], 0);
+        return;
+    case MOp::VEXTRACTI128:
+        vex(3, false, true, 0x39, regNum(i.ops[1].reg), 0, i.ops[2], 1);
+        imm8(i.ops[0].value);
+        return;
+    case MOp::VPEXTRQ:
+        vex(3, true, false, 0x16, regNum(i.ops[1].reg), 0, i.ops[2], 1);
+        imm8(i.ops[0].value);
+        return;
+    case MOp::VZEROUPPER:
+        byte(0xC5);
+        byte(0xF8);
+        byte(0x77);
+        return;
+    case MOp::JMP:
+        jump({0xEB}, {0xE9}, i.ops[0].sym);
+        return;
+    case MOp::JE: case MOp::JNE: case MOp::JL:
+    case MOp::JLE: case MOp::JG: case MOp::JGE:
+    case MOp::JA: case MOp::JAE: case MOp::JB: case MOp::JBE:
+    case MOp::JP: case MOp::JNP:
+        jump({0x70 + condCode(i.op)}, {0x0F, 0x80 + condCode(i.op)}, i.ops[0].sym);
+        return;
+    case MOp::JMPQ:
+        rm({0xFF}, 4, i.ops[0], 0, false);
+        return;
+    case MOp::CALLQ:
+        byte(0xE8);
+        relocs.push_back(Relocation{code.size(), i.ops[0].sym, R_X86_64_PLT32, -4});
+        imm32(0);
+        return;
+    case MOp::RETQ:
+        byte(0xC3);
+        return;
+    }
+
+    throw CodeGenError("Cannot encode '" + i.toString() + "'.");
+}
+
+void X86Encoder::encode(std::vector<MInstr> &text) {
+    // a long jump only makes the code longer, so the set of long jumps
+    // grows until every short one reaches its target
+    bool grew = true;
+    while (grew) {
+        code.clear();
+        labels.clear();
+        fixups.clear();
+        relocs.clear();
+
+        for (current = 0; current < text.size(); current++) {
+            encode(text[current]);
+        }
+
+        grew = false;
+        for (auto &f : fixups) {
+            if (!f.isShort)
+                continue;
+
+            auto it = labels.find(f.label);
+            if (it == labels.end() || !fits8((long)it->second - (long)(f.offset + 1))) {
+                longJumps.insert(f.index);
+                grew = true;
+            }
+        }
+    }
+
+    // a jump to a label outside this section, another function's for
+    // instance, is left to the linker
+    for (auto &f : fixups) {
+        auto it = labels.find(f.label);
+
+        if (it == labels.end()) {
+            relocs.push_back(Relocation{f.offset, f.label, R_X86_64_PLT32, -4});
+            continue;
+        }
+
+        if (f.isShort) {
+            code[f.offset] = ((long)it->second - (long)(f.offset + 1)) & 0xff;
+            continue;
+        }
+
+        long rel = (long)it->second - (long)(f.offset + 4);
+        for (int k = 0; k < 4; k++)
+            code[f.offset + k] = (rel >> (8 * k)) & 0xff;
+    }
+    fixups.clear();
+}
+
+std::vector<unsigned char> &X86Encoder::getCode() {
+    return code;
+}
+
+std::map<std::string, unsigned long> &X86Encoder::getLabels() {
+    return labels;
+}
+
+std::vector<Relocation> &X86Encoder::getRelocations() {
+    return relocs;
+}
@@ -113,3 +113,17 @@ void CodeGenError::printException() {
     std::cout << " Code Gen Error: " << err << std::endl;
 }
 // ----------------------------------------------------
+
+// Runtime Exception
+
+// Used when the interpreter meets something the program cannot go on from,
+// like a division by zero
+RuntimeError::RuntimeError(std::string err) {
+    this->err = err;
+}
+
+// Override the printException method
+void RuntimeError::printException() {
+    std::cout << " Runtime Error: " << err << std::endl;
+}
+// ----------------------------------------------------
@@ -59,6 +59,7 @@ UnaryExp::~UnaryExp() {
 PrimaryExp::PrimaryExp(Token value):
     value(value) {
     this->value = Token(value);
+    this->scope = -1;
 }
 
 void PrimaryExp::accept(ExpressionVisitor *visitor) {
@@ -106,6 +107,7 @@ Assignment::Assignment(Token name, Token op, Expression *exp):
     name(name), op(op)
 {
     this->exp = exp;
+    this->scope = -1;
 }
 
 void Assignment::accept(ExpressionVisitor *visitor) {
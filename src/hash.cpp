@@ -0,0 +1,28 @@
+/* File: hash.cpp
+ * Authors: agent
+ * Description: 64 bit FNV-1a hashing
+ */
+
+#include <cstdio>
+#include "hash.h"
+
+const unsigned long FNV_OFFSET = 14695981039346656037UL;
+static const unsigned long FNV_PRIME = 1099511628211UL;
+
+unsigned long hashBytes(unsigned long h, const void *bytes, unsigned long size) {
+    for (unsigned long k = 0; k < size; k++) {
+        h ^= ((const unsigned char *)bytes)[k];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+unsigned long hashString(unsigned long h, const std::string &s) {
+    return hashBytes(h, s.c_str(), s.size() + 1);
+}
+
+std::string string_of_hash(unsigned long h) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016lx", h);
+    return buf;
+}
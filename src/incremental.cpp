@@ -0,0 +1,354 @@
+/* File: incremental.cpp
+ * Authors: agent
+ * Description: Incremental compilation keyed on the tokens of top-level
+ *              declarations
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include "incremental.h"
+#include "hash.h"
+
+// Bumped whenever the state file or the code it holds changes meaning
+#define INCREMENTAL_VERSION 5
+
+static unsigned long hashTokens(unsigned long h, std::vector<Token> &tokens, unsigned int begin, unsigned int end) {
+    for (unsigned int k = begin; k < end; k++) {
+        unsigned char type = tokens[k].getType();
+        h = hashBytes(h, &type, 1);
+        h = hashString(h, tokens[k].getLexeme());
+    }
+    return h;
+}
+
+// Index just past the token closing the bracket at k, 0 if the list ends first
+static unsigned int skipBrackets(std::vector<Token> &tokens, unsigned int k, TokenType open, TokenType close) {
+    int depth = 0;
+
+    for (; tokens[k].getType() != EOFILE; k++) {
+        if (tokens[k].getType() == open) {
+            depth++;
+        } else if (tokens[k].getType() == close && --depth == 0) {
+            return k + 1;
+        }
+    }
+
+    return 0;
+}
+
+// Jump, local, jump table and float constant labels are numbered per
+// build, so every function's own labels get its name appended before its
+// code is shared between builds
+static void localizeLabels(std::string fun, FunctionCode &code) {
+    std::set<std::string> local;
+
+    for (auto &i : code.text) {
+        if (i.isLabel() && i.ops[0].sym != fun)
+            local.insert(i.ops[0].sym);
+    }
+    for (auto &i : code.rodata) {
+        if (i.isLabel())
+            local.insert(i.ops[0].sym);
+    }
+
+    for (auto &i : code.text) {
+        for (auto &o : i.ops) {
+            if ((o.type == M_SYM || o.isMem()) && local.count(o.sym))
+                o.sym += "." + fun;
+        }
+    }
+    for (auto &i : code.rodata) {
+        for (auto &o : i.ops) {
+            if (local.count(o.sym))
+                o.sym += "." + fun;
+        }
+    }
+}
+
+// State file entries, one instruction per line, empty strings as "-"
+static std::string field(std::string s) {
+    return s.empty() ? "-" : s;
+}
+
+static std::string unfield(std::string s) {
+    return s == "-" ? "" : s;
+}
+
+static void writeInstr(std::ostream &out, MInstr &i) {
+    out << (int)i.op << " " << i.ops.size();
+    for (auto &o : i.ops) {
+        out << " " << o.type << " " << o.value << " " << o.scale << " " << field(o.reg)
+            << " " << field(o.index) << " " << field(o.sym);
+    }
+    out << "\n";
+}
+
+static bool readInstr(std::istream &in, MInstr &i) {
+    std::string line;
+    int op;
+    unsigned int n;
+
+    if (!std::getline(in, line))
+        return false;
+
+    std::istringstream fields(line);
+    if (!(fields >> op >> n) || op < 0 || op > (int)MOp::RETQ || n > 3)
+        return false;
+
+    i = MInstr((MOp)op);
+    for (unsigned int k = 0; k < n; k++) {
+        MOperand o;
+        int type;
+        std::string reg, index, sym;
+
+        if (!(fields >> type >> o.value >> o.scale >> reg >> index >> sym) || type < M_NONE || type > M_SYM)
+            return false;
+
+        o.type = (MOperandType)type;
+        o.reg = unfield(reg);
+        o.index = unfield(index);
+        o.sym = unfield(sym);
+        i.ops.push_back(o);
+    }
+
+    return true;
+}
+
+Incremental::Incremental(std::string stateFile, int optLevel, std::string target):
+    stateFile(stateFile), optLevel(optLevel), target(target)
+{
+    reused = 0;
+    recompiled = 0;
+}
+
+// A missing or unreadable state file is an empty one
+void Incremental::load() {
+    std::ifstream in(stateFile);
+    std::string magic;
+    int version;
+
+    cache.clear();
+    if (!(in >> magic >> version) || magic != "coolcompiler-incremental" || version != INCREMENTAL_VERSION)
+        return;
+
+    std::string kind;
+    unsigned long key;
+    unsigned int count;
+    unsigned int rodataCount;
+    while (in >> kind >> std::hex >> key >> std::dec >> count >> rodataCount) {
+        FunctionCode &code = cache[key];
+
+        in.ignore(1);
+        for (unsigned int k = 0; k < count + rodataCount; k++) {
+            std::vector<MInstr> &section = k < count ? code.text : code.rodata;
+
+            section.push_back(MInstr(MOp::RETQ));
+            if (!readInstr(in, section.back())) {
+                cache.clear();
+                return;
+            }
+        }
+    }
+}
+
+bool Incremental::split(std::vector<Token> &tokens) {
+    std::set<std::string> defined;
+    unsigned int k = 0;
+
+    decls.clear();
+    while (tokens[k].getType() != EOFILE) {
+        TopLevelDecl d;
+        d.begin = k;
+
+        // type name ...
+        if (k + 2 >= tokens.size() || tokens[k + 1].getType() != IDENTIFIER)
+            return false;
+        d.name = tokens[k + 1].getLexeme();
+
+        if (tokens[k + 2].getType() == LEFT_PAREN) {
+            k = skipBrackets(tokens, k + 2, LEFT_PAREN, RIGHT_PAREN);
+            if (k == 0)
+                return false;
+            d.sigEnd = k;
+
+            if (tokens[k].getType() == SEMICOLON) {
+                d.kind = D_PROTO;
+                k++;
+            } else if (tokens[k].getType() == LEFT_BRACE) {
+                d.kind = D_FUNC;
+                k = skipBrackets(tokens, k, LEFT_BRACE, RIGHT_BRACE);
+
+                // a second definition is an error the full compile reports
+                if (k == 0 || !defined.insert(d.name).second)
+                    return false;
+            } else {
+                return false;
+            }
+        } else {
+            d.kind = D_VAR;
+            d.sigEnd = k + 2;
+            while (tokens[k].getType() != SEMICOLON) {
+                if (tokens[k].getType() == EOFILE)
+                    return false;
+                k++;
+            }
+            k++;
+        }
+
+        d.end = k;
+        decls.push_back(d);
+    }
+
+    computeKeys(tokens);
+    return true;
+}
+
+void Incremental::computeKeys(std::vector<Token> &tokens) {
+    // signature of every top-level name, a global's type and name or a
+    // function's return type, name and parameters
+    std::map<std::string, unsigned long> signatures;
+
+    for (auto &d : decls) {
+        auto it = signatures.find(d.name);
+        unsigned long h = it == signatures.end() ? FNV_OFFSET : it->second;
+
+        signatures[d.name] = hashTokens(h, tokens, d.begin, d.sigEnd);
+    }
+
+    unsigned long seed = hashString(FNV_OFFSET, "coolcompiler " + std::to_string(INCREMENTAL_VERSION) +
+        " -O" + std::to_string(optLevel) + " -m" + target);
+
+    for (auto &d : decls) {
+        if (d.kind != D_FUNC)
+            continue;
+
+        std::set<std::string> used;
+        for (unsigned int k = d.sigEnd; k < d.end; k++) {
+            if (tokens[k].getType() == IDENTIFIER && signatures.count(tokens[k].getLexeme()))
+                used.insert(tokens[k].getLexeme());
+        }
+
+        d.key = hashTokens(seed, tokens, d.begin, d.end);
+        for (auto &name : used) {
+            d.key = hashString(d.key, name);
+            d.key = hashBytes(d.key, &signatures[name], sizeof(unsigned long));
+        }
+    }
+}
+
+std::vector<Token> Incremental::reduce(std::vector<Token> &tokens) {
+    std::vector<Token> program;
+    // names a prototype in the program already declares
+    std::set<std::string> declared;
+
+    load();
+
+    for (auto &d : decls) {
+        if (d.kind != D_FUNC || cache.count(d.key) == 0) {
+            program.insert(program.end(), tokens.begin() + d.begin, tokens.begin() + d.end);
+
+            if (d.kind == D_PROTO)
+                declared.insert(d.name);
+            else if (d.kind == D_FUNC)
+                recompiled++;
+            continue;
+        }
+
+        // the symbol table still needs the signature of a reused function
+        if (declared.insert(d.name).second) {
+            program.insert(program.end(), tokens.begin() + d.begin, tokens.begin() + d.sigEnd);
+            program.push_back(Token(SEMICOLON, ";", tokens[d.sigEnd - 1].getLine()));
+        }
+        reused++;
+    }
+    program.push_back(tokens.back());
+
+    return program;
+}
+
+void Incremental::merge(MModule &module) {
+    // the text section of the compiled program, split at each function's
+    // .globl
+    std::map<std::string, FunctionCode> compiled;
+    std::string fun;
+
+    for (auto &i : module.text) {
+        if (i.op == MOp::GLOBL)
+            fun = i.ops[0].sym;
+        compiled[fun].text.push_back(i);
+    }
+
+    // the jump tables and float constants, each starts with its label, go
+    // with every function that addresses them
+    std::map<std::string, std::vector<MInstr>> tables;
+    std::string table;
+    for (auto &i : module.rodata) {
+        if (i.isLabel())
+            table = i.ops[0].sym;
+        tables[table].push_back(i);
+    }
+    for (auto &f : compiled) {
+        std::set<std::string> used;
+
+        for (auto &i : f.second.text) {
+            for (auto &o : i.ops) {
+                if (!o.isMem() || !tables.count(o.sym) || !used.insert(o.sym).second)
+                    continue;
+
+                std::vector<MInstr> &t = tables[o.sym];
+                f.second.rodata.insert(f.second.rodata.end(), t.begin(), t.end());
+            }
+        }
+        localizeLabels(f.first, f.second);
+    }
+
+    module.text = compiled[""].text;
+    module.rodata.clear();
+    current.clear();
+    for (auto &d : decls) {
+        if (d.kind != D_FUNC)
+            continue;
+
+        auto it = compiled.find(d.name);
+        FunctionCode &code = it != compiled.end() ? it->second : cache[d.key];
+
+        current[d.key] = code;
+        module.text.insert(module.text.end(), code.text.begin(), code.text.end());
+        module.rodata.insert(module.rodata.end(), code.rodata.begin(), code.rodata.end());
+    }
+}
+
+// Written next to the state file and renamed over it, so an interrupted
+// build leaves the previous state intact
+void Incremental::save() {
+    std::string tmp = stateFile + ".tmp";
+    std::ofstream out(tmp);
+
+    out << "coolcompiler-incremental " << INCREMENTAL_VERSION << "\n";
+    for (auto &f : current) {
+        out << "function " << std::hex << f.first << std::dec << " " << f.second.text.size() <<
+            " " << f.second.rodata.size() << "\n";
+        for (auto &i : f.second.text) {
+            writeInstr(out, i);
+        }
+        for (auto &i : f.second.rodata) {
+            writeInstr(out, i);
+        }
+    }
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), stateFile.c_str()) != 0) {
+        std::cerr << "Could not write incremental state '" << stateFile << "'" << std::endl;
+        std::remove(tmp.c_str());
+    }
+}
+
+void Incremental::printStats() {
+    std::cout << "======================\nIncremental Statistics\n======================\n\n";
+    std::cout << std::left << std::setw(28) << "functions reused" << reused << std::endl;
+    std::cout << std::left << std::setw(28) << "functions recompiled" << recompiled << std::endl;
+}
@@ -0,0 +1,674 @@
+/* File: interp.cpp
+ * Authors: agent
+ * Description: IR interpreter, see interp.h
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <iomanip>
+#include <iostream>
+
+#include <dlfcn.h>
+#include "interp.h"
+
+Interpreter::Interpreter(std::list<Instruction *> IR) {
+    this->IR = IR;
+
+    calls = 0;
+    seconds = 0;
+    stackSlots = 0;
+    depthLimit = 0;
+}
+
+// ints and chars are cut down like the stores of the generated code do
+Interpreter::Width Interpreter::widthOf(SymbolType sym) {
+    switch (sym) {
+    case SYM_CHAR:
+        return Width::BYTE;
+    case SYM_INT:
+        return Width::LONG;
+    default:
+        return Width::WIDE;
+    }
+}
+
+bool Interpreter::isGlobal(Scope &s, Container c) {
+    return c.isVariable() && s.vars.count(c.getStringValue()) == 0 &&
+        globalSlots.count(c.getStringValue()) > 0;
+}
+
+int Interpreter::slot(Scope &s, Container c) {
+    Function &f = *s.fun;
+
+    switch (c.type) {
+    case REG:
+        if (s.regs.count(c.getIntValue()) == 0)
+            s.regs[c.getIntValue()] = f.slots++;
+        return s.regs[c.getIntValue()];
+    case STR:
+        if (s.vars.count(c.getStringValue()) == 0)
+            s.vars[c.getStringValue()] = f.slots++;
+        return s.vars[c.getStringValue()];
+    case IMM:
+    {
+        // a constant is put in the frame when the call starts
+        std::map<int, int> &pool = c.isFloat() ? s.floats : s.ints;
+        int key = c.getIntImmediate();
+
+        if (pool.count(key) == 0) {
+            Value v;
+            v.i = 0;
+            if (c.isFloat())
+                v.f = c.getFloatImmediate();
+            else
+                v.i = c.getIntImmediate();
+
+            pool[key] = f.slots;
+            f.constants.resize(f.slots + 1);
+            f.constants[f.slots++] = v;
+        }
+        return pool[key];
+    }
+    default:
+        throw RuntimeError("Unhandled operand '" + c.toString() + "'.");
+    }
+}
+
+int Interpreter::operand(Scope &s, Container c) {
+    if (isGlobal(s, c)) {
+        int t = s.fun->slots++;
+        emit(Opcode::GLOAD, t, globalSlots[c.getStringValue()], 0, 0);
+        return t;
+    }
+    return slot(s, c);
+}
+
+int Interpreter::target(Scope &s, Container dest) {
+    if (dest.isRegister())
+        return slot(s, dest);
+    if (dest.isVariable() && !isGlobal(s, dest) && s.widths[dest.getStringValue()] == Width::WIDE)
+        return slot(s, dest);
+    return s.fun->slots++;
+}
+
+void Interpreter::store(Scope &s, Container dest, int src) {
+    if (isGlobal(s, dest)) {
+        std::string name = dest.getStringValue();
+        Width w = globalWidths[name];
+        Opcode op = w == Width::LONG ? Opcode::GSTOREL : w == Width::BYTE ? Opcode::GSTOREB : Opcode::GSTORE;
+
+        emit(op, globalSlots[name], src, 0, 0);
+        return;
+    }
+
+    int d = slot(s, dest);
+    Width w = dest.isVariable() ? s.widths[dest.getStringValue()] : Width::WIDE;
+
+    if (w == Width::LONG)
+        emit(Opcode::MOVL, d, src, 0, 0);
+    else if (w == Width::BYTE)
+        emit(Opcode::MOVB, d, src, 0, 0);
+    else if (d != src)
+        emit(Opcode::MOV, d, src, 0, 0);
+}
+
+// functions the program only declares are looked up in the C library
+int Interpreter::external(std::string name) {
+    if (byExternal.count(name) == 0) {
+        void *address = dlsym(RTLD_DEFAULT, name.c_str());
+        if (address == nullptr)
+            throw RuntimeError("Undefined function '" + name + "'.");
+
+        byExternal[name] = externals.size();
+        externals.push_back(External{name, address});
+    }
+    return byExternal[name];
+}
+
+void Interpreter::emit(Opcode op, int dst, int a, int b, int c) {
+    code.push_back(Code{nullptr, op, dst, a, b, c});
+}
+
+void Interpreter::translate(Scope &s, Instruction *i) {
+    switch (i->getOp()) {
+    case DEF:
+        // the parameters come right after the constants
+        for (auto &p : *((DefInstr *)i)->getParams()) {
+            s.vars[p.getStringValue()] = s.fun->slots++;
+            s.widths[p.getStringValue()] = widthOf(p.sym);
+        }
+        break;
+    case DECL:
+    {
+        // top level declarations are the globals
+        Container c = ((DeclInstr *)i)->getContainer();
+        if (s.fun != &functions[0] && s.vars.count(c.getStringValue()) == 0) {
+            s.vars[c.getStringValue()] = s.fun->slots++;
+            s.widths[c.getStringValue()] = widthOf(c.sym);
+        }
+        break;
+    }
+    case LABEL:
+        s.labels[((LableInstr *)i)->getLabelName()] = code.size();
+        break;
+    case JUMP:
+        s.jumps.push_back(std::make_pair(code.size(), ((JumpInstr *)i)->getLabelName()));
+        emit(Opcode::JUMP, 0, 0, 0, 0);
+        break;
+    case BRANCH:
+    {
+        // falls through on 1 like the generated code
+        BranchInstr *br = (BranchInstr *)i;
+        int cond = operand(s, br->getContainer());
+
+        s.jumps.push_back(std::make_pair(code.size(), br->getLabelTwo() ? *br->getLabelTwo() : br->getLabelOne()));
+        emit(Opcode::BRANCH, 0, cond, 0, 0);
+        break;
+    }
+    case JUMP_TABLE:
+    {
+        SwitchInstr *si = (SwitchInstr *)i;
+        int value = operand(s, si->getContainer());
+        int first = tables.size();
+
+        for (auto &t : si->getTargets()) {
+            s.cases.push_back(std::make_pair(tables.size(), t));
+            tables.push_back(0);
+        }
+        s.cases.push_back(std::make_pair(tables.size(), si->getDefault()));
+        tables.push_back(0);
+
+        emit(Opcode::SWITCH, si->getLow(), value, first, si->getTargets().size());
+        break;
+    }
+    case RET:
+    {
+        Container c = ((ReturnInstr *)i)->getContainer();
+        if (c.type == NIL)
+            emit(Opcode::RETV, 0, 0, 0, 0);
+        else
+            emit(Opcode::RET, 0, operand(s, c), 0, 0);
+        break;
+    }
+    case END:
+        emit(Opcode::RETV, 0, 0, 0, 0);
+        break;
+    case CONST_LET:
+    {
+        LetInstr *li = (LetInstr *)i;
+        store(s, li->getContainer(), operand(s, li->getOp1()));
+        break;
+    }
+    case UNARY_LET:
+    {
+        LetInstr *li = (LetInstr *)i;
+        bool isFloat = li->getOp1().isFloat();
+        Opcode op;
+
+        switch (li->getOperation()) {
+        case IrOp::ITOF: op = Opcode::ITOF; break;
+        case IrOp::FTOI: op = Opcode::FTOI; break;
+        case IrOp::SUB: op = isFloat ? Opcode::FNEG : Opcode::NEG; break;
+        case IrOp::BFLIP: op = Opcode::BNOT; break;
+        case IrOp::NOT: op = Opcode::LNOT; break;
+        case IrOp::ADD:
+            store(s, li->getContainer(), operand(s, li->getOp1()));
+            return;
+        default:
+            throw RuntimeError("Unhandled unary operation '" +
+                string_of_irop(li->getOperation()) + "'.");
+        }
+
+        int a = operand(s, li->getOp1());
+        int d = target(s, li->getContainer());
+        emit(op, d, a, 0, 0);
+        store(s, li->getContainer(), d);
+        break;
+    }
+    case BINARY_LET:
+    {
+        LetInstr *li = (LetInstr *)i;
+        bool isFloat = li->getOp1().isFloat() || li->getOp2().isFloat();
+        Opcode op;
+
+        switch (li->getOperation()) {
+        case IrOp::ADD: op = isFloat ? Opcode::FADD : Opcode::ADD; break;
+        case IrOp::SUB: op = isFloat ? Opcode::FSUB : Opcode::SUB; break;
+        case IrOp::MUL: op = isFloat ? Opcode::FMUL : Opcode::MUL; break;
+        case IrOp::DIV: op = isFloat ? Opcode::FDIV : Opcode::DIV; break;
+        case IrOp::LESS: op = isFloat ? Opcode::FLT : Opcode::LT; break;
+        case IrOp::GREATER: op = isFloat ? Opcode::FGT : Opcode::GT; break;
+        case IrOp::LESS_EQ: op = isFloat ? Opcode::FLE : Opcode::LE; break;
+        case IrOp::GREATER_EQ: op = isFloat ? Opcode::FGE : Opcode::GE; break;
+        case IrOp::EQUAL_EQUAL: op = isFloat ? Opcode::FEQ : Opcode::EQ; break;
+        case IrOp::NOT_EQ: op = isFloat ? Opcode::FNE : Opcode::NE; break;
+        case IrOp::MOD: op = Opcode::MOD; break;
+        case IrOp::AND: op = Opcode::AND; break;
+        case IrOp::OR: op = Opcode::OR; break;
+        case IrOp::XOR: op = Opcode::XOR; break;
+        case IrOp::AND_AND: op = Opcode::LAND; break;
+        case IrOp::OR_OR: op = Opcode::LOR; break;
+        default:
+            throw RuntimeError("Unhandled operation '" +
+                string_of_irop(li->getOperation()) + "'.");
+        }
+
+        int a = operand(s, li->getOp1());
+        int b = operand(s, li->getOp2());
+        int d = target(s, li->getContainer());
+        emit(op, d, a, b, 0);
+        store(s, li->getContainer(), d);
+        break;
+    }
+    case CALL:
+    {
+        CallInstr *ci = (CallInstr *)i;
+        std::string name = ci->getName();
+        Container ret = ci->getContainer();
+        std::vector<int> slots;
+
+        for (auto &arg : *ci->getArgs())
+            slots.push_back(operand(s, arg));
+
+        int first = args.size();
+        args.push_back(slots.size());
+        args.insert(args.end(), slots.begin(), slots.end());
+
+        // only the low bytes of an int or char are returned
+        int d = ci->getFlag() ? target(s, ret) : -1;
+        Width w = !ci->getFlag() || ret.isFloat() ? Width::WIDE : ret.sym == SYM_CHAR ? Width::BYTE : Width::LONG;
+
+        if (byName.count(name)) {
+            if (functions[byName[name]].params.size() != slots.size())
+                throw RuntimeError("Wrong number of arguments to '" + name + "'.");
+            emit(Opcode::CALL, d, byName[name], first, (int)w);
+        } else {
+            // C library functions get their arguments in the int registers
+            bool floats = ci->getFlag() && ret.isFloat();
+            for (auto &arg : *ci->getArgs())
+                floats = floats || arg.isFloat();
+
+            if (floats || slots.size() > 6)
+                throw RuntimeError("Cannot call '" + name + "', only up to six int arguments are passed outside of the program.");
+            emit(Opcode::CALLX, d, external(name), first, (int)w);
+        }
+
+        if (d >= 0)
+            store(s, ret, d);
+        break;
+    }
+    default:
+        throw RuntimeError("Unhandled instruction '" + i->toString() + "'.");
+    }
+}
+
+void Interpreter::translate(Function &f, std::vector<Instruction *> &body) {
+    Scope s;
+    s.fun = &f;
+    f.entry = code.size();
+    f.slots = 0;
+
+    // the constants go first so a call copies them in at once
+    for (auto *i : body) {
+        for (auto &c : containers_of_instruction(i)) {
+            if (c.isImmediate())
+                slot(s, c);
+        }
+    }
+
+    for (auto *i : body)
+        translate(s, i);
+
+    // the top level code has no funcend
+    if (body.empty() || body.back()->getOp() != END)
+        emit(Opcode::RETV, 0, 0, 0, 0);
+
+    for (auto &j : s.jumps) {
+        if (s.labels.count(j.second) == 0)
+            throw RuntimeError("Undefined label '" + j.second + "' in '" + f.name + "'.");
+        code[j.first].b = s.labels[j.second];
+    }
+    for (auto &j : s.cases) {
+        if (s.labels.count(j.second) == 0)
+            throw RuntimeError("Undefined label '" + j.second + "' in '" + f.name + "'.");
+        tables[j.first] = s.labels[j.second];
+    }
+}
+
+// the value of a call is cut down to what the function returns
+static inline long narrow(long value, int width) {
+    switch (width) {
+    case 1:
+        return (int)value;
+    case 2:
+        return (signed char)value;
+    default:
+        return value;
+    }
+}
+
+// idivl divides the low 4 bytes and traps where C is undefined
+static inline long divide(long x, long y, bool mod) {
+    int a = (int)x;
+    int b = (int)y;
+
+    if (b == 0)
+        throw RuntimeError("Division by zero.");
+    if (a == INT_MIN && b == -1)
+        throw RuntimeError("Division overflow.");
+    return mod ? a % b : a / b;
+}
+
+// cvttss2si gives the lowest long for floats out of range
+static inline long truncate(float x) {
+    if (x >= -9223372036854775808.0f && x < 9223372036854775808.0f)
+        return (long)x;
+    return LONG_MIN;
+}
+
+bool Interpreter::grow(int depth, int slots, Value *&fp, Value *&sp, Value *&end) {
+    if (depth == depthLimit) {
+        if (depthLimit == INTERP_MAX_DEPTH)
+            return false;
+
+        int limit = std::min(2 * depthLimit, INTERP_MAX_DEPTH);
+        Return *bigger = new Return[limit];
+        std::copy(frames.get(), frames.get() + depth, bigger);
+        frames.reset(bigger);
+        depthLimit = limit;
+    }
+
+    long used = sp - stack.get();
+    if (stackSlots - used < slots) {
+        if (INTERP_MAX_STACK_SLOTS - used < slots)
+            return false;
+
+        long size = stackSlots;
+        while (size - used < slots)
+            size *= 2;
+        size = std::min(size, INTERP_MAX_STACK_SLOTS);
+
+        // only the slots in use are copied, the rest stays untouched
+        Value *bigger = new Value[size];
+        std::copy(stack.get(), sp, bigger);
+        for (int k = 0; k < depth; k++)
+            frames[k].fp = bigger + (frames[k].fp - stack.get());
+        fp = bigger + (fp - stack.get());
+        sp = bigger + used;
+        end = bigger + size;
+        stack.reset(bigger);
+        stackSlots = size;
+    }
+
+    return true;
+}
+
+long Interpreter::execute() {
+    int depth = 0;
+
+    // the start has one slot for zero and one for main's value
+    const Code *pc = code.data();
+    Value *fp = stack.get();
+    Value *sp = fp + 2;
+    Value *end = fp + stackSlots;
+    Value ret;
+    ret.i = 0;
+    fp[0].i = 0;
+    fp[1].i = 0;
+
+#define I(x) fp[pc->x].i
+#define F(x) fp[pc->x].f
+#define WRAP(op) (long)((unsigned long)I(a) op (unsigned long)I(b))
+
+#if INTERP_THREADED
+    static const void *handlers[] = {
+        &&op_MOV, &&op_MOVL, &&op_MOVB,
+        &&op_GLOAD, &&op_GSTORE, &&op_GSTOREL, &&op_GSTOREB,
+        &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD, &&op_AND, &&op_OR, &&op_XOR, &&op_LAND, &&op_LOR,
+        &&op_LT, &&op_GT, &&op_LE, &&op_GE, &&op_EQ, &&op_NE,
+        &&op_NEG, &&op_BNOT, &&op_LNOT,
+        &&op_FADD, &&op_FSUB, &&op_FMUL, &&op_FDIV, &&op_FNEG,
+        &&op_FLT, &&op_FGT, &&op_FLE, &&op_FGE, &&op_FEQ, &&op_FNE,
+        &&op_ITOF, &&op_FTOI,
+        &&op_JUMP, &&op_BRANCH, &&op_SWITCH,
+        &&op_CALL, &&op_CALLX, &&op_RET, &&op_RETV, &&op_HALT
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == (unsigned int)Opcode::NUM_OPCODES,
+        "every opcode needs a handler");
+
+    for (auto &c : code)
+        c.handler = handlers[(int)c.op];
+
+#define CASE(op) op_##op:
+#define DISPATCH() goto *pc->handler
+#else
+#define CASE(op) case Opcode::op:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() { pc++; DISPATCH(); }
+
+#if INTERP_THREADED
+    DISPATCH();
+#else
+dispatch:
+    switch (pc->op) {
+#endif
+    CASE(MOV) fp[pc->dst] = fp[pc->a]; NEXT();
+    CASE(MOVL) I(dst) = (int)I(a); NEXT();
+    CASE(MOVB) I(dst) = (signed char)I(a); NEXT();
+
+    CASE(GLOAD) fp[pc->dst] = globals[pc->a]; NEXT();
+    CASE(GSTORE) globals[pc->dst] = fp[pc->a]; NEXT();
+    CASE(GSTOREL) globals[pc->dst].i = (int)I(a); NEXT();
+    CASE(GSTOREB) globals[pc->dst].i = (signed char)I(a); NEXT();
+
+    CASE(ADD) I(dst) = WRAP(+); NEXT();
+    CASE(SUB) I(dst) = WRAP(-); NEXT();
+    CASE(MUL) I(dst) = WRAP(*); NEXT();
+    CASE(DIV) I(dst) = divide(I(a), I(b), false); NEXT();
+    CASE(MOD) I(dst) = divide(I(a), I(b), true); NEXT();
+    CASE(AND) I(dst) = I(a) & I(b); NEXT();
+    CASE(OR) I(dst) = I(a) | I(b); NEXT();
+    CASE(XOR) I(dst) = I(a) ^ I(b); NEXT();
+    CASE(LAND) I(dst) = I(a) != 0 && I(b) != 0; NEXT();
+    CASE(LOR) I(dst) = I(a) != 0 || I(b) != 0; NEXT();
+
+    CASE(LT) I(dst) = I(a) < I(b); NEXT();
+    CASE(GT) I(dst) = I(a) > I(b); NEXT();
+    CASE(LE) I(dst) = I(a) <= I(b); NEXT();
+    CASE(GE) I(dst) = I(a) >= I(b); NEXT();
+    CASE(EQ) I(dst) = I(a) == I(b); NEXT();
+    CASE(NE) I(dst) = I(a) != I(b); NEXT();
+
+    CASE(NEG) I(dst) = (long)(0UL - (unsigned long)I(a)); NEXT();
+    CASE(BNOT) I(dst) = ~I(a); NEXT();
+    CASE(LNOT) I(dst) = I(a) == 0; NEXT();
+
+    CASE(FADD) F(dst) = F(a) + F(b); NEXT();
+    CASE(FSUB) F(dst) = F(a) - F(b); NEXT();
+    CASE(FMUL) F(dst) = F(a) * F(b); NEXT();
+    CASE(FDIV) F(dst) = F(a) / F(b); NEXT();
+    CASE(FNEG) F(dst) = -F(a); NEXT();
+
+    CASE(FLT) I(dst) = F(a) < F(b); NEXT();
+    CASE(FGT) I(dst) = F(a) > F(b); NEXT();
+    CASE(FLE) I(dst) = F(a) <= F(b); NEXT();
+    CASE(FGE) I(dst) = F(a) >= F(b); NEXT();
+    CASE(FEQ) I(dst) = F(a) == F(b); NEXT();
+    CASE(FNE) I(dst) = F(a) != F(b); NEXT();
+
+    CASE(ITOF) F(dst) = (float)I(a); NEXT();
+    CASE(FTOI) I(dst) = truncate(F(a)); NEXT();
+
+    CASE(JUMP)
+        pc = code.data() + pc->b;
+        DISPATCH();
+    CASE(BRANCH)
+        if (I(a) != 1)
+            pc = code.data() + pc->b;
+        else
+            pc++;
+        DISPATCH();
+    CASE(SWITCH)
+    {
+        unsigned long k = (unsigned long)I(a) - (unsigned long)(long)pc->dst;
+        pc = code.data() + tables[pc->b + (k < (unsigned long)pc->c ? k : pc->c)];
+        DISPATCH();
+    }
+
+    CASE(CALL)
+    {
+        Function &f = functions[pc->a];
+        const int *arg = &args[pc->b + 1];
+        int k = f.constants.size();
+
+        if ((depth == depthLimit || end - sp < f.slots) && !grow(depth, f.slots, fp, sp, end))
+            throw RuntimeError("Interpreter stack overflow calling '" + f.name + "'.");
+
+        std::copy(f.constants.begin(), f.constants.end(), sp);
+        for (unsigned int n = 0; n < f.params.size(); n++) {
+            sp[k + n] = fp[arg[n]];
+            if (f.params[n] != Width::WIDE)
+                sp[k + n].i = narrow(sp[k + n].i, (int)f.params[n]);
+        }
+
+        frames[depth++] = Return{pc, fp};
+        fp = sp;
+        sp = fp + f.slots;
+        pc = code.data() + f.entry;
+        calls++;
+        DISPATCH();
+    }
+    CASE(CALLX)
+    {
+        typedef long (*CFunction)(long, long, long, long, long, long);
+        CFunction fun = (CFunction)externals[pc->a].address;
+        const int *arg = &args[pc->b];
+        long x[6] = {0, 0, 0, 0, 0, 0};
+
+        for (int n = 0; n < arg[0]; n++)
+            x[n] = fp[arg[n + 1]].i;
+
+        long value = fun(x[0], x[1], x[2], x[3], x[4], x[5]);
+        if (pc->dst >= 0)
+            I(dst) = narrow(value, pc->c);
+        calls++;
+        NEXT();
+    }
+    CASE(RET)
+        ret = fp[pc->a];
+        goto leave;
+    CASE(RETV)
+        ret.i = 0;
+    leave:
+        sp = fp;
+        depth--;
+        pc = frames[depth].pc;
+        fp = frames[depth].fp;
+        if (pc->dst >= 0) {
+            fp[pc->dst] = ret;
+            if (pc->c != (int)Width::WIDE)
+                I(dst) = narrow(I(dst), pc->c);
+        }
+        NEXT();
+    CASE(HALT)
+        return I(a);
+#if !INTERP_THREADED
+    default:
+        throw RuntimeError("Bad instruction.");
+    }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef WRAP
+#undef F
+#undef I
+    return 0;
+}
+
+int Interpreter::run() {
+    std::vector<std::vector<Instruction *>> bodies;
+    bool inDef = false;
+
+    // the top level code runs first, as a function without a name
+    functions.push_back(Function{"", 0, {}, 0, {}});
+    bodies.push_back({});
+
+    for (auto *i : IR) {
+        switch (i->getOp()) {
+        case DEF:
+        {
+            DefInstr *def = (DefInstr *)i;
+            byName[def->getName()] = functions.size();
+            functions.push_back(Function{def->getName(), 0, {}, 0, {}});
+            for (auto &p : *def->getParams())
+                functions.back().params.push_back(widthOf(p.sym));
+            bodies.push_back({i});
+            inDef = true;
+            break;
+        }
+        case END:
+            bodies.back().push_back(i);
+            inDef = false;
+            break;
+        default:
+            if (inDef) {
+                bodies.back().push_back(i);
+            } else {
+                if (i->getOp() == DECL) {
+                    Container c = ((DeclInstr *)i)->getContainer();
+                    Value zero;
+                    zero.i = 0;
+
+                    globalSlots[c.getStringValue()] = globals.size();
+                    globalWidths[c.getStringValue()] = widthOf(c.sym);
+                    globals.push_back(zero);
+                }
+                bodies[0].push_back(i);
+            }
+            break;
+        }
+    }
+
+    if (byName.count("main") == 0)
+        throw RuntimeError("No function 'main' to run.");
+
+    // the start calls the top level code, then main with zeros for its
+    // parameters and stops with what main returns
+    Function &main = functions[byName["main"]];
+    int noArgs = args.size();
+    args.push_back(0);
+    int mainArgs = args.size();
+    args.push_back(main.params.size());
+    args.insert(args.end(), main.params.size(), 0);
+
+    emit(Opcode::CALL, -1, 0, noArgs, (int)Width::WIDE);
+    emit(Opcode::CALL, 1, byName["main"], mainArgs, (int)Width::LONG);
+    emit(Opcode::HALT, 0, 1, 0, 0);
+
+    for (unsigned int k = 0; k < functions.size(); k++)
+        translate(functions[k], bodies[k]);
+
+    stackSlots = INTERP_STACK_SLOTS;
+    depthLimit = INTERP_DEPTH;
+    stack.reset(new Value[stackSlots]);
+    frames.reset(new Return[depthLimit]);
+
+    auto start = std::chrono::steady_clock::now();
+    long value = execute();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    seconds = time.count();
+
+    return (int)value;
+}
+
+void Interpreter::printStats() {
+    std::cout << "======================\nInterpreter Statistics\n======================\n\n";
+    std::cout << std::left << std::setw(28) << "functions" << functions.size() - 1 << std::endl;
+    std::cout << std::left << std::setw(28) << "instructions" << code.size() << std::endl;
+    std::cout << std::left << std::setw(28) << "calls" << calls << std::endl;
+    std::cout << std::left << std::setw(28) << "seconds" << seconds << std::endl;
+}
@@ -0,0 +1,622 @@
+/* File: ipo.cpp
+ * Authors: agent
+ * Description: Interprocedural optimizations over a whole program's IR
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "ipo.h"
+
+// The allocator has this many registers and never spills
+#define ALLOCATABLE_REGS 7
+
+// Line ranges of a function's virtual registers, as CPU::BuildRange sees
+// them: from the last definition to the last use
+static std::map<int, std::pair<int, int>> regRanges(std::vector<Instruction *> &body) {
+    std::map<int, std::pair<int, int>> ranges;
+
+    for (unsigned int k = 0; k < body.size(); k++) {
+        Instruction *i = body[k];
+        Container def;
+        bool hasDef = false;
+
+        if (i->getOp() == CONST_LET || i->getOp() == UNARY_LET || i->getOp() == BINARY_LET) {
+            def = ((LetInstr *)i)->getContainer();
+            hasDef = true;
+        } else if (i->getOp() == CALL && ((CallInstr *)i)->getFlag()) {
+            def = ((CallInstr *)i)->getContainer();
+            hasDef = true;
+        }
+
+        for (auto &c : containers_of_instruction(i)) {
+            if (c.isRegister() && !(hasDef && def.isRegister() && c.getIntValue() == def.getIntValue()))
+                ranges[c.getIntValue()].second = k;
+        }
+        if (hasDef && def.isRegister())
+            ranges[def.getIntValue()].first = k;
+    }
+
+    return ranges;
+}
+
+// Registers holding a value across line k
+static int liveAcross(std::map<int, std::pair<int, int>> &ranges, int k) {
+    int live = 0;
+
+    for (auto &r : ranges) {
+        if (r.second.first < k && r.second.second > k)
+            live++;
+    }
+    return live;
+}
+
+// Most registers a function holds at once
+static int maxLive(std::vector<Instruction *> &body) {
+    std::map<int, std::pair<int, int>> ranges = regRanges(body);
+    int most = 0;
+
+    for (int k = 0; k < (int)body.size(); k++) {
+        int live = 0;
+        for (auto &r : ranges) {
+            if (r.second.first <= k && r.second.second >= k)
+                live++;
+        }
+        most = std::max(most, live);
+    }
+    return most;
+}
+
+Interprocedural::Interprocedural(std::list<Instruction *> IR) {
+    bool inDef = false;
+
+    nextReg = 0;
+    nextInline = 0;
+    profile = nullptr;
+    folded = 0;
+    callsRemoved = 0;
+    tailCalls = 0;
+    inlined = 0;
+    hotInlined = 0;
+    constArgs = 0;
+    removed = 0;
+    removedGlobals = 0;
+
+    for (auto *i : IR) {
+        for (auto &c : containers_of_instruction(i)) {
+            if (c.isRegister())
+                nextReg = std::max(nextReg, c.getIntValue() + 1);
+        }
+
+        switch (i->getOp()) {
+            case DEF:
+                byName[((DefInstr *)i)->getName()] = functions.size();
+                functions.push_back(Function{(DefInstr *)i, {}, nullptr, false, false, false, Container(IMM)});
+                topLevel.push_back(nullptr);
+                inDef = true;
+                break;
+            case END:
+                functions.back().end = i;
+                inDef = false;
+                break;
+            default:
+                if (inDef) {
+                    functions.back().body.push_back(i);
+                } else {
+                    if (i->getOp() == DECL)
+                        globals.insert(((DeclInstr *)i)->getContainer().getStringValue());
+                    topLevel.push_back(i);
+                }
+                break;
+        }
+    }
+}
+
+// Globals are named for their scope in the IR, a source name stands for
+// the function and the global
+void Interprocedural::exportSymbol(std::string name) {
+    exported.insert(name);
+    exported.insert(name + "_0");
+}
+
+void Interprocedural::setProfile(Profile *profile) {
+    this->profile = profile;
+}
+
+bool Interprocedural::closedWorld() {
+    return byName.count("main") > 0 || !exported.empty();
+}
+
+bool Interprocedural::isLeaf(Function &f) {
+    for (auto *i : f.body) {
+        if (i->getOp() == CALL)
+            return false;
+    }
+    return true;
+}
+
+// Summaries of what every function does for its callers. Purity is
+// assumed and taken back until nothing changes, so recursive functions can
+// be pure
+void Interprocedural::summarize() {
+    for (auto &f : functions) {
+        bool returns = false;
+
+        f.pure = f.end != nullptr;
+        f.constant = f.end != nullptr;
+        for (auto *i : f.body) {
+            if (i->getOp() != RET)
+                continue;
+
+            Container c = ((ReturnInstr *)i)->getContainer();
+            // a char function returns the low byte of its value
+            if (c.isImmediate() && f.def->getType() == SYM_CHAR)
+                c.setVal((int)(signed char)c.getIntImmediate());
+
+            if (!c.isImmediate() || (returns && c.getIntImmediate() != f.value.getIntImmediate()))
+                f.constant = false;
+            else
+                f.value = c;
+            returns = true;
+        }
+        f.constant = f.constant && returns;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto &f : functions) {
+            if (!f.pure)
+                continue;
+
+            for (auto *i : f.body) {
+                bool effect = false;
+
+                if (i->getOp() == CALL) {
+                    auto it = byName.find(((CallInstr *)i)->getName());
+                    effect = it == byName.end() || !functions[it->second].pure;
+                } else if (i->getOp() == CONST_LET || i->getOp() == UNARY_LET || i->getOp() == BINARY_LET) {
+                    Container c = ((LetInstr *)i)->getContainer();
+                    effect = c.isVariable() && globals.count(c.getStringValue()) > 0;
+                }
+
+                if (effect) {
+                    f.pure = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void Interprocedural::foldCalls() {
+    summarize();
+
+    for (auto &f : functions) {
+        // registers read in the function, a call result nobody reads can go
+        std::map<int, int> reads;
+        for (auto *i : f.body) {
+            for (auto &c : containers_of_instruction(i)) {
+                if (c.isRegister())
+                    reads[c.getIntValue()]++;
+            }
+        }
+
+        for (unsigned int k = 0; k < f.body.size(); k++) {
+            if (f.body[k]->getOp() != CALL)
+                continue;
+
+            CallInstr *call = (CallInstr *)f.body[k];
+            auto it = byName.find(call->getName());
+            if (it == byName.end())
+                continue;
+
+            Function &callee = functions[it->second];
+            bool used = call->getFlag() && reads[call->getContainer().getIntValue()] > 1;
+
+            if (callee.pure && !used) {
+                f.body.erase(f.body.begin() + k--);
+                callsRemoved++;
+            } else if (callee.constant && used) {
+                LetInstr *li = new LetInstr(call->getContainer(), CONST_LET, NULL);
+                li->setExpression(callee.value);
+
+                // the call stays for what else it does
+                if (callee.pure) {
+                    f.body[k] = li;
+                    callsRemoved++;
+                } else {
+                    f.body[k] = new CallInstr(call->getName(), call->getArgs(), NULL);
+                    f.body.insert(f.body.begin() + ++k, li);
+                }
+                folded++;
+            }
+        }
+    }
+}
+
+void Interprocedural::eliminateTailRecursion() {
+    for (auto &f : functions) {
+        std::string name = f.def->getName();
+        std::list<Container> *params = f.def->getParams();
+        std::string entry = "Ltail." + name;
+        bool looped = false;
+
+        for (unsigned int k = 0; k + 1 < f.body.size(); k++) {
+            if (f.body[k]->getOp() != CALL || f.body[k + 1]->getOp() != RET)
+                continue;
+
+            CallInstr *call = (CallInstr *)f.body[k];
+            Container ret = ((ReturnInstr *)f.body[k + 1])->getContainer();
+            if (call->getName() != name || call->getArgs()->size() != params->size())
+                continue;
+            if (ret.type != NIL && !(ret.isRegister() && call->getFlag() &&
+                    ret.getIntValue() == call->getContainer().getIntValue()))
+                continue;
+
+            // every argument is read before the first parameter changes
+            std::vector<Instruction *> loop;
+            std::vector<Container> args;
+            auto param = params->begin();
+            for (auto &a : *call->getArgs()) {
+                if (a.isVariable()) {
+                    Container tmp(REG, nextReg++);
+                    tmp.sym = param->sym == SYM_FLOAT ? SYM_FLOAT : SYM_INT;
+                    LetInstr *load = new LetInstr(tmp, CONST_LET, NULL);
+                    load->setExpression(a);
+                    loop.push_back(load);
+                    args.push_back(tmp);
+                } else {
+                    args.push_back(a);
+                }
+                ++param;
+            }
+
+            auto arg = args.begin();
+            for (auto &p : *params) {
+                LetInstr *li = new LetInstr(p, CONST_LET, NULL);
+                li->setExpression(*arg++);
+                loop.push_back(li);
+            }
+            loop.push_back(new JumpInstr(entry, NULL));
+
+            f.body.erase(f.body.begin() + k, f.body.begin() + k + 2);
+            f.body.insert(f.body.begin() + k, loop.begin(), loop.end());
+            k += loop.size() - 1;
+            looped = true;
+            tailCalls++;
+        }
+
+        if (looped)
+            f.body.insert(f.body.begin(), new LableInstr(entry, NULL));
+    }
+}
+
+// Replace the call at caller.body[k] with the callee's body. Parameters
+// and locals are renamed into the caller, every return stores the result
+// and jumps past the copy
+bool Interprocedural::inlineCall(Function &caller, unsigned int k) {
+    CallInstr *call = (CallInstr *)caller.body[k];
+    auto it = byName.find(call->getName());
+
+    if (it == byName.end())
+        return false;
+
+    // a call that never ran is not worth its copy, a hot one is worth a
+    // bigger one
+    long count = profile != nullptr ? profile->countAt(caller.def->getName(), caller.body, k) : -1;
+    if (profile != nullptr && profile->isCold(count))
+        return false;
+    unsigned int limit = profile != nullptr && profile->isHot(count) ? INLINE_HOT_MAX_INSTRS : INLINE_MAX_INSTRS;
+
+    Function &callee = functions[it->second];
+    if (&callee == &caller || !isLeaf(callee) || callee.end == nullptr ||
+            callee.body.size() > limit ||
+            caller.body.size() + callee.body.size() > INLINE_MAX_CALLER ||
+            call->getArgs()->size() != callee.def->getParams()->size())
+        return false;
+
+    // the copy's registers are live along with the caller's
+    std::map<int, std::pair<int, int>> ranges = regRanges(caller.body);
+    if (liveAcross(ranges, k) + maxLive(callee.body) + 1 > ALLOCATABLE_REGS)
+        return false;
+
+    std::string suffix = ".i" + std::to_string(nextInline++);
+    std::map<int, int> regs;
+    std::map<std::string, std::string *> vars;
+
+    auto cont = [&](Container c) -> Container {
+        if (c.isRegister()) {
+            if (regs.count(c.getIntValue()) == 0)
+                regs[c.getIntValue()] = nextReg++;
+            c.value.reg = regs[c.getIntValue()];
+        } else if (c.isVariable() && globals.count(c.getStringValue()) == 0) {
+            std::string *&name = vars[c.getStringValue()];
+            if (name == nullptr)
+                name = new std::string(c.getStringValue() + suffix);
+            c.value.varName = name;
+        }
+        return c;
+    };
+    auto label = [&](std::string l) -> std::string {
+        return l + suffix;
+    };
+    // let dest = value, through a register when both would be memory
+    auto assign = [&](std::vector<Instruction *> &out, Container dest, Container value) {
+        if (value.isVariable()) {
+            Container tmp(REG, nextReg++);
+            tmp.sym = dest.sym == SYM_FLOAT ? SYM_FLOAT : SYM_INT;
+            LetInstr *load = new LetInstr(tmp, CONST_LET, NULL);
+            load->setExpression(value);
+            out.push_back(load);
+            value = tmp;
+        }
+
+        LetInstr *li = new LetInstr(dest, CONST_LET, NULL);
+        li->setExpression(value);
+        out.push_back(li);
+    };
+
+    std::vector<Instruction *> copy;
+    auto arg = call->getArgs()->begin();
+    for (auto &p : *callee.def->getParams()) {
+        Container param = cont(p);
+
+        copy.push_back(new DeclInstr(param.value.varName, p.sym, NULL));
+        assign(copy, param, *arg++);
+    }
+
+    std::string done = "Lret" + suffix;
+    Container result(STR, new std::string("ret" + suffix), callee.def->getType());
+    if (call->getFlag())
+        copy.push_back(new DeclInstr(result.value.varName, result.sym, NULL));
+
+    for (auto *i : callee.body) {
+        if (i->getOp() != RET) {
+            copy.push_back(map_instruction(i, cont, label));
+            continue;
+        }
+
+        Container value = cont(((ReturnInstr *)i)->getContainer());
+        if (call->getFlag() && value.type != NIL)
+            assign(copy, result, value);
+        copy.push_back(new JumpInstr(done, NULL));
+    }
+    copy.push_back(new LableInstr(done, NULL));
+
+    if (call->getFlag()) {
+        LetInstr *li = new LetInstr(call->getContainer(), CONST_LET, NULL);
+        li->setExpression(result);
+        copy.push_back(li);
+    }
+
+    caller.body.erase(caller.body.begin() + k);
+    caller.body.insert(caller.body.begin() + k, copy.begin(), copy.end());
+    inlined++;
+    if (callee.body.size() > INLINE_MAX_INSTRS)
+        hotInlined++;
+    return true;
+}
+
+// Leaf functions are inlined first, the callers that leaves them can be
+// inlined in the next round
+void Interprocedural::inlineCalls() {
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (auto &f : functions) {
+            for (unsigned int k = 0; k < f.body.size(); k++) {
+                if (f.body[k]->getOp() == CALL && inlineCall(f, k))
+                    changed = true;
+            }
+        }
+    }
+}
+
+void Interprocedural::propagateConstArgs() {
+    if (!closedWorld())
+        return;
+
+    // every call of every function
+    std::map<std::string, std::vector<CallInstr *>> calls;
+    for (auto &f : functions) {
+        for (auto *i : f.body) {
+            if (i->getOp() == CALL)
+                calls[((CallInstr *)i)->getName()].push_back((CallInstr *)i);
+        }
+    }
+
+    for (auto &f : functions) {
+        std::string name = f.def->getName();
+        std::list<Container> *params = f.def->getParams();
+        std::vector<CallInstr *> &sites = calls[name];
+
+        if (name == "main" || exported.count(name) > 0 || sites.empty())
+            continue;
+
+        bool matches = true;
+        for (auto *ci : sites) {
+            matches = matches && ci->getArgs()->size() == params->size();
+        }
+        if (!matches)
+            continue;
+
+        // the value every call passes for each parameter, if it is the same
+        // constant everywhere
+        std::vector<bool> constant(params->size(), true);
+        std::vector<Container> values(params->size());
+        for (unsigned int j = 0; j < params->size(); j++) {
+            for (auto *ci : sites) {
+                Container a = *std::next(ci->getArgs()->begin(), j);
+
+                if (!a.isImmediate() || a.getIntImmediate() != (*std::next(sites[0]->getArgs()->begin(), j)).getIntImmediate())
+                    constant[j] = false;
+            }
+            if (constant[j])
+                values[j] = *std::next(sites[0]->getArgs()->begin(), j);
+        }
+
+        // drop the parameter from the definition and every call, it is
+        // assigned on entry instead
+        std::vector<Instruction *> entry;
+        unsigned int j = 0;
+        for (auto p = params->begin(); p != params->end(); j++) {
+            if (!constant[j]) {
+                ++p;
+                continue;
+            }
+
+            LetInstr *li = new LetInstr(*p, CONST_LET, NULL);
+            li->setExpression(values[j]);
+            entry.push_back(li);
+            p = params->erase(p);
+            constArgs++;
+        }
+        f.body.insert(f.body.begin(), entry.begin(), entry.end());
+
+        for (auto *ci : sites) {
+            std::list<Container> *args = ci->getArgs();
+            j = 0;
+            for (auto a = args->begin(); a != args->end(); j++) {
+                a = constant[j] ? args->erase(a) : std::next(a);
+            }
+        }
+    }
+}
+
+// The global a top level instruction stores to, or an empty string
+static std::string globalStored(Instruction *i, std::set<std::string> &globals) {
+    if (i->getOp() == DECL) {
+        return ((DeclInstr *)i)->getContainer().getStringValue();
+    } else if (i->getOp() == CONST_LET || i->getOp() == UNARY_LET || i->getOp() == BINARY_LET) {
+        Container c = ((LetInstr *)i)->getContainer();
+        if (c.isVariable() && globals.count(c.getStringValue()) > 0)
+            return c.getStringValue();
+    }
+    return "";
+}
+
+void Interprocedural::removeDeadCode() {
+    if (!closedWorld())
+        return;
+
+    std::vector<bool> reached(functions.size(), false);
+    std::vector<unsigned int> work;
+
+    for (auto &f : byName) {
+        if (f.first == "main" || exported.count(f.first) > 0) {
+            reached[f.second] = true;
+            work.push_back(f.second);
+        }
+    }
+
+    while (!work.empty()) {
+        Function &f = functions[work.back()];
+        work.pop_back();
+
+        for (auto *i : f.body) {
+            if (i->getOp() != CALL)
+                continue;
+
+            auto it = byName.find(((CallInstr *)i)->getName());
+            if (it != byName.end() && !reached[it->second]) {
+                reached[it->second] = true;
+                work.push_back(it->second);
+            }
+        }
+    }
+
+    for (unsigned int k = 0; k < functions.size(); k++) {
+        if (!reached[k] && !functions[k].dead) {
+            functions[k].dead = true;
+            removed++;
+        }
+    }
+
+    // globals the remaining functions use, and the ones their
+    // initializers use in turn
+    std::set<std::string> used;
+    auto use = [&](Instruction *i) {
+        for (auto &c : containers_of_instruction(i)) {
+            if (c.isVariable() && globals.count(c.getStringValue()) > 0)
+                used.insert(c.getStringValue());
+        }
+    };
+
+    for (auto &g : globals) {
+        if (exported.count(g) > 0)
+            used.insert(g);
+    }
+    for (auto &f : functions) {
+        if (!f.dead) {
+            for (auto *i : f.body)
+                use(i);
+        }
+    }
+    for (auto *i : topLevel) {
+        if (i != nullptr && globalStored(i, globals).empty())
+            use(i);
+    }
+
+    unsigned int before = 0;
+    while (before != used.size()) {
+        before = used.size();
+
+        for (auto *i : topLevel) {
+            if (i != nullptr && i->getOp() != DECL && used.count(globalStored(i, globals)) > 0)
+                use(i);
+        }
+    }
+
+    std::vector<Instruction *> kept;
+    for (auto *i : topLevel) {
+        std::string g = i == nullptr ? "" : globalStored(i, globals);
+
+        if (!g.empty() && used.count(g) == 0) {
+            if (i->getOp() == DECL)
+                removedGlobals++;
+            continue;
+        }
+        kept.push_back(i);
+    }
+    topLevel = kept;
+}
+
+std::list<Instruction *> Interprocedural::getIR() {
+    std::list<Instruction *> IR;
+    unsigned int next = 0;
+
+    for (auto *i : topLevel) {
+        if (i != nullptr) {
+            IR.push_back(i);
+            continue;
+        }
+
+        Function &f = functions[next++];
+        if (f.dead)
+            continue;
+
+        IR.push_back(f.def);
+        IR.insert(IR.end(), f.body.begin(), f.body.end());
+        if (f.end != nullptr)
+            IR.push_back(f.end);
+    }
+
+    return IR;
+}
+
+void Interprocedural::printStats() {
+    std::cout << "==========================\nInterprocedural Statistics\n==========================\n\n";
+    std::cout << std::left << std::setw(28) << "call results folded" << folded << std::endl;
+    std::cout << std::left << std::setw(28) << "calls removed" << callsRemoved << std::endl;
+    std::cout << std::left << std::setw(28) << "tail calls made loops" << tailCalls << std::endl;
+    std::cout << std::left << std::setw(28) << "calls inlined" << inlined << std::endl;
+    std::cout << std::left << std::setw(28) << "hot calls inlined" << hotInlined << std::endl;
+    std::cout << std::left << std::setw(28) << "constant arguments" << constArgs << std::endl;
+    std::cout << std::left << std::setw(28) << "functions removed" << removed << std::endl;
+    std::cout << std::left << std::setw(28) << "globals removed" << removedGlobals << std::endl;
+}
@@ -0,0 +1,394 @@
+/* File: irbinary.cpp
+ * Authors: agent
+ * Description: Writes and reads the binary form of the IR
+ */
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "irbinary.h"
+
+// Record flags
+#define IRB_CAPTURE 1
+#define IRB_LABEL_TWO 2
+#define IRB_SAVED 4
+
+// Collects the records and the string table of a program
+class IRBinaryWriter {
+public:
+    std::vector<IRBinaryContainer> containers;
+    std::vector<IRBinaryRecord> records;
+    std::vector<std::string> strings;
+    std::map<std::string, uint32_t> indices;
+
+    uint32_t intern(std::string s) {
+        auto it = indices.find(s);
+        if (it != indices.end())
+            return it->second;
+
+        strings.push_back(s);
+        return indices[s] = strings.size() - 1;
+    }
+
+    void container(Container c) {
+        IRBinaryContainer b = {(uint8_t)c.type, (int8_t)c.sym, 0, 0};
+
+        switch (c.type) {
+            case STR:
+                b.value = intern(*c.value.varName);
+                break;
+            case PREG:
+                b.value = intern(*c.value.physReg);
+                break;
+            case REG:
+                b.value = c.value.reg;
+                break;
+            case IMM:
+                memcpy(&b.value, &c.value.cval, sizeof(b.value));
+                break;
+            case NIL:
+                break;
+        }
+
+        containers.push_back(b);
+    }
+
+    void instruction(Instruction *i) {
+        IRBinaryRecord r = {(uint8_t)i->getOp(), 0, 0, 0, 0, 0, (uint32_t)containers.size(), 0, 0};
+
+        switch (i->getOp()) {
+            case UNARY_LET:
+            case BINARY_LET:
+            case CONST_LET:
+            {
+                LetInstr *li = (LetInstr *)i;
+
+                container(li->getContainer());
+                container(li->getOp1());
+                if (i->getOp() == BINARY_LET)
+                    container(li->getOp2());
+                if (i->getOp() != CONST_LET)
+                    r.irop = (uint8_t)li->getOperation();
+                break;
+            }
+            case DECL:
+                container(((DeclInstr *)i)->getContainer());
+                break;
+            case DEF:
+            {
+                DefInstr *di = (DefInstr *)i;
+
+                r.name = intern(di->getName());
+                r.sym = (int8_t)di->getType();
+                for (auto &c : *di->getParams())
+                    container(c);
+                break;
+            }
+            case CALL:
+            {
+                CallInstr *ci = (CallInstr *)i;
+
+                r.name = intern(ci->getName());
+                for (auto &c : *ci->getArgs())
+                    container(c);
+                if (ci->getFlag()) {
+                    r.flags |= IRB_CAPTURE;
+                    container(ci->getContainer());
+                }
+                if (ci->getSavedRegs()) {
+                    r.flags |= IRB_SAVED;
+                    r.saved = ci->getSavedRegs()->size();
+                    for (auto &reg : *ci->getSavedRegs())
+                        containers.push_back(IRBinaryContainer{PREG, 0, 0, intern(reg)});
+                }
+                break;
+            }
+            case BRANCH:
+            {
+                BranchInstr *bi = (BranchInstr *)i;
+
+                container(bi->getContainer());
+                r.name = intern(bi->getLabelOne());
+                if (bi->getLabelTwo()) {
+                    r.flags |= IRB_LABEL_TWO;
+                    r.label = intern(*bi->getLabelTwo());
+                }
+                break;
+            }
+            case LABEL:
+                r.name = intern(((LableInstr *)i)->getLabelName());
+                break;
+            case JUMP:
+                r.name = intern(((JumpInstr *)i)->getLabelName());
+                break;
+            case JUMP_TABLE:
+            {
+                SwitchInstr *si = (SwitchInstr *)i;
+                Container low(IMM);
+
+                // the value, the lowest case value and the table's labels
+                low.setVal(si->getLow());
+                container(si->getContainer());
+                container(low);
+                for (auto &t : si->getTargets())
+                    containers.push_back(IRBinaryContainer{STR, 0, 0, intern(t)});
+                r.name = intern(si->getDefault());
+                break;
+            }
+            case RET:
+                container(((ReturnInstr *)i)->getContainer());
+                break;
+            case END:
+                break;
+        }
+
+        r.count = containers.size() - r.first;
+        records.push_back(r);
+    }
+};
+
+void writeBinaryIR(std::ostream &out, const std::list<Instruction *> &ir) {
+    IRBinaryWriter w;
+
+    for (auto *i : ir) {
+        w.instruction(i);
+    }
+
+    // offset of every string in the string bytes, and the end of the last
+    std::vector<uint32_t> offsets;
+    std::string bytes;
+    for (auto &s : w.strings) {
+        offsets.push_back(bytes.size());
+        bytes += s;
+    }
+    offsets.push_back(bytes.size());
+
+    IRBinaryHeader h;
+    memcpy(h.magic, IR_BINARY_MAGIC, sizeof(h.magic));
+    h.version = IR_BINARY_VERSION;
+    h.containerCount = w.containers.size();
+    h.recordCount = w.records.size();
+    h.stringCount = w.strings.size();
+    h.stringBytes = bytes.size();
+
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)w.containers.data(), w.containers.size() * sizeof(IRBinaryContainer));
+    out.write((const char *)w.records.data(), w.records.size() * sizeof(IRBinaryRecord));
+    out.write((const char *)offsets.data(), offsets.size() * sizeof(uint32_t));
+    out.write(bytes.data(), bytes.size());
+}
+
+bool isBinaryIR(std::string path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+
+    return in.read(magic, sizeof(magic)) && memcmp(magic, IR_BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+IR_BinaryReader::IR_BinaryReader(std::string path) {
+    irFilePath = path;
+}
+
+std::string *IR_BinaryReader::stringAt(uint32_t index) {
+    if (index >= strings.size())
+        throw IR_Error("Bad string index in binary IR file: " + irFilePath + ".");
+    return strings[index];
+}
+
+Container IR_BinaryReader::container(const IRBinaryContainer &b) {
+    Container c((ContainerType)b.type);
+    c.sym = (SymbolType)b.sym;
+
+    switch (b.type) {
+        case STR:
+            c.value.varName = stringAt(b.value);
+            break;
+        case PREG:
+            c.value.physReg = stringAt(b.value);
+            break;
+        case REG:
+            c.value.reg = b.value;
+            break;
+        case IMM:
+            memcpy(&c.value.cval, &b.value, sizeof(b.value));
+            break;
+        case NIL:
+            break;
+        default:
+            throw IR_Error("Bad container in binary IR file: " + irFilePath + ".");
+    }
+
+    return c;
+}
+
+// Map the file and build the instructions straight from the records
+std::list<Instruction *> IR_BinaryReader::parse() {
+    int fd = open(irFilePath.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0)
+            close(fd);
+        throw IR_Error("Failed to open IR source file: " + irFilePath + ".");
+    }
+
+    size_t size = st.st_size;
+    void *map = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED)
+        throw IR_Error("Failed to map IR source file: " + irFilePath + ".");
+
+    const char *base = (const char *)map;
+    const IRBinaryHeader *h = (const IRBinaryHeader *)base;
+    std::list<Instruction *> ilist;
+
+    try {
+        if (size < sizeof(IRBinaryHeader) || memcmp(h->magic, IR_BINARY_MAGIC, sizeof(h->magic)) != 0)
+            throw IR_Error("Not a binary IR file: " + irFilePath + ".");
+        if (h->version != IR_BINARY_VERSION)
+            throw IR_Error("Unsupported binary IR version " + std::to_string(h->version) + ": " + irFilePath + ".");
+
+        // the counts are 32 bit, so the sizes cannot overflow 64 bits
+        size_t containersAt = sizeof(IRBinaryHeader);
+        size_t recordsAt = containersAt + (size_t)h->containerCount * sizeof(IRBinaryContainer);
+        size_t offsetsAt = recordsAt + (size_t)h->recordCount * sizeof(IRBinaryRecord);
+        size_t bytesAt = offsetsAt + ((size_t)h->stringCount + 1) * sizeof(uint32_t);
+        if (bytesAt + h->stringBytes != size)
+            throw IR_Error("Truncated binary IR file: " + irFilePath + ".");
+
+        const IRBinaryContainer *containers = (const IRBinaryContainer *)(base + containersAt);
+        const IRBinaryRecord *records = (const IRBinaryRecord *)(base + recordsAt);
+        const uint32_t *offsets = (const uint32_t *)(base + offsetsAt);
+
+        strings.clear();
+        for (uint32_t k = 0; k < h->stringCount; k++) {
+            if (offsets[k] > offsets[k + 1] || offsets[k + 1] > h->stringBytes)
+                throw IR_Error("Bad string table in binary IR file: " + irFilePath + ".");
+            strings.push_back(new std::string(base + bytesAt + offsets[k], offsets[k + 1] - offsets[k]));
+        }
+
+        for (uint32_t k = 0; k < h->recordCount; k++) {
+            const IRBinaryRecord &r = records[k];
+
+            if ((size_t)r.first + r.count > h->containerCount || r.saved > r.count)
+                throw IR_Error("Bad instruction in binary IR file: " + irFilePath + ".");
+
+            const IRBinaryContainer *c = containers + r.first;
+            Instruction *i;
+
+            switch (r.op) {
+                case UNARY_LET:
+                case BINARY_LET:
+                case CONST_LET:
+                {
+                    if (r.count != (r.op == BINARY_LET ? 3u : 2u) || r.irop > (uint8_t)IrOp::FTOI)
+                        throw IR_Error("Bad let in binary IR file: " + irFilePath + ".");
+
+                    LetInstr *li = new LetInstr(container(c[0]), (OpType)r.op, nullptr);
+                    if (r.op == BINARY_LET)
+                        li->setExpression(container(c[1]), container(c[2]), (IrOp)r.irop);
+                    else if (r.op == UNARY_LET)
+                        li->setExpression(container(c[1]), (IrOp)r.irop);
+                    else
+                        li->setExpression(container(c[1]));
+                    i = li;
+                    break;
+                }
+                case DECL:
+                {
+                    if (r.count != 1 || c[0].type != STR)
+                        throw IR_Error("Bad declaration in binary IR file: " + irFilePath + ".");
+
+                    i = new DeclInstr(stringAt(c[0].value), (SymbolType)c[0].sym, nullptr);
+                    break;
+                }
+                case DEF:
+                {
+                    std::list<Container> *params = new std::list<Container>();
+
+                    for (uint32_t n = 0; n < r.count; n++)
+                        params->push_back(container(c[n]));
+                    i = new DefInstr(*stringAt(r.name), (SymbolType)r.sym, params, nullptr);
+                    break;
+                }
+                case CALL:
+                {
+                    uint32_t args = r.count - r.saved - (r.flags & IRB_CAPTURE ? 1 : 0);
+                    std::list<Container> *alist = new std::list<Container>();
+
+                    if (args > r.count)
+                        throw IR_Error("Bad call in binary IR file: " + irFilePath + ".");
+
+                    for (uint32_t n = 0; n < args; n++)
+                        alist->push_back(container(c[n]));
+
+                    CallInstr *ci = new CallInstr(*stringAt(r.name), alist, nullptr);
+                    if (r.flags & IRB_CAPTURE)
+                        ci->setExpression(container(c[args]));
+                    if (r.flags & IRB_SAVED) {
+                        std::list<std::string> *regs = new std::list<std::string>();
+
+                        for (uint32_t n = r.count - r.saved; n < r.count; n++)
+                            regs->push_back(*stringAt(c[n].value));
+                        ci->setSavedRegs(regs);
+                    }
+                    i = ci;
+                    break;
+                }
+                case BRANCH:
+                {
+                    if (r.count != 1)
+                        throw IR_Error("Bad branch in binary IR file: " + irFilePath + ".");
+
+                    std::string *two = r.flags & IRB_LABEL_TWO ? new std::string(*stringAt(r.label)) : nullptr;
+                    i = new BranchInstr(container(c[0]), *stringAt(r.name), two, nullptr);
+                    break;
+                }
+                case LABEL:
+                    i = new LableInstr(*stringAt(r.name), nullptr);
+                    break;
+                case JUMP:
+                    i = new JumpInstr(*stringAt(r.name), nullptr);
+                    break;
+                case JUMP_TABLE:
+                {
+                    std::vector<std::string> targets;
+
+                    if (r.count < 2 || c[1].type != IMM)
+                        throw IR_Error("Bad switch in binary IR file: " + irFilePath + ".");
+
+                    for (uint32_t n = 2; n < r.count; n++)
+                        targets.push_back(*stringAt(c[n].value));
+                    i = new SwitchInstr(container(c[0]), container(c[1]).getIntImmediate(), targets, *stringAt(r.name), nullptr);
+                    break;
+                }
+                case RET:
+                {
+                    if (r.count != 1)
+                        throw IR_Error("Bad return in binary IR file: " + irFilePath + ".");
+
+                    i = new ReturnInstr(container(c[0]), nullptr);
+                    break;
+                }
+                case END:
+                    i = new FuncEnd(nullptr);
+                    break;
+                default:
+                    throw IR_Error("Bad instruction in binary IR file: " + irFilePath + ".");
+            }
+
+            ilist.push_back(i);
+        }
+    } catch (IR_Error &) {
+        munmap(map, size);
+        throw;
+    }
+
+    munmap(map, size);
+    return ilist;
+}
@@ -3,6 +3,8 @@
  * Description: implementation for intermediate representation data structures
  */
 
+#include <algorithm>
+#include <cstdio>
 #include "irep.h"
 
 // Container Structure
@@ -73,6 +75,14 @@ bool Container::isImmediate() {
     return type == IMM;
 }
 
+bool Container::isFloat() {
+    return sym == SYM_FLOAT;
+}
+
+bool Container::isVector() {
+    return sym == SYM_VECTOR;
+}
+
 /**
  *Used to get string of symbol type.
  */
@@ -99,6 +109,10 @@ int Container::getIntImmediate() {
     return value.cval.ival;
 }
 
+float Container::getFloatImmediate() {
+    return value.cval.fval;
+}
+
 
 //gets the string union value
 std::string Container::getReg() {
@@ -117,10 +131,18 @@ std::string Container::toString() {
             full = std::string(*(value.varName)); 
             break;
         case IMM: 
-            full = std::to_string(value.cval.ival); 
+            if (isFloat()) {
+                // enough digits to read the same float back, the f tells it
+                // from an int
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%.9gf", value.cval.fval);
+                full = buf;
+            } else {
+                full = std::to_string(value.cval.ival); 
+            }
             break;
         case REG: 
-            full = "%r" + std::to_string(value.reg); 
+            full = (isFloat() ? "%f" : isVector() ? "%v" : "%r") + std::to_string(value.reg); 
             break;
         case PREG:
             full = std::string(*(value.physReg));
@@ -278,6 +300,10 @@ std::string DefInstr::getName() {
     return funName;
 }
 
+SymbolType DefInstr::getType() {
+    return funType;
+}
+
 std::list<Container> *DefInstr::getParams() {
     return params;
 }
@@ -314,6 +340,14 @@ void CallInstr::setExpression(Container captureReg) {
     this->regCaptureFlag = 1;
 }
 
+std::list<std::string> *CallInstr::getSavedRegs() {
+    return this->savedRegs;
+}
+
+void CallInstr::setSavedRegs(std::list<std::string> *regs) {
+    this->savedRegs = regs;
+}
+
 //converts call instr to string 
 std::string CallInstr::toString() {
     std::string ret = "call@ " + this->funName + "(";
@@ -412,6 +446,44 @@ std::string JumpInstr::getLabelName() {
 
 // -----------------------------------------------------------------
 
+// Switch Instruction
+// -----------------------------------------------------------------
+SwitchInstr::SwitchInstr(Container value, int low, std::vector<std::string> targets, std::string defaultLabel, SymbolTable *table):
+    value(value), low(low), targets(targets), defaultLabel(defaultLabel) {
+    this->operation = JUMP_TABLE;
+    this->currentSymbolTable = table;
+}
+
+Container SwitchInstr::getContainer() {
+    return this->value;
+}
+
+int SwitchInstr::getLow() {
+    return this->low;
+}
+
+std::vector<std::string> &SwitchInstr::getTargets() {
+    return this->targets;
+}
+
+std::string SwitchInstr::getDefault() {
+    return this->defaultLabel;
+}
+
+std::string SwitchInstr::toString() {
+    std::string ret = "switch " + value.toString() + " from " + std::to_string(low) + " (";
+
+    for (unsigned int k = 0; k < targets.size(); k++) {
+        if (k > 0)
+            ret += ", ";
+        ret += targets[k];
+    }
+
+    return ret + ") else " + defaultLabel;
+}
+
+// -----------------------------------------------------------------
+
 // Return Instruction
 // -----------------------------------------------------------------
 ReturnInstr::ReturnInstr(Container value, SymbolTable *table):
@@ -497,11 +569,25 @@ std::string string_of_irop(IrOp op) {
         case IrOp::PLUS_PLUS: return "++";
         case IrOp::MINUS_MINUS: return "--";
         case IrOp::EQUAL_EQUAL: return "==";
+        case IrOp::ITOF: return "itof";
+        case IrOp::FTOI: return "ftoi";
+        case IrOp::SPLAT: return "splat";
+        case IrOp::STEP: return "step";
+        case IrOp::LANE: return "lane";
         default:
             throw IR_Error("Unrecognized operator.");
     }
 }
 
+IrOp irop_of_string(std::string s) {
+    for (int op = (int)IrOp::ADD; op <= (int)IrOp::FTOI; op++) {
+        if (string_of_irop((IrOp)op) == s)
+            return (IrOp)op;
+    }
+
+    throw IR_Error("Unrecognized operator '" + s + "'.");
+}
+
 IrOp irop_of_token(Token t) {
     switch (t.getType()) {
         case PLUS:          return IrOp::ADD;
@@ -553,6 +639,10 @@ std::vector<BasicBlock> bblist_of_instruction_list(std::list<Instruction *>instr
     };
     // --------------------------------------------
 
+    // a program of only prototypes has no code at all
+    if (instructions.empty())
+        return bblist;
+
     // add the initial basic block to the list
     bblist.push_back(BasicBlock());
 
@@ -596,6 +686,7 @@ std::vector<BasicBlock> bblist_of_instruction_list(std::list<Instruction *>instr
                 break;
             // jumps end a basic block, next instruction should be leader
             case JUMP:
+            case JUMP_TABLE:
                 addInstruction(i);
                 pushBB();
                 break;
@@ -617,10 +708,136 @@ std::vector<BasicBlock> bblist_of_instruction_list(std::list<Instruction *>instr
     return bblist;
 }
 
-// remove empty basic blocks
+// remove empty basic blocks, in one pass as erasing them one by one moves
+// every block behind them each time
 void removeEmptyBlocks(std::vector<BasicBlock> &bblist) {
-    for (auto it = bblist.begin(); it != bblist.end(); it++) {
-        if (it->isEmpty() && (it + 1) == bblist.end()) {bblist.erase(it); return;}
-        if (it->isEmpty()) it = bblist.erase(it);
+    bblist.erase(std::remove_if(bblist.begin(), bblist.end(), [](BasicBlock &bb) {
+        return bb.isEmpty();
+    }), bblist.end());
+}
+
+
+// collect the containers an instruction touches, unset operands are skipped
+std::vector<Container> containers_of_instruction(Instruction *i) {
+    std::vector<Container> conts;
+
+    switch (i->getOp()) {
+        case CONST_LET:
+            conts.push_back(((LetInstr *)i)->getContainer());
+            conts.push_back(((LetInstr *)i)->getOp1());
+            break;
+        case UNARY_LET:
+            conts.push_back(((LetInstr *)i)->getContainer());
+            conts.push_back(((LetInstr *)i)->getOp1());
+            break;
+        case BINARY_LET:
+            conts.push_back(((LetInstr *)i)->getContainer());
+            conts.push_back(((LetInstr *)i)->getOp1());
+            conts.push_back(((LetInstr *)i)->getOp2());
+            break;
+        case DECL:
+            conts.push_back(((DeclInstr *)i)->getContainer());
+            break;
+        case DEF:
+            for (auto &c : *((DefInstr *)i)->getParams())
+                conts.push_back(c);
+            break;
+        case CALL:
+            for (auto &c : *((CallInstr *)i)->getArgs())
+                conts.push_back(c);
+            if (((CallInstr *)i)->getFlag())
+                conts.push_back(((CallInstr *)i)->getContainer());
+            break;
+        case BRANCH:
+            conts.push_back(((BranchInstr *)i)->getContainer());
+            break;
+        case JUMP_TABLE:
+            conts.push_back(((SwitchInstr *)i)->getContainer());
+            break;
+        case RET:
+            conts.push_back(((ReturnInstr *)i)->getContainer());
+            break;
+        default:
+            break;
+    }
+
+    return conts;
+}
+
+// copy an instruction with its containers and labels renamed, used to
+// renumber linked modules and to inline function bodies
+Instruction *map_instruction(Instruction *i, std::function<Container (Container)> cont,
+        std::function<std::string (std::string)> label) {
+    switch (i->getOp()) {
+        case CONST_LET:
+        case UNARY_LET:
+        case BINARY_LET:
+        {
+            LetInstr *li = (LetInstr *)i;
+            LetInstr *copy = new LetInstr(cont(li->getContainer()), i->getOp(), NULL);
+
+            if (i->getOp() == CONST_LET)
+                copy->setExpression(cont(li->getOp1()));
+            else if (i->getOp() == UNARY_LET)
+                copy->setExpression(cont(li->getOp1()), li->getOperation());
+            else
+                copy->setExpression(cont(li->getOp1()), cont(li->getOp2()), li->getOperation());
+            return copy;
+        }
+        case DECL:
+        {
+            Container c = cont(((DeclInstr *)i)->getContainer());
+            return new DeclInstr(c.value.varName, c.sym, NULL);
+        }
+        case DEF:
+        {
+            DefInstr *di = (DefInstr *)i;
+            std::list<Container> *params = new std::list<Container>();
+
+            for (auto &c : *di->getParams())
+                params->push_back(cont(c));
+            return new DefInstr(di->getName(), di->getType(), params, NULL);
+        }
+        case CALL:
+        {
+            CallInstr *ci = (CallInstr *)i;
+            std::list<Container> *args = new std::list<Container>();
+
+            for (auto &c : *ci->getArgs())
+                args->push_back(cont(c));
+
+            CallInstr *copy = new CallInstr(ci->getName(), args, NULL);
+            if (ci->getFlag())
+                copy->setExpression(cont(ci->getContainer()));
+            if (ci->getSavedRegs())
+                copy->setSavedRegs(new std::list<std::string>(*ci->getSavedRegs()));
+            return copy;
+        }
+        case BRANCH:
+        {
+            BranchInstr *bi = (BranchInstr *)i;
+            std::string *two = bi->getLabelTwo() ? new std::string(label(*bi->getLabelTwo())) : NULL;
+
+            return new BranchInstr(cont(bi->getContainer()), label(bi->getLabelOne()), two, NULL);
+        }
+        case LABEL:
+            return new LableInstr(label(((LableInstr *)i)->getLabelName()), NULL);
+        case JUMP:
+            return new JumpInstr(label(((JumpInstr *)i)->getLabelName()), NULL);
+        case JUMP_TABLE:
+        {
+            SwitchInstr *si = (SwitchInstr *)i;
+            std::vector<std::string> targets;
+
+            for (auto &t : si->getTargets())
+                targets.push_back(label(t));
+            return new SwitchInstr(cont(si->getContainer()), si->getLow(), targets, label(si->getDefault()), NULL);
+        }
+        case RET:
+            return new ReturnInstr(cont(((ReturnInstr *)i)->getContainer()), NULL);
+        case END:
+            return new FuncEnd(NULL);
+        default:
+            throw IR_Error("Unhandled IR instruction.");
     }
 }
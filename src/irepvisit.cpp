@@ -5,8 +5,63 @@
  *  Problem : Currently not maintaing symbol table when we traverse AKA set nulls to real pointers if needed  
  */
 
+#include <map>
 #include "irepvisit.h"
 #include "token.h"
+
+// Evaluates a case value, which has to be an integer constant expression
+class CaseValue : public ExpressionVisitor {
+public:
+    bool constant = true;
+    int value = 0;
+
+    virtual void visit(Expression &exp) {
+        constant = false;
+    }
+
+    virtual void visit(BinaryExp &exp) {
+        exp.left->accept(this);
+        int left = value;
+        exp.right->accept(this);
+
+        switch (exp.op.getType()) {
+            case PLUS: value = left + value; break;
+            case MINUS: value = left - value; break;
+            case STAR: value = left * value; break;
+            default: constant = false;
+        }
+    }
+
+    virtual void visit(UnaryExp &exp) {
+        exp.exp->accept(this);
+
+        switch (exp.op.getType()) {
+            case MINUS: value = -value; break;
+            case TILDA: value = ~value; break;
+            default: constant = false;
+        }
+    }
+
+    virtual void visit(PrimaryExp &exp) {
+        if (exp.value.getType() == INTEGER)
+            value = std::stoi(exp.value.getLexeme());
+        else
+            constant = false;
+    }
+
+    virtual void visit(GroupExp &exp) {
+        exp.exp->accept(this);
+    }
+
+    virtual void visit(FunCall &exp) {
+        constant = false;
+    }
+
+    virtual void visit(Assignment &exp) {
+        constant = false;
+    }
+};
+
 // Helper functions
 // Printer
 void IRepVisitor::printIR() {
@@ -20,53 +75,20 @@ void IRepVisitor::printIR() {
 bool IRepVisitor::labelsAreGood() {
     // Label Names also have to be unique
     // The parser handles if they are in a scope or not but not for unique ness
-    // Converting list of instructions to vector of instructions locally to check
-    std::vector<Instruction *> goToListCheck;
-    
-    // Get the Label names and which function they occur in
-    for (auto instr: this->irep) {
-        goToListCheck.push_back(instr);
-        if (instr->toString().find("label ") != std::string::npos) {
-            this->labelNames.push_back(instr->toString());
-            this->labelNames.back().erase(0,6);
-            for (std::vector<Instruction *>::reverse_iterator rit=goToListCheck.rbegin(); rit!=goToListCheck.rend(); ++rit) {
-                if ((*rit)->toString().find("def @") != std::string::npos) {
-                    this->labelFunctionNames.push_back((*rit)->toString());
-                    this->labelFunctionNames.back().erase(0,this->labelFunctionNames.back().find(" ") + 2);
-                    this->labelFunctionNames.back().erase(this->labelFunctionNames.back().find("("),this->labelFunctionNames.back().npos);
-                    break;
-                }
-            }
-        }
-    }
-    
-    // Now Check Label Unqiueness by comparing the name and the function it belongs too
-    // If it is found that name and function name are duplicated then RETURN FALSE
-    for (unsigned int i = 0; i < this->labelNames.size(); i++) {
-        for (unsigned int j = i + 1; j < this->labelNames.size(); j++) {
-            if ((this->labelNames.at(i).compare(this->labelNames.at(j)) == 0) & (this->labelFunctionNames.at(i).compare(this->labelFunctionNames.at(j)) == 0)) {
-            // Need to  Throw propper error
-                std::cout << "Error Non-Unique Labels: repeat of label: "<< this->labelNames.at(i) << " in function: "<<  this->labelFunctionNames.at(i) << std::endl;
-                return false;
-            }
-        }
+    if (!this->repeatedLabels.empty()) {
+        // Need to  Throw propper error
+        std::cout << "Error Non-Unique Labels: repeat of label: "<< this->repeatedLabels[0].second << " in function: "<<  this->repeatedLabels[0].first << std::endl;
+        return false;
     }
 
-    // Now we check every goto function against the label list
+    // Now we check every goto against the labels of its function
     for (unsigned int i = 0; i < this->goToLabelName.size(); i++) {
-        // Check the function name of the goto to the function name of the labels
-        // as well as the label names of each goto 
-        for (unsigned int j = 0; j < this->labelNames.size(); j++) {
-            // Same Function 
-            if ((this->goToFuncName.at(i).compare(this->labelFunctionNames.at(j)) == 0) && (this->goToLabelName.at(i).compare(this->labelNames.at(j)) == 0)) {
-                // Same Label
-                break;
-            }
-            // if j = size - 1 then no match was found for this goto so report it and exit
-            if (j == (this->labelNames.size() - 1)) {
-                std::cout << "No Matching Label found for goto labelname: "<< this->goToLabelName.at(i) << " in scope of function: "<<  this->goToFuncName.at(i) << std::endl;
-                return false;
-            }
+        auto labels = this->functionLabels.find(this->goToFuncName.at(i));
+
+        // if no match was found for this goto so report it and exit
+        if (labels == this->functionLabels.end() || labels->second.count(this->goToLabelName.at(i)) == 0) {
+            std::cout << "No Matching Label found for goto labelname: "<< this->goToLabelName.at(i) << " in scope of function: "<<  this->goToFuncName.at(i) << std::endl;
+            return false;
         }
     }
         
@@ -117,6 +139,67 @@ SymbolType IRepVisitor::getSymType(Token token) {
     }
     
 }
+// The value of the expression just visited
+Container IRepVisitor::lastReg(Expression *exp) {
+    Container c = Container(REG, (this->getReg() - 1));
+    if (exp && exp->type == SYM_FLOAT)
+        c.sym = SYM_FLOAT;
+    return c;
+}
+
+// Convert between int and float. A constant that was just loaded is loaded
+// as the other type instead
+Container IRepVisitor::convert(Container value, SymbolType type) {
+    bool toFloat = type == SYM_FLOAT;
+    if (value.isFloat() == toFloat)
+        return value;
+
+    Container result = Container(REG, this->generateReg());
+    result.sym = toFloat ? SYM_FLOAT : SYM_INT;
+
+    Instruction *last = this->irep.empty() ? NULL : this->irep.back();
+    if (last && last->getOp() == CONST_LET && value.isRegister()) {
+        LetInstr *li = (LetInstr *)last;
+        Container dest = li->getContainer();
+        Container imm = li->getOp1();
+
+        if (imm.isImmediate() && dest.isRegister() && dest.getIntValue() == value.getIntValue()) {
+            Container converted = Container(IMM);
+            if (toFloat)
+                converted.setVal((float)imm.getIntImmediate());
+            else
+                converted.setVal((int)imm.getFloatImmediate());
+            converted.sym = result.sym;
+
+            LetInstr *load = new LetInstr(result, CONST_LET, NULL);
+            load->setExpression(converted);
+            this->irep.back() = load;
+            return result;
+        }
+    }
+
+    LetInstr *conversion = new LetInstr(result, UNARY_LET, NULL);
+    conversion->setExpression(value, toFloat ? IrOp::ITOF : IrOp::FTOI);
+    this->irep.push_back(conversion);
+    return result;
+}
+
+// Conditions and the logic operators look at ints
+Container IRepVisitor::truth(Container value) {
+    if (!value.isFloat())
+        return value;
+
+    Container zero = Container(IMM);
+    zero.setVal(0.0f);
+    zero.sym = SYM_FLOAT;
+
+    Container test = Container(REG, this->generateReg());
+    LetInstr *compare = new LetInstr(test, BINARY_LET, NULL);
+    compare->setExpression(value, zero, IrOp::NOT_EQ);
+    this->irep.push_back(compare);
+    return test;
+}
+
 // StatementVisitor methods to override
 void IRepVisitor::visit(Statement &stat) {
     // Do nothing
@@ -152,6 +235,7 @@ void IRepVisitor::visit(FunctionDec &stat) {
     
     // Push it onto the list
     this->irep.push_back(funDef);
+    this->currentDef = funDef;
 }
 
 // Really just check the declaration and statement to visit them
@@ -182,42 +266,16 @@ void IRepVisitor::visit(VarDec &stat) {
     SymbolType symbol = this->getSymType(stat.type);
     varDecl = new DeclInstr(varname, symbol, NULL);
     
-    // Check if there is any above function definition and throw a flag if there is
+    // Check the parameters of the function we are in and throw a flag if
+    // the declaration shadows one
     int reDecFlag = 0;
-    if (this->scope >= 1) {
-        for (std::list<Instruction *>::reverse_iterator rit=this->irep.rbegin(); rit!=this->irep.rend(); ++rit) {
-           // Check the definition
-           
-            if ((*rit)->toString().find("def @") != std::string::npos) {
-                
-                // ok we know we are at a definition instruction now
-                DefInstr *copy = dynamic_cast<DefInstr *>((*rit));
-                // Go throw the args list and compare the container names to the varname
-                if (copy) {
-                   // Get the parameter list
-                   std::list<Container> *defParams = copy->getParams();
-                   // Extract the name aka get rid of the _1 in params and compare to the first part of the declaration
-                   std::string extract;
-                   // Now check the names
-                   for (auto container: *defParams) {
-                        extract = container.toString();
-                        extract.erase((extract.size() - 2), extract.npos);
-                        //std::cout << container.toString() <<  " " << extract<<std::endl;
-                        if (extract.compare(stat.name.getLexeme()) == 0) {
-                            // Conflicting declarations
-                            reDecFlag = 1;
-                        }
-                   }
-                    
-                } else {
-                    std::cerr << "Dynamic Cast Did Not work "<<std::endl;
-                    exit(-1);
-                }
-                
-                // Break out on first function definition
-                break; 
-            }            
-        } 
+    if (this->scope >= 1 && this->currentDef) {
+        for (auto container: *this->currentDef->getParams()) {
+            if (container.getStringValue() == stat.name.getLexeme() + "_1") {
+                // Conflicting declarations
+                reDecFlag = 1;
+            }
+        }
     }
     if (reDecFlag == 1) {
         std::cerr << "Variable Declaration: " << *varname << " already declared in parameters of function."<< std::endl;
@@ -227,8 +285,8 @@ void IRepVisitor::visit(VarDec &stat) {
     }
     // Determine if it as assignment else this should be null
     if (stat.init) {
-        Container varDeclCont = Container(STR, varname);
-        Container prevReg = Container(REG, (this->getReg() - 1));
+        Container varDeclCont = Container(STR, varname, symbol);
+        Container prevReg = this->convert(this->lastReg(stat.init), symbol);
         
         LetInstr *assmt = new LetInstr(varDeclCont, CONST_LET, NULL);
         assmt->setExpression(prevReg);
@@ -255,7 +313,7 @@ void IRepVisitor::visit(Return &stat) {
     ReturnInstr *rtrn = NULL;
     if (stat.retVal) {
         stat.retVal->accept(this);
-        Container prevReg = Container(REG, (this->getReg() - 1));
+        Container prevReg = this->convert(this->lastReg(stat.retVal), this->currentDef->getType());
         
         rtrn = new ReturnInstr(prevReg, NULL);
     } else {
@@ -280,13 +338,15 @@ void IRepVisitor::visit(While &stat) {
     
     if (stat.condition)
         stat.condition->accept(this);
-    Container prevReg = Container(REG, (this->getReg() - 1));
+    Container prevReg = this->truth(this->lastReg(stat.condition));
     BranchInstr *branchCode = new BranchInstr(prevReg, labelName, labelNameTwo, NULL);
     
     this->irep.push_back(branchCode);
         
+    this->breakLabels.push_back(*labelNameTwo);
     if (stat.body)
         stat.body->accept(this);
+    this->breakLabels.pop_back();
 
     this->irep.push_back(jumpTooOne);
     this->irep.push_back(whileLabelEnd);
@@ -303,7 +363,7 @@ void IRepVisitor::visit(If &stat) {
     if (stat.condition)
         stat.condition->accept(this);
     
-    Container condReg = Container(REG, (this->getReg() - 1));
+    Container condReg = this->truth(this->lastReg(stat.condition));
     std::string labelName = "L" + std::to_string(this->generateLabel());
     std::string *labelNameTwo = NULL;
     
@@ -361,14 +421,16 @@ void IRepVisitor::visit(For &stat) {
     if (stat.condition)
         stat.condition->accept(this);
         
-    Container prevReg = Container(REG, (this->getReg() - 1));
+    Container prevReg = this->truth(this->lastReg(stat.condition));
     BranchInstr *branchCode = new BranchInstr(prevReg, labelName, labelNameTwo, NULL);
     
     this->irep.push_back(branchCode);
     
     // Visit the code and let it populate the stuff
+    this->breakLabels.push_back(*labelNameTwo);
     if (stat.body)
         stat.body->accept(this);
+    this->breakLabels.pop_back();
     
     // This should be the incrementer for the incrementing so this code needs to be put below the body
     if (stat.inc)
@@ -381,20 +443,121 @@ void IRepVisitor::visit(For &stat) {
 }
 
 // Visit Switch
+// Every case gets a label and the bodies follow each other in order, so
+// control falls through from one case to the next until a break jumps to
+// the end. Dense cases are dispatched through a jump table, sparse ones
+// through a balanced tree of compares.
 void IRepVisitor::visit(Switch &stat) {
     stat.value->accept(this);
-    // We need several things
-    // The conditional 
+    if (stat.value->type == SYM_FLOAT) {
+        std::cerr << "Error Switch value is not an integer" << std::endl;
+        exit(-1);
+    }
+    Container value = Container(REG, (this->getReg() - 1));
+
+    std::string endLabel = "L" + std::to_string(this->generateLabel());
+    std::string defaultLabel = endLabel;
+    std::vector<std::string> caseLabels;
+    std::map<int, std::string> cases;
+    bool hasDefault = false;
+
+    // the parser only puts cases in a switch body
     for (Statement *s : stat.body) {
+        Case *c = (Case *)s;
+        std::string label = "L" + std::to_string(this->generateLabel());
+        caseLabels.push_back(label);
+
+        if (!c->value) {
+            if (hasDefault) {
+                std::cerr << "Error Multiple default labels in one switch" << std::endl;
+                exit(-1);
+            }
+            hasDefault = true;
+            defaultLabel = label;
+            continue;
+        }
+
+        CaseValue v;
+        c->value->accept(&v);
+        if (!v.constant) {
+            std::cerr << "Error Case value is not an integer constant" << std::endl;
+            exit(-1);
+        }
+        if (!cases.insert(std::make_pair(v.value, label)).second) {
+            std::cerr << "Error Duplicate case value: " << v.value << std::endl;
+            exit(-1);
+        }
+    }
+
+    std::vector<std::pair<int, std::string>> sorted(cases.begin(), cases.end());
+    long range = sorted.empty() ? 0 : (long)sorted.back().first - sorted.front().first + 1;
+
+    if (sorted.size() >= SWITCH_TABLE_MIN_CASES && range <= (long)sorted.size() * SWITCH_TABLE_DENSITY) {
+        // values without a case of their own go to the default
+        std::vector<std::string> targets(range, defaultLabel);
+        for (auto &c : sorted)
+            targets[(long)c.first - sorted.front().first] = c.second;
+
+        this->irep.push_back(new SwitchInstr(value, sorted.front().first, targets, defaultLabel, NULL));
+    } else {
+        this->switchSearch(value, sorted, 0, sorted.size(), defaultLabel);
+    }
+
+    this->breakLabels.push_back(endLabel);
+    unsigned int k = 0;
+    for (Statement *s : stat.body) {
+        this->irep.push_back(new LableInstr(caseLabels[k++], NULL));
         s->accept(this);
     }
+    this->breakLabels.pop_back();
+
+    this->irep.push_back(new LableInstr(endLabel, NULL));
+}
+
+// Emit the compares finding a value among the sorted cases [begin, end).
+// A branch jumps when its condition is false, so a range is split with
+// value < pivot jumping to the upper half and a case is matched with
+// value != case jumping to its label
+void IRepVisitor::switchSearch(Container value, std::vector<std::pair<int, std::string>> &cases,
+        unsigned int begin, unsigned int end, std::string defaultLabel) {
+    if (end - begin <= SWITCH_LINEAR_CASES) {
+        for (unsigned int k = begin; k < end; k++) {
+            Container caseValue = Container(IMM);
+            caseValue.setVal(cases[k].first);
+
+            Container test = Container(REG, this->generateReg());
+            LetInstr *compare = new LetInstr(test, BINARY_LET, NULL);
+            compare->setExpression(value, caseValue, IrOp::NOT_EQ);
+
+            this->irep.push_back(compare);
+            this->irep.push_back(new BranchInstr(test, cases[k].second, NULL, NULL));
+        }
+
+        this->irep.push_back(new JumpInstr(defaultLabel, NULL));
+        return;
+    }
+
+    unsigned int mid = (begin + end) / 2;
+    std::string upper = "L" + std::to_string(this->generateLabel());
+
+    Container pivot = Container(IMM);
+    pivot.setVal(cases[mid].first);
+
+    Container test = Container(REG, this->generateReg());
+    LetInstr *compare = new LetInstr(test, BINARY_LET, NULL);
+    compare->setExpression(value, pivot, IrOp::LESS);
+
+    this->irep.push_back(compare);
+    this->irep.push_back(new BranchInstr(test, upper, NULL, NULL));
+
+    this->switchSearch(value, cases, begin, mid, defaultLabel);
+    this->irep.push_back(new LableInstr(upper, NULL));
+    this->switchSearch(value, cases, mid, end, defaultLabel);
 }
 
 // Visit Case
+// The switch placed the case's label, only the body is left
 void IRepVisitor::visit(Case &stat) {
-    if (stat.value)
-        stat.value->accept(this);
-
     for (Statement *s : stat.body) {
         s->accept(this);
     }
@@ -403,38 +566,40 @@ void IRepVisitor::visit(Case &stat) {
 // Visit Goto
 void IRepVisitor::visit(Goto &stat) {
     std::string labelName = stat.id.getLexeme() + "_u";
-    JumpInstr *jumpGoTo = new JumpInstr(labelName, NULL);
+    // every function has its own labels, the assembly has one namespace
+    JumpInstr *jumpGoTo = new JumpInstr(labelName + "." + this->funNameHolder, NULL);
     
     this->irep.push_back(jumpGoTo);
     
     // Now push back the location of the goto jump statement which is just the current size of the instruciton list - 1 for 0 decrementing
     this->goToMarker.push_back(this->irep.size() - 1);
     
-    // Check for the first definition instruction
-    for (std::list<Instruction *>::reverse_iterator rit=this->irep.rbegin(); rit!=this->irep.rend(); ++rit) {
-        if ((*rit)->toString().find("def @") != std::string::npos) {
-            this->goToFuncName.push_back((*rit)->toString());
-            this->goToFuncName.back().erase(0,this->goToFuncName.back().find(" ") + 2);
-            this->goToFuncName.back().erase(this->goToFuncName.back().find("("),this->goToFuncName.back().npos);
-            this->goToLabelName.push_back(labelName);
-            break;
-        }
-    }
-
-    
+    // Record the function the goto is in
+    this->goToFuncName.push_back(this->funNameHolder);
+    this->goToLabelName.push_back(labelName);
 }
 
 // Visit Label
 void IRepVisitor::visit(Label &stat) {
     // Labels have ID's so push them onto the Structure
     std::string labelName = stat.id.getLexeme() + "_u";
-    LableInstr *newLabel = new LableInstr(labelName, NULL);
+    LableInstr *newLabel = new LableInstr(labelName + "." + this->funNameHolder, NULL);
     
     this->irep.push_back(newLabel);
+
+    // Record it for the function it is in, labelsAreGood reports repeats
+    if (!this->functionLabels[this->funNameHolder].insert(labelName).second)
+        this->repeatedLabels.push_back(std::make_pair(this->funNameHolder, labelName));
 }
 
 // Visit break statement
 void IRepVisitor::visit(Break &stat) {
+    if (this->breakLabels.empty()) {
+        std::cerr << "Error break outside of a loop or switch" << std::endl;
+        exit(-1);
+    }
+
+    this->irep.push_back(new JumpInstr(this->breakLabels.back(), NULL));
 }
 
 // ExpresisonVisitor methods to override
@@ -444,20 +609,32 @@ void IRepVisitor::visit(Expression &exp) {
 
 // Visit Binary expression
 void IRepVisitor::visit(BinaryExp &exp) {
+    // logic looks at ints, everything else is done in float when either
+    // operand is one. Each operand is converted right after it is computed.
+    IrOp op = irop_of_token(exp.op);
+    bool logic = op == IrOp::AND_AND || op == IrOp::OR_OR;
+    bool isFloat = !logic && ((exp.left && exp.left->type == SYM_FLOAT) ||
+        (exp.right && exp.right->type == SYM_FLOAT));
+    auto operand = [&](Expression *e) -> Container {
+        Container c = this->lastReg(e);
+        return logic ? this->truth(c) : this->convert(c, isFloat ? SYM_FLOAT : SYM_INT);
+    };
+
     if (exp.right)
         exp.right->accept(this);
     
     // Create a let expression to take both register - 1 and - 2
-    Container prevRegRight = Container(REG, (this->getReg() - 1));
+    Container prevRegRight = operand(exp.right);
 
     if (exp.left)
         exp.left->accept(this);
-    Container prevRegLeft = Container(REG, (this->getReg() - 1));
+    Container prevRegLeft = operand(exp.left);
     
     // Now Create a let instr where the current register is assigned the previous two registers
     Container currentReg = Container(REG, this->generateReg());
+    currentReg.sym = exp.type;
     LetInstr *binInstr = new LetInstr(currentReg, BINARY_LET, NULL);
-    binInstr->setExpression(prevRegLeft, prevRegRight, irop_of_token(exp.op));
+    binInstr->setExpression(prevRegLeft, prevRegRight, op);
     
     this->irep.push_back(binInstr);
 }
@@ -468,202 +645,56 @@ void IRepVisitor::visit(Assignment &exp) {
     if (exp.exp)
         exp.exp->accept(this);
     
-    // Get previous register because at this point the assignment should be 
-    // Variable name is %prevReg since generate reg function advances reg by 1
-    // Each time it is called
-    std::string *varName = NULL;// = new std::string( exp.name.getLexeme()+ "_"+ std::to_string(this->scope));
-    Container varAssign;// = Container(STR, varName);
-    Container prevReg = Container(REG, (this->getReg() - 1));
-    // 
-    // Check the list for any matching above declarations that match the 
-    // Mark the exiting of the function 
-    
-    // Mark the when you exit a function and entering another
-    //std::cout << exp.name.getLexeme() << std::endl;
-    int ex = 0;
-    int bad = 0;
-    // This is the check loop that looks for any declarations in the function or in global
-    // Sets a flag if it made through the entire list
-    for (std::list<Instruction *>::reverse_iterator rit=this->irep.rbegin(); rit!=this->irep.rend(); ++rit) {
-        if ((*rit)->toString().find("def @") != std::string::npos) {
-            // Check the global list
-            
-            if (ex == 1) {
-                varAssign = Container(STR, varName);
-                break;
-            }  
-            DefInstr *copy = dynamic_cast<DefInstr *>((*rit));
-            int paramFlag = 0;
-            
-            // Go throw the args list and compare the container names to the varname
-            if (copy) {
-               // Get the parameter list
-               std::list<Container> *defParams = copy->getParams();
-               // Extract the name aka get rid of the _1 in params and compare to the first part of the declaration
-               std::string extract;
-               // Now check the names
-               for (auto container: *defParams) {
-                    extract = container.toString();
-                    extract.erase((extract.size() - 2), extract.npos);
-                    //std::cout << container.toString() <<  " " << extract<<std::endl;
-                    if (extract.compare(exp.name.getLexeme()) == 0) {
-                        // Conflicting declarations
-                        paramFlag = 1;
-                    }
-               }
-               if (paramFlag == 1) {
-                    varName = new std::string(exp.name.getLexeme() + "_1");
-                    varAssign = Container(STR, varName);
-                    break;
-               }
-               
-                
-            } else {
-                std::cerr << "Dynamic Cast Did Not work "<<std::endl;
-                exit(-1);
-            }
-            
-             if (paramFlag == 0) {
-                // Need to search the global list 
-                unsigned int nearEnd = 0;
-                for (std::list<Instruction *>::reverse_iterator star=this->irep.rbegin(); star!=this->irep.rend(); ++star) {
-            
-                        // If there was a declaration in the global scope and return 
-                        if ((*star)->toString().find("decl " + exp.name.getLexeme() + "_0 ") != std::string::npos) {
-                            varName = new std::string(exp.name.getLexeme() + "_0");
-                            varAssign = Container(STR, varName);
-                            break;
-                        }
-                        nearEnd++;
-                    
-                }
-                //std::cout << nearEnd << "   " << this->irep.size() << std::endl;
-                
-                if (nearEnd == (this->irep.size())) {
-                    // set bad flag
-                    bad = 1;
-                }
-                break;
-            }  
-        }
-        
-        // You found a declaration that contains the string now check if they share the same name by extracting the _ number and if they are eaul then continue
-        // Current logic error with finding names inside of names 
-        if ((*rit)->toString().find("decl " + exp.name.getLexeme() ) != std::string::npos) {
-            std::string varCompare = (*rit)->toString();
-            std::string name;
-            varCompare.erase(0,5);
-            
-            varCompare.erase(varCompare.find(" "), varCompare.npos);
-            name = varCompare;
-            name.erase((name.size() - 2),name.npos);
-            //std::cout << name << " scope: " << this->scope <<std::endl;
-            // Now compare if they are the same variable 
-            if (name.compare(exp.name.getLexeme()) == 0) {
-                //std::cout << varCompare << std::endl;
-                std::string scopeExtract = varCompare;
-                scopeExtract.erase(0 , varCompare.size() - 1);
-                //std::cout << scopeExtract << std::endl;
-                //std::cout << name << " scope: " << this->scope  << " | extracted scope: " << scopeExtract <<std::endl;
-                //If the varnames are equal break else reassign the varname
-                
-                if (this->scope == std::stoi(scopeExtract)) {
-                    varName = new std::string(varCompare);
-                    varAssign = Container(STR, varName);
-                    break;
-                } else if (this->scope > std::stoi(scopeExtract)) {
-                    // Record the closest visible scope
-                    if (varName == NULL) {
-                        varName = new std::string(varCompare);
-                    }
-
-                    ex = 1;
-                }
-            }
-        }
-    }
-    
-
-    // Check the exit flag meaning you are out of the function
-    if (bad == 1) {
+    // The variable is named after the scope that declares it, which the
+    // symbol table resolved
+    Container prevReg = this->lastReg(exp.exp);
+    if (exp.scope < 0) {
         std::cerr << "Error No Declaration for variable: " << exp.name.getLexeme() << std::endl;
         exit(-1);
     }
+    std::string *varName = new std::string(exp.name.getLexeme() + "_" + std::to_string(exp.scope));
+    Container varAssign = Container(STR, varName, exp.type);
     
-    // Switch over the different type of assignments
-    // All of these do something and push that something to a register and then assig x to the previous register
+    // The operation of a compound assignment
+    IrOp op;
     switch (exp.op.getType()) {
-        case PLUS_EQUAL: {
-            // Have to advance the register for assignment and let the instructions push in a specific order 
-            Container currentReg = Container(REG, this->generateReg());
-            LetInstr *plusEqual = new LetInstr(currentReg, BINARY_LET, NULL);
-            plusEqual->setExpression(varAssign, prevReg, IrOp::ADD);
+        case PLUS_EQUAL: op = IrOp::ADD; break;
+        case MINUS_EQUAL: op = IrOp::SUB; break;
+        case SLASH_EQUAL: op = IrOp::DIV; break;
+        case STAR_EQUAL: op = IrOp::MUL; break;
+        case MOD_EQUAL: op = IrOp::MOD; break;
+        // Just an equals
+        default: {
             LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
-            assignment->setExpression(currentReg);
-            
-            //Push let instructions onto the board
-            this->irep.push_back(plusEqual);
-            this->irep.push_back(assignment);
-            break; 
-       }
-       case MINUS_EQUAL: {
-            // Have to advance the register for assignment and let the instructions push in a specific order 
-            Container currentReg = Container(REG, this->generateReg());
-            LetInstr *minusEqual = new LetInstr(currentReg, BINARY_LET, NULL);
-            minusEqual->setExpression(varAssign, prevReg, IrOp::SUB);
-            LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
-            assignment->setExpression(currentReg);
-            
-            //Push let instructions onto the board
-            this->irep.push_back(minusEqual);
+            assignment->setExpression(this->convert(prevReg, exp.type));
             this->irep.push_back(assignment);
-            break; 
-       }
-       case SLASH_EQUAL:{
-            // Have to advance the register for assignment and let the instructions push in a specific order 
-            Container currentReg = Container(REG, this->generateReg());
-            LetInstr *slashEqual = new LetInstr(currentReg, BINARY_LET, NULL);
-            slashEqual->setExpression(varAssign, prevReg, IrOp::DIV);
-            LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
-            assignment->setExpression(currentReg);
-            
-            //Push let instructions onto the board
-            this->irep.push_back(slashEqual);
-            this->irep.push_back(assignment);
-            break; 
-       }
-       case STAR_EQUAL: {
-            // Have to advance the register for assignment and let the instructions push in a specific order 
-            Container currentReg = Container(REG, this->generateReg());
-            LetInstr *starEqual = new LetInstr(currentReg, BINARY_LET, NULL);
-            starEqual->setExpression(varAssign, prevReg,  IrOp::MUL);
-            LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
-            assignment->setExpression(currentReg);
-            
-            //Push let instructions onto the board
-            this->irep.push_back(starEqual);
-            this->irep.push_back(assignment);
-            break; 
-       }
-       case MOD_EQUAL: {
-            // Have to advance the register for assignment and let the instructions push in a specific order 
-            Container currentReg = Container(REG, this->generateReg());
-            LetInstr *modEqual = new LetInstr(currentReg, BINARY_LET, NULL);
-            modEqual->setExpression(varAssign, prevReg, IrOp::MOD);
-            LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
-            assignment->setExpression(currentReg);
-            
-            //Push let instructions onto the board
-            this->irep.push_back(modEqual);
-            this->irep.push_back(assignment);
-            break; 
-       }
-       // Just an equals
-       default: 
-        LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
-        assignment->setExpression(prevReg);
-        this->irep.push_back(assignment);
+            return;
+        }
+    }
+
+    // x op= y is x = x op y, done in float when either of them is one
+    SymbolType opType = exp.type == SYM_FLOAT || prevReg.isFloat() ? SYM_FLOAT : SYM_INT;
+    prevReg = this->convert(prevReg, opType);
+
+    Container varValue = varAssign;
+    if (exp.type != opType) {
+        Container loaded = Container(REG, this->generateReg());
+        LetInstr *load = new LetInstr(loaded, CONST_LET, NULL);
+        load->setExpression(varAssign);
+        this->irep.push_back(load);
+        varValue = this->convert(loaded, opType);
     }
+
+    // Have to advance the register for assignment and let the instructions push in a specific order 
+    Container currentReg = Container(REG, this->generateReg());
+    currentReg.sym = opType;
+    LetInstr *compound = new LetInstr(currentReg, BINARY_LET, NULL);
+    compound->setExpression(varValue, prevReg, op);
+    this->irep.push_back(compound);
+
+    LetInstr *assignment = new LetInstr(varAssign, CONST_LET, NULL);
+    assignment->setExpression(this->convert(currentReg, exp.type));
+    this->irep.push_back(assignment);
 }
 
 // Visit Unary expression
@@ -672,8 +703,23 @@ void IRepVisitor::visit(UnaryExp &exp) {
         exp.exp->accept(this);
     // At this point it should be the previous register that we need to apply 
     //  The unary expression too since its unaryOp %prevReg
-    Container prevReg = Container(REG, (this->getReg() - 1));
+    Container prevReg = this->lastReg(exp.exp);
+
+    // !f is f == 0.0
+    if (exp.op.getType() == BANG && prevReg.isFloat()) {
+        Container zero = Container(IMM);
+        zero.setVal(0.0f);
+        zero.sym = SYM_FLOAT;
+
+        Container test = Container(REG, this->generateReg());
+        LetInstr *compare = new LetInstr(test, BINARY_LET, NULL);
+        compare->setExpression(prevReg, zero, IrOp::EQUAL_EQUAL);
+        this->irep.push_back(compare);
+        return;
+    }
+
     Container storeReg= Container(REG, this->generateReg());
+    storeReg.sym = exp.type;
     LetInstr *unaryInstr = new LetInstr(storeReg, UNARY_LET, NULL);
     unaryInstr->setExpression(prevReg, irop_of_token(exp.op));
     
@@ -686,121 +732,17 @@ void IRepVisitor::visit(UnaryExp &exp) {
 void IRepVisitor::visit(PrimaryExp &exp) {
     switch (exp.value.getType()) {
         case IDENTIFIER: {
-            std::string *varName = NULL;// = new std::string(exp.value.getLexeme());
-            Container idCont ; // = Container(STR, idName);
-            // Check to see which declaration you are using
-            int ex = 0;
-            int bad = 0;
-            for (std::list<Instruction *>::reverse_iterator rit=this->irep.rbegin(); rit!=this->irep.rend(); ++rit) {
-               // Check the global list
-                if ((*rit)->toString().find("def @") != std::string::npos) {
-
-                    // ok we know we are at a definition instruction now
-                    // WE need to check the argslist then the global list unless it was already found
-                    if (ex == 1) {
-                        idCont = Container(STR, varName);
-                        break;
-                    }
-                    
-                    DefInstr *copy = dynamic_cast<DefInstr *>((*rit));
-                    int paramFlag = 0;
-                    
-                    // Go throw the args list and compare the container names to the varname
-                    if (copy) {
-                       // Get the parameter list
-                       std::list<Container> *defParams = copy->getParams();
-                       // Extract the name aka get rid of the _1 in params and compare to the first part of the declaration
-                       std::string extract;
-                       // Now check the names
-                       for (auto container: *defParams) {
-                            extract = container.toString();
-                            extract.erase((extract.size() - 2), extract.npos);
-                            //std::cout << container.toString() <<  " " << extract<<std::endl;
-                            if (extract.compare(exp.value.getLexeme()) == 0) {
-                                // Conflicting declarations
-                                paramFlag = 1;
-                            }
-                       }
-                       if (paramFlag == 1) {
-                            varName = new std::string(exp.value.getLexeme() + "_1");
-                            idCont = Container(STR, varName);
-                            break;
-                       }
-                       
-                        
-                    } else {
-                        std::cerr << "Dynamic Cast Did Not work "<<std::endl;
-                        exit(-1);
-                    }
-                    
-                     if (paramFlag == 0) {
-                        // Need to search the global list 
-                        unsigned int nearEnd = 0;
-                        for (std::list<Instruction *>::reverse_iterator star=this->irep.rbegin(); star!=this->irep.rend(); ++star) {
-                    
-                                // If there was a declaration in the global scope and return 
-                                if ((*star)->toString().find("decl " + exp.value.getLexeme() + "_0 ") != std::string::npos) {
-                                    varName = new std::string(exp.value.getLexeme() + "_0");
-                                    idCont = Container(STR, varName);
-                                    break;
-                                }
-                                nearEnd++;
-                            
-                        }
-                        //std::cout << nearEnd << "   " << this->irep.size() << std::endl;
-                        
-                        if (nearEnd == (this->irep.size())) {
-                            // set bad flag
-                            bad = 1;
-                        }
-                        break;
-                    }  
-                }
-                
-                // You found a declaration that contains the string now check 
-                // if they share the same name by extracting the _ number and if they are equal then continue
-                if ((*rit)->toString().find("decl " + exp.value.getLexeme() ) != std::string::npos) {
-                    std::string varCompare = (*rit)->toString();
-                    std::string name;
-                    varCompare.erase(0,5);
-                    
-                    varCompare.erase(varCompare.find(" "), varCompare.npos);
-                    name = varCompare;
-                    name.erase((name.size() - 2),name.npos);
-                    //std::cout << name << " scope: " << this->scope <<std::endl;
-                    // Now compare if they are the same variable 
-                    if (name.compare(exp.value.getLexeme()) == 0) {
-                        //std::cout << varCompare << std::endl;
-                        std::string scopeExtract = varCompare;
-                        scopeExtract.erase(0 , varCompare.size() - 1);
-                        //std::cout << scopeExtract << std::endl;
-                        //std::cout << name << " scope: " << this->scope  << " | extracted scope: " << scopeExtract <<std::endl;
-                        //If the varnames are equal break else reassign the varname
-                        
-                        if (this->scope == std::stoi(scopeExtract)) {
-                            varName = new std::string(varCompare);
-                            idCont = Container(STR, varName);
-                            break;
-                        } else if (this->scope > std::stoi(scopeExtract)) {
-                            // Record the closest visible scope
-                            if (varName == NULL) {
-                                varName = new std::string(varCompare);
-                            }
-
-                            ex = 1;
-                        }
-                    }
-                }
-            }
-            
-
-            // Check the exit flag meaning you are out of the function
-            if (bad == 1) {
+            // The variable is named after the scope that declares it,
+            // which the symbol table resolved
+            if (exp.scope < 0) {
                 std::cerr << "Error No Declaration for variable call: " << exp.value.getLexeme() << std::endl;
                 exit(-1);
             }
+            std::string *varName = new std::string(exp.value.getLexeme() + "_" + std::to_string(exp.scope));
+            Container idCont = Container(STR, varName, exp.type);
              
             Container regCont = Container(REG, this->generateReg());
+            regCont.sym = exp.type;
 
             
             LetInstr *letVar = new LetInstr(regCont, CONST_LET, NULL);
@@ -827,6 +769,19 @@ void IRepVisitor::visit(PrimaryExp &exp) {
                 //        std::cout << "I pushed an instruction"<< std::endl;
             break;
         }
+        case FLOAT: {
+            Container regCont = Container(REG, this->generateReg());
+            regCont.sym = SYM_FLOAT;
+
+            Container imdCont = Container(IMM);
+            imdCont.setVal(std::stof(exp.value.getLexeme()));
+            imdCont.sym = SYM_FLOAT;
+
+            LetInstr *letReg = new LetInstr(regCont, CONST_LET, NULL);
+            letReg->setExpression(imdCont);
+            this->irep.push_back(letReg);
+            break;
+        }
         default: {   
             // Throw Exception
            // std::cout << "I am in a thrown exception"<< std::endl;
@@ -846,11 +801,15 @@ void IRepVisitor::visit(FunCall &exp) {
     std::string funName = exp.name.getLexeme();
     //std::string *funNamePtr = new std::string(exp.name.getLexeme());
     std::list<Container> *args = new std::list<Container>();
+    // arguments are passed as the types of the parameters
+    std::vector<SymbolType> params = this->symbolTable->lookupFun(funName)->getParameters();
+    unsigned int k = 0;
     
     for(auto expr:exp.arglist) {
         expr->accept(this); 
-        Container prevReg = Container(REG, (this->getReg() - 1));
-        args->push_back(prevReg);
+        SymbolType type = k < params.size() ? params[k] : SYM_INT;
+        args->push_back(this->convert(this->lastReg(expr), type));
+        k++;
     }
     // Get the return type of the function name 
     //CallInstr *funCall = new CallInstr(funName, args, NULL);
@@ -861,6 +820,7 @@ void IRepVisitor::visit(FunCall &exp) {
             this->irep.push_back(funCall);
     } else {
         Container currentReg = Container(REG, this->generateReg());
+        currentReg.sym = this->symbolTable->lookupFun(funName)->getReturn();
         CallInstr *funCall = new CallInstr(funName, args, NULL);
         funCall->setExpression(currentReg);
         this->irep.push_back(funCall);
@@ -0,0 +1,99 @@
+/* File: irlink.cpp
+ * Authors: agent
+ * Description: Links the IR of separately compiled files
+ */
+
+#include <set>
+#include "irlink.h"
+
+void IRLinker::add(std::string name, std::list<Instruction *> ir) {
+    modules.push_back(Module{name, ir});
+}
+
+std::list<Instruction *> IRLinker::link() {
+    std::list<Instruction *> program;
+    // module that defines every function and declares every global
+    std::map<std::string, std::string> functions;
+    std::map<std::string, std::pair<std::string, SymbolType>> globals;
+    std::set<std::string> initialized;
+    // every module numbers its registers and labels from 0
+    int regOffset = 0;
+
+    for (unsigned int k = 0; k < modules.size(); k++) {
+        Module &m = modules[k];
+        std::string suffix = k == 0 ? "" : "." + std::to_string(k);
+        int maxReg = -1;
+        bool inDef = false;
+
+        auto cont = [&](Container c) -> Container {
+            if (c.isRegister()) {
+                maxReg = std::max(maxReg, c.getIntValue());
+                c.value.reg += regOffset;
+            }
+            return c;
+        };
+        auto label = [&](std::string l) -> std::string {
+            return l + suffix;
+        };
+
+        for (auto *i : m.ir) {
+            switch (i->getOp()) {
+                case DEF:
+                {
+                    std::string name = ((DefInstr *)i)->getName();
+                    auto it = functions.find(name);
+
+                    if (it != functions.end())
+                        throw IR_Error("Function '" + name + "' is defined in both " + it->second + " and " + m.name + ".");
+                    functions[name] = m.name;
+                    inDef = true;
+                    break;
+                }
+                case END:
+                    inDef = false;
+                    break;
+                case DECL:
+                {
+                    if (inDef)
+                        break;
+
+                    // a global declared by several modules is one variable
+                    Container c = ((DeclInstr *)i)->getContainer();
+                    auto it = globals.find(c.getStringValue());
+                    if (it != globals.end()) {
+                        if (it->second.second != c.sym)
+                            throw IR_Error("Global '" + c.getStringValue() + "' has different types in " +
+                                it->second.first + " and " + m.name + ".");
+                        continue;
+                    }
+                    globals[c.getStringValue()] = std::make_pair(m.name, c.sym);
+                    break;
+                }
+                case CONST_LET:
+                {
+                    Container c = ((LetInstr *)i)->getContainer();
+                    if (!inDef && c.isVariable() && !initialized.insert(c.getStringValue()).second)
+                        throw IR_Error("Global '" + c.getStringValue() + "' is initialized more than once.");
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            program.push_back(k == 0 ? i : map_instruction(i, cont, label));
+        }
+
+        // the first module keeps its instructions, its registers still
+        // have to be counted
+        if (k == 0) {
+            for (auto *i : m.ir) {
+                for (auto &c : containers_of_instruction(i))
+                    cont(c);
+            }
+        }
+
+        regOffset += maxReg + 1;
+    }
+
+    return program;
+}
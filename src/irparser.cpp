@@ -1,242 +1,292 @@
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include "assert.h"
 #include "irparser.h"
 
 IR_Parser::IR_Parser(std::string path) {
-    buildGrammar();
-
     irFilePath = path;
 }
 
-void IR_Parser::buildGrammar() {
-    grammar = R"(
-            # Grammar for IR
-            Prog <- Stat+
-            Stat <- Let / Def / Ret / VarDecl / If / Label / Jump / Call
-            Call <- 'call' '@' ID '(' Arglist ')' ('->' Container)?
-            If <- 'if' Container ID ID
-            Label <- 'label' ID
-            Jump <- 'jump' ID
-            Def <- 'def' '@' ID '(' Paramlist ')' ('->' Var)?
-            Ret <- 'return' Container / 'return'
-            Let <- 'let' Container '=' Container Binop Container / 'let' Container '=' Container
-            Var <- 'int' / 'float' / 'char'
-            VarDecl <- 'decl' ID Var
-            Arglist <- (Container (',' Container)*)?
-            Paramlist <- (ID (',' ID)*)?
-            Container <- Register / ID / < [0-9]+ >
-            Register <- '%r' < [0-9]+ >
-            ID <- < [a-zA-Z]+ >
-            Binop <- '+' / '-' / '/' / '*'
-            %whitespace <- [ \t\n]*
-        )";
-
-    parser.log = [](size_t line, size_t col, const std::string &msg) {
-        throw IR_Error(std::string("[line ") + std::to_string(line) + ", " + std::to_string(col) + "] " + msg);
-    };
-
-    auto ok = parser.load_grammar(grammar.c_str());
-    assert(ok);
-
-    parser["Prog"] = [](const peg::SemanticValues &sv) {
-        std::list<Instruction *> ilist;
-
-        for (unsigned i = 0; i < sv.size(); i++) {
-            ilist.push_back(sv[i].get<Instruction *>());
-        }
+IR_Error IR_Parser::error(std::string msg) {
+    return IR_Error("[line " + std::to_string(line) + ", " + std::to_string(cur - lineStart + 1) + "] " + msg);
+}
 
-        return ilist;
-    };
-
-    // Actions
-    parser["Stat"] = [](const peg::SemanticValues &sv) -> Instruction * {
-        switch (sv.choice()) {
-            case 0:  // Let
-                return sv[0].get<LetInstr *>();
-            case 1: // Def
-                return sv[0].get<DefInstr *>();
-            case 2: // Ret
-                return sv[0].get<ReturnInstr *>();
-            case 3: // var declaration
-                return sv[0].get<DeclInstr *>();
-            case 4: // If
-                return sv[0].get<BranchInstr *>();
-            case 5: // Label
-                return sv[0].get<LableInstr *>();
-            case 6: // Jump
-                return sv[0].get<JumpInstr *>();
-            case 7: // Call
-                return sv[0].get<CallInstr *>();
-            default:
-                throw IR_Error("Unhandled statement.");
-        }
-    };
+void IR_Parser::skipSpace() {
+    while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r'))
+        cur++;
+}
+
+bool IR_Parser::atEnd() {
+    skipSpace();
+    return cur == end;
+}
 
-    parser["Call"] = [](const peg::SemanticValues &sv) {
-        return new CallInstr(sv[0].get<std::string>(), sv[1].get<std::list<Container>*>(), nullptr);
-    };
+bool IR_Parser::accept(char c) {
+    skipSpace();
+    if (cur < end && *cur == c) {
+        cur++;
+        return true;
+    }
+    return false;
+}
 
-    parser["Arglist"] = [](const peg::SemanticValues &sv) {
-        std::list<Container> *alist = new std::list<Container>();
+void IR_Parser::expect(char c) {
+    if (!accept(c))
+        throw error(std::string("expected '") + c + "'");
+}
 
-        for (unsigned i = 0; i < sv.size(); i++) {
-            alist->push_back(sv[i].get<Container>());
-        }
+std::string IR_Parser::word() {
+    skipSpace();
 
-        return alist;
-    };
+    const char *start = cur;
+    while (cur < end && !strchr(" \t\r,()@", *cur))
+        cur++;
 
-    parser["Paramlist"] = [](const peg::SemanticValues &sv) {
-        std::list<Container> *plist = new std::list<Container>();
+    if (cur == start)
+        throw error("expected a name or value");
+    return std::string(start, cur);
+}
 
-        for (unsigned i = 0; i < sv.size(); i++) {
-            std::string *s = new std::string(sv[i].get<std::string>());
-            plist->push_back(Container(STR, s));
+std::string *IR_Parser::name(std::string word) {
+    std::string *&s = names[word];
+    if (s == nullptr)
+        s = new std::string(word);
+    return s;
+}
+
+Container IR_Parser::container(std::string word) {
+    char *rest;
+
+    if (word == "NIL")
+        return Container(NIL);
+
+    // %r for int registers, %f for float registers
+    if (word.size() > 2 && word[0] == '%' && (word[1] == 'r' || word[1] == 'f')) {
+        long reg = strtol(word.c_str() + 2, &rest, 10);
+        if (*rest != '\0')
+            throw error("bad register '" + word + "'");
+        Container c(REG, (int)reg);
+        c.sym = word[1] == 'f' ? SYM_FLOAT : SYM_INT;
+        return c;
+    }
+
+    long value = strtol(word.c_str(), &rest, 10);
+    if (*rest == '\0') {
+        Container c(IMM);
+        c.setVal((int)value);
+        return c;
+    }
+
+    // float immediates end in f, names never start with a digit or sign
+    if (word.back() == 'f' && strchr("0123456789-+.in", word[0])) {
+        std::string digits = word.substr(0, word.size() - 1);
+        float f = strtof(digits.c_str(), &rest);
+        if (*rest == '\0' && !digits.empty()) {
+            Container c(IMM);
+            c.setVal(f);
+            c.sym = SYM_FLOAT;
+            return c;
         }
+    }
+
+    return Container(STR, name(word));
+}
 
-        return plist;
-    };
-
-    parser["Jump"] = [](const peg::SemanticValues &sv) {
-        return new JumpInstr(sv[0].get<std::string>(), nullptr);
-    };
-
-    parser["If"] = [](const peg::SemanticValues &sv) {
-        Container cond = sv[0].get<Container>();
-        std::string lbl1 = sv[1].get<std::string>();
-        std::string lbl2 = sv[2].get<std::string>();
-
-        return new BranchInstr(cond, lbl1, new std::string(lbl2), nullptr);
-    };
-
-    parser["Label"] = [](const peg::SemanticValues &sv) {
-        return new LableInstr(sv[0].get<std::string>(), nullptr);
-    };
-
-    parser["Def"] = [](const peg::SemanticValues &sv) {
-        return new DefInstr(sv[0].get<std::string>(), sv[2].get<SymbolType>(), sv[1].get<std::list<Container> *>(), nullptr);
-    };
-
-    parser["Ret"] = [](const peg::SemanticValues &sv) {
-        switch (sv.choice()) {
-            case 0:  // ret
-                {
-                    ReturnInstr *ri = new ReturnInstr(sv[0].get<Container>(), nullptr);
-                    return ri;
-                }
-            case 1: // ret Container
-                {
-                    ReturnInstr *ri = new ReturnInstr(nullptr);
-                    return ri;
-                }
-            default:
-                throw IR_Error("Unhandled Return case.");
+Container IR_Parser::container() {
+    return container(word());
+}
+
+SymbolType IR_Parser::type(std::string word) {
+    if (word == "int")
+        return SYM_INT;
+    if (word == "char")
+        return SYM_CHAR;
+    if (word == "float")
+        return SYM_FLOAT;
+    if (word == "void")
+        return SYM_VOID;
+    // what Container::getSymType prints for anything else
+    if (word == "Undifined")
+        return SYM_ERR;
+    throw error("unknown type '" + word + "'");
+}
+
+IrOp IR_Parser::irop(std::string word) {
+    try {
+        return irop_of_string(word);
+    } catch (IR_Error &) {
+        throw error("unknown operator '" + word + "'");
+    }
+}
+
+// One instruction from the rest of the line
+Instruction *IR_Parser::instruction() {
+    skipSpace();
+
+    const char *start = cur;
+    while (cur < end && *cur >= 'a' && *cur <= 'z')
+        cur++;
+    std::string op(start, cur);
+
+    if (op == "let") {
+        Container dest = container();
+        expect('=');
+
+        std::string first = word();
+        if (atEnd()) {
+            LetInstr *li = new LetInstr(dest, CONST_LET, nullptr);
+            li->setExpression(container(first));
+            return li;
         }
-    };
-
-    // Handle variable type
-    parser["Var"] = [](const peg::SemanticValues &sv) {
-        switch (sv.choice()) {
-            case 0: return SYM_INT;
-            case 1: return SYM_FLOAT;
-            case 2: return SYM_CHAR;
-            default:
-                    throw IR_Error("Unhandled Vartype syntax");
-                    return SYM_ERR;
+
+        std::string second = word();
+        if (atEnd()) {
+            LetInstr *li = new LetInstr(dest, UNARY_LET, nullptr);
+            li->setExpression(container(second), irop(first));
+            return li;
         }
-    };
-
-    parser["Let"] = [](const peg::SemanticValues &sv) {
-        switch (sv.choice()) {
-            case 0:  // let Container = Container 'Binop Container"
-                {
-                    LetInstr *li = new LetInstr(sv[0].get<Container>(), BINARY_LET, nullptr);
-                    li->setExpression(sv[1].get<Container>(), sv[3].get<Container>(), sv[2].get<IrOp>());
-                    return li;
-                }
-            case 1: // "let Container = Container"
-                {
-                    LetInstr *li = new LetInstr(sv[0].get<Container>(), CONST_LET, nullptr);
-                    li->setExpression(sv[1].get<Container>());
-                    return li;
-                }
-            default:
-                throw IR_Error("Unhandled 'let' syntax.");
+
+        LetInstr *li = new LetInstr(dest, BINARY_LET, nullptr);
+        li->setExpression(container(first), container(), irop(second));
+        return li;
+    } else if (op == "decl") {
+        std::string *var = name(word());
+        return new DeclInstr(var, type(word()), nullptr);
+    } else if (op == "def") {
+        accept('@');
+        std::string fun = word();
+        std::list<Container> *params = new std::list<Container>();
+
+        expect('(');
+        while (!accept(')')) {
+            if (!params->empty())
+                expect(',');
+
+            // parameters are "type name", older dumps have only the name
+            std::string first = word();
+            skipSpace();
+            if (cur < end && *cur != ',' && *cur != ')')
+                params->push_back(Container(STR, name(word()), type(first)));
+            else
+                params->push_back(Container(STR, name(first), SYM_INT));
         }
-    };
-
-    parser["Container"] = [](const peg::SemanticValues &sv) {
-        switch (sv.choice()) {
-            case 0:  // register
-                {
-                    int reg = sv[0].get<int>();
-                    Container c(REG, reg);
-                    return c;
-                }
-            case 1: // id
-                {
-                    std::string *s = new std::string(sv[0].get<std::string>());
-                    Container c(STR, s);
-                    return c;
-                    // return;
-                }
-            case 2: // immediate value
-                {
-                    int val = std::stoi(sv.token(), nullptr, 10);
-                    Container c(IMM);
-                    c.setVal(val);
-                    return c;
-                }
-            default:
-                throw IR_Error("Unhandled container type.");
+
+        SymbolType ret = SYM_VOID;
+        if (!atEnd()) {
+            if (word() != "->")
+                throw error("expected '->'");
+            ret = type(word());
         }
-    };
-
-    parser["Binop"] = [](const peg::SemanticValues &sv) {
-        switch (sv.choice()) {
-            case 0:  // +
-                return IrOp::ADD;
-            case 1: // -
-                return IrOp::SUB;
-            case 2: // /
-                return IrOp::DIV;
-            case 3: // *
-                return IrOp::MUL;
-            default:
-                throw IR_Error("Unhandled binary operator.");
+        return new DefInstr(fun, ret, params, nullptr);
+    } else if (op == "call") {
+        accept('@');
+        std::string fun = word();
+        std::list<Container> *args = new std::list<Container>();
+
+        expect('(');
+        while (!accept(')')) {
+            if (!args->empty())
+                expect(',');
+            args->push_back(container());
         }
-    };
-
-    parser["Register"] = [](const peg::SemanticValues& sv) {
-        return std::stoi(sv.token(), nullptr, 10);
-    };
 
-    parser["ID"] = [](const peg::SemanticValues& sv) {
-        return std::string(sv.token());
-    };
+        CallInstr *ci = new CallInstr(fun, args, nullptr);
+        if (!atEnd()) {
+            if (word() != "->")
+                throw error("expected '->'");
+            ci->setExpression(container());
+        }
+        return ci;
+    } else if (op == "if") {
+        Container cond = container();
+        std::string one = word();
+        std::string *two = atEnd() ? nullptr : new std::string(word());
+        return new BranchInstr(cond, one, two, nullptr);
+    } else if (op == "label") {
+        return new LableInstr(word(), nullptr);
+    } else if (op == "jump") {
+        return new JumpInstr(word(), nullptr);
+    } else if (op == "switch") {
+        Container value = container();
+        std::vector<std::string> targets;
+
+        if (word() != "from")
+            throw error("expected 'from'");
+        Container low = container();
+        if (!low.isImmediate())
+            throw error("expected the lowest case value");
+
+        expect('(');
+        while (!accept(')')) {
+            if (!targets.empty())
+                expect(',');
+            targets.push_back(word());
+        }
 
-    parser["VarDecl"] = [](const peg::SemanticValues& sv) {
-        return new DeclInstr(new std::string(sv[0].get<std::string>()), sv[1].get<SymbolType>(), nullptr);
-    };
+        if (word() != "else")
+            throw error("expected 'else'");
+        return new SwitchInstr(value, low.getIntImmediate(), targets, word(), nullptr);
+    } else if (op == "return") {
+        if (atEnd())
+            return new ReturnInstr(nullptr);
+        return new ReturnInstr(container(), nullptr);
+    } else if (op == "funcend") {
+        return new FuncEnd(nullptr);
+    }
 
-    // enable packrat parsing
-    parser.enable_packrat_parsing();
+    cur = start;
+    throw error("unknown instruction '" + std::string(start, end) + "'");
 }
 
-// Parse the file into a list of IR instructions
+// Parse the file into a list of IR instructions, a line at a time
 std::list<Instruction *>  IR_Parser::parse() {
-    std::ifstream inFile(irFilePath);
+    int fd = open(irFilePath.c_str(), O_RDONLY);
+    struct stat st;
 
-    if (!inFile.is_open()) {
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0)
+            close(fd);
         throw IR_Error("Failed to open IR source file: " + irFilePath + ".");
     }
 
-    std::string source((std::istreambuf_iterator<char>(inFile)),
-                 std::istreambuf_iterator<char>());
+    size_t size = st.st_size;
+    void *map = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (map == MAP_FAILED)
+        throw IR_Error("Failed to map IR source file: " + irFilePath + ".");
 
+    const char *p = (const char *)map;
+    const char *fileEnd = p + size;
     std::list<Instruction *> ilist;
-    parser.parse(source.c_str(), ilist);
 
+    line = 0;
+    try {
+        while (p < fileEnd) {
+            const char *nl = (const char *)memchr(p, '\n', fileEnd - p);
+
+            line++;
+            lineStart = cur = p;
+            end = nl ? nl : fileEnd;
+            p = nl ? nl + 1 : fileEnd;
+
+            if (atEnd())
+                continue;
+
+            ilist.push_back(instruction());
+            if (!atEnd())
+                throw error("unexpected '" + std::string(cur, end) + "'");
+        }
+    } catch (IR_Error &) {
+        if (map)
+            munmap(map, size);
+        throw;
+    }
+
+    if (map)
+        munmap(map, size);
     return ilist;
 }
@@ -0,0 +1,162 @@
+/* File: jit.cpp
+ * Authors: agent
+ * Description: In memory execution, see jit.h
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "jit.h"
+#include "exceptions.h"
+
+// jmpq *0(%rip) followed by the address it jumps to
+static const unsigned char stubCode[] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+static const unsigned long stubSize = 16;
+
+static unsigned long alignUp(unsigned long n, unsigned long to) {
+    return (n + to - 1) / to * to;
+}
+
+Jit::Jit(MModule &module):
+    object(module)
+{
+    memory = nullptr;
+    size = 0;
+    textPages = 0;
+    loadSeconds = 0;
+    runSeconds = 0;
+}
+
+Jit::~Jit() {
+    if (memory != nullptr)
+        munmap(memory, size);
+}
+
+unsigned char *Jit::address(std::string sym) {
+    auto it = addresses.find(sym);
+    if (it != addresses.end())
+        return it->second;
+
+    it = stubs.find(sym);
+    if (it != stubs.end())
+        return it->second;
+
+    throw RuntimeError("Undefined symbol '" + sym + "'.");
+}
+
+void Jit::load() {
+    auto start = std::chrono::steady_clock::now();
+    unsigned long page = sysconf(_SC_PAGESIZE);
+
+    object.layout();
+
+    std::vector<unsigned char> &text = object.getText();
+    std::vector<unsigned char> &rodata = object.getRodata();
+    std::vector<unsigned char> &data = object.getData();
+
+    // undefined symbols get a stub each, defined ones keep their offset
+    std::vector<std::pair<std::string, void *>> externals;
+    for (auto &s : object.getSymbols()) {
+        if (s.section != SEC_NULL)
+            continue;
+
+        void *target = dlsym(RTLD_DEFAULT, s.name.c_str());
+        if (target == nullptr)
+            throw RuntimeError("Undefined symbol '" + s.name + "'.");
+        externals.push_back(std::make_pair(s.name, target));
+    }
+
+    unsigned long stubsAt = alignUp(text.size(), stubSize);
+    unsigned long rodataAt = alignUp(stubsAt + externals.size() * stubSize, page);
+    unsigned long dataAt = alignUp(rodataAt + rodata.size(), JIT_SECTION_ALIGN);
+    unsigned long bssAt = alignUp(dataAt + data.size(), JIT_SECTION_ALIGN);
+
+    textPages = rodataAt;
+    size = alignUp(bssAt + object.getBssSize(), page);
+
+    void *m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+        throw RuntimeError("Cannot map " + std::to_string(size) + " bytes for the code.");
+    memory = (unsigned char *)m;
+
+    // the mapping comes zero filled, so the bss already is
+    memcpy(memory, text.data(), text.size());
+    memcpy(memory + rodataAt, rodata.data(), rodata.size());
+    memcpy(memory + dataAt, data.data(), data.size());
+
+    for (unsigned int k = 0; k < externals.size(); k++) {
+        unsigned char *stub = memory + stubsAt + k * stubSize;
+
+        memcpy(stub, stubCode, sizeof(stubCode));
+        memcpy(stub + sizeof(stubCode), &externals[k].second, sizeof(void *));
+        stubs[externals[k].first] = stub;
+    }
+
+    for (auto &s : object.getSymbols()) {
+        switch (s.section) {
+        case SEC_TEXT: addresses[s.name] = memory + s.value; break;
+        case SEC_RODATA: addresses[s.name] = memory + rodataAt + s.value; break;
+        case SEC_DATA: addresses[s.name] = memory + dataAt + s.value; break;
+        case SEC_BSS: addresses[s.name] = memory + bssAt + s.value; break;
+        default: break;
+        }
+    }
+
+    // the fields the linker would fill in, S + A - P
+    for (auto &r : object.getTextRelocations()) {
+        unsigned char *field = memory + r.offset;
+        long value = (long)(address(r.sym) + r.addend - field);
+
+        if (value < INT32_MIN || value > INT32_MAX)
+            throw RuntimeError("Relocation against '" + r.sym + "' out of range.");
+
+        int rel32 = (int)value;
+        memcpy(field, &rel32, sizeof(rel32));
+    }
+    for (auto &r : object.getRodataRelocations()) {
+        unsigned char *field = memory + rodataAt + r.offset;
+        long value = (long)(address(r.sym) + r.addend - field);
+
+        memcpy(field, &value, sizeof(value));
+    }
+
+    // the code is never written again
+    if (mprotect(memory, textPages, PROT_READ | PROT_EXEC) != 0)
+        throw RuntimeError("Cannot make the code executable.");
+
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    loadSeconds = time.count();
+}
+
+int Jit::run() {
+    auto it = addresses.find("main");
+    if (it == addresses.end() || it->second >= memory + textPages)
+        throw RuntimeError("No function 'main' to run.");
+
+    // main may take parameters, they are all zero
+    typedef long (*Entry)(long, long);
+    Entry entry = (Entry)it->second;
+
+    auto start = std::chrono::steady_clock::now();
+    int value = (int)entry(0, 0);
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    runSeconds = time.count();
+
+    return value;
+}
+
+void Jit::printStats() {
+    std::cout << "==============\nJIT Statistics\n==============\n\n";
+    std::cout << std::left << std::setw(28) << "code bytes" << object.getText().size() << std::endl;
+    std::cout << std::left << std::setw(28) << "data bytes" <<
+        object.getRodata().size() + object.getData().size() + object.getBssSize() << std::endl;
+    std::cout << std::left << std::setw(28) << "stubs" << stubs.size() << std::endl;
+    std::cout << std::left << std::setw(28) << "load seconds" << loadSeconds << std::endl;
+    std::cout << std::left << std::setw(28) << "run seconds" << runSeconds << std::endl;
+}
@@ -0,0 +1,295 @@
+/* File: layout.cpp
+ * Authors: agent
+ * Description: Block placement, see layout.h
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "layout.h"
+
+BlockLayout::BlockLayout(Profile *profile) {
+    this->profile = profile;
+
+    nextLabel = 0;
+    moved = 0;
+    inverted = 0;
+    added = 0;
+    removed = 0;
+    cold = 0;
+}
+
+// A block starts at a label and ends with a jump or a return, the first
+// one of a function also holds its directives
+std::vector<BlockLayout::Block> BlockLayout::split(std::vector<MInstr> &text, unsigned int begin, unsigned int end) {
+    std::vector<Block> blocks;
+    std::map<std::string, int> labels;
+    // the current block has a label or an instruction
+    bool open = false;
+
+    blocks.push_back(Block{{}, "", -1, true, 0, 0, 0});
+    for (unsigned int k = begin; k < end; k++) {
+        MInstr &i = text[k];
+
+        if (i.isLabel() && open) {
+            blocks.push_back(Block{{}, "", -1, true, 0, 0, 0});
+            open = false;
+        }
+
+        Block &b = blocks.back();
+        if (i.isLabel() && b.label.empty()) {
+            b.label = i.ops[0].sym;
+            labels[b.label] = blocks.size() - 1;
+        }
+        b.code.push_back(i);
+        open = open || !i.isDirective();
+
+        if (i.isJump() || i.op == MOp::JMPQ || i.op == MOp::RETQ) {
+            b.falls = i.isCondJump();
+            blocks.push_back(Block{{}, "", -1, true, 0, 0, 0});
+            open = false;
+        }
+    }
+
+    if (blocks.back().code.empty() && blocks.size() > 1)
+        blocks.pop_back();
+
+    // jumps out of the function are tail calls
+    for (auto &b : blocks) {
+        MInstr &last = b.code.back();
+        if (last.isJump() && labels.count(last.ops[0].sym))
+            b.taken = labels[last.ops[0].sym];
+    }
+    return blocks;
+}
+
+// The counts were taken per block of the IR, the blocks code generation
+// added inside of them run as often as the block they are in. A block
+// that ends with a conditional jump to the label of a branch falls
+// through as often as the branch did not jump, any other one is taken
+// to fall through half of the time and runs on in a block that is
+// counted with it.
+bool BlockLayout::countsFromProfile(std::vector<Block> &blocks) {
+    long count = profile != nullptr ? profile->count(Profile::entryKey(function)) : -1;
+
+    if (count < 0)
+        return false;
+
+    for (unsigned int b = 0; b < blocks.size(); b++) {
+        long n = -1;
+
+        if (b > 0 && !blocks[b].label.empty())
+            n = profile->count(Profile::labelKey(blocks[b].label));
+        if (n >= 0)
+            count = n;
+        blocks[b].count = count;
+        blocks[b].fallCount = blocks[b].falls ? count : 0;
+
+        MInstr &last = blocks[b].code.back();
+        if (last.isCondJump()) {
+            n = profile->count(Profile::fallKey(last.ops[0].sym));
+            blocks[b].fallCount = n >= 0 ? std::min(n, count) : count / 2;
+            if (n >= 0)
+                count = blocks[b].fallCount;
+        }
+    }
+    return true;
+}
+
+// A block nested in d loops, the ranges from a label to a jump back to it,
+// runs LAYOUT_LOOP_WEIGHT^d times. The jump back to the head of a loop is
+// taken and the jump out of a loop is not, most of the time.
+void BlockLayout::countsFromLoops(std::vector<Block> &blocks) {
+    std::vector<int> depth(blocks.size(), 0);
+
+    for (unsigned int b = 0; b < blocks.size(); b++) {
+        int t = blocks[b].taken;
+        if (t < 0 || t > (int)b)
+            continue;
+        for (unsigned int k = t; k <= b; k++)
+            depth[k]++;
+    }
+
+    for (unsigned int b = 0; b < blocks.size(); b++) {
+        long count = LAYOUT_LOOP_WEIGHT * LAYOUT_LOOP_WEIGHT;
+        for (int d = 0; d < std::min(depth[b], LAYOUT_MAX_DEPTH); d++)
+            count *= LAYOUT_LOOP_WEIGHT;
+
+        Block &blk = blocks[b];
+        blk.count = count;
+        blk.fallCount = blk.falls ? count : 0;
+
+        if (!blk.code.back().isCondJump() || blk.taken < 0 || b + 1 >= blocks.size())
+            continue;
+
+        long unlikely = count / LAYOUT_LOOP_WEIGHT;
+        if (blk.taken <= (int)b || depth[b + 1] < depth[b])
+            blk.fallCount = unlikely;
+        else if (depth[blk.taken] < depth[b])
+            blk.fallCount = count - unlikely;
+        else
+            blk.fallCount = count / 2;
+    }
+}
+
+// Pettis and Hansen: the edges from the most to the least frequent join
+// the chain ending in their source to the chain starting at their
+// target. Of edges that run as often the one to the next block goes first
+// so code is not moved for nothing. The chain of the entry stays first,
+// the rest keep their order, with the ones that never ran last.
+std::vector<int> BlockLayout::chain(std::vector<Block> &blocks, bool profiled) {
+    std::vector<Edge> edges;
+    std::vector<std::vector<int>> chains;
+
+    for (unsigned int b = 0; b < blocks.size(); b++) {
+        Block &blk = blocks[b];
+
+        blk.chain = b;
+        chains.push_back(std::vector<int>(1, b));
+
+        if (blk.falls && b + 1 < blocks.size())
+            edges.push_back(Edge{(int)b, (int)b + 1, blk.fallCount});
+        if (blk.taken >= 0)
+            edges.push_back(Edge{(int)b, blk.taken, blk.count - blk.fallCount});
+    }
+
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &x, const Edge &y) {
+        if (x.weight != y.weight)
+            return x.weight > y.weight;
+        return x.to == x.from + 1 && y.to != y.from + 1;
+    });
+
+    for (auto &e : edges) {
+        int from = blocks[e.from].chain;
+        int to = blocks[e.to].chain;
+
+        // edges that never ran would pull cold blocks in line
+        if ((profiled && e.weight <= 0) || e.to == 0 || from == to)
+            continue;
+        if (chains[from].back() != e.from || chains[to].front() != e.to)
+            continue;
+
+        for (int b : chains[to])
+            blocks[b].chain = from;
+        chains[from].insert(chains[from].end(), chains[to].begin(), chains[to].end());
+        chains[to].clear();
+    }
+
+    std::vector<int> order;
+    std::vector<int> coldOrder;
+    for (auto &c : chains) {
+        bool ran = !profiled;
+        for (int b : c)
+            ran = ran || blocks[b].count > 0;
+
+        if (c.empty())
+            continue;
+        if (ran || blocks[c.front()].chain == blocks[0].chain) {
+            order.insert(order.end(), c.begin(), c.end());
+        } else {
+            coldOrder.insert(coldOrder.end(), c.begin(), c.end());
+            cold += c.size();
+        }
+    }
+    order.insert(order.end(), coldOrder.begin(), coldOrder.end());
+    return order;
+}
+
+// The chain of the entry is chains[0] and comes first already
+void BlockLayout::place(std::vector<Block> &blocks, std::vector<int> &order, std::vector<MInstr> &out) {
+    unsigned int n = blocks.size();
+
+    auto label = [&](int b) -> std::string {
+        if (blocks[b].label.empty()) {
+            blocks[b].label = ".PL" + std::to_string(nextLabel++);
+            blocks[b].code.insert(blocks[b].code.begin(), MInstr(MOp::LABEL, MOperand::Sym(blocks[b].label)));
+        }
+        return blocks[b].label;
+    };
+
+    for (unsigned int p = 0; p < n; p++) {
+        int b = order[p];
+        int next = p + 1 < n ? order[p + 1] : -1;
+        Block &blk = blocks[b];
+        MInstr &last = blk.code.back();
+
+        if (b != (int)p)
+            moved++;
+
+        if (last.isCondJump()) {
+            if (b + 1 == next)
+                continue;
+
+            // jump to where the block fell through to and fall into the
+            // jump's target instead
+            if (blk.taken >= 0 && blk.taken == next) {
+                last = MInstr(invert_jump(last.op), MOperand::Sym(label(b + 1)));
+                inverted++;
+            } else {
+                blk.code.push_back(MInstr(MOp::JMP, MOperand::Sym(label(b + 1))));
+                added++;
+            }
+        } else if (last.op == MOp::JMP && blk.taken >= 0 && blk.taken == next) {
+            blk.code.pop_back();
+            removed++;
+        } else if (blk.falls && b + 1 != next) {
+            blk.code.push_back(MInstr(MOp::JMP, MOperand::Sym(label(b + 1))));
+            added++;
+        }
+    }
+
+    for (int b : order)
+        out.insert(out.end(), blocks[b].code.begin(), blocks[b].code.end());
+}
+
+// A function starts with the directives in front of its label
+void BlockLayout::run(std::vector<MInstr> &text) {
+    std::vector<MInstr> out;
+    unsigned int begin = 0;
+
+    auto starts = [&](unsigned int k) {
+        return (text[k].op == MOp::GLOBL || text[k].op == MOp::TYPE) &&
+            (k == 0 || (text[k - 1].op != MOp::GLOBL && text[k - 1].op != MOp::TYPE));
+    };
+
+    while (begin < text.size()) {
+        unsigned int end = begin + 1;
+        while (end < text.size() && !starts(end))
+            end++;
+
+        std::vector<Block> blocks = split(text, begin, end);
+
+        function = "";
+        for (auto &i : blocks[0].code) {
+            if (i.isLabel()) {
+                function = i.ops[0].sym;
+                break;
+            }
+        }
+
+        // the last block has nowhere to go when it falls through
+        if (blocks.back().falls) {
+            out.insert(out.end(), text.begin() + begin, text.begin() + end);
+        } else {
+            bool profiled = countsFromProfile(blocks);
+            if (!profiled)
+                countsFromLoops(blocks);
+
+            std::vector<int> order = chain(blocks, profiled);
+            place(blocks, order, out);
+        }
+
+        begin = end;
+    }
+
+    text = out;
+}
+
+void BlockLayout::printStats() {
+    std::cout << "=======================\nBlock Layout Statistics\n=======================\n\n";
+    std::cout << std::left << std::setw(28) << "blocks moved" << moved << std::endl;
+    std::cout << std::left << std::setw(28) << "cold blocks out of line" << cold << std::endl;
+    std::cout << std::left << std::setw(28) << "jumps inverted" << inverted << std::endl;
+    std::cout << std::left << std::setw(28) << "jumps added" << added << std::endl;
+    std::cout << std::left << std::setw(28) << "jumps removed" << removed << std::endl;
+}
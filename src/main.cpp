@@ -7,6 +7,10 @@
  */
 
 // Preprocessing
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
 #include <istream>
 #include <fstream>
@@ -26,7 +30,19 @@
 #include "exceptions.h"
 #include "optIR.h"
 #include "irparser.h"
+#include "irbinary.h"
+#include "irlink.h"
+#include "ipo.h"
+#include "vectorize.h"
+#include "profile.h"
+#include "layout.h"
+#include "interp.h"
+#include "jit.h"
 #include "codegen.h"
+#include "peephole.h"
+#include "elfwriter.h"
+#include "incremental.h"
+#include "cache.h"
 
 // Functions
 void printUsage();
@@ -50,12 +66,26 @@ int main(int argc, char *argv[]) {
     bool readIRFlag = false;
     bool irFlag = false;
     bool irOut = false;
+    bool binaryFlag = false;
     bool output = false;
     bool optFlag = false;
+    bool statsFlag = false;
+    bool objFlag = false;
+    bool incrFlag = false;
+    bool cacheFlag = false;
+    bool avx2 = false;
+    bool runFlag = false;
+    bool jitFlag = false;
+    bool profileGenerate = false;
+    bool profileUse = false;
 
     std::string irFile = "";
+    std::string stateFile = "";
+    std::string cacheDir = "";
+    std::string profileFile = "";
+    std::vector<std::string> exports;
 
-    while ((opt = getopt(argc, argv, "sphtirO:I:o:")) != -1) {
+    while ((opt = getopt(argc, argv, "sphtircbxjSO:I:o:u:C:e:m:f:")) != -1) {
         switch (opt) {
         // Stop at scanning
         case 's':
@@ -79,6 +109,70 @@ int main(int argc, char *argv[]) {
         case 'r':
             readIRFlag = true;
             break;
+        // Write the IR in the binary form
+        case 'b':
+            binaryFlag = true;
+            break;
+        // Run the program with the interpreter instead of compiling it
+        case 'x':
+            runFlag = true;
+            break;
+        // Run the compiled code in memory instead of writing it out
+        case 'j':
+            jitFlag = true;
+            break;
+        // Write an object file instead of assembly
+        case 'c':
+            objFlag = true;
+            break;
+        // Reuse the code of unchanged functions from a state file
+        case 'u':
+            stateFile = std::string(optarg);
+            incrFlag = true;
+            break;
+        // Take the output from a cache directory when the input was compiled before
+        case 'C':
+            cacheDir = std::string(optarg);
+            cacheFlag = true;
+            break;
+        // Keep a symbol outside main's reach when removing dead code
+        case 'e':
+            exports.push_back(std::string(optarg));
+            break;
+        // Print parser and optimization statistics
+        case 'S':
+            statsFlag = true;
+            break;
+        // Count the blocks of the compiled program into a profile, or
+        // optimize with the counts of one, -fprofile-generate works too
+        case 'f':
+        {
+            std::string arg = std::string(optarg);
+            std::string mode = arg.substr(0, arg.find('='));
+
+            if (mode == "profile-generate" || mode == "profile-use") {
+                profileGenerate = mode == "profile-generate";
+                profileUse = mode == "profile-use";
+                profileFile = arg.find('=') != std::string::npos ? arg.substr(arg.find('=') + 1) : "";
+            } else {
+                std::cout << "Unsupported -f option. See usage." << std::endl;
+                printUsage();
+                exit(-1);
+            }
+            break;
+        }
+        // Vector instructions the vectorized loops may use
+        case 'm':
+            if (std::string(optarg) == "avx2") {
+                avx2 = true;
+            } else if (std::string(optarg) == "sse2") {
+                avx2 = false;
+            } else {
+                std::cout << "Unsupported instruction set. See usage." << std::endl;
+                printUsage();
+                exit(-1);
+            }
+            break;
         case 'o':
             irFile = std::string(optarg);
             output = true;
@@ -108,7 +202,7 @@ int main(int argc, char *argv[]) {
     // We output to out.s by default
     output = true;
     if (irFile == std::string("")) {
-        irFile = std::string("out.s");
+        irFile = std::string(objFlag ? "out.o" : "out.s");
     }
 
     // Ensure there is file argument at the end of flags
@@ -117,6 +211,9 @@ int main(int argc, char *argv[]) {
         exit(-1);
     }
 
+    // Compiling and running in memory is timed as a whole
+    auto compileStart = chrono::steady_clock::now();
+
     // Open file into string object
     string fileName = string(argv[optind]);
     ifstream file(fileName.data());
@@ -127,13 +224,80 @@ int main(int argc, char *argv[]) {
     string str((istreambuf_iterator<char>(file)),
             istreambuf_iterator<char>());
 
+    // Only whole compilations are cached, the cached output replaces all
+    // of them
+    CompileCache cache(cacheDir);
+    unsigned long cacheKey = 0;
+    cacheFlag = cacheFlag && !scanFlag && !readIRFlag && !parseFlag && !tableFlag && !irFlag && !irOut && !incrFlag &&
+        !runFlag && !jitFlag && !profileGenerate && !profileUse;
+
+    if (cacheFlag == true) {
+        std::string flags = std::string(objFlag ? "-c" : "-S") + " -O" + std::to_string(optFlag ? optLevel : 0) +
+            (avx2 ? " -mavx2" : "");
+        for (auto &e : exports)
+            flags += " -e " + e;
+
+        cacheKey = cache.key(str, fileName, flags);
+        if (cache.lookup(cacheKey, irFile)) {
+            if (statsFlag == true)
+                cache.printStats();
+            return 0;
+        }
+    }
+
     std::list<Instruction *> instructionList;
 
-    // If we are reading in an IR file, then parse that, else
+    // Incremental builds only make sense when compiling all the way
+    Incremental incremental(stateFile, optFlag ? optLevel : 0, avx2 ? "avx2" : "sse2");
+    incrFlag = incrFlag && !readIRFlag && !parseFlag && !tableFlag && !irFlag && !irOut && !runFlag && !jitFlag &&
+        !profileGenerate && !profileUse;
+
+    // The profile sits next to the input by default. Its full path is
+    // built into an instrumented program, which may run anywhere.
+    if ((profileGenerate || profileUse) && profileFile == "") {
+        char path[PATH_MAX];
+        profileFile = (realpath(fileName.c_str(), path) ? std::string(path) : fileName) + ".prof";
+    }
+
+    Profile profile(profileFile);
+    // the counts optimizations go by, null without them
+    Profile *counts = nullptr;
+    if (profileUse == true && profile.load())
+        counts = &profile;
+
+    // If we are reading in IR files, then parse and link them, else
     // continue compilation normally
     if (readIRFlag == true) {
-        IR_Parser irp(fileName);
-        instructionList = irp.parse();
+        auto readStart = chrono::steady_clock::now();
+        IRLinker linker;
+
+        try {
+            for (int k = optind; k < argc; k++) {
+                std::string irName = argv[k];
+
+                if (isBinaryIR(irName)) {
+                    IR_BinaryReader irb(irName);
+                    linker.add(irName, irb.parse());
+                } else {
+                    IR_Parser irp(irName);
+                    linker.add(irName, irp.parse());
+                }
+            }
+            instructionList = linker.link();
+        } catch (IR_Error &ire) {
+            ire.printException();
+            exit(-1);
+        }
+        chrono::duration<double> readTime = chrono::steady_clock::now() - readStart;
+
+        if (statsFlag == true) {
+            std::cout << "====================\nIR Reader Statistics\n====================\n\n";
+            std::cout << std::left << std::setw(28) << "modules" << argc - optind << std::endl;
+            std::cout << std::left << std::setw(28) << "instructions" << instructionList.size() << std::endl;
+            std::cout << std::left << std::setw(28) << "seconds" << readTime.count() << std::endl;
+            std::cout << std::endl;
+        }
+
     } else {
         // -------------------------------------------------------
         // Scan
@@ -156,11 +320,31 @@ int main(int argc, char *argv[]) {
             exit(-1);
         }
 
+        // Leave out the bodies of functions whose code can be reused
+        if (incrFlag == true) {
+            if (incremental.split(toks))
+                toks = incremental.reduce(toks);
+            else
+                incrFlag = false;
+        }
+
         // -------------------------------------------------------
         // Parse
         // -------------------------------------------------------
-        Parser parser(toks);
+        auto parseStart = chrono::steady_clock::now();
+        Parser parser(std::move(toks));
         std::list<Statement *> ast = parser.parse();
+        chrono::duration<double> parseTime = chrono::steady_clock::now() - parseStart;
+
+        if (statsFlag == true) {
+            double seconds = parseTime.count();
+
+            std::cout << "=================\nParser Statistics\n=================\n\n";
+            std::cout << std::left << std::setw(28) << "tokens" << parser.getTokenCount() << std::endl;
+            std::cout << std::left << std::setw(28) << "seconds" << seconds << std::endl;
+            std::cout << std::left << std::setw(28) << "tokens/s" << (long)(parser.getTokenCount() / seconds) << std::endl;
+            std::cout << std::endl;
+        }
 
         if (parser.hadError()) {
             std::cerr << "Exiting with parser error." << std::endl;
@@ -227,6 +411,33 @@ int main(int argc, char *argv[]) {
         instructionList = irepTransform.getIR();
     }
 
+    // The program is optimized as a whole, IR written with -I may still be
+    // linked with more and the reused functions of an incremental build
+    // have no bodies
+    if (optFlag == true && !irOut && !incrFlag) {
+        // constants are propagated first so returns and arguments show them
+        Optimizer pre = Optimizer(instructionList);
+        pre.constProp();
+
+        Interprocedural ipo(pre.getIR());
+
+        for (auto &e : exports)
+            ipo.exportSymbol(e);
+
+        ipo.setProfile(counts);
+        ipo.foldCalls();
+        ipo.eliminateTailRecursion();
+        ipo.inlineCalls();
+        ipo.propagateConstArgs();
+        ipo.removeDeadCode();
+        instructionList = ipo.getIR();
+
+        if (statsFlag == true) {
+            ipo.printStats();
+            std::cout << std::endl;
+        }
+    }
+
     Optimizer optM = Optimizer(instructionList);
     optM.constProp();
 
@@ -263,28 +474,92 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    CPU cpu = CPU();
-
-    cpu.BuildRange(bblist);
-    //used for debugging part of the register allocation
-    // cpu.printRange();
-    
-    bblist = cpu.assignRegs(bblist);
-
+    // Output IR to a file if flag set, as text or in the binary form -r
+    // reads back
     if (irOut == true) {
         ofstream outFile;
-        outFile.open(irFile);
 
-        for(auto i : optM.getIR()) {
-            outFile << i->toString() << std::endl;
+        if (binaryFlag == true) {
+            outFile.open(irFile, ios::binary);
+            writeBinaryIR(outFile, optM.getIR());
+        } else {
+            outFile.open(irFile);
+
+            for(auto i : optM.getIR()) {
+                outFile << i->toString() << std::endl;
+            }
         }
 
         outFile.close();
+        return 1;
+    }
+
+    // Run the optimized IR right away, main's value is our exit status
+    if (runFlag == true) {
+        Interpreter interpreter(optM.getIR());
+        int status;
+
+        try {
+            status = interpreter.run();
+        } catch (RuntimeError &re) {
+            re.printException();
+            exit(-1);
+        }
+
+        if (statsFlag == true) {
+            std::cout << std::endl;
+            interpreter.printStats();
+        }
+        return status;
+    }
+
+    // Vector loops are part of selecting instructions for the target, the
+    // IR written out above stays scalar
+    instructionList = optM.getIR();
+    if (optFlag == true && optLevel == 2) {
+        Vectorizer vectorizer(instructionList, avx2 ? 4 : 2);
+
+        vectorizer.vectorizeLoops();
+        instructionList = vectorizer.getIR();
+
+        if (statsFlag == true) {
+            vectorizer.printStats();
+            std::cout << std::endl;
+        }
+    }
+
+    // An instrumented main writes the counts out before it returns
+    if (profileGenerate == true)
+        profile.instrumentExits(instructionList);
+
+    bblist = bblist_of_instruction_list(instructionList);
+    removeEmptyBlocks(bblist);
+
+    CPU cpu = CPU();
+
+    cpu.setProfile(counts);
+
+    cpu.BuildRange(bblist);
+    //used for debugging part of the register allocation
+    // cpu.printRange();
+    
+    try {
+        bblist = cpu.assignRegs(bblist);
+    } catch (CodeGenError &ce) {
+        ce.printException();
+        std::cout << "exiting with code generation error." << endl;
+        exit(-1);
     }
 
-    Program p(fileName);
+    Program p(fileName, cpu);
     bool hadError = false;
 
+    p.setTailCalls(optFlag);
+    p.setAvx2(avx2);
+    if (profileGenerate == true)
+        p.setProfile(&profile);
+    p.layoutFrames(bblist);
+
     for (auto &i : bblist) {
         try {
             p.insertBasicBlock(i);
@@ -299,29 +574,126 @@ int main(int argc, char *argv[]) {
         exit(-1);
     }
 
+    if (profileGenerate == true)
+        p.insertProfileDump();
+
+    if (statsFlag == true && (profileGenerate || profileUse)) {
+        profile.printStats();
+        std::cout << std::endl;
+    }
+
+    // Clean up the selected instructions, then put the likely successor
+    // of every block right after it
+    if (optFlag == true) {
+        Peephole peephole;
+        peephole.run(p.getText());
+
+        if (statsFlag == true)
+            peephole.printStats();
+
+        BlockLayout layout(counts);
+        layout.run(p.getText());
+
+        if (statsFlag == true) {
+            std::cout << std::endl;
+            layout.printStats();
+        }
+    }
+
+    // Run the code in memory, main's value is our exit status
+    if (jitFlag == true) {
+        Jit jit(p.getModule());
+        int status;
+
+        try {
+            jit.load();
+            status = jit.run();
+        } catch (CodeGenError &ce) {
+            ce.printException();
+            exit(-1);
+        } catch (RuntimeError &re) {
+            re.printException();
+            exit(-1);
+        }
+        chrono::duration<double> totalTime = chrono::steady_clock::now() - compileStart;
+
+        if (statsFlag == true) {
+            std::cout << std::endl;
+            jit.printStats();
+            std::cout << std::left << std::setw(28) << "compile and run seconds" << totalTime.count() << std::endl;
+        }
+        return status;
+    }
+
+    // Put the reused functions back in
+    if (incrFlag == true) {
+        incremental.merge(p.getModule());
+
+        if (statsFlag == true)
+            incremental.printStats();
+    }
+
     // std::cout << p.toString() << std::endl;
 
     if (output == true) {
         ofstream outFile;
-        outFile.open(irFile);
 
-        outFile << p.toString();
+        if (objFlag == true) {
+            outFile.open(irFile, ios::binary);
+
+            try {
+                ElfWriter elf(p.getModule());
+                elf.write(outFile);
+            } catch (CodeGenError &ce) {
+                ce.printException();
+                outFile.close();
+                remove(irFile.c_str());
+                exit(-1);
+            }
+        } else {
+            outFile.open(irFile);
+            p.write(outFile);
+        }
 
         outFile.close();
     }
+
+    if (incrFlag == true) {
+        incremental.save();
+    }
+
+    if (cacheFlag == true) {
+        cache.store(cacheKey, irFile);
+
+        if (statsFlag == true)
+            cache.printStats();
+    }
     return 0;
 
 }
 
 // Prints the program use cases
 void printUsage() {
-    std::cout << "Usage: ./compile [-pstiIo] File\n"
+    std::cout << "Usage: ./compile [-pstiIbroScuCemxjf] File...\n"
         "-p: stop execution after parsing\n"
         "-s: stop execution after scanning\n"
         "-t: stop execution after filling symbol table\n"
         "-i: stop execution after IR generation\n"
         "-I [File]: stop execution after IR generation and output IR to [File]\n"
+        "-b: with -I, output the IR in the binary form\n"
+        "-r: read the input files as IR, text or binary, and link them\n"
         "-O [opt level]: Optimize IR code, supported levels: 1-2\n"
+        "-m [sse2|avx2]: vector instructions for the loops -O2 vectorizes, sse2 by default\n"
+        "-e [Name]: with -O, keep the function or global [Name] even if main does not use it\n"
+        "-S: print parser and optimization statistics\n"
+        "-c: output a relocatable ELF object file instead of assembly\n"
+        "-x: run the program with the IR interpreter instead of compiling it\n"
+        "-j: compile the program into memory and run it instead of writing it out\n"
+        "-f profile-generate[=File]: count how often the blocks of the compiled program run, main\n"
+        "   writes the counts to [File], by default the input's path with .prof appended\n"
+        "-f profile-use[=File]: with -O, inline, allocate registers and lay out blocks by the counts in [File]\n"
+        "-u [File]: compile incrementally, reusing unchanged functions recorded in [File]\n"
+        "-C [Dir]: reuse the output of an identical earlier compilation cached in [Dir]\n"
         "-o [File] output to at end of compilation to [File]\n"
         "File: input file to be used\n";
 }
@@ -0,0 +1,492 @@
+/* File: mir.cpp
+ * Authors: agent
+ * Description: Machine instructions and their printing as AT&T assembly
+ */
+
+#include <map>
+#include "mir.h"
+
+// Full register a 32 bit or byte register is part of
+static std::string reg64(std::string reg) {
+    static const std::map<std::string, std::string> full = {
+        {"eax", "rax"}, {"ecx", "rcx"}, {"edx", "rdx"}, {"ebx", "rbx"},
+        {"esi", "rsi"}, {"edi", "rdi"},
+        {"al", "rax"}, {"cl", "rcx"}, {"dl", "rdx"}, {"bl", "rbx"},
+        {"sil", "rsi"}, {"dil", "rdi"}
+    };
+
+    auto it = full.find(reg);
+    if (it != full.end())
+        return it->second;
+    // %r8d and %r8b are part of %r8
+    if (reg[0] == 'r' && (reg.back() == 'd' || reg.back() == 'b'))
+        return reg.substr(0, reg.size() - 1);
+    return reg;
+}
+
+//---------------------------------------
+// MOperand
+
+MOperand MOperand::Reg(std::string reg) {
+    MOperand m;
+    m.type = M_REG;
+    m.reg = reg;
+    return m;
+}
+
+MOperand MOperand::Imm(long value) {
+    MOperand m;
+    m.type = M_IMM;
+    m.value = value;
+    return m;
+}
+
+MOperand MOperand::Mem(std::string base, long disp) {
+    MOperand m;
+    m.type = M_MEM;
+    m.reg = base;
+    m.value = disp;
+    return m;
+}
+
+MOperand MOperand::Mem(std::string base, std::string index, int scale, long disp) {
+    MOperand m = Mem(base, disp);
+    m.index = index;
+    m.scale = scale;
+    return m;
+}
+
+MOperand MOperand::Rip(std::string sym) {
+    MOperand m = Mem("rip", 0);
+    m.sym = sym;
+    return m;
+}
+
+MOperand MOperand::Sym(std::string sym) {
+    MOperand m;
+    m.type = M_SYM;
+    m.sym = sym;
+    return m;
+}
+
+bool MOperand::isReg() {
+    return type == M_REG;
+}
+
+bool MOperand::isReg(std::string name) {
+    return type == M_REG && reg == name;
+}
+
+bool MOperand::isImm() {
+    return type == M_IMM;
+}
+
+bool MOperand::isMem() {
+    return type == M_MEM;
+}
+
+bool MOperand::isNone() {
+    return type == M_NONE;
+}
+
+bool MOperand::uses(std::string name) {
+    if (type == M_REG)
+        return reg64(reg) == name;
+    if (type == M_MEM)
+        return reg == name || index == name;
+    return false;
+}
+
+bool MOperand::operator==(const MOperand &other) const {
+    if (type != other.type)
+        return false;
+
+    switch (type) {
+    case M_REG:
+        return reg == other.reg;
+    case M_IMM:
+        return value == other.value;
+    case M_MEM:
+        return reg == other.reg && index == other.index &&
+            scale == other.scale && value == other.value && sym == other.sym;
+    case M_SYM:
+        return sym == other.sym;
+    default:
+        return true;
+    }
+}
+
+bool MOperand::operator!=(const MOperand &other) const {
+    return !(*this == other);
+}
+
+std::string MOperand::toString() {
+    AsmEmitter e;
+
+    e.emit(*this);
+    return e.getBuffer();
+}
+
+//---------------------------------------
+// MInstr
+
+MInstr::MInstr(MOp op):
+    op(op)
+{
+}
+
+MInstr::MInstr(MOp op, MOperand a):
+    op(op)
+{
+    ops.push_back(a);
+}
+
+MInstr::MInstr(MOp op, MOperand a, MOperand b):
+    op(op)
+{
+    ops.push_back(a);
+    ops.push_back(b);
+}
+
+MInstr::MInstr(MOp op, MOperand a, MOperand b, MOperand c):
+    op(op)
+{
+    ops.push_back(a);
+    ops.push_back(b);
+    ops.push_back(c);
+}
+
+bool MInstr::isLabel() {
+    return op == MOp::LABEL;
+}
+
+bool MInstr::isDirective() {
+    switch (op) {
+    case MOp::GLOBL: case MOp::TYPE: case MOp::SIZE: case MOp::BALIGN:
+    case MOp::QUAD: case MOp::LONG: case MOp::BYTE: case MOp::ZERO:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool MInstr::isJump() {
+    return op == MOp::JMP || isCondJump();
+}
+
+bool MInstr::isCondJump() {
+    switch (op) {
+    case MOp::JE: case MOp::JNE: case MOp::JL:
+    case MOp::JLE: case MOp::JG: case MOp::JGE:
+    case MOp::JA: case MOp::JAE: case MOp::JB: case MOp::JBE:
+    case MOp::JP: case MOp::JNP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool MInstr::readsFlags() {
+    switch (op) {
+    case MOp::SETE: case MOp::SETNE: case MOp::SETL:
+    case MOp::SETLE: case MOp::SETG: case MOp::SETGE:
+    case MOp::SETA: case MOp::SETAE: case MOp::SETB: case MOp::SETBE:
+    case MOp::SETP: case MOp::SETNP:
+        return true;
+    default:
+        return isCondJump();
+    }
+}
+
+// calls count as writing the flags, the callee leaves them undefined
+bool MInstr::writesFlags() {
+    switch (op) {
+    case MOp::ADDQ: case MOp::SUBQ: case MOp::IMULQ: case MOp::IDIVQ:
+    case MOp::IDIVL: case MOp::NEGQ: case MOp::ANDQ: case MOp::ORQ: case MOp::XORQ:
+    case MOp::SHLQ: case MOp::CMPQ: case MOp::TESTQ: case MOp::CALLQ:
+    case MOp::UCOMISS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string MInstr::toString() {
+    AsmEmitter e;
+
+    e.emit(*this);
+    std::string line = e.getBuffer();
+    line.pop_back();
+    return line;
+}
+
+//---------------------------------------
+// AsmEmitter
+
+// Operands are appended in place, immediates of directives have no '$'
+void AsmEmitter::put(MOperand &o, bool directive) {
+    switch (o.type) {
+    case M_REG:
+        buffer += '%';
+        buffer += o.reg;
+        break;
+    case M_IMM:
+        if (!directive)
+            buffer += '$';
+        buffer += std::to_string(o.value);
+        break;
+    case M_SYM:
+        buffer += o.sym;
+        break;
+    case M_MEM:
+        if (!o.sym.empty()) {
+            buffer += o.sym;
+            if (o.value != 0) {
+                buffer += '+';
+                buffer += std::to_string(o.value);
+            }
+        } else if (o.value != 0) {
+            buffer += std::to_string(o.value);
+        }
+
+        buffer += '(';
+        if (!o.reg.empty()) {
+            buffer += '%';
+            buffer += o.reg;
+        }
+        if (!o.index.empty()) {
+            buffer += ", %";
+            buffer += o.index;
+            buffer += ", ";
+            buffer += std::to_string(o.scale);
+        }
+        buffer += ')';
+        break;
+    default:
+        break;
+    }
+}
+
+void AsmEmitter::emit(MOperand &o) {
+    put(o, false);
+}
+
+void AsmEmitter::emit(MInstr &i) {
+    if (i.op == MOp::LABEL) {
+        buffer += i.ops[0].sym;
+        buffer += ":\n";
+        return;
+    }
+
+    buffer += "    ";
+    buffer += string_of_mop(i.op);
+
+    for (unsigned int k = 0; k < i.ops.size(); k++) {
+        if (k == 0)
+            buffer += i.op == MOp::JMPQ ? " *" : " ";
+        else
+            buffer += i.op == MOp::QUAD ? "-" : ", ";
+        put(i.ops[k], i.isDirective());
+    }
+
+    buffer += '\n';
+}
+
+void AsmEmitter::emit(std::vector<MInstr> &code) {
+    for (auto &i : code) {
+        emit(i);
+    }
+}
+
+void AsmEmitter::emit(MModule &module) {
+    // most lines are shorter than this, so the buffer rarely grows
+    buffer.reserve(buffer.size() + 64 +
+        24 * (module.data.size() + module.bss.size() + module.rodata.size() + module.text.size()));
+
+    buffer += ".file \"" + module.fileName + "\"\n\n";
+
+    buffer += ".section .data\n";
+    emit(module.data);
+
+    buffer += "\n.section .bss\n";
+    emit(module.bss);
+
+    // only switches and float constants make read only data
+    if (!module.rodata.empty()) {
+        buffer += "\n.section .rodata\n";
+        emit(module.rodata);
+    }
+
+    buffer += "\n.section .text\n";
+    emit(module.text);
+
+    // I like having an extra newline at the end
+    buffer += '\n';
+}
+
+std::string &AsmEmitter::getBuffer() {
+    return buffer;
+}
+
+void AsmEmitter::write(std::ostream &out) {
+    out.write(buffer.data(), buffer.size());
+}
+
+//---------------------------------------
+// Helpers
+
+std::string string_of_mop(MOp op) {
+    switch (op) {
+    case MOp::LABEL: return "label";
+    case MOp::GLOBL: return ".globl";
+    case MOp::TYPE: return ".type";
+    case MOp::SIZE: return ".size";
+    case MOp::BALIGN: return ".balign";
+    case MOp::QUAD: return ".quad";
+    case MOp::LONG: return ".long";
+    case MOp::BYTE: return ".byte";
+    case MOp::ZERO: return ".zero";
+    case MOp::MOVQ: return "movq";
+    case MOp::MOVL: return "movl";
+    case MOp::MOVB: return "movb";
+    case MOp::MOVZBQ: return "movzbq";
+    case MOp::MOVSLQ: return "movslq";
+    case MOp::MOVSBQ: return "movsbq";
+    case MOp::LEAQ: return "leaq";
+    case MOp::PUSHQ: return "pushq";
+    case MOp::POPQ: return "popq";
+    case MOp::ADDQ: return "addq";
+    case MOp::SUBQ: return "subq";
+    case MOp::IMULQ: return "imulq";
+    case MOp::IDIVQ: return "idivq";
+    case MOp::CQTO: return "cqto";
+    case MOp::IDIVL: return "idivl";
+    case MOp::CLTD: return "cltd";
+    case MOp::NEGQ: return "negq";
+    case MOp::NOTQ: return "notq";
+    case MOp::ANDQ: return "andq";
+    case MOp::ORQ: return "orq";
+    case MOp::XORQ: return "xorq";
+    case MOp::SHLQ: return "shlq";
+    case MOp::CMPQ: return "cmpq";
+    case MOp::TESTQ: return "testq";
+    case MOp::SETE: return "sete";
+    case MOp::SETNE: return "setne";
+    case MOp::SETL: return "setl";
+    case MOp::SETLE: return "setle";
+    case MOp::SETG: return "setg";
+    case MOp::SETGE: return "setge";
+    case MOp::SETA: return "seta";
+    case MOp::SETAE: return "setae";
+    case MOp::SETB: return "setb";
+    case MOp::SETBE: return "setbe";
+    case MOp::SETP: return "setp";
+    case MOp::SETNP: return "setnp";
+    case MOp::MOVSS: return "movss";
+    case MOp::ADDSS: return "addss";
+    case MOp::SUBSS: return "subss";
+    case MOp::MULSS: return "mulss";
+    case MOp::DIVSS: return "divss";
+    case MOp::XORPS: return "xorps";
+    case MOp::UCOMISS: return "ucomiss";
+    case MOp::CVTSI2SSQ: return "cvtsi2ssq";
+    case MOp::CVTTSS2SIQ: return "cvttss2siq";
+    case MOp::MOVQX: return "movq";
+    case MOp::MOVDQA: return "movdqa";
+    case MOp::MOVDQU: return "movdqu";
+    case MOp::PADDQ: return "paddq";
+    case MOp::PSUBQ: return "psubq";
+    case MOp::PMULUDQ: return "pmuludq";
+    case MOp::PAND: return "pand";
+    case MOp::POR: return "por";
+    case MOp::PXOR: return "pxor";
+    case MOp::PSRLQ: return "psrlq";
+    case MOp::PSLLQ: return "psllq";
+    case MOp::PCMPEQD: return "pcmpeqd";
+    case MOp::PSHUFD: return "pshufd";
+    case MOp::PUNPCKLQDQ: return "punpcklqdq";
+    case MOp::VMOVQ: return "vmovq";
+    case MOp::VPEXTRQ: return "vpextrq";
+    case MOp::VPBROADCASTQ: return "vpbroadcastq";
+    case MOp::VEXTRACTI128: return "vextracti128";
+    case MOp::VPADDQ: return "vpaddq";
+    case MOp::VPSUBQ: return "vpsubq";
+    case MOp::VPMULUDQ: return "vpmuludq";
+    case MOp::VPAND: return "vpand";
+    case MOp::VPOR: return "vpor";
+    case MOp::VPXOR: return "vpxor";
+    case MOp::VPSRLQ: return "vpsrlq";
+    case MOp::VPSLLQ: return "vpsllq";
+    case MOp::VPCMPEQD: return "vpcmpeqd";
+    case MOp::VZEROUPPER: return "vzeroupper";
+    case MOp::JMP: return "jmp";
+    case MOp::JE: return "je";
+    case MOp::JNE: return "jne";
+    case MOp::JL: return "jl";
+    case MOp::JLE: return "jle";
+    case MOp::JG: return "jg";
+    case MOp::JGE: return "jge";
+    case MOp::JA: return "ja";
+    case MOp::JAE: return "jae";
+    case MOp::JB: return "jb";
+    case MOp::JBE: return "jbe";
+    case MOp::JP: return "jp";
+    case MOp::JNP: return "jnp";
+    case MOp::JMPQ: return "jmpq";
+    case MOp::CALLQ: return "callq";
+    case MOp::RETQ: return "retq";
+    }
+
+    return "";
+}
+
+MOp invert_jump(MOp op) {
+    switch (op) {
+    case MOp::JE: return MOp::JNE;
+    case MOp::JNE: return MOp::JE;
+    case MOp::JL: return MOp::JGE;
+    case MOp::JGE: return MOp::JL;
+    case MOp::JG: return MOp::JLE;
+    case MOp::JLE: return MOp::JG;
+    case MOp::JA: return MOp::JBE;
+    case MOp::JBE: return MOp::JA;
+    case MOp::JAE: return MOp::JB;
+    case MOp::JB: return MOp::JAE;
+    case MOp::JP: return MOp::JNP;
+    case MOp::JNP: return MOp::JP;
+    default: return op;
+    }
+}
+
+MOp set_of_jump(MOp op) {
+    switch (op) {
+    case MOp::JE: return MOp::SETE;
+    case MOp::JNE: return MOp::SETNE;
+    case MOp::JL: return MOp::SETL;
+    case MOp::JLE: return MOp::SETLE;
+    case MOp::JG: return MOp::SETG;
+    case MOp::JGE: return MOp::SETGE;
+    case MOp::JA: return MOp::SETA;
+    case MOp::JAE: return MOp::SETAE;
+    case MOp::JB: return MOp::SETB;
+    case MOp::JBE: return MOp::SETBE;
+    case MOp::JP: return MOp::SETP;
+    case MOp::JNP: return MOp::SETNP;
+    default: return op;
+    }
+}
+
+// The low 4 or 1 bytes of a full register
+std::string sub_register(std::string reg, int bytes) {
+    static const std::map<std::string, std::pair<std::string, std::string>> low = {
+        {"rax", {"eax", "al"}}, {"rcx", {"ecx", "cl"}}, {"rdx", {"edx", "dl"}},
+        {"rbx", {"ebx", "bl"}}, {"rsi", {"esi", "sil"}}, {"rdi", {"edi", "dil"}}
+    };
+
+    auto it = low.find(reg);
+    if (bytes == 8)
+        return reg;
+    if (it != low.end())
+        return bytes == 4 ? it->second.first : it->second.second;
+    return reg + (bytes == 4 ? "d" : "b");
+}
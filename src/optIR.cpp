@@ -6,7 +6,7 @@ Optimizer::Optimizer(std::list<Instruction *> IR) {
 
 //function that handles constant propigation
 void Optimizer::constProp() {
-    std::map<std::string, int> constants;
+    std::map<std::string, Container> constants;
     std::list<Instruction *> IR2;
 
     for(auto instr: this->IR) {
@@ -18,7 +18,7 @@ void Optimizer::constProp() {
                 if (reg.isRegister()) {
                     if (constant.isImmediate()) {
                         std::string temp = "%r" + std::to_string(reg.getIntValue());
-                        constants[temp] = constant.getIntImmediate();
+                        constants[temp] = constant;
                     }
                 }
                 break;
@@ -33,8 +33,9 @@ void Optimizer::constProp() {
             case CONST_LET: {
                 Container cont = ((LetInstr *)instr)->getOp1();
                 std::string reg;
-                //if container is an immediate do next itteration
-                if (cont.isImmediate()) {
+                //a register set to an immediate was replaced by the immediate
+                //everywhere, a variable still has to be stored
+                if (cont.isImmediate() && ((LetInstr *)instr)->getContainer().isRegister()) {
                     break;
                 }
 
@@ -44,7 +45,7 @@ void Optimizer::constProp() {
 
                     if (constants.find(reg) != constants.end()) {
 
-                        Container rhs = Container(IMM, constants[reg]);
+                        Container rhs = constants[reg];
                         ((LetInstr *)instr)->setExpression(rhs);                    
                     }
                 }
@@ -60,7 +61,7 @@ void Optimizer::constProp() {
                     
                     //replace
                     if (constants.find(reg) != constants.end()) {
-                        Container rhs = Container(IMM, constants[reg]);
+                        Container rhs = constants[reg];
                         ((LetInstr *)instr)->setExpression(rhs, ((LetInstr *)instr)->getOperation());
                     }
                 }
@@ -80,7 +81,7 @@ void Optimizer::constProp() {
                 
                     if (constants.find(reg) != constants.end()) {
                         //replace cont
-                        cont = Container(IMM, constants[reg]);
+                        cont = constants[reg];
                     }
 
                 }
@@ -90,7 +91,7 @@ void Optimizer::constProp() {
                     
                     if (constants.find(reg2) != constants.end()) {
                         //replace cont2
-                        cont2 = Container(IMM, constants[reg2]);                        
+                        cont2 = constants[reg2];                        
                     }
 
                 }
@@ -111,7 +112,7 @@ void Optimizer::constProp() {
                         reg = "%r" + std::to_string(arg.getIntValue());
 
                         if (constants.find(reg) != constants.end()) {
-                            Container temp = Container(IMM, constants[reg]);
+                            Container temp = constants[reg];
 
                             new_args->push_back(temp);
 
@@ -119,12 +120,15 @@ void Optimizer::constProp() {
                             new_args->push_back(arg);
                         }
 
+                    } else {
+                        new_args->push_back(arg);
                     }
                 }
                 Container cont = ((CallInstr *)instr)->getContainer();
 
                 CallInstr *call = new CallInstr(((CallInstr *)instr)->getName(), new_args, NULL);
-                call->setExpression(cont);
+                if (((CallInstr *)instr)->getFlag())
+                    call->setExpression(cont);
                 IR2.push_back(call);
 
                 break;
@@ -137,7 +141,7 @@ void Optimizer::constProp() {
                     reg = "%r" + std::to_string(cond.getIntValue());
                     //replace
                     if (constants.find(reg) != constants.end()) {
-                        cond = Container(IMM, constants[reg]);
+                        cond = constants[reg];
                         std::string one = ((BranchInstr *)instr)->getLabelOne();
                         std::string *two = ((BranchInstr *)instr)->getLabelTwo();
                         
@@ -150,6 +154,24 @@ void Optimizer::constProp() {
                 IR2.push_back(instr);
                 break;
             }
+            case JUMP_TABLE:{
+                SwitchInstr *si = (SwitchInstr *)instr;
+                Container value = si->getContainer();
+
+                if (value.isRegister()) {
+                    std::string reg = "%r" + std::to_string(value.getIntValue());
+
+                    //replace
+                    if (constants.find(reg) != constants.end()) {
+                        value = constants[reg];
+                        IR2.push_back(new SwitchInstr(value, si->getLow(), si->getTargets(), si->getDefault(), NULL));
+                        break;
+                    }
+                }
+
+                IR2.push_back(instr);
+                break;
+            }
             case RET:{
                 Container cont = ((ReturnInstr *)instr)->getContainer();
                 std::string reg;
@@ -159,7 +181,7 @@ void Optimizer::constProp() {
 
                     //replace
                     if (constants.find(reg) != constants.end()) {
-                        Container val = Container(IMM, constants[reg]);
+                        Container val = constants[reg];
 
                         Instruction *ret = new ReturnInstr(val, NULL);
                         IR2.push_back(ret);
@@ -189,10 +211,31 @@ void Optimizer::constFold() {
                 Container cont = ((LetInstr *)instr)->getOp1();
                 Container cont2 = ((LetInstr *)instr)->getOp2();
 
-                if (cont.isImmediate() && cont2.isImmediate()) {
+                IrOp op = ((LetInstr *)instr)->getOperation();
+                // only + - * / fold, and never an integer division by zero
+                bool foldable = op == IrOp::ADD || op == IrOp::SUB || op == IrOp::MUL ||
+                    (op == IrOp::DIV && cont2.isImmediate() && (cont2.isFloat() || cont2.getIntImmediate() != 0));
+
+                // floats fold with float arithmetic, as the code would run
+                if (foldable && cont.isImmediate() && cont2.isImmediate() && cont.isFloat()) {
+                    float x = cont.getFloatImmediate();
+                    float y = cont2.getFloatImmediate();
+                    Container result = Container(IMM);
+
+                    switch(op) {
+                    case IrOp::ADD: result.setVal(x + y); break;
+                    case IrOp::SUB: result.setVal(x - y); break;
+                    case IrOp::MUL: result.setVal(x * y); break;
+                    default: result.setVal(x / y); break;
+                    }
+                    result.sym = SYM_FLOAT;
+
+                    LetInstr *fin = new LetInstr(((LetInstr *)instr)->getContainer(), CONST_LET, NULL);
+                    fin->setExpression(result);
+                    IR2.push_back(fin);
+                } else if (foldable && cont.isImmediate() && cont2.isImmediate()) {
                     int i = cont.getIntImmediate();
                     int j = cont2.getIntImmediate();
-                    IrOp op = ((LetInstr *)instr)->getOperation();
 
                     Instruction *fin = new LetInstr(((LetInstr *)instr)->getContainer(), CONST_LET, NULL);
 
@@ -219,6 +262,28 @@ void Optimizer::constFold() {
 
                 break;
             }
+            case UNARY_LET: {
+                // conversions of constants
+                Container cont = ((LetInstr *)instr)->getOp1();
+                IrOp op = ((LetInstr *)instr)->getOperation();
+
+                if (cont.isImmediate() && (op == IrOp::ITOF || op == IrOp::FTOI)) {
+                    Container result = Container(IMM);
+                    if (op == IrOp::ITOF) {
+                        result.setVal((float)cont.getIntImmediate());
+                        result.sym = SYM_FLOAT;
+                    } else {
+                        result.setVal((int)cont.getFloatImmediate());
+                    }
+
+                    LetInstr *fin = new LetInstr(((LetInstr *)instr)->getContainer(), CONST_LET, NULL);
+                    fin->setExpression(result);
+                    IR2.push_back(fin);
+                } else {
+                    IR2.push_back(instr);
+                }
+                break;
+            }
             default:
                 IR2.push_back(instr);
                 break;
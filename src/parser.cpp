@@ -6,8 +6,27 @@
 #include "parser.h"
 #include "pprinter.h"
 
+// Token types the rules branch on
+static constexpr TokenSet ASSIGN_OPS = tokenSet(EQUAL) | tokenSet(PLUS_EQUAL) |
+    tokenSet(MINUS_EQUAL) | tokenSet(STAR_EQUAL) | tokenSet(SLASH_EQUAL);
+static constexpr TokenSet STEP_OPS = tokenSet(PLUS_PLUS) | tokenSet(MINUS_MINUS);
+static constexpr TokenSet UNARY_OPS = tokenSet(PLUS) | tokenSet(MINUS) |
+    tokenSet(BANG) | tokenSet(TILDA);
+// Types a variable or function can have
+static constexpr TokenSet VALUE_TYPES = tokenSet(TYPE_INT) | tokenSet(TYPE_VOID) |
+    tokenSet(TYPE_CHAR) | tokenSet(TYPE_FLOAT);
+// Types that start a declaration
+static constexpr TokenSet DECL_TYPES = tokenSet(TYPE_INT) | tokenSet(TYPE_CHAR) |
+    tokenSet(TYPE_FLOAT) | tokenSet(TYPE_STRING) | tokenSet(TYPE_VOID);
+// Tokens after 'type id' that make it a variable declaration
+static constexpr TokenSet VAR_DECL_END = tokenSet(SEMICOLON) | tokenSet(EQUAL) | tokenSet(COMMA);
+// Tokens synchronize() stops in front of
+static constexpr TokenSet SYNC_POINTS = tokenSet(IF) | tokenSet(ELSE) | tokenSet(SWITCH) |
+    tokenSet(BREAK) | tokenSet(FOR) | tokenSet(WHILE) | tokenSet(RETURN) |
+    tokenSet(GOTO) | tokenSet(CONTINUE) | tokenSet(RIGHT_BRACE);
+
 Parser::Parser(std::vector<Token> tokens) {
-    this->tokens = tokens;
+    this->tokens = std::move(tokens);
     this->current = 0;
     this->err = false;
 }
@@ -15,22 +34,24 @@ bool Parser::hadError() {
     return this->err;
 }
 
+unsigned long Parser::getTokenCount() {
+    return tokens.size();
+}
+
 
-// Checks current token type against passed list of token types
+// Checks current token type against a set of token types
 // Advances if found
-bool Parser::match(std::list<TokenType> tokenList) {
-    for (std::list<TokenType>::iterator i = tokenList.begin(); i != tokenList.end(); ++i) {
-        if (check(*i)) {
-            advance();
-            return true;
-        }
+bool Parser::match(TokenSet types) {
+    if (check(types)) {
+        advance();
+        return true;
     }
 
     return false;
 }
 
 // If not at he end of the list advance the currrent token
-Token Parser::advance() {
+const Token &Parser::advance() {
     if (!isAtEnd()) {
         current++;
     }
@@ -39,19 +60,28 @@ Token Parser::advance() {
 }
 
 // Returns the last token
-Token Parser::previous() {
-    return tokens.at(current - 1);
+const Token &Parser::previous() {
+    return tokens[current - 1];
+}
+
+// Returns a reference to the current token, the scanner always ends the
+// list with EOFILE and advance() never moves past it
+const Token &Parser::peek() {
+    return tokens[current];
 }
 
-// Returns a reference to the current token
-Token Parser::peek() {
-    //std::cout << tokens.at(current) << std::endl;
-    return tokens.at(current);
+// Returns the type of the token n places ahead
+TokenType Parser::lookahead(unsigned int n) {
+    if ((unsigned)current + n >= tokens.size()) {
+        return EOFILE;
+    }
+
+    return tokens[current + n].getType();
 }
 
 // Returns wether the current is at he eof
 bool Parser::isAtEnd() {
-    return (peek().getType() == EOFILE);
+    return (tokens[current].getType() == EOFILE);
 }
 
 // Checks current token type again passed var
@@ -63,23 +93,32 @@ bool Parser::check(TokenType type) {
     return (peek().getType() == type);
 }
 
+// Checks current token type against a set of types, EOFILE is never in a set
+bool Parser::check(TokenSet types) {
+    return (types >> peek().getType()) & 1;
+}
+
 //checks if the next token matches a passed type
 bool Parser::checkNext(TokenType type) {
     if (isAtEnd()) {
         return false;
     }
 
-    return (tokens.at(current+1).getType() == type);
+    return (tokens[current+1].getType() == type);
 }
 
-//checks if the next token is for an identifying type
-bool Parser::isType() {
-    TokenType type = peek().getType();
-    if (type == TYPE_INT || type == TYPE_VOID || type == TYPE_CHAR || type == TYPE_FLOAT) {
-        return true;
+//checks if the next token is in a set of types
+bool Parser::checkNext(TokenSet types) {
+    if (isAtEnd()) {
+        return false;
     }
 
-    return false;
+    return (types >> tokens[current+1].getType()) & 1;
+}
+
+//checks if the next token is for an identifying type
+bool Parser::isType() {
+    return check(VALUE_TYPES);
 }
 
 // Discard tokens until we reach a semicolon or a left brace
@@ -95,21 +134,8 @@ void Parser::synchronize() {
         if (previous().getType() == SEMICOLON || previous().getType() == LEFT_BRACE)
             return;
 
-        switch (peek().getType()) {
-            case IF:
-            case ELSE:
-            case SWITCH:
-            case BREAK:
-            case FOR:
-            case WHILE:
-            case RETURN:
-            case GOTO:
-            case CONTINUE:
-            case RIGHT_BRACE:
-                return;
-            default:
-                ;//continue;
-        }
+        if (check(SYNC_POINTS))
+            return;
 
         advance();
     }
@@ -160,7 +186,7 @@ Statement *Parser::declaration() {
     //erro checks for out of bounds
     if((unsigned)current+2 < tokens.size()) {
         //checks if token 2 ahead is a proper type
-        if (tokens.at(current+2).getType() == SEMICOLON || tokens.at(current+2).getType() == EQUAL || tokens.at(current+2).getType() == COMMA) {
+        if ((VAR_DECL_END >> lookahead(2)) & 1) {
             return varDecl();
         }
     } else {
@@ -188,11 +214,11 @@ Statement *Parser::function() {
 // Function for program production rule, returns returnType + id + ( params )
 Statement *Parser::funcDecl() {
     
-    Token type = returnType();
+    const Token &type = returnType();
     
     //error check for identifier
     if (check(IDENTIFIER)) {
-        Token id = advance();
+        const Token &id = advance();
         
         //get params 
         std::list<std::pair<Token, Token>> args = params();
@@ -235,11 +261,11 @@ std::list<std::pair<Token, Token>> Parser::paramList() {
 
     //while ) doesn't show up 
     while(!check(RIGHT_PAREN)) {
-        Token type = typeSpecifier();
+        const Token &type = typeSpecifier();
         
         //check for id
         if (check(IDENTIFIER)) {
-            Token id = advance(); //consume
+            const Token &id = advance(); //consume
             
             //init arg pair
             std::pair<Token, Token> arg(type, id);
@@ -360,7 +386,7 @@ Statement *Parser::statement() {
     }
 
     if (isType()) {//if it has a type id check for var dec
-        if (tokens.at(current+2).getType() == SEMICOLON || tokens.at(current+2).getType() == EQUAL || tokens.at(current+2).getType() == COMMA) {
+        if ((VAR_DECL_END >> lookahead(2)) & 1) {
             return varDecl();
         }
     } 
@@ -566,7 +592,7 @@ Statement *Parser::gotoStmt() {
     advance();
     //check for id
     if (check(IDENTIFIER)) {
-        Token id = advance();
+        const Token &id = advance();
         //check for ;
         if (check(SEMICOLON)) {
             advance();    
@@ -586,7 +612,7 @@ Statement *Parser::gotoStmt() {
 //builds a label statement
 Statement *Parser::label() {
     //safe to assume name exists since it is the entry condition
-    Token id = advance();
+    const Token &id = advance();
 
     //colon is part of the entry condition
     advance();
@@ -594,7 +620,7 @@ Statement *Parser::label() {
     // Check to see if the next token is not a part of statement
     if (check(RIGHT_BRACE)) {
         throw ParseError("Label at end of Compound Statement", peek());
-    } else if (check(TYPE_INT) || check(TYPE_CHAR) || check(TYPE_FLOAT) || check(TYPE_STRING) || check(TYPE_VOID)) {
+    } else if (check(DECL_TYPES)) {
         throw ParseError("Label Can't Be followed by declaration", peek());
     } 
     return new Label(id);
@@ -619,10 +645,10 @@ Statement *Parser::expressionStmt() {
 Statement *Parser::varDecl() {
     // At this stage it is confirmed that the third token is either a ; or , or = 
     if (isType()) {
-        Token type = typeSpecifier();
+        const Token &type = typeSpecifier();
         //check for id
         if (check(IDENTIFIER)) {
-            Token name = advance();
+            const Token &name = advance();
 
             // Check if Semicolon
             if (check(SEMICOLON)) {
@@ -665,7 +691,7 @@ Statement *Parser::varDecl() {
 
 // Function for returnStmt production rule, returns  return + expressionStmt
 Statement *Parser::returnStmt() {
-    Token ret = advance();
+    const Token &ret = advance();
 
     if (check(SEMICOLON)) {
         advance();
@@ -684,13 +710,13 @@ Statement *Parser::returnStmt() {
 }
 
 // Function for returnType production rule, returns typeSpecifier or returns void
-Token Parser::returnType() {
+const Token &Parser::returnType() {
     if (check(TYPE_VOID)) return advance();
     return typeSpecifier();
 }
 
 // Function for typeSpecifier production rule, returns terminals for supported types
-Token Parser::typeSpecifier() {
+const Token &Parser::typeSpecifier() {
     if (check(TYPE_INT)) return advance();
     if (check(TYPE_CHAR)) return advance();
     if (check(TYPE_FLOAT)) return advance();
@@ -700,9 +726,9 @@ Token Parser::typeSpecifier() {
 }
 
 //Function for constant production rule, returns terminals for constants
-Token Parser::constant() {
+const Token &Parser::constant() {
     //check if  next token is an int constant
-    if (check(INTEGER)) {
+    if (check(INTEGER) || check(FLOAT)) {
         return advance();
     }
 
@@ -736,11 +762,11 @@ Expression *Parser::expression() {
     //check for id
     if (check(IDENTIFIER)) {
         //check for assignment ops
-        if (checkNext(EQUAL) || checkNext(PLUS_EQUAL) || checkNext(MINUS_EQUAL) || checkNext(STAR_EQUAL) || checkNext(SLASH_EQUAL)) {
+        if (checkNext(ASSIGN_OPS)) {
             //consume token and operator
-            Token id = advance();
+            const Token &id = advance();
 
-            Token op = advance();
+            const Token &op = advance();
 
             Expression *right = expressionList();
 
@@ -748,152 +774,68 @@ Expression *Parser::expression() {
         }
     }
 
-    return simpleExpression();
-}
-
-//handles OR expressions
-Expression *Parser::simpleExpression() {
-    Expression *left = andExpr();
-//check for ||
-    if (check(BAR_BAR)) {
-        //get operator
-        Token op = advance();
-
-        Expression * right = simpleExpression();
-
-        return new BinaryExp(left, op, right);
-    }
-
-    return left;
-}
-
-//handles and expressions
-Expression *Parser::andExpr() {
-    Expression *left = bitOrExpr();
-//check for &&
-    if (check(AND_AND)) {
-        //get operaor
-        Token op = advance();
-
-        Expression *right = andExpr();
-
-        return new BinaryExp(left, op, right);
-    }
-
-    return left;
-}
-
-//handles bit or expressions
-Expression *Parser::bitOrExpr() {
-    Expression *left = bitXorExpr();
-//check for |
-    if (check(BAR)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = bitOrExpr();
-
-        return new BinaryExp(left, op, right);
-    }
-
-    return left;
+    return binaryExpr(1);
 }
 
-//handles xor expressions
-Expression *Parser::bitXorExpr() {
-    Expression *left = bitAndExpr();
-//check for ^
-    if (check(XOR)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = bitXorExpr();
-
-        return new BinaryExp(left, op, right);
+// Binding power of a binary operator, 0 if the token is not one. The
+// levels run from || up to * / %, there are no shift operators yet
+static int bindingPower(TokenType type) {
+    switch (type) {
+    case BAR_BAR: return 1;
+    case AND_AND: return 2;
+    case BAR: return 3;
+    case XOR: return 4;
+    case AND: return 5;
+    case EQUAL_EQUAL: case BANG_EQUAL: return 6;
+    case LESS: case GREATER: case LESS_EQUAL: case GREATER_EQUAL: return 7;
+    case PLUS: case MINUS: return 8;
+    case STAR: case SLASH: case MOD: return 9;
+    default: return 0;
     }
-
-    return left;
 }
 
-//handles bit and expresions
-Expression *Parser::bitAndExpr() {
-    Expression *left = relop1Expr();
-//check for &
-    if (check(AND)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = bitAndExpr();
-
-        return new BinaryExp(left, op, right);
-    }
-
-    return left;
-}
-//handles comparison an *=
-Expression *Parser::relop1Expr() {
-    Expression *left = relop2Expr();
-//check for == and *=
-    if (check(EQUAL_EQUAL) || check(BANG_EQUAL)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = relop1Expr();
-
-        return new BinaryExp(left, op, right);
-    }
-
-    return left;
-}
-
-//handles basic boolean operations
-Expression *Parser::relop2Expr() {
-    Expression *left = bitShiftExpr();
-//check for < <= > >=
-    if (check(LESS) || check(GREATER) || check(LESS_EQUAL) || check(GREATER_EQUAL)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = relop2Expr();
-
-        return new BinaryExp(left, op, right);
-    }
+//handles binary expressions whose operators bind at least as tightly as
+//minPower, every level is right associative
+Expression *Parser::binaryExpr(int minPower) {
+    Expression *left = preUnaryExpr();
+    int power;
 
-    return left;
-}
+    while ((power = bindingPower(peek().getType())) >= minPower) {
+        const Token &op = advance();
+        Expression *right = binaryExpr(power + 1);
 
-//handles the un implemented bitshifts
-Expression *Parser::bitShiftExpr() {
-    return sumExpr();
-}
+        if (bindingPower(peek().getType()) != power) {
+            left = new BinaryExp(left, op, right);
+            continue;
+        }
 
-//handles arithmatic ops
-Expression *Parser::sumExpr() {
-    Expression *left = term();
-//check for + and -
-    if (check(PLUS) || check(MINUS)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = sumExpr();
+        // a run of operators of the same power groups to the right, its
+        // operands wait on the stacks until the last one is parsed, so
+        // long runs do not recurse
+        unsigned int base = operators.size();
 
-        return new BinaryExp(left, op, right);
-    }
+        try {
+            operands.push_back(left);
+            operators.push_back(&op);
 
-    return left;
-}
+            while (bindingPower(peek().getType()) == power) {
+                operands.push_back(right);
+                operators.push_back(&advance());
+                right = binaryExpr(power + 1);
+            }
+        } catch (ParseError &se) {
+            operands.resize(base);
+            operators.resize(base);
+            throw;
+        }
 
-//handles multiplication ops
-Expression *Parser::term() {
-    Expression *left = preUnaryExpr();
-//check for * / %
-    if (check(STAR) || check(SLASH) || check(MOD)) {
-        //get operaor
-        Token op = advance();
-        
-        Expression *right = term();
+        while (operators.size() > base) {
+            right = new BinaryExp(operands.back(), *operators.back(), right);
+            operands.pop_back();
+            operators.pop_back();
+        }
 
-        return new BinaryExp(left, op, right);
+        left = right;
     }
 
     return left;
@@ -902,11 +844,11 @@ Expression *Parser::term() {
 //handles prefix unary expressions
 Expression *Parser::preUnaryExpr() {
     //check for++ and --
-    if (check(PLUS_PLUS) || check(MINUS_MINUS)) {
-        Token op = advance();
+    if (check(STEP_OPS)) {
+        const Token &op = advance();
 
         if (check(IDENTIFIER)) {
-            Token id = advance();
+            const Token &id = advance();
             Token fixedOp;
             PrimaryExp *value = new PrimaryExp(Token(INTEGER, std::to_string(1), id.getLine(), 1));
             
@@ -922,8 +864,8 @@ Expression *Parser::preUnaryExpr() {
         }
     } 
     //check for + - ! ~ unary ops
-    if (check(PLUS) || check(MINUS) || check(BANG) || check(TILDA)) {
-        Token op = advance();
+    if (check(UNARY_OPS)) {
+        const Token &op = advance();
 
         Expression *exp = preUnaryExpr();
 
@@ -960,7 +902,7 @@ Expression *Parser::factor() {
             return call();
         }
 
-        Token id = advance();
+        const Token &id = advance();
 
         return new PrimaryExp(id);
     }
@@ -990,7 +932,7 @@ Expression *Parser::immutable() {
 
 //handles function calls
 Expression *Parser::call() {
-    Token id = advance();
+    const Token &id = advance();
     std::list<Expression *> arg;
 
     //check for (
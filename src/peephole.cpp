@@ -0,0 +1,513 @@
+/* File: peephole.cpp
+ * Authors: agent
+ * Description: Peephole optimizer, rewrites short instruction patterns of the
+ *              text section into cheaper equivalents
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <set>
+#include "peephole.h"
+
+static const char *ruleNames[P_NUM_RULES] = {
+    "redundant move",
+    "store/load forwarding",
+    "copy propagation",
+    "dead register write",
+    "jump to next",
+    "unreachable code",
+    "zero via xor",
+    "multiply by constant",
+    "compare and branch fusion",
+    "setcc materialization",
+    "dead flag computation"
+};
+
+// paths longer than this are not followed, the register counts as live
+static const int LIVENESS_BUDGET = 256;
+
+// registers a call may clobber, rax is also where a function returns
+static bool isCallerSaved(std::string reg) {
+    static const std::set<std::string> regs = {
+        "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"
+    };
+    return regs.count(reg) > 0;
+}
+
+// is the register one of the first n argument registers
+static bool isArgReg(std::string reg, int n) {
+    static const std::vector<std::string> regs = {
+        "rdi", "rsi", "rdx", "rcx", "r8", "r9"
+    };
+    for (int k = 0; k < n && k < (int)regs.size(); k++) {
+        if (regs[k] == reg)
+            return true;
+    }
+    return false;
+}
+
+static bool fitsImm32(long value) {
+    return value >= -2147483648L && value <= 2147483647L;
+}
+
+// Does the instruction read the register
+static bool reads(MInstr &i, std::string reg) {
+    switch (i.op) {
+    case MOp::LABEL:
+        return false;
+    case MOp::MOVQ: case MOp::MOVL: case MOp::MOVB:
+    case MOp::MOVZBQ: case MOp::MOVSLQ: case MOp::MOVSBQ:
+    case MOp::LEAQ:
+        return i.ops[0].uses(reg) || (i.ops[1].isMem() && i.ops[1].uses(reg));
+    case MOp::POPQ:
+        return i.ops[0].isMem() && i.ops[0].uses(reg);
+    case MOp::CQTO:
+    case MOp::CLTD:
+        return reg == "rax";
+    case MOp::IDIVQ:
+    case MOp::IDIVL:
+        return reg == "rax" || reg == "rdx" || i.ops[0].uses(reg);
+    case MOp::CALLQ:
+        return isArgReg(reg, i.ops[0].value);
+    case MOp::XORQ:
+        // xorq %r, %r only zeroes the register
+        if (i.ops[0].isReg() && i.ops[0] == i.ops[1])
+            return false;
+        break;
+    default:
+        break;
+    }
+
+    // setcc writes the low byte and keeps the rest, so it reads too
+    for (auto &o : i.ops) {
+        if (o.uses(reg))
+            return true;
+    }
+    return false;
+}
+
+// Does the instruction overwrite all of the register
+static bool writes(MInstr &i, std::string reg) {
+    switch (i.op) {
+    // the 32 bit forms clear the upper halves
+    case MOp::CQTO:
+    case MOp::CLTD:
+        return reg == "rdx";
+    case MOp::IDIVQ:
+    case MOp::IDIVL:
+        return reg == "rax" || reg == "rdx";
+    // a byte write keeps the rest of the register
+    case MOp::MOVB:
+        return false;
+    case MOp::LABEL: case MOp::CMPQ: case MOp::TESTQ:
+    case MOp::PUSHQ: case MOp::CALLQ: case MOp::RETQ: case MOp::JMPQ:
+    case MOp::SETE: case MOp::SETNE: case MOp::SETL:
+    case MOp::SETLE: case MOp::SETG: case MOp::SETGE:
+    case MOp::SETA: case MOp::SETAE: case MOp::SETB: case MOp::SETBE:
+    case MOp::SETP: case MOp::SETNP:
+        return false;
+    default:
+        if (i.isJump())
+            return false;
+        return !i.ops.empty() && i.ops.back().isReg(reg);
+    }
+}
+
+// Two operand instructions whose source may be any operand
+static bool foldable(MOp op) {
+    switch (op) {
+    case MOp::MOVQ: case MOp::ADDQ: case MOp::SUBQ: case MOp::ANDQ:
+    case MOp::ORQ: case MOp::XORQ: case MOp::CMPQ: case MOp::IMULQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// movq $0, %r or its xorq form
+static bool isZeroing(MInstr &i) {
+    if (i.op == MOp::MOVQ)
+        return i.ops[0].isImm() && i.ops[0].value == 0;
+    return i.op == MOp::XORQ && i.ops[0].isReg() && i.ops[0] == i.ops[1];
+}
+
+Peephole::Peephole() {
+    code = NULL;
+    passes = 0;
+    for (int k = 0; k < P_NUM_RULES; k++)
+        hits[k] = 0;
+}
+
+void Peephole::run(std::vector<MInstr> &code) {
+    this->code = &code;
+
+    // no rule produces what another one rewrites back, so this terminates
+    while (pass()) {
+    }
+
+    this->code = NULL;
+}
+
+int Peephole::getHits(PeepholeRule rule) {
+    return hits[rule];
+}
+
+void Peephole::printStats() {
+    std::cout << "===================\nPeephole Statistics\n===================\n\n";
+    for (int k = 0; k < P_NUM_RULES; k++) {
+        std::cout << std::left << std::setw(28) << ruleNames[k] << hits[k] << std::endl;
+    }
+    std::cout << std::left << std::setw(28) << "passes" << passes << std::endl;
+}
+
+// One sweep over the code. Rules look at the code as it was at the start of
+// the sweep, which is safe because a rewrite only reads registers and flags
+// where the replaced instructions already read them.
+bool Peephole::pass() {
+    std::vector<MInstr> out;
+    bool changed = false;
+
+    labels.clear();
+    refs.clear();
+    for (unsigned int k = 0; k < code->size(); k++) {
+        MInstr &i = (*code)[k];
+
+        if (i.isLabel())
+            labels[i.ops[0].sym] = k;
+        else if (i.isJump())
+            refs[i.ops[0].sym]++;
+    }
+
+    out.reserve(code->size());
+
+    unsigned int k = 0;
+    while (k < code->size()) {
+        unsigned int n = rewrite(k, out);
+
+        if (n == 0) {
+            out.push_back((*code)[k]);
+            k++;
+        } else {
+            k += n;
+            changed = true;
+        }
+    }
+
+    code->swap(out);
+    passes++;
+
+    return changed;
+}
+
+bool Peephole::at(unsigned int pos, MOp op) {
+    return pos < code->size() && (*code)[pos].op == op;
+}
+
+// Follow every path from pos until the register is read (live) or
+// overwritten (dead)
+bool Peephole::regDead(unsigned int pos, std::string reg) {
+    std::vector<unsigned int> work(1, pos);
+    std::set<unsigned int> seen;
+    int budget = LIVENESS_BUDGET;
+
+    while (!work.empty()) {
+        unsigned int p = work.back();
+        work.pop_back();
+
+        for (; p < code->size(); p++) {
+            MInstr &i = (*code)[p];
+
+            if (!seen.insert(p).second)
+                break;
+            if (--budget < 0 || reads(i, reg))
+                return false;
+            if (writes(i, reg))
+                break;
+
+            // the caller sees the return value and its own callee saved
+            // registers
+            if (i.op == MOp::RETQ) {
+                if (reg == "rax" || !isCallerSaved(reg))
+                    return false;
+                break;
+            }
+            if (i.op == MOp::CALLQ && isCallerSaved(reg))
+                break;
+            // any case of a jump table may come next
+            if (i.op == MOp::JMPQ)
+                return false;
+
+            if (i.isJump()) {
+                auto it = labels.find(i.ops[0].sym);
+                if (it == labels.end())
+                    return false;
+                work.push_back(it->second);
+                if (i.op == MOp::JMP)
+                    break;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Same walk as regDead, for the condition flags
+bool Peephole::flagsDead(unsigned int pos) {
+    std::vector<unsigned int> work(1, pos);
+    std::set<unsigned int> seen;
+    int budget = LIVENESS_BUDGET;
+
+    while (!work.empty()) {
+        unsigned int p = work.back();
+        work.pop_back();
+
+        for (; p < code->size(); p++) {
+            MInstr &i = (*code)[p];
+
+            if (!seen.insert(p).second)
+                break;
+            if (--budget < 0 || i.readsFlags())
+                return false;
+            if (i.writesFlags() || i.op == MOp::RETQ)
+                break;
+            if (i.op == MOp::JMPQ)
+                return false;
+
+            if (i.op == MOp::JMP) {
+                auto it = labels.find(i.ops[0].sym);
+                if (it == labels.end())
+                    return false;
+                work.push_back(it->second);
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+unsigned int Peephole::rewrite(unsigned int k, std::vector<MInstr> &out) {
+    std::vector<MInstr> &c = *code;
+    MInstr &i = c[k];
+
+    // Float equality also jumps when ucomiss found the operands unordered,
+    // V is 1 for == and 0 for !=:
+    //     jne A; jp A; movq $V, D; jmp B; A: movq $!V, D; B:
+    if (i.op == MOp::JNE && k + 6 < c.size() &&
+            at(k + 1, MOp::JP) && c[k + 1].ops[0].sym == i.ops[0].sym &&
+            (isZeroing(c[k + 2]) || (at(k + 2, MOp::MOVQ) && c[k + 2].ops[0] == MOperand::Imm(1))) &&
+            at(k + 3, MOp::JMP) &&
+            at(k + 4, MOp::LABEL) && c[k + 4].ops[0].sym == i.ops[0].sym &&
+            at(k + 5, MOp::MOVQ) && c[k + 5].ops[1] == c[k + 2].ops[1] &&
+            c[k + 5].ops[0] == MOperand::Imm(isZeroing(c[k + 2]) ? 1 : 0) &&
+            at(k + 6, MOp::LABEL) && c[k + 6].ops[0].sym == c[k + 3].ops[0].sym &&
+            refs[c[k + 4].ops[0].sym] == 2 && refs[c[k + 6].ops[0].sym] == 1) {
+        MOperand dest = c[k + 2].ops[1];
+        bool equal = !isZeroing(c[k + 2]);
+
+        // a branch on the boolean jumps where it is 0:
+        //     cmpq $1, D; jne L  ->  jne L; jp L          for ==
+        //                        ->  jp A; je L; A:       for !=
+        if (dest.isReg() && at(k + 7, MOp::CMPQ) &&
+                c[k + 7].ops[0] == MOperand::Imm(1) && c[k + 7].ops[1] == dest &&
+                at(k + 8, MOp::JNE) && labels.count(c[k + 8].ops[0].sym)) {
+            unsigned int target = labels[c[k + 8].ops[0].sym];
+
+            if (regDead(k + 9, dest.reg) && regDead(target, dest.reg) &&
+                    flagsDead(k + 9) && flagsDead(target)) {
+                if (equal) {
+                    out.push_back(MInstr(MOp::JNE, c[k + 8].ops[0]));
+                    out.push_back(MInstr(MOp::JP, c[k + 8].ops[0]));
+                } else {
+                    out.push_back(MInstr(MOp::JP, c[k + 4].ops[0]));
+                    out.push_back(MInstr(MOp::JE, c[k + 8].ops[0]));
+                    out.push_back(c[k + 4]);
+                }
+                hits[P_BRANCH_FUSION]++;
+                return 9;
+            }
+        }
+
+        // otherwise combine the two conditions in the low bytes of the
+        // scratch registers
+        if (regDead(k + 7, "rax") && regDead(k + 7, "rcx")) {
+            out.push_back(MInstr(equal ? MOp::SETE : MOp::SETNE, MOperand::Reg("al")));
+            out.push_back(MInstr(equal ? MOp::SETNP : MOp::SETP, MOperand::Reg("cl")));
+            out.push_back(MInstr(equal ? MOp::ANDQ : MOp::ORQ, MOperand::Reg("rcx"), MOperand::Reg("rax")));
+            if (dest.isReg()) {
+                out.push_back(MInstr(MOp::MOVZBQ, MOperand::Reg("al"), dest));
+            } else {
+                out.push_back(MInstr(MOp::MOVZBQ, MOperand::Reg("al"), MOperand::Reg("rax")));
+                out.push_back(MInstr(MOp::MOVQ, MOperand::Reg("rax"), dest));
+            }
+            hits[P_SETCC]++;
+            return 7;
+        }
+    }
+
+    // Booleans from comparisons are built with branches:
+    //     jCC A; movq $0, D; jmp B; A: movq $1, D; B:
+    if (i.isCondJump() && k + 5 < c.size() &&
+            isZeroing(c[k + 1]) && at(k + 2, MOp::JMP) &&
+            at(k + 3, MOp::LABEL) && c[k + 3].ops[0].sym == i.ops[0].sym &&
+            at(k + 4, MOp::MOVQ) && c[k + 4].ops[0] == MOperand::Imm(1) &&
+            c[k + 4].ops[1] == c[k + 1].ops[1] &&
+            at(k + 5, MOp::LABEL) && c[k + 5].ops[0].sym == c[k + 2].ops[0].sym &&
+            refs[c[k + 3].ops[0].sym] == 1 && refs[c[k + 5].ops[0].sym] == 1) {
+        MOperand dest = c[k + 1].ops[1];
+
+        // a branch on the boolean that is its only use jumps on the
+        // original condition instead:
+        //     cmpq $1, D; jne L  ->  j!CC L
+        if (dest.isReg() && at(k + 6, MOp::CMPQ) &&
+                c[k + 6].ops[0] == MOperand::Imm(1) && c[k + 6].ops[1] == dest &&
+                at(k + 7, MOp::JNE) && labels.count(c[k + 7].ops[0].sym)) {
+            unsigned int target = labels[c[k + 7].ops[0].sym];
+
+            if (regDead(k + 8, dest.reg) && regDead(target, dest.reg) &&
+                    flagsDead(k + 8) && flagsDead(target)) {
+                out.push_back(MInstr(invert_jump(i.op), c[k + 7].ops[0]));
+                hits[P_BRANCH_FUSION]++;
+                return 8;
+            }
+        }
+
+        // otherwise set it without branching
+        if (regDead(k + 6, "rax")) {
+            out.push_back(MInstr(set_of_jump(i.op), MOperand::Reg("al")));
+            if (dest.isReg()) {
+                out.push_back(MInstr(MOp::MOVZBQ, MOperand::Reg("al"), dest));
+            } else {
+                out.push_back(MInstr(MOp::MOVZBQ, MOperand::Reg("al"), MOperand::Reg("rax")));
+                out.push_back(MInstr(MOp::MOVQ, MOperand::Reg("rax"), dest));
+            }
+            hits[P_SETCC]++;
+            return 6;
+        }
+    }
+
+    // jump to a label that directly follows
+    if (i.isJump()) {
+        for (unsigned int j = k + 1; j < c.size() && c[j].isLabel(); j++) {
+            if (c[j].ops[0].sym == i.ops[0].sym) {
+                hits[P_JUMP_NEXT]++;
+                return 1;
+            }
+        }
+    }
+
+    // nothing falls through a jmp, jmpq or retq, only a label makes the code
+    // after them reachable again
+    if (i.op == MOp::JMP || i.op == MOp::JMPQ || i.op == MOp::RETQ) {
+        unsigned int j = k + 1;
+        while (j < c.size() && !c[j].isLabel() && !c[j].isDirective())
+            j++;
+
+        if (j > k + 1) {
+            out.push_back(i);
+            hits[P_UNREACHABLE] += j - k - 1;
+            return j - k;
+        }
+    }
+
+    // movl %r, M; movslq M, %s  ->  movl %r, M; movslq %r, %s
+    // and the same for movb and movsbq
+    if ((i.op == MOp::MOVL || i.op == MOp::MOVB) && i.ops[0].isReg() && i.ops[1].isMem() &&
+            at(k + 1, i.op == MOp::MOVL ? MOp::MOVSLQ : MOp::MOVSBQ) && c[k + 1].ops[0] == i.ops[1]) {
+        out.push_back(i);
+        out.push_back(MInstr(c[k + 1].op, i.ops[0], c[k + 1].ops[1]));
+        hits[P_STORE_LOAD]++;
+        return 2;
+    }
+
+    if (i.op == MOp::MOVQ) {
+        MOperand src = i.ops[0];
+        MOperand dst = i.ops[1];
+
+        if (src == dst) {
+            hits[P_REDUNDANT_MOVE]++;
+            return 1;
+        }
+
+        if (at(k + 1, MOp::MOVQ)) {
+            MOperand src2 = c[k + 1].ops[0];
+            MOperand dst2 = c[k + 1].ops[1];
+
+            // movq A, B; movq B, A  ->  movq A, B
+            if (src2 == dst && dst2 == src && !(dst.isReg() && src.uses(dst.reg))) {
+                out.push_back(i);
+                hits[P_STORE_LOAD]++;
+                return 2;
+            }
+
+            // movq %r, M; movq M, %s  ->  movq %r, M; movq %r, %s
+            if (src.isReg() && dst.isMem() && src2 == dst && dst2.isReg()) {
+                out.push_back(i);
+                out.push_back(MInstr(MOp::MOVQ, src, dst2));
+                hits[P_STORE_LOAD]++;
+                return 2;
+            }
+        }
+
+        // movq S, %t; OP %t, D  ->  OP S, D  when %t is not needed after
+        if (dst.isReg() && k + 1 < c.size() && foldable(c[k + 1].op) &&
+                c[k + 1].ops.size() == 2 && c[k + 1].ops[0] == dst &&
+                !c[k + 1].ops[1].uses(dst.reg) &&
+                !(src.isMem() && c[k + 1].ops[1].isMem()) &&
+                !(src.isImm() && !fitsImm32(src.value)) &&
+                regDead(k + 2, dst.reg)) {
+            out.push_back(MInstr(c[k + 1].op, src, c[k + 1].ops[1]));
+            hits[P_COPY_PROP]++;
+            return 2;
+        }
+
+        if (src.isImm() && src.value == 0 && dst.isReg() && flagsDead(k + 1)) {
+            out.push_back(MInstr(MOp::XORQ, dst, dst));
+            hits[P_ZERO_XOR]++;
+            return 1;
+        }
+    }
+
+    // a register nobody reads, %rsp and %rbp hold the frame
+    if ((i.op == MOp::MOVQ || i.op == MOp::MOVZBQ || i.op == MOp::MOVSLQ ||
+                i.op == MOp::MOVSBQ || i.op == MOp::LEAQ) &&
+            i.ops[1].isReg() && !i.ops[1].isReg("rsp") && !i.ops[1].isReg("rbp") &&
+            regDead(k + 1, i.ops[1].reg)) {
+        hits[P_DEAD_WRITE]++;
+        return 1;
+    }
+
+    // imulq $c, %r  ->  leaq (%r, %r, c-1), %r  or  shlq $log2(c), %r
+    if (i.op == MOp::IMULQ && i.ops[0].isImm() && i.ops[1].isReg() && flagsDead(k + 1)) {
+        long v = i.ops[0].value;
+        MOperand r = i.ops[1];
+
+        if (v == 1) {
+            hits[P_MUL_CONST]++;
+            return 1;
+        }
+
+        if (v == 3 || v == 5 || v == 9) {
+            out.push_back(MInstr(MOp::LEAQ, MOperand::Mem(r.reg, r.reg, v - 1, 0), r));
+            hits[P_MUL_CONST]++;
+            return 1;
+        }
+
+        if (v > 0 && (v & (v - 1)) == 0) {
+            int shift = 0;
+            while ((1L << shift) != v)
+                shift++;
+            out.push_back(MInstr(MOp::SHLQ, MOperand::Imm(shift), r));
+            hits[P_MUL_CONST]++;
+            return 1;
+        }
+    }
+
+    // compare whose result nobody looks at
+    if ((i.op == MOp::CMPQ || i.op == MOp::TESTQ) && flagsDead(k + 1)) {
+        hits[P_DEAD_FLAGS]++;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* File: profile.cpp
+ * Authors: agent
+ * Description: Profile guided optimization, see profile.h
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "profile.h"
+
+// First line of every profile, bumped whenever the keys change meaning
+#define PROFILE_MAGIC "cool profile 1"
+
+Profile::Profile(std::string fileName) {
+    this->fileName = fileName;
+
+    hottest = 0;
+}
+
+// Inlining appends .i and a number to the labels of a callee's copy
+bool Profile::inlined(std::string label) {
+    size_t dot = label.rfind(".i");
+
+    if (dot == std::string::npos || dot + 2 == label.size())
+        return false;
+    for (size_t k = dot + 2; k < label.size(); k++) {
+        if (!isdigit(label[k]))
+            return false;
+    }
+    return true;
+}
+
+// Neither labels nor branch targets have parentheses
+std::string Profile::entryKey(std::string function) {
+    return function + "()";
+}
+
+std::string Profile::labelKey(std::string label) {
+    return label;
+}
+
+std::string Profile::fallKey(BranchInstr *br) {
+    return fallKey(br->getLabelTwo() ? *br->getLabelTwo() : br->getLabelOne());
+}
+
+std::string Profile::fallKey(std::string target) {
+    return target + "/fall";
+}
+
+std::string Profile::getFileName() {
+    return fileName;
+}
+
+int Profile::counter(std::string key) {
+    auto it = counters.find(key);
+    if (it != counters.end())
+        return it->second;
+
+    keys.push_back(key);
+    counters[key] = keys.size() - 1;
+    return keys.size() - 1;
+}
+
+std::vector<std::string> &Profile::getKeys() {
+    return keys;
+}
+
+std::string Profile::header() {
+    std::string h = std::string(PROFILE_MAGIC) + "\n" + std::to_string(keys.size()) + "\n";
+
+    for (auto &k : keys)
+        h += k + "\n";
+    return h;
+}
+
+// Once main's value is in its register nothing of the function is left
+// to run, so the counters are complete
+void Profile::instrumentExits(std::list<Instruction *> &IR) {
+    bool inMain = false;
+
+    for (auto it = IR.begin(); it != IR.end(); ++it) {
+        Instruction *i = *it;
+
+        switch (i->getOp()) {
+        case DEF:
+            inMain = ((DefInstr *)i)->getName() == "main";
+            break;
+        case RET:
+            if (inMain)
+                IR.insert(it, new CallInstr(PROFILE_DUMP, new std::list<Container>(), NULL));
+            break;
+        case END:
+            // main may also run off its end
+            if (inMain && (*std::prev(it))->getOp() != RET)
+                IR.insert(it, new CallInstr(PROFILE_DUMP, new std::list<Container>(), NULL));
+            inMain = false;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool Profile::load() {
+    std::ifstream in(fileName, std::ios::binary);
+    std::string magic;
+    std::string line;
+    unsigned long n = 0;
+
+    counts.clear();
+    hottest = 0;
+
+    std::getline(in, magic);
+    std::getline(in, line);
+    std::istringstream(line) >> n;
+
+    std::vector<std::string> names;
+    while (in && names.size() < n && std::getline(in, line))
+        names.push_back(line);
+
+    std::vector<unsigned long> values(n);
+    if (n > 0)
+        in.read((char *)values.data(), n * sizeof(unsigned long));
+
+    if (!in || magic != PROFILE_MAGIC || names.size() != n) {
+        std::cerr << "Could not read profile '" << fileName << "'" << std::endl;
+        return false;
+    }
+
+    for (unsigned long k = 0; k < n; k++) {
+        counts[names[k]] += values[k];
+        hottest = std::max(hottest, counts[names[k]]);
+    }
+    return true;
+}
+
+long Profile::count(std::string key) {
+    auto it = counts.find(key);
+    return it == counts.end() ? -1 : (long)it->second;
+}
+
+long Profile::countAt(std::string function, std::vector<Instruction *> &code, unsigned int k) {
+    for (int j = k; j >= 0; j--) {
+        long n = -1;
+
+        switch (code[j]->getOp()) {
+        case DEF:
+            return count(entryKey(function));
+        case LABEL:
+            if (!inlined(((LableInstr *)code[j])->getLabelName()))
+                n = count(labelKey(((LableInstr *)code[j])->getLabelName()));
+            break;
+        case BRANCH:
+        {
+            BranchInstr *br = (BranchInstr *)code[j];
+            std::string target = br->getLabelTwo() ? *br->getLabelTwo() : br->getLabelOne();
+            if (j < (int)k && !inlined(target))
+                n = count(fallKey(br));
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (n >= 0)
+            return n;
+    }
+
+    return count(entryKey(function));
+}
+
+bool Profile::isHot(long count) {
+    return count > 0 && (unsigned long)count * 100 >= hottest * PROFILE_HOT_PERCENT;
+}
+
+bool Profile::isCold(long count) {
+    return count == 0;
+}
+
+void Profile::printStats() {
+    std::cout << "==================\nProfile Statistics\n==================\n\n";
+    std::cout << std::left << std::setw(28) << "file" << fileName << std::endl;
+    std::cout << std::left << std::setw(28) << "counters" << keys.size() << std::endl;
+    std::cout << std::left << std::setw(28) << "blocks counted" << counts.size() << std::endl;
+    std::cout << std::left << std::setw(28) << "hottest block" << hottest << std::endl;
+}
@@ -72,6 +72,7 @@ std::string stringOfSymbolType(SymbolType type) {
         case SYM_FLOAT: return "FLOAT";
         case SYM_VOID: return "VOID";
         case SYM_FUNCT: return "FUNCT";
+        case SYM_VECTOR: return "VECTOR";
         case SYM_ERR: return "ERR";
     }
     return "ERROR";
@@ -123,6 +124,14 @@ Symbol* SymbolTable::lookupVar(std::string key) {
     return this->parent->lookupVar(key);
 }
 
+SymbolTable *SymbolTable::lookupVarScope(std::string key) {
+    if (this->varTable.find(key) != this->varTable.end())
+        return this;
+    if (this->parent == NULL)
+        return NULL;
+    return this->parent->lookupVarScope(key);
+}
+
 Symbol* SymbolTable::lookupFun(std::string key) {
     std::map<std::string, Symbol>::iterator it;
     it = this->funTable.find(key);
@@ -234,7 +243,10 @@ void symTest() {
 }
 
 SymbolTable *SymbolTable::addScope() {
-    internalScopes.push_back(SymbolTable(this, this->nextContext));
+    // blocks nested in a function body belong to the same function
+    std::string context = this->nextContext.empty() ? this->functionCtxt : this->nextContext;
+
+    internalScopes.push_back(SymbolTable(this, context));
     return &internalScopes.back();
 }
 
@@ -224,17 +224,44 @@ void SymbolVisit::visit(Expression &exp) {
 }
 
 // Visit Binary expression
+// Arithmetic on a float is done in float, comparisons and logic give an int
 void SymbolVisit::visit(BinaryExp &exp) {
     if (exp.left)
         exp.left->accept(this);
     if (exp.right)
         exp.right->accept(this);
+
+    bool isFloat = (exp.left && exp.left->type == SYM_FLOAT) ||
+        (exp.right && exp.right->type == SYM_FLOAT);
+
+    switch (exp.op.getType()) {
+        case PLUS: case MINUS: case STAR: case SLASH:
+            exp.type = isFloat ? SYM_FLOAT : SYM_INT;
+            break;
+        case MOD: case AND: case BAR: case XOR:
+            if (isFloat) {
+                std::string err = "Invalid float operand to binary '" +
+                    exp.op.getLexeme() + "'";
+                throw SyntaxError(err, exp.op);
+            }
+            exp.type = SYM_INT;
+            break;
+        default:
+            exp.type = SYM_INT;
+    }
 }
 
 // Visit Unary expression
 void SymbolVisit::visit(UnaryExp &exp) {
     if (exp.exp)
         exp.exp->accept(this);
+
+    SymbolType type = exp.exp ? exp.exp->type : SYM_INT;
+    if (exp.op.getType() == TILDA && type == SYM_FLOAT) {
+        std::string err = "Invalid float operand to unary '~'";
+        throw SyntaxError(err, exp.op);
+    }
+    exp.type = exp.op.getType() == BANG || type != SYM_FLOAT ? SYM_INT : SYM_FLOAT;
 }
 
 // Primary expression
@@ -242,19 +269,27 @@ void SymbolVisit::visit(PrimaryExp &exp) {
 
     // Test if identifier exists in symbol table
     if (exp.value.getType() == IDENTIFIER) {
+        SymbolTable *scope = current->lookupVarScope(exp.value.getLexeme());
         Symbol *s = current->lookupVar(exp.value.getLexeme());
         if (!s || s->isFunction()) {
             std::string err = "Undefined reference to variable '" +
             exp.value.getLexeme() + "'";
             throw SyntaxError(err, exp.value);
         }
+        // the IR names the variable after this scope
+        exp.scope = scope->currentLevel();
+        exp.type = s->getType() == SYM_FLOAT ? SYM_FLOAT : SYM_INT;
+    } else if (exp.value.getType() == FLOAT) {
+        exp.type = SYM_FLOAT;
     }
 }
 
 // Visit Grouping expression
 void SymbolVisit::visit(GroupExp &exp) {
-    if (exp.exp)
+    if (exp.exp) {
         exp.exp->accept(this);
+        exp.type = exp.exp->type;
+    }
 }
 
 // Visit Function Call expression
@@ -281,18 +316,30 @@ void SymbolVisit::visit(FunCall &exp) {
             " in this context";
         throw SyntaxError(err, exp.name);
     }
+    // the caller narrows a char result, only its low byte is returned
+    exp.type = s->getReturn() == SYM_FLOAT || s->getReturn() == SYM_CHAR ? s->getReturn() : SYM_INT;
 }
 
 // Visit Assignment expression
 void SymbolVisit::visit(Assignment &exp) {
-    if (!(current->lookupVar(exp.name.getLexeme()))) {
+    SymbolTable *scope = current->lookupVarScope(exp.name.getLexeme());
+    if (!scope) {
         std::string err = "Variable '" +
             exp.name.getLexeme() + "' does not exist in this context";
         throw SyntaxError(err, exp.name);
     }
+    exp.scope = scope->currentLevel();
     if(exp.exp) {
         exp.exp->accept(this);
     }
+
+    // an assignment has the type of its variable
+    exp.type = current->lookupVar(exp.name.getLexeme())->getType() == SYM_FLOAT ? SYM_FLOAT : SYM_INT;
+    if (exp.op.getType() == MOD_EQUAL &&
+            (exp.type == SYM_FLOAT || (exp.exp && exp.exp->type == SYM_FLOAT))) {
+        std::string err = "Invalid float operand to '%='";
+        throw SyntaxError(err, exp.op);
+    }
 }
 
 // Return pointer to current table/scope
@@ -49,16 +49,16 @@ Token::Token(const Token &tok) {
 }
 
 // Return the lexeme stored in the token
-std::string Token::getLexeme() {
+std::string Token::getLexeme() const {
     return this->lexeme;
 }
 
-int Token::getLine() {
+int Token::getLine() const {
     return this->line;
 }
 
 // Return the token type stored in the lexeme
-TokenType Token::getType() {
+TokenType Token::getType() const {
     return this->type;
 }
 
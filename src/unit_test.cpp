@@ -1,9 +1,89 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 
 #include "irparser.h"
 #include "exceptions.h"
+#include "encoder.h"
+#include "mir.h"
+
+static MOperand reg(std::string name) {
+    return MOperand::Reg(name);
+}
+
+// The encoder has to produce the same bytes as the assembler, short forms
+// included, for the instructions code generation selects
+static bool encoderMatchesAs() {
+    std::vector<MInstr> text = {
+        MInstr(MOp::LABEL, MOperand::Sym("top")),
+        MInstr(MOp::CMPQ, MOperand::Imm(1000), reg("rax")),
+        MInstr(MOp::ADDQ, MOperand::Imm(128), reg("rax")),
+        MInstr(MOp::SUBQ, MOperand::Imm(300000000), reg("rax")),
+        MInstr(MOp::ANDQ, MOperand::Imm(-1000), reg("rax")),
+        MInstr(MOp::SUBQ, MOperand::Imm(300000000), reg("rbx")),
+        MInstr(MOp::CMPQ, MOperand::Imm(5), reg("rax")),
+        MInstr(MOp::CMPQ, MOperand::Imm(1000), MOperand::Mem("rbp", -8)),
+        MInstr(MOp::XORQ, reg("rax"), reg("rax")),
+        MInstr(MOp::MOVQ, MOperand::Imm(-1), reg("r10")),
+        MInstr(MOp::MOVQ, MOperand::Mem("rsp", 8), reg("r12")),
+        MInstr(MOp::MOVL, reg("r11d"), MOperand::Mem("rbp", -200)),
+        MInstr(MOp::MOVB, reg("sil"), MOperand::Mem("r13", 0)),
+        MInstr(MOp::MOVSLQ, MOperand::Mem("rbp", -4), reg("rax")),
+        MInstr(MOp::UCOMISS, reg("xmm8"), reg("xmm0")),
+        MInstr(MOp::SETP, reg("cl")),
+        MInstr(MOp::SETNP, reg("cl")),
+        MInstr(MOp::JP, MOperand::Sym("top")),
+        MInstr(MOp::JNE, MOperand::Sym("top")),
+        MInstr(MOp::VPADDQ, reg("ymm1"), reg("ymm0"), reg("ymm0")),
+        MInstr(MOp::VPADDQ, reg("ymm0"), reg("ymm1"), reg("ymm12")),
+        MInstr(MOp::VPADDQ, reg("ymm8"), reg("ymm1"), reg("ymm0")),
+        MInstr(MOp::VPSLLQ, MOperand::Imm(32), reg("ymm0"), reg("ymm0")),
+        MInstr(MOp::VPBROADCASTQ, reg("xmm0"), reg("ymm0")),
+        MInstr(MOp::VMOVQ, reg("rax"), reg("xmm0")),
+        MInstr(MOp::VPEXTRQ, MOperand::Imm(1), reg("xmm9"), reg("rax")),
+        MInstr(MOp::VZEROUPPER),
+        MInstr(MOp::RETQ)
+    };
+    std::string base = "encoder_test";
+
+    std::ofstream out(base + ".s");
+    AsmEmitter emitter;
+    emitter.emit(text);
+    emitter.write(out);
+    out.close();
+
+    std::string cmd = "as " + base + ".s -o " + base + ".o && objcopy -O binary -j .text " +
+        base + ".o " + base + ".bin";
+    if (std::system(cmd.c_str()) != 0) {
+        std::cout << "encoder: could not run as" << std::endl;
+        return false;
+    }
+
+    std::ifstream in(base + ".bin", std::ios::binary);
+    std::vector<unsigned char> expected((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    for (std::string ext : {".s", ".o", ".bin"})
+        std::remove((base + ext).c_str());
+
+    X86Encoder encoder;
+    encoder.encode(text);
+    std::vector<unsigned char> &code = encoder.getCode();
+
+    for (unsigned int k = 0; k < code.size() || k < expected.size(); k++) {
+        if (k >= code.size() || k >= expected.size() || code[k] != expected[k]) {
+            std::cout << "encoder: differs from as at byte " << k << std::endl;
+            return false;
+        }
+    }
+    std::cout << "encoder: " << code.size() << " bytes match as" << std::endl;
+    return true;
+}
 
 int main() {
+    bool ok = true;
+
     try{
         IR_Parser irp("test_ir.ir");
 
@@ -12,5 +92,7 @@ int main() {
         ire.printException();
     }
 
-    return 0;
-}
\ No newline at end of file
+    ok = encoderMatchesAs() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,588 @@
+/* File: vectorize.cpp
+ * Authors: agent
+ * Description: Loop vectorizer, see vectorize.h
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "vectorize.h"
+
+Vectorizer::Vectorizer(std::list<Instruction *> IR, int lanes) {
+    this->IR = IR;
+    this->lanes = lanes;
+
+    nextReg = 0;
+    vectorized = 0;
+
+    for (auto *i : IR) {
+        for (auto &c : containers_of_instruction(i)) {
+            if (c.isRegister())
+                nextReg = std::max(nextReg, c.getIntValue() + 1);
+        }
+    }
+}
+
+int Vectorizer::var(std::string name) {
+    nodes.push_back(Node{Node::VAR, name, 0, IrOp::ADD, -1, -1});
+    return nodes.size() - 1;
+}
+
+int Vectorizer::imm(int value) {
+    nodes.push_back(Node{Node::IMM, "", value, IrOp::ADD, -1, -1});
+    return nodes.size() - 1;
+}
+
+int Vectorizer::op(IrOp op, int a, int b) {
+    nodes.push_back(Node{Node::OP, "", 0, op, a, b});
+    return nodes.size() - 1;
+}
+
+// The same key means the same value
+std::string Vectorizer::key(int n) {
+    Node &x = nodes[n];
+
+    switch (x.kind) {
+    case Node::VAR:
+        return x.var;
+    case Node::IMM:
+        return std::to_string(x.imm);
+    default:
+        if (x.b < 0)
+            return "(" + string_of_irop(x.op) + key(x.a) + ")";
+        return "(" + key(x.a) + " " + string_of_irop(x.op) + " " + key(x.b) + ")";
+    }
+}
+
+bool Vectorizer::uses(int n, std::string var) {
+    Node &x = nodes[n];
+
+    if (x.kind == Node::VAR)
+        return x.var == var;
+    if (x.kind == Node::IMM)
+        return false;
+    return uses(x.a, var) || (x.b >= 0 && uses(x.b, var));
+}
+
+// Reads no variable the loop changes
+bool Vectorizer::invariant(int n, std::map<std::string, int> &vars) {
+    Node &x = nodes[n];
+
+    if (x.kind == Node::VAR)
+        return vars.count(x.var) == 0;
+    if (x.kind == Node::IMM)
+        return true;
+    return invariant(x.a, vars) && (x.b < 0 || invariant(x.b, vars));
+}
+
+// Only operations there are vector instructions for, none of them traps
+bool Vectorizer::vectorizable(int n) {
+    Node &x = nodes[n];
+
+    if (x.kind != Node::OP)
+        return true;
+
+    if (x.b < 0)
+        return (x.op == IrOp::SUB || x.op == IrOp::BFLIP) && vectorizable(x.a);
+
+    switch (x.op) {
+    case IrOp::ADD: case IrOp::SUB: case IrOp::MUL:
+    case IrOp::AND: case IrOp::OR: case IrOp::XOR:
+        return vectorizable(x.a) && vectorizable(x.b);
+    default:
+        return false;
+    }
+}
+
+// Vector registers computing the value takes besides the loop invariant
+// ones, which are computed before the loop
+int Vectorizer::temps(int n, std::map<std::string, int> &vars) {
+    Node &x = nodes[n];
+
+    if (x.kind != Node::OP || invariant(n, vars))
+        return 0;
+    if (x.b < 0)
+        return std::max(temps(x.a, vars), 1);
+    return std::max(temps(x.a, vars), temps(x.b, vars)) + 1;
+}
+
+// The largest loop invariant parts of a value
+void Vectorizer::hoisted(int n, std::map<std::string, int> &vars, std::map<std::string, int> &out) {
+    Node &x = nodes[n];
+
+    if (invariant(n, vars)) {
+        out[key(n)] = n;
+    } else if (x.kind == Node::OP) {
+        hoisted(x.a, vars, out);
+        if (x.b >= 0)
+            hoisted(x.b, vars, out);
+    }
+}
+
+// Split a chain of the reduction's operation into its terms, subtraction
+// is adding the negated term
+void Vectorizer::terms(int n, IrOp op, bool neg, std::vector<std::pair<int, bool>> &out) {
+    Node &x = nodes[n];
+
+    if (x.kind == Node::OP && op == IrOp::ADD && (x.op == IrOp::ADD || x.op == IrOp::SUB)) {
+        if (x.b < 0) {
+            terms(x.a, op, !neg, out);
+        } else {
+            terms(x.a, op, neg, out);
+            terms(x.b, op, x.op == IrOp::SUB ? !neg : neg, out);
+        }
+    } else if (x.kind == Node::OP && op != IrOp::ADD && x.op == op && x.b >= 0) {
+        terms(x.a, op, neg, out);
+        terms(x.b, op, neg, out);
+    } else {
+        out.push_back(std::make_pair(n, neg));
+    }
+}
+
+// Emit a loop invariant value as scalar code, variables and immediates are
+// used as they are
+Container Vectorizer::scalar(int n, std::list<Instruction *> &out) {
+    Node &x = nodes[n];
+
+    if (x.kind == Node::VAR)
+        return Container(STR, new std::string(x.var), SYM_INT);
+    if (x.kind == Node::IMM) {
+        Container c(IMM);
+        c.setVal(x.imm);
+        return c;
+    }
+
+    IrOp o = x.op;
+    int a = x.a;
+    int b = x.b;
+    Container r(REG, nextReg++);
+    LetInstr *li;
+
+    if (b < 0) {
+        Container ca = scalar(a, out);
+        li = new LetInstr(r, UNARY_LET, NULL);
+        li->setExpression(ca, o);
+    } else {
+        Container ca = scalar(a, out);
+        Container cb = scalar(b, out);
+        li = new LetInstr(r, BINARY_LET, NULL);
+        li->setExpression(ca, cb, o);
+    }
+    out.push_back(li);
+    return r;
+}
+
+// Emit a value as vector code, the loop invariant parts and the counter
+// are in pre already
+Container Vectorizer::vector(int n, std::map<std::string, Container> &pre, std::list<Instruction *> &out) {
+    auto it = pre.find(key(n));
+    if (it != pre.end())
+        return it->second;
+
+    IrOp o = nodes[n].op;
+    int a = nodes[n].a;
+    int b = nodes[n].b;
+    Container r(REG, nextReg++);
+    LetInstr *li;
+
+    r.sym = SYM_VECTOR;
+    if (b < 0) {
+        Container ca = vector(a, pre, out);
+        li = new LetInstr(r, UNARY_LET, NULL);
+        li->setExpression(ca, o);
+    } else {
+        Container ca = vector(a, pre, out);
+        Container cb = vector(b, pre, out);
+        li = new LetInstr(r, BINARY_LET, NULL);
+        li->setExpression(ca, cb, o);
+    }
+    out.push_back(li);
+    return r;
+}
+
+// A loop looks like
+//     label L; lets of registers; if c L E; lets; jump L; label E
+// and vectorizes when c is i < n or i <= n, the lets add one to i, every
+// other variable they assign is a reduction whose terms read no assigned
+// variable but i, and n reads none at all. The vector loop goes in front:
+//     hoisted values, splat to vectors; v = step i; acc = splat identity
+//     label L.v
+//     if i < n - (lanes - 1) L.v L.ve
+//     acc = acc op terms of v; v = v + lanes; i = i + lanes
+//     jump L.v
+//     label L.ve
+//     s = s op every lane of acc
+// and the scalar loop does what is left.
+bool Vectorizer::vectorize(std::vector<Instruction *> &code, unsigned int k, std::list<Instruction *> &out) {
+    std::string head = ((LableInstr *)code[k])->getLabelName();
+    std::map<int, int> regs;
+    std::map<std::string, int> vars;
+    bool ok = true;
+
+    if (labelRefs[head] != 1)
+        return false;
+    nodes.clear();
+
+    auto value = [&](Container c) -> int {
+        if (c.isFloat() || c.isVector())
+            return -1;
+        if (c.isRegister()) {
+            auto it = regs.find(c.getIntValue());
+            return it == regs.end() ? -1 : it->second;
+        }
+        if (c.isVariable()) {
+            std::string name = c.getStringValue();
+            auto t = types.find(name);
+            if (t == types.end() || t->second != SYM_INT)
+                return -1;
+            auto it = vars.find(name);
+            return it == vars.end() ? var(name) : it->second;
+        }
+        if (c.isImmediate())
+            return imm(c.getIntImmediate());
+        return -1;
+    };
+
+    // the value a let computes, in the header it may only set registers
+    auto let = [&](LetInstr *li, bool header) -> bool {
+        Container dest = li->getContainer();
+        IrOp o = li->getOperation();
+        int n = -1;
+
+        switch (li->getOp()) {
+        case CONST_LET:
+            n = value(li->getOp1());
+            break;
+        case UNARY_LET:
+        {
+            int a = value(li->getOp1());
+            if (a < 0)
+                return false;
+            if (o == IrOp::ADD)
+                n = a;
+            else if (o == IrOp::SUB || o == IrOp::BFLIP)
+                n = op(o, a, -1);
+            break;
+        }
+        default:
+        {
+            int a = value(li->getOp1());
+            int b = value(li->getOp2());
+            if (a < 0 || b < 0)
+                return false;
+
+            switch (o) {
+            case IrOp::ADD: case IrOp::SUB: case IrOp::MUL:
+            case IrOp::AND: case IrOp::OR: case IrOp::XOR:
+            case IrOp::LESS: case IrOp::LESS_EQ:
+            case IrOp::GREATER: case IrOp::GREATER_EQ:
+                n = op(o, a, b);
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+        }
+
+        if (n < 0 || dest.isFloat())
+            return false;
+        if (dest.isRegister()) {
+            regs[dest.getIntValue()] = n;
+            return true;
+        }
+        if (header || !dest.isVariable() || types.count(dest.getStringValue()) == 0 ||
+                types[dest.getStringValue()] != SYM_INT)
+            return false;
+        vars[dest.getStringValue()] = n;
+        return true;
+    };
+
+    auto isLet = [&](unsigned int p) -> bool {
+        if (p >= code.size())
+            return false;
+        OpType t = code[p]->getOp();
+        return t == CONST_LET || t == UNARY_LET || t == BINARY_LET;
+    };
+
+    unsigned int p = k + 1;
+    while (ok && isLet(p) && ((LetInstr *)code[p])->getContainer().isRegister())
+        ok = let((LetInstr *)code[p++], true);
+    if (!ok || p >= code.size() || code[p]->getOp() != BRANCH)
+        return false;
+
+    BranchInstr *br = (BranchInstr *)code[p++];
+    Container cond = br->getContainer();
+    if (br->getLabelTwo() == nullptr || !cond.isRegister() || regs.count(cond.getIntValue()) == 0)
+        return false;
+    std::string exit = *br->getLabelTwo();
+
+    while (ok && isLet(p))
+        ok = let((LetInstr *)code[p++], false);
+    if (!ok || p + 1 >= code.size() || code[p]->getOp() != JUMP ||
+            ((JumpInstr *)code[p])->getLabelName() != head ||
+            code[p + 1]->getOp() != LABEL || ((LableInstr *)code[p + 1])->getLabelName() != exit)
+        return false;
+
+    // storing what was loaded changes nothing
+    for (auto it = vars.begin(); it != vars.end();) {
+        Node &x = nodes[it->second];
+        if (x.kind == Node::VAR && x.var == it->first)
+            it = vars.erase(it);
+        else
+            ++it;
+    }
+
+    // i < n, i <= n or the same turned around
+    Node c = nodes[regs[cond.getIntValue()]];
+    IrOp cmp;
+    int counter, bound;
+    if (c.kind != Node::OP || c.b < 0)
+        return false;
+    if (c.op == IrOp::LESS || c.op == IrOp::LESS_EQ) {
+        cmp = c.op;
+        counter = c.a;
+        bound = c.b;
+    } else if (c.op == IrOp::GREATER || c.op == IrOp::GREATER_EQ) {
+        cmp = c.op == IrOp::GREATER ? IrOp::LESS : IrOp::LESS_EQ;
+        counter = c.b;
+        bound = c.a;
+    } else {
+        return false;
+    }
+    if (nodes[counter].kind != Node::VAR || !invariant(bound, vars))
+        return false;
+
+    // the counter goes up by one
+    std::string i = nodes[counter].var;
+    if (vars.count(i) == 0)
+        return false;
+    Node step = nodes[vars[i]];
+    if (step.kind != Node::OP || step.op != IrOp::ADD || step.b < 0 ||
+            !((key(step.a) == i && key(step.b) == "1") || (key(step.a) == "1" && key(step.b) == i)))
+        return false;
+
+    // everything else is a reduction
+    std::vector<Reduction> reductions;
+    for (auto &v : vars) {
+        if (v.first == i)
+            continue;
+
+        Node &x = nodes[v.second];
+        Reduction r{v.first, IrOp::ADD, {}};
+        if (x.kind != Node::OP)
+            return false;
+        if (x.op == IrOp::AND || x.op == IrOp::OR || x.op == IrOp::XOR)
+            r.op = x.op;
+        else if (x.op != IrOp::ADD && x.op != IrOp::SUB)
+            return false;
+
+        std::vector<std::pair<int, bool>> all;
+        int self = 0;
+        terms(v.second, r.op, false, all);
+        for (auto &t : all) {
+            if (nodes[t.first].kind == Node::VAR && nodes[t.first].var == v.first) {
+                if (t.second)
+                    return false;
+                self++;
+                continue;
+            }
+
+            if (!vectorizable(t.first))
+                return false;
+            for (auto &w : vars) {
+                if (w.first != i && uses(t.first, w.first))
+                    return false;
+            }
+            r.terms.push_back(t);
+        }
+        if (self != 1)
+            return false;
+        reductions.push_back(r);
+    }
+    if (reductions.empty())
+        return false;
+
+    // counter, step, accumulators, hoisted values and temporaries all
+    // have to fit in registers
+    std::map<std::string, int> invariants;
+    int most = 0;
+    for (auto &r : reductions) {
+        for (auto &t : r.terms) {
+            hoisted(t.first, vars, invariants);
+            most = std::max(most, temps(t.first, vars));
+        }
+    }
+    if (2 + (int)reductions.size() + (int)invariants.size() + most > VECTORIZE_MAX_REGS)
+        return false;
+
+    // Everything checks out, build the vector loop
+    std::string vhead = head + ".v";
+    std::string *vexit = new std::string(head + ".ve");
+    std::map<std::string, Container> pre;
+    Container iVar(STR, new std::string(i), SYM_INT);
+
+    auto vreg = [&]() -> Container {
+        Container r(REG, nextReg++);
+        r.sym = SYM_VECTOR;
+        return r;
+    };
+    auto immediate = [](int value) -> Container {
+        Container c(IMM);
+        c.setVal(value);
+        return c;
+    };
+    auto unary = [&](Container dest, IrOp o, Container a) {
+        LetInstr *li = new LetInstr(dest, UNARY_LET, NULL);
+        li->setExpression(a, o);
+        out.push_back(li);
+    };
+    auto binary = [&](Container dest, Container a, IrOp o, Container b) {
+        LetInstr *li = new LetInstr(dest, BINARY_LET, NULL);
+        li->setExpression(a, b, o);
+        out.push_back(li);
+    };
+
+    // the last iteration of a vector loop runs i + lanes - 1
+    Container limit = scalar(bound, out);
+    if (limit.isImmediate()) {
+        limit = immediate(limit.getIntImmediate() - (lanes - 1));
+    } else {
+        Container r(REG, nextReg++);
+        binary(r, limit, IrOp::SUB, immediate(lanes - 1));
+        limit = r;
+    }
+
+    for (auto &h : invariants) {
+        Container v = vreg();
+        unary(v, IrOp::SPLAT, scalar(h.second, out));
+        pre[h.first] = v;
+    }
+
+    Container counters = vreg();
+    Container width = vreg();
+    unary(counters, IrOp::STEP, iVar);
+    unary(width, IrOp::SPLAT, immediate(lanes));
+    pre[i] = counters;
+
+    std::vector<Container> accs;
+    for (auto &r : reductions) {
+        Container a = vreg();
+        unary(a, IrOp::SPLAT, immediate(r.op == IrOp::AND ? -1 : 0));
+        accs.push_back(a);
+    }
+
+    out.push_back(new LableInstr(vhead, NULL));
+    Container test(REG, nextReg++);
+    binary(test, iVar, cmp, limit);
+    out.push_back(new BranchInstr(test, vhead, vexit, NULL));
+
+    for (unsigned int r = 0; r < reductions.size(); r++) {
+        for (auto &t : reductions[r].terms) {
+            Container v = vector(t.first, pre, out);
+            binary(accs[r], accs[r], t.second ? IrOp::SUB : reductions[r].op, v);
+        }
+    }
+
+    Container next(REG, nextReg++);
+    binary(counters, counters, IrOp::ADD, width);
+    binary(next, iVar, IrOp::ADD, immediate(lanes));
+    LetInstr *store = new LetInstr(iVar, CONST_LET, NULL);
+    store->setExpression(next);
+    out.push_back(store);
+    out.push_back(new JumpInstr(vhead, NULL));
+    out.push_back(new LableInstr(*vexit, NULL));
+
+    // fold the lanes into the variables
+    for (unsigned int r = 0; r < reductions.size(); r++) {
+        Container s(STR, new std::string(reductions[r].var), SYM_INT);
+        Container sum = s;
+
+        for (int l = 0; l < lanes; l++) {
+            Container lane(REG, nextReg++);
+            Container total(REG, nextReg++);
+            binary(lane, accs[r], IrOp::LANE, immediate(l));
+            binary(total, sum, reductions[r].op, lane);
+            sum = total;
+        }
+
+        LetInstr *li = new LetInstr(s, CONST_LET, NULL);
+        li->setExpression(sum);
+        out.push_back(li);
+    }
+
+    return true;
+}
+
+void Vectorizer::vectorizeLoops() {
+    std::vector<Instruction *> code(IR.begin(), IR.end());
+    std::list<Instruction *> out;
+    bool inDef = false;
+
+    labelRefs.clear();
+    for (auto *i : code) {
+        switch (i->getOp()) {
+        case JUMP:
+            labelRefs[((JumpInstr *)i)->getLabelName()]++;
+            break;
+        case BRANCH:
+        {
+            BranchInstr *br = (BranchInstr *)i;
+            labelRefs[br->getLabelTwo() ? *br->getLabelTwo() : br->getLabelOne()]++;
+            break;
+        }
+        case JUMP_TABLE:
+        {
+            SwitchInstr *si = (SwitchInstr *)i;
+            for (auto &t : si->getTargets())
+                labelRefs[t]++;
+            labelRefs[si->getDefault()]++;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    for (unsigned int k = 0; k < code.size(); k++) {
+        Instruction *i = code[k];
+
+        switch (i->getOp()) {
+        case DEF:
+            types = globalTypes;
+            for (auto &p : *((DefInstr *)i)->getParams())
+                types[p.getStringValue()] = p.sym;
+            inDef = true;
+            break;
+        case END:
+            inDef = false;
+            break;
+        case DECL:
+        {
+            Container c = ((DeclInstr *)i)->getContainer();
+            (inDef ? types : globalTypes)[c.getStringValue()] = c.sym;
+            break;
+        }
+        case LABEL:
+            if (inDef && vectorize(code, k, out))
+                vectorized++;
+            break;
+        default:
+            break;
+        }
+
+        out.push_back(i);
+    }
+
+    IR = out;
+}
+
+std::list<Instruction *> Vectorizer::getIR() {
+    return IR;
+}
+
+void Vectorizer::printStats() {
+    std::cout << "=====================\nVectorizer Statistics\n=====================\n\n";
+    std::cout << std::left << std::setw(28) << "lanes" << lanes << std::endl;
+    std::cout << std::left << std::setw(28) << "loops vectorized" << vectorized << std::endl;
+}
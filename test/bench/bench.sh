@@ -0,0 +1,58 @@
+#!/bin/sh
+# Times the compiler on programs written by gen.sh, from the top of the
+# repository: make bench
+
+C=${COOLC:-bin/coolcompiler}
+T=$(mktemp -d)
+
+trap 'rm -rf "$T"' EXIT
+
+now() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+# Run a command and print how many milliseconds it took
+timed() {
+    name=$1
+    shift
+    start=$(now)
+    "$@" >/dev/null 2>&1
+    printf "%-28s%d ms\n" "$name" $(($(now) - start))
+}
+
+sh test/bench/gen.sh 4000 > "$T/f4000.c"
+
+# tokens/s of the parser alone, as -S reports it
+echo "parse 4000 functions"
+$C -p -S "$T/f4000.c" | grep -E "^(tokens|seconds)"
+
+# Print the load time -S reports for reading the IR file $1
+readIR() {
+    $C -r -S -o "$T/read.s" "$1" | awk '/^seconds/ { print $2; exit }'
+}
+
+echo
+echo "read the IR of 4000 functions"
+$C -b -I "$T/f4000.irb" "$T/f4000.c"
+printf "%-28s%s\n" "binary seconds" "$(readIR "$T/f4000.irb")"
+$C -I "$T/f4000.ir" "$T/f4000.c"
+printf "%-28s%s\n" "text seconds" "$(readIR "$T/f4000.ir")"
+
+# IR generation has to stay linear in the size of the program
+echo
+echo "write the IR"
+for n in 1500 3000 6000; do
+    sh test/bench/gen.sh $n > "$T/f$n.c"
+    timed "$n functions" $C -I "$T/f$n.ir" "$T/f$n.c"
+done
+
+# from source to the program's exit, in the compiler or through gcc
+echo
+echo "compile and run 20 functions ten times"
+sh test/bench/gen.sh 20 > "$T/f20.c"
+ten() {
+    sh -c "for k in 1 2 3 4 5 6 7 8 9 10; do $1 || exit 1; done"
+}
+timed "-j" ten "$C -j $T/f20.c"
+timed "-x" ten "$C -x $T/f20.c"
+timed "gcc" ten "$C -o $T/f20.s $T/f20.c && gcc -no-pie $T/f20.s -o $T/f20 && $T/f20"
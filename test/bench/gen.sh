@@ -0,0 +1,24 @@
+#!/bin/sh
+# Writes a program of N functions, each a loop with a branch in it that
+# stores to a global of its own and calls the function before it, to the
+# standard output: sh test/bench/gen.sh N
+
+awk -v n="${1:-1000}" 'BEGIN {
+    for (k = 0; k < n; k++) {
+        printf "int g%d;\n\n", k
+        printf "int f%d(int n) {\n", k
+        printf "    int i;\n    int s;\n    s = 0;\n"
+        printf "    for (i = 0; i < n; i = i + 1) {\n"
+        printf "        if (i %% 3 == 0) {\n"
+        printf "            s = s + i * %d;\n", k % 7 + 1
+        printf "        } else {\n"
+        printf "            s = s ^ (i + %d);\n", k
+        printf "        }\n    }\n"
+        printf "    g%d = s;\n", k
+        if (k > 0)
+            printf "    return s + f%d(n);\n}\n\n", k - 1
+        else
+            printf "    return s;\n}\n\n"
+    }
+    printf "int main() {\n    f%d(3);\n    return 0;\n}\n", n - 1
+}'
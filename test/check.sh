@@ -0,0 +1,170 @@
+#!/bin/sh
+# Runs the test programs and the checks of the compiler's modes, from the
+# top of the repository: make check
+
+C=${COOLC:-bin/coolcompiler}
+T=$(mktemp -d)
+failed=0
+
+trap 'rm -rf "$T"' EXIT
+
+fail() {
+    echo "FAIL: $*"
+    failed=$((failed + 1))
+}
+
+# Compile a program with the given flags and run it, -x and -j run it in
+# the compiler itself
+run() {
+    flags=$1
+    src=$2
+
+    case "$flags" in
+    *-x*|*-j*)
+        $C $flags "$src"
+        ;;
+    *-c*)
+        $C $flags -o "$T/prog.o" "$src" >/dev/null &&
+            gcc -no-pie "$T/prog.o" -o "$T/prog" 2>/dev/null &&
+            "$T/prog"
+        ;;
+    *)
+        $C $flags -o "$T/prog.s" "$src" >/dev/null &&
+            gcc -no-pie "$T/prog.s" -o "$T/prog" 2>/dev/null &&
+            "$T/prog"
+        ;;
+    esac
+}
+
+# A test program returns the number of its checks that failed, and has to
+# print the same in every configuration it runs in
+program() {
+    src=test/$1
+    shift
+    first=""
+
+    for flags in "$@"; do
+        out=$(run "$flags" "$src")
+        status=$?
+
+        if [ $status -ne 0 ]; then
+            fail "$src [$flags] returned $status"
+        elif [ -z "$first" ]; then
+            first=$flags
+            expected=$out
+        elif [ "$out" != "$expected" ]; then
+            fail "$src [$flags] prints differently than [$first]"
+        fi
+    done
+}
+
+program test8.c "" "-O 2" "-x" "-j"
+program test9.c "" "-O 1" "-O 2" "-O 2 -m avx2" "-c" "-x" "-j" "-O 2 -x"
+program test10.c "" "-O 2" "-O 2 -m avx2" "-O 2 -c" "-O 2 -m avx2 -c" "-x" "-O 2 -j"
+program test11.c "" "-O 1" "-O 2" "-c" "-O 2 -c" "-x" "-j"
+
+# only optimized code survives the recursion of test12.c, and a tail call
+# whose arguments go on the stack has to stay a call
+program test12.c "-O 1" "-O 2" "-O 2 -m avx2" "-O 2 -c" "-O 2 -j"
+$C -O 2 -o "$T/tail.s" test/test12.c >/dev/null
+sed -n '/^viaSeven:/,/retq/p' "$T/tail.s" | grep -q "callq *seven" ||
+    fail "test/test12.c: the call with stack arguments in viaSeven is not a call"
+
+# The interpreter's stack grows with the recursion, and running out of it
+# is an error instead of a crash
+cat > "$T/deep.c" <<'EOF'
+int down(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return down(n - 1) + 1;
+}
+int main() {
+    return down(500000) - 500000;
+}
+EOF
+$C -x "$T/deep.c" || fail "-x returned $? from a recursion 500000 calls deep"
+sed 's/n - 1/n + 1/' "$T/deep.c" > "$T/endless.c"
+err=$($C -x "$T/endless.c" 2>&1)
+status=$?
+[ $status -ne 0 ] && echo "$err" | grep -q "Interpreter stack overflow calling 'down'" ||
+    fail "-x returned $status from an endless recursion"
+
+# A function -u reused has to be recompiled once a function it calls or a
+# global it uses changes type, even when its own code stays the same
+incr() {
+    cat > "$T/incr.c" <<EOF
+int putchar(int c);
+$1 g;
+$2 half($2 a) {
+    return a / 2;
+}
+void printInt(int n) {
+    if (n >= 10) {
+        printInt(n / 10);
+    }
+    putchar(48 + n % 10);
+}
+int main() {
+    g = 300;
+    printInt(g);
+    putchar(32);
+    printInt(half(7) * 2);
+    putchar(10);
+    return 0;
+}
+EOF
+    n=$($C -S -u "$T/incr.state" -o "$T/incr.s" "$T/incr.c" | awk '/functions recompiled/ { print $3 }')
+    out=$(gcc -no-pie "$T/incr.s" -o "$T/incr" 2>/dev/null && "$T/incr")
+
+    [ "$out" = "$3" ] && [ "$n" = "$4" ] ||
+        fail "-u with $1 g and $2 half printed '$out' after recompiling $n functions"
+}
+incr int int "300 6" 3
+incr int float "300 7" 2
+incr char float "44 7" 1
+incr char float "44 7" 0
+
+# A program run from the cache directory still runs, an earlier
+# compilation of it is no output for -x or -j
+cat > "$T/hello.c" <<'EOF'
+int putchar(int c);
+int main() {
+    putchar(104);
+    putchar(105);
+    putchar(10);
+    return 7;
+}
+EOF
+$C -C "$T/cache" -o "$T/hello.s" "$T/hello.c" >/dev/null
+for mode in -x -j; do
+    for k in 1 2; do
+        out=$($C -C "$T/cache" $mode "$T/hello.c")
+        status=$?
+        [ "$out" = "hi" ] && [ $status -eq 7 ] ||
+            fail "-C $mode run $k printed '$out' and returned $status"
+    done
+done
+
+# The second compilation of the same input hits, a changed input misses,
+# and an entry of another input stored under the same key is no hit
+cached() {
+    $C -S -C "$1" -o "$T/cached.s" "$2" | awk '/this compilation/ { print $3 }'
+}
+sed 's/104/72/' "$T/hello.c" > "$T/hello2.c"
+$C -o "$T/plain.s" "$T/hello2.c" >/dev/null
+r1=$(cached "$T/cache2" "$T/hello.c")
+r2=$(cached "$T/cache2" "$T/hello.c")
+r3=$(cached "$T/cache3" "$T/hello2.c")
+cp "$T"/cache2/*.entry "$T"/cache3/*.entry
+r4=$(cached "$T/cache3" "$T/hello2.c")
+[ "$r1 $r2 $r3 $r4" = "miss hit miss miss" ] ||
+    fail "-C compilations went $r1 $r2 $r3 $r4"
+cmp -s "$T/cached.s" "$T/plain.s" ||
+    fail "-C wrote other code than a compilation without it"
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi
+echo "all passed"
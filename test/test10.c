@@ -0,0 +1,140 @@
+int putchar(int c);
+
+int failed;
+
+void printInt(int n) {
+    if (n < 0) {
+        putchar(45);
+        n = -n;
+    }
+    if (n >= 10) {
+        printInt(n / 10);
+    }
+    putchar(48 + n % 10);
+}
+
+// prints every result, and the number of every check that does not hold
+void check(int n, int got, int expected) {
+    printInt(got);
+    putchar(10);
+    if (got != expected) {
+        putchar(35);
+        printInt(n);
+        putchar(10);
+        failed = failed + 1;
+    }
+}
+
+// the calls keep the reference loops scalar
+int square(int i) {
+    return i * i;
+}
+
+int same(int i) {
+    return i;
+}
+
+// at -O2 these loops run 2 or 4 iterations per pass, the rest go through
+// the scalar loop
+int sumSquares(int a, int n) {
+    int i;
+    int s;
+    s = 0;
+    for (i = a; i < n; i = i + 1) {
+        s = s + i * i + 3 * i - 7;
+    }
+    return s;
+}
+
+int sumSquaresRef(int a, int n) {
+    int i;
+    int s;
+    s = 0;
+    for (i = a; i < n; i = i + 1) {
+        s = s + square(i) + 3 * same(i) - 7;
+    }
+    return s;
+}
+
+int bits(int a, int n, int k) {
+    int i;
+    int x;
+    int o;
+    int d;
+    x = 0;
+    o = 0;
+    d = -1;
+    for (i = a; i < n; i = i + 1) {
+        x = x ^ (i * k);
+        o = o | (i + k);
+        d = d & (i - k);
+    }
+    return x + 3 * o + 7 * d;
+}
+
+int bitsRef(int a, int n, int k) {
+    int i;
+    int x;
+    int o;
+    int d;
+    x = 0;
+    o = 0;
+    d = -1;
+    for (i = a; i < n; i = i + 1) {
+        x = x ^ (same(i) * k);
+        o = o | (same(i) + k);
+        d = d & (same(i) - k);
+    }
+    return x + 3 * o + 7 * d;
+}
+
+// wraps around 32 bits many times over
+int overflow(int a, int n) {
+    int i;
+    int s;
+    s = 0;
+    for (i = a; i < n; i = i + 1) {
+        s = s + i * 100003 - i * i * 7;
+    }
+    return s;
+}
+
+int overflowRef(int a, int n) {
+    int i;
+    int s;
+    s = 0;
+    for (i = a; i < n; i = i + 1) {
+        s = s + same(i) * 100003 - square(i) * 7;
+    }
+    return s;
+}
+
+int main() {
+    int n;
+    int k;
+
+    failed = 0;
+    k = 1;
+
+    // trip counts that are not a multiple of 2 or 4
+    for (n = 0; n < 10; n = n + 1) {
+        check(k, sumSquares(0, n), sumSquaresRef(0, n));
+        check(k + 1, bits(0, n, 5), bitsRef(0, n, 5));
+        k = k + 2;
+    }
+
+    // negative starts, and loops that do not run at all
+    check(21, sumSquares(-5, 8), sumSquaresRef(-5, 8));
+    check(22, sumSquares(-13, -2), sumSquaresRef(-13, -2));
+    check(23, sumSquares(4, 4), 0);
+    check(24, sumSquares(9, -9), 0);
+    check(25, bits(-7, 6, 3), bitsRef(-7, 6, 3));
+    check(26, bits(-1001, -990, -4), bitsRef(-1001, -990, -4));
+
+    check(27, overflow(0, 65537), overflowRef(0, 65537));
+    check(28, overflow(-40001, 39998), overflowRef(-40001, 39998));
+    check(29, sumSquares(0, 3), -7);
+    check(30, sumSquares(-3, 2), -35);
+
+    return failed;
+}
@@ -0,0 +1,173 @@
+int putchar(int c);
+
+int failed;
+
+void printInt(int n) {
+    if (n < 0) {
+        putchar(45);
+        n = -n;
+    }
+    if (n >= 10) {
+        printInt(n / 10);
+    }
+    putchar(48 + n % 10);
+}
+
+// prints the number of every check that does not hold
+void check(int n, int got, int expected) {
+    if (got != expected) {
+        putchar(35);
+        printInt(n);
+        putchar(32);
+        printInt(got);
+        putchar(10);
+        failed = failed + 1;
+    }
+}
+
+// dense enough for a jump table, with holes, fallthrough and the default
+// in the middle falling through into the case after it
+int dense(int x) {
+    int r;
+    r = 0;
+    switch (x) {
+    case 0:
+        r = r + 1;
+    case 1:
+        r = r + 10;
+        break;
+    case 2:
+        r = r + 100;
+        break;
+    default:
+        r = r + 1000;
+    case 5:
+        r = r + 10000;
+        break;
+    case 6:
+    case 7:
+        r = r + 100000;
+    }
+    return r;
+}
+
+// a jump table starting below zero
+int negative(int x) {
+    switch (x) {
+    case -3:
+        return 30;
+    case -2:
+        return 20;
+    case -1:
+        return 10;
+    case 0:
+        return 0;
+    case 2:
+        return -20;
+    }
+    return 99;
+}
+
+// too sparse for a table, found through a tree of compares
+int sparse(int x) {
+    int r;
+    r = 0;
+    switch (x) {
+    case -50000:
+        r = 1;
+        break;
+    case -7:
+        r = 2;
+    case 1:
+        r = r + 3;
+        break;
+    case 42:
+        r = 4;
+        break;
+    default:
+        r = -1;
+        break;
+    case 1000:
+        r = 5;
+        break;
+    case 99999:
+        r = 6;
+        break;
+    case 1073741824:
+        r = 7;
+        break;
+    case 123456:
+        r = 8;
+        break;
+    }
+    return r;
+}
+
+// two cases are compared one after the other, no default falls out
+int small(int x) {
+    int r;
+    r = 5;
+    switch (x) {
+    case 3:
+        r = 6;
+        break;
+    case -3:
+        r = 7;
+        break;
+    }
+    return r;
+}
+
+int main() {
+    int i;
+    int sum;
+
+    failed = 0;
+
+    check(1, dense(0), 11);
+    check(2, dense(1), 10);
+    check(3, dense(2), 100);
+    check(4, dense(3), 11000);
+    check(5, dense(4), 11000);
+    check(6, dense(5), 10000);
+    check(7, dense(6), 100000);
+    check(8, dense(7), 100000);
+    check(9, dense(8), 11000);
+    check(10, dense(-1), 11000);
+
+    check(11, negative(-3), 30);
+    check(12, negative(-2), 20);
+    check(13, negative(-1), 10);
+    check(14, negative(0), 0);
+    check(15, negative(1), 99);
+    check(16, negative(2), -20);
+    check(17, negative(3), 99);
+    check(18, negative(-4), 99);
+
+    check(19, sparse(-50000), 1);
+    check(20, sparse(-7), 5);
+    check(21, sparse(1), 3);
+    check(22, sparse(42), 4);
+    check(23, sparse(1000), 5);
+    check(24, sparse(99999), 6);
+    check(25, sparse(1073741824), 7);
+    check(26, sparse(123456), 8);
+    check(27, sparse(0), -1);
+    check(28, sparse(43), -1);
+    check(29, sparse(-49999), -1);
+    check(30, sparse(2000000000), -1);
+
+    check(31, small(3), 6);
+    check(32, small(-3), 7);
+    check(33, small(0), 5);
+
+    // every path, summed
+    sum = 0;
+    for (i = -10; i < 12; i = i + 1) {
+        sum = sum + dense(i) + negative(i) + sparse(i) + small(i);
+    }
+    printInt(sum);
+    putchar(10);
+
+    return failed;
+}
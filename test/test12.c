@@ -0,0 +1,94 @@
+int putchar(int c);
+
+int failed;
+
+void printInt(int n) {
+    if (n < 0) {
+        putchar(45);
+        n = -n;
+    }
+    if (n >= 10) {
+        printInt(n / 10);
+    }
+    putchar(48 + n % 10);
+}
+
+// prints the number of every check that does not hold
+void check(int n, int got, int expected) {
+    if (got != expected) {
+        putchar(35);
+        printInt(n);
+        putchar(32);
+        printInt(got);
+        putchar(10);
+        failed = failed + 1;
+    }
+}
+
+// millions of calls deep, these only finish when the recursion became a
+// loop or the calls became jumps
+int count(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return count(n - 1, acc + n % 7);
+}
+
+float halves(int n, float acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return halves(n - 1, acc + 0.5);
+}
+
+int isOdd(int n);
+
+int isEven(int n) {
+    if (n == 0) {
+        return 1;
+    }
+    return isOdd(n - 1);
+}
+
+int isOdd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return isEven(n - 1);
+}
+
+float scale(float x, int n, float by) {
+    if (n == 0) {
+        return x;
+    }
+    return scale(x * by, n - 1, by);
+}
+
+// the seventh argument goes on the stack, which the caller's frame has to
+// hold for the call, so calling this stays a call
+int seven(int a, int b, int c, int d, int e, int f, int g) {
+    if (g > 100) {
+        return seven(a, b, c, d, e, f, g - 100) + 1;
+    }
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g;
+}
+
+int viaSeven(int x) {
+    return seven(x, 1, 2, 3, 4, 5, x);
+}
+
+int main() {
+    failed = 0;
+
+    check(1, count(3000000, 0), 8999997);
+    check(2, halves(2000000, 0.0) == 1000000.0, 1);
+    check(3, isEven(2000001), 0);
+    check(4, isOdd(2000001), 1);
+    check(5, isEven(1000000), 1);
+    check(6, scale(1.0, 10, 2.0) == 1024.0, 1);
+    check(7, scale(3.0, 3, 0.5) == 0.375, 1);
+    check(8, viaSeven(10), 150);
+    check(9, viaSeven(250), 672);
+
+    return failed;
+}
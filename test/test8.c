@@ -0,0 +1,29 @@
+char narrow(int x) {
+    return x;
+}
+
+char constant() {
+    return 300;
+}
+
+int widen(int x) {
+    return narrow(x);
+}
+
+int main() {
+    int failed;
+    failed = 0;
+    if (narrow(300) != 44) {
+        failed = failed + 1;
+    }
+    if (constant() != 44) {
+        failed = failed + 1;
+    }
+    if (widen(300) != 44) {
+        failed = failed + 1;
+    }
+    if (narrow(200) != -56) {
+        failed = failed + 1;
+    }
+    return failed;
+}
@@ -0,0 +1,118 @@
+int putchar(int c);
+
+int failed;
+
+void printInt(int n) {
+    if (n >= 10) {
+        printInt(n / 10);
+    }
+    putchar(48 + n % 10);
+}
+
+// prints the number of every check that does not hold
+void check(int n, int ok) {
+    if (!ok) {
+        putchar(35);
+        printInt(n);
+        putchar(10);
+        failed = failed + 1;
+    }
+}
+
+float zero(float a) {
+    return a - a;
+}
+
+float half(float a) {
+    return a / 2.0;
+}
+
+int truncate(float a) {
+    return a;
+}
+
+float widen(int a) {
+    return a;
+}
+
+// the ninth float and the int after the sixth go on the stack
+float many(float a, float b, float c, float d, float e, float f, float g, float h, float i, int j, float k) {
+    return a + b * 2.0 + c * 3.0 + d + e + f + g + h + i * 10.0 + j + k * 100.0;
+}
+
+float mixed(int a, float b, int c, float d, int e, float f, int g, int h, int i) {
+    return a * b + c * d + e * f + g + h + i;
+}
+
+int equal(float a, float b) {
+    return a == b;
+}
+
+int notEqual(float a, float b) {
+    return a != b;
+}
+
+int less(float a, float b) {
+    return a < b;
+}
+
+int lessEq(float a, float b) {
+    return a <= b;
+}
+
+int main() {
+    float one;
+    float nan;
+    float r;
+    int i;
+
+    failed = 0;
+    one = 1.0;
+    nan = zero(one) / zero(one);
+
+    // unordered operands are unequal, and neither less nor greater
+    check(1, !(nan == nan));
+    check(2, nan != nan);
+    check(3, !(nan < one));
+    check(4, !(nan <= one));
+    check(5, !(nan > one));
+    check(6, !(nan >= one));
+    check(7, !(one < nan));
+    check(8, !(one <= nan));
+    check(9, !equal(nan, one));
+    check(10, notEqual(nan, one));
+    check(11, !less(nan, nan));
+    check(12, !lessEq(nan, nan));
+    check(13, equal(one, one));
+    check(14, !notEqual(one, one));
+    check(15, lessEq(one, one));
+    check(16, (nan == nan) + 2 * (nan != nan) == 2);
+    if (nan == nan) {
+        check(17, 0);
+    }
+    if (nan != nan) {
+    } else {
+        check(18, 0);
+    }
+
+    // conversions truncate toward zero
+    check(19, truncate(2.75) == 2);
+    check(20, truncate(-2.75) == -2);
+    check(21, widen(-7) == -7.0);
+    check(22, truncate(widen(123456)) == 123456);
+    i = 3;
+    r = i;
+    check(23, r == 3.0);
+    i = r * 2.5;
+    check(24, i == 7);
+    check(25, half(7) == 3.5);
+
+    // arguments and returns across calls
+    r = many(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10, 0.5);
+    check(26, r == 194.0);
+    r = mixed(1, 1.5, 2, 2.5, 3, 3.5, 4, 5, 6);
+    check(27, r == 32.0);
+    check(28, half(half(one)) == 0.25);
+
+    return failed;
+}